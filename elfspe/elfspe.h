@@ -0,0 +1,35 @@
+/*
+ * elfspe - A wrapper to allow direct execution of SPE binaries
+ * Copyright (C) 2008 IBM Corp.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this library; if not, write to the Free Software Foundation,
+ *   Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef _elfspe_h_
+#define _elfspe_h_
+
+#include "libspe2.h"
+
+/* run.c */
+extern int elfspe_run (spe_context_ptr_t spe, spe_program_handle_t *spe_handle,
+		       int argc, char **argv, int *clean);
+extern int elfspe_run_loaded (spe_context_ptr_t spe, int argc, char **argv,
+			      int *clean);
+
+/* server.c */
+extern int elfspe_server (int argc, char **argv);
+extern int elfspe_client (int argc, char **argv);
+
+#endif
@@ -0,0 +1,709 @@
+/*
+ * elfspe - A wrapper to allow direct execution of SPE binaries
+ * Copyright (C) 2008 IBM Corp.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this library; if not, write to the Free Software Foundation,
+ *   Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * elfspe --server keeps a pool of worker processes, each owning a warm
+ * SPE context and a cache of opened images, so that launching an SPE
+ * program costs a connection instead of a context creation and an ELF
+ * verification. The workers all accept() on the same Unix socket.
+ *
+ * A plain elfspe invocation becomes a client when the socket exists: it
+ * sends its working directory, argv and environment, passes its stdin,
+ * stdout and stderr descriptors, and exits with the code the worker
+ * returns. Without a server, elfspe runs the program itself.
+ *
+ * While the program runs, the client forwards SIGINT, SIGTERM and SIGHUP
+ * to its worker over the connection; the worker, like a client that
+ * went away, interrupts the run and does not reuse the context.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdio_ext.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "elfspe.h"
+
+#define ELFSPE_MAGIC		0x454c4653	/* "ELFS" */
+#define ELFSPE_MAX_REQUEST	(256 * 1024)
+#define ELFSPE_IMAGE_CACHE	16
+#define ELFSPE_NOCONTEXT	2		/* worker exit code */
+
+struct request_header {
+  unsigned int magic;
+  unsigned int argc;
+  unsigned int envc;
+  unsigned int size;		/* of the strings that follow */
+};
+
+/* what a worker restores after each request */
+struct worker_state {
+  int fds[3];
+  int cwd;
+};
+
+struct request {
+  char *cwd;
+  int argc;
+  char **argv;
+  char **envp;
+  int fds[3];
+  char *buf;
+};
+
+static void
+socket_path (struct sockaddr_un *addr, const char *path)
+{
+  memset (addr, 0, sizeof (*addr));
+  addr->sun_family = AF_UNIX;
+  if (!path)
+    path = getenv ("ELFSPE_SOCKET");
+  if (path)
+    snprintf (addr->sun_path, sizeof (addr->sun_path), "%s", path);
+  else
+    snprintf (addr->sun_path, sizeof (addr->sun_path),
+	      "/tmp/elfspe-%u.sock", (unsigned int) getuid ());
+}
+
+/* Only talk to processes of the same user; anyone may create a socket
+ * under /tmp. */
+static int
+peer_is_trusted (int fd)
+{
+  struct ucred cred;
+  socklen_t len = sizeof (cred);
+
+  if (getsockopt (fd, SOL_SOCKET, SO_PEERCRED, &cred, &len))
+    return 0;
+  return cred.uid == getuid ();
+}
+
+static int
+write_all (int fd, const void *buf, size_t size)
+{
+  const char *p = buf;
+  ssize_t n;
+
+  while (size) {
+    n = write (fd, p, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    p += n;
+    size -= n;
+  }
+  return 0;
+}
+
+static int
+read_all (int fd, void *buf, size_t size)
+{
+  char *p = buf;
+  ssize_t n;
+
+  while (size) {
+    n = read (fd, p, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    p += n;
+    size -= n;
+  }
+  return 0;
+}
+
+/****** CLIENT ******/
+
+static int client_fd = -1;
+static volatile sig_atomic_t client_signal;
+
+/* pass the signal on to the worker, which answers with the exit code */
+static void
+client_forward (int signr)
+{
+  int saved_errno = errno;
+
+  client_signal = signr;
+  write (client_fd, &signr, sizeof (signr));
+  errno = saved_errno;
+}
+
+/* Returns the exit code of the program, or -1 if no server could be
+ * reached and the caller should run the program itself. */
+int
+elfspe_client (int argc, char **argv)
+{
+  struct request_header hdr;
+  struct sockaddr_un addr;
+  struct sigaction sa, old_sa[3];
+  static const int signals[3] = { SIGINT, SIGTERM, SIGHUP };
+  struct msghdr msg;
+  struct cmsghdr *cmsg;
+  struct iovec iov;
+  char control[CMSG_SPACE (3 * sizeof (int))];
+  char cwd[PATH_MAX];
+  char *buf, *p;
+  int fd, i, status;
+
+  socket_path (&addr, NULL);
+  fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  if (connect (fd, (struct sockaddr *) &addr, sizeof (addr))
+      || !peer_is_trusted (fd) || !getcwd (cwd, sizeof (cwd))) {
+    close (fd);
+    return -1;
+  }
+
+  hdr.magic = ELFSPE_MAGIC;
+  hdr.argc = argc;
+  hdr.size = strlen (cwd) + 1;
+  for (i = 0; i < argc; i++)
+    hdr.size += strlen (argv[i]) + 1;
+  for (hdr.envc = 0; environ[hdr.envc]; hdr.envc++)
+    hdr.size += strlen (environ[hdr.envc]) + 1;
+  if (hdr.size > ELFSPE_MAX_REQUEST) {
+    close (fd);
+    return -1;
+  }
+
+  buf = p = malloc (hdr.size);
+  if (!buf) {
+    close (fd);
+    return -1;
+  }
+  p = stpcpy (p, cwd) + 1;
+  for (i = 0; i < argc; i++)
+    p = stpcpy (p, argv[i]) + 1;
+  for (i = 0; i < hdr.envc; i++)
+    p = stpcpy (p, environ[i]) + 1;
+
+  /* the header carries our stdin, stdout and stderr */
+  memset (&msg, 0, sizeof (msg));
+  iov.iov_base = &hdr;
+  iov.iov_len = sizeof (hdr);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof (control);
+  cmsg = CMSG_FIRSTHDR (&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN (3 * sizeof (int));
+  for (i = 0; i < 3; i++)
+    ((int *) CMSG_DATA (cmsg))[i] = i;
+
+  if (sendmsg (fd, &msg, 0) != sizeof (hdr)
+      || write_all (fd, buf, hdr.size)) {
+    free (buf);
+    close (fd);
+    return -1;
+  }
+  free (buf);
+
+  /* From here on the program may have started: never run it twice. */
+  client_fd = fd;
+  memset (&sa, 0, sizeof (sa));
+  sa.sa_handler = client_forward;
+  for (i = 0; i < 3; i++)
+    sigaction (signals[i], &sa, &old_sa[i]);
+
+  if (read_all (fd, &status, sizeof (status))) {
+    fprintf (stderr, "elfspe: lost connection to the server\n");
+    status = 1;
+  }
+
+  for (i = 0; i < 3; i++)
+    sigaction (signals[i], &old_sa[i], NULL);
+  client_fd = -1;
+  close (fd);
+
+  if (client_signal)
+    fprintf (stderr, "Killed by signal %d\n", (int) client_signal);
+
+  return status;
+}
+
+/****** IMAGE CACHE ******/
+
+static struct cached_image {
+  char *path;
+  time_t mtime;
+  off_t size;
+  spe_program_handle_t *handle;
+  unsigned long last_use;
+} image_cache[ELFSPE_IMAGE_CACHE];
+
+static unsigned long image_clock;
+
+/* Images are keyed by their resolved path and modification time, so a
+ * rebuilt program is picked up by the next launch. */
+static spe_program_handle_t *
+image_get (const char *name)
+{
+  struct cached_image *img, *victim = &image_cache[0];
+  char path[PATH_MAX];
+  struct stat st;
+  int i;
+
+  if (!realpath (name, path) || stat (path, &st))
+    return NULL;
+
+  for (i = 0; i < ELFSPE_IMAGE_CACHE; i++) {
+    img = &image_cache[i];
+    if (img->path && !strcmp (img->path, path)) {
+      if (img->mtime == st.st_mtime && img->size == st.st_size) {
+	img->last_use = ++image_clock;
+	return img->handle;
+      }
+      victim = img;
+      break;
+    }
+    if (img->last_use < victim->last_use)
+      victim = img;
+  }
+
+  if (victim->handle) {
+    spe_image_close (victim->handle);
+    free (victim->path);
+    memset (victim, 0, sizeof (*victim));
+  }
+
+  victim->handle = spe_image_open (path);
+  if (!victim->handle)
+    return NULL;
+  victim->path = strdup (path);
+  if (!victim->path) {
+    spe_image_close (victim->handle);
+    victim->handle = NULL;
+    return NULL;
+  }
+  victim->mtime = st.st_mtime;
+  victim->size = st.st_size;
+  victim->last_use = ++image_clock;
+
+  return victim->handle;
+}
+
+/****** WORKER ******/
+
+static int
+receive_request (int conn, struct request *req)
+{
+  struct request_header hdr;
+  struct msghdr msg;
+  struct cmsghdr *cmsg;
+  struct iovec iov;
+  char control[CMSG_SPACE (3 * sizeof (int))];
+  char *p, *end;
+  int i;
+
+  memset (req, 0, sizeof (*req));
+  req->fds[0] = req->fds[1] = req->fds[2] = -1;
+
+  memset (&msg, 0, sizeof (msg));
+  iov.iov_base = &hdr;
+  iov.iov_len = sizeof (hdr);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof (control);
+
+  if (recvmsg (conn, &msg, MSG_CMSG_CLOEXEC) != sizeof (hdr))
+    return -1;
+  cmsg = CMSG_FIRSTHDR (&msg);
+  if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS
+      || cmsg->cmsg_len != CMSG_LEN (3 * sizeof (int)))
+    return -1;
+  memcpy (req->fds, CMSG_DATA (cmsg), sizeof (req->fds));
+
+  if (hdr.magic != ELFSPE_MAGIC || hdr.argc < 1
+      || hdr.size > ELFSPE_MAX_REQUEST)
+    return -1;
+
+  req->buf = malloc (hdr.size);
+  req->argv = malloc ((hdr.argc + 1) * sizeof (char *));
+  req->envp = malloc ((hdr.envc + 1) * sizeof (char *));
+  if (!req->buf || !req->argv || !req->envp
+      || read_all (conn, req->buf, hdr.size))
+    return -1;
+
+  /* split the strings, checking that they all fit */
+  p = req->buf;
+  end = req->buf + hdr.size;
+  for (i = -1; i < (int) (hdr.argc + hdr.envc); i++) {
+    char *s = p;
+
+    p = memchr (p, '\0', end - p);
+    if (!p)
+      return -1;
+    p++;
+    if (i < 0)
+      req->cwd = s;
+    else if (i < hdr.argc)
+      req->argv[i] = s;
+    else
+      req->envp[i - hdr.argc] = s;
+  }
+  req->argc = hdr.argc;
+  req->argv[hdr.argc] = NULL;
+  req->envp[hdr.envc] = NULL;
+
+  return 0;
+}
+
+static void
+free_request (struct request *req)
+{
+  int i;
+
+  for (i = 0; i < 3; i++)
+    if (req->fds[i] >= 0)
+      close (req->fds[i]);
+  free (req->buf);
+  free (req->argv);
+  free (req->envp);
+}
+
+/* Watches the client connection while a request runs. A signal number
+ * from the client, or the client going away, interrupts the run: the
+ * runner is signalled until spe_context_run returns with EINTR, as the
+ * signal may come before the run starts, but not once the run is over:
+ * the signal would then interrupt the writes flushing the output. */
+struct run_watch {
+  int conn;
+  pthread_t runner;
+  volatile int ran;
+  volatile int done;
+  volatile int signr;
+};
+
+static void
+runner_interrupt (int signr)
+{
+}
+
+static void *
+run_watch_thread (void *arg)
+{
+  struct run_watch *w = arg;
+  struct pollfd pfd;
+  int signr;
+
+  pfd.fd = w->conn;
+  pfd.events = POLLIN;
+
+  while (!w->done) {
+    if (w->signr) {
+      if (!w->ran)
+	pthread_kill (w->runner, SIGUSR1);
+      poll (NULL, 0, 100);
+      continue;
+    }
+    if (poll (&pfd, 1, 100) <= 0)
+      continue;
+    if (read_all (w->conn, &signr, sizeof (signr)) || signr <= 0)
+      signr = SIGKILL;
+    w->signr = signr;
+  }
+
+  return NULL;
+}
+
+/* Runs a request with the client's stdio, environment and working
+ * directory in place of the worker's. */
+static int
+run_request (spe_context_ptr_t *spe, struct request *req,
+	     struct worker_state *state, struct run_watch *watch)
+{
+  char **saved_environ = environ;
+  spe_program_handle_t *handle;
+  sigset_t usr1;
+  int i, status, clean = 1;
+
+  for (i = 0; i < 3; i++)
+    dup2 (req->fds[i], i);
+  environ = req->envp;
+
+  if (chdir (req->cwd)) {
+    perror (req->cwd);
+    status = 1;
+  } else if (!(handle = image_get (req->argv[0]))) {
+    perror (req->argv[0]);
+    status = 1;
+  } else {
+    status = elfspe_run (*spe, handle, req->argc, req->argv, &clean);
+  }
+
+  /* a signal sent before the watcher sees this stays pending until the
+     worker unblocks it */
+  sigemptyset (&usr1);
+  sigaddset (&usr1, SIGUSR1);
+  pthread_sigmask (SIG_BLOCK, &usr1, NULL);
+  watch->ran = 1;
+
+  /* the library call handlers use stdio on the client's descriptors */
+  fflush (stdout);
+  fflush (stderr);
+  __fpurge (stdin);
+  clearerr (stdin);
+  clearerr (stdout);
+  clearerr (stderr);
+
+  environ = saved_environ;
+  for (i = 0; i < 3; i++)
+    dup2 (state->fds[i], i);
+  if (fchdir (state->cwd))
+    perror ("elfspe: fchdir");
+
+  /* a context that did not stop cleanly is not reused */
+  if (!clean) {
+    spe_context_destroy (*spe);
+    *spe = spe_context_create (0, NULL);
+  }
+
+  return status;
+}
+
+static void
+worker (int listen_fd)
+{
+  struct worker_state state;
+  struct run_watch watch;
+  struct sigaction sa;
+  pthread_t watcher;
+  struct request req;
+  sigset_t usr1;
+  spe_context_ptr_t spe;
+  int conn, i, status;
+
+  signal (SIGTERM, SIG_DFL);
+  signal (SIGINT, SIG_DFL);
+  signal (SIGPIPE, SIG_IGN);
+
+  /* no SA_RESTART, so that the signal ends spe_context_run */
+  memset (&sa, 0, sizeof (sa));
+  sa.sa_handler = runner_interrupt;
+  sigaction (SIGUSR1, &sa, NULL);
+  sigemptyset (&usr1);
+  sigaddset (&usr1, SIGUSR1);
+
+  for (i = 0; i < 3; i++)
+    state.fds[i] = fcntl (i, F_DUPFD_CLOEXEC, 3);
+  state.cwd = open (".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (state.cwd < 0) {
+    perror ("elfspe: open");
+    exit (1);
+  }
+
+  spe = spe_context_create (0, NULL);
+  if (!spe) {
+    perror ("elfspe: spe_context_create");
+    exit (ELFSPE_NOCONTEXT);
+  }
+
+  for (;;) {
+    conn = accept (listen_fd, NULL, NULL);
+    if (conn < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+	continue;
+      perror ("elfspe: accept");
+      exit (1);
+    }
+
+    if (!peer_is_trusted (conn)) {
+      close (conn);
+      continue;
+    }
+    if (!receive_request (conn, &req)) {
+      watch.conn = conn;
+      watch.runner = pthread_self ();
+      watch.ran = 0;
+      watch.done = 0;
+      watch.signr = 0;
+      if (pthread_create (&watcher, NULL, run_watch_thread, &watch)) {
+	perror ("elfspe: pthread_create");
+	exit (1);
+      }
+
+      status = run_request (&spe, &req, &state, &watch);
+
+      watch.done = 1;
+      pthread_join (watcher, NULL);
+      pthread_sigmask (SIG_UNBLOCK, &usr1, NULL);
+      if (watch.signr)
+	status = 128 + watch.signr;
+      write_all (conn, &status, sizeof (status));
+    }
+    free_request (&req);
+    close (conn);
+
+    if (!spe) {
+      perror ("elfspe: spe_context_create");
+      exit (ELFSPE_NOCONTEXT);
+    }
+  }
+}
+
+/****** SERVER ******/
+
+static volatile sig_atomic_t server_quit;
+
+static void
+server_signal (int signr)
+{
+  server_quit = 1;
+}
+
+static pid_t
+spawn_worker (int listen_fd)
+{
+  pid_t pid = fork ();
+
+  if (pid == 0) {
+    worker (listen_fd);
+    exit (0);
+  }
+  if (pid < 0)
+    perror ("elfspe: fork");
+  return pid;
+}
+
+static void
+server_usage (void)
+{
+  fprintf (stderr,
+	   "Usage: elfspe --server [--workers=N] [--socket=PATH]\n"
+	   "Keep N warm SPE contexts (default: one per usable SPE) serving\n"
+	   "elfspe launches through a Unix socket (default: $ELFSPE_SOCKET or\n"
+	   "/tmp/elfspe-UID.sock). Set ELFSPE_NO_SERVER to launch without it.\n");
+}
+
+int
+elfspe_server (int argc, char **argv)
+{
+  struct sockaddr_un addr;
+  struct sigaction sa;
+  const char *path = NULL;
+  pid_t *workers, pid;
+  int nworkers = 0, listen_fd, fd, status, i;
+
+  for (i = 1; i < argc; i++) {
+    if (!strncmp (argv[i], "--workers=", 10))
+      nworkers = atoi (argv[i] + 10);
+    else if (!strncmp (argv[i], "--socket=", 9))
+      path = argv[i] + 9;
+    else {
+      server_usage ();
+      return 1;
+    }
+  }
+  if (nworkers <= 0)
+    nworkers = spe_cpu_info_get (SPE_COUNT_USABLE_SPES, -1);
+  if (nworkers <= 0)
+    nworkers = 1;
+
+  workers = calloc (nworkers, sizeof (pid_t));
+  if (!workers) {
+    perror ("elfspe");
+    return 1;
+  }
+
+  socket_path (&addr, path);
+  listen_fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd < 0) {
+    perror ("elfspe: socket");
+    return 1;
+  }
+
+  /* a socket nobody listens on is left over from a previous server */
+  fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (fd >= 0 && !connect (fd, (struct sockaddr *) &addr, sizeof (addr))) {
+    fprintf (stderr, "elfspe: a server is already running on %s\n",
+	     addr.sun_path);
+    return 1;
+  }
+  if (fd >= 0)
+    close (fd);
+  unlink (addr.sun_path);
+
+  if (bind (listen_fd, (struct sockaddr *) &addr, sizeof (addr))
+      || chmod (addr.sun_path, S_IRUSR | S_IWUSR)
+      || listen (listen_fd, 64)) {
+    perror (addr.sun_path);
+    return 1;
+  }
+
+  memset (&sa, 0, sizeof (sa));
+  sa.sa_handler = server_signal;
+  sigaction (SIGTERM, &sa, NULL);
+  sigaction (SIGINT, &sa, NULL);
+  sigaction (SIGHUP, &sa, NULL);
+
+  for (i = 0; i < nworkers; i++)
+    workers[i] = spawn_worker (listen_fd);
+
+  /* replace workers that die, unless they cannot get a context at all */
+  while (!server_quit) {
+    pid = wait (&status);
+    if (pid < 0) {
+      if (errno == EINTR)
+	continue;
+      break;
+    }
+    for (i = 0; i < nworkers; i++)
+      if (workers[i] == pid)
+	break;
+    if (i == nworkers)
+      continue;
+    workers[i] = -1;
+    if (WIFEXITED (status) && WEXITSTATUS (status) == ELFSPE_NOCONTEXT) {
+      fprintf (stderr, "elfspe: worker could not create an SPE context\n");
+      break;
+    }
+    workers[i] = spawn_worker (listen_fd);
+  }
+
+  close (listen_fd);
+  unlink (addr.sun_path);
+  for (i = 0; i < nworkers; i++)
+    if (workers[i] > 0)
+      kill (workers[i], SIGTERM);
+  while (wait (NULL) > 0 || errno == EINTR)
+    ;
+  free (workers);
+
+  return server_quit ? 0 : 1;
+}
@@ -0,0 +1,444 @@
+/*
+ * spe-run-batch - Run an SPE program over many argument sets on all SPEs
+ * Copyright (C) 2008 IBM Corp.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this library; if not, write to the Free Software Foundation,
+ *   Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * The image is opened once and every worker thread owns a context, which
+ * it reuses for job after job. Each line of the work list is one job: its
+ * whitespace separated words are appended to the fixed arguments, or
+ * replace every "{}" among them.
+ *
+ * Unless told otherwise, a worker owns a second context into which the
+ * program is loaded for its next job while the current one runs, so that
+ * only the part of the load that outlasts the run delays the next job.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "elfspe.h"
+
+struct job {
+  char *line;			/* as read from the work list */
+  int argc;
+  char **argv;
+  int done;
+  int status;
+  unsigned long long latency_ns;
+  unsigned long long load_ns;		/* spent loading the program */
+  unsigned long long load_wait_ns;	/* of it, not hidden behind a run */
+};
+
+static spe_program_handle_t *image;
+static struct job *jobs;
+static int njobs;
+static int serial;
+
+/* the queue: the index of the next job to run */
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static int next_job;
+
+static unsigned long long
+now_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static struct job *
+dequeue (void)
+{
+  struct job *job = NULL;
+
+  pthread_mutex_lock (&queue_lock);
+  if (next_job < njobs)
+    job = &jobs[next_job++];
+  pthread_mutex_unlock (&queue_lock);
+
+  return job;
+}
+
+static spe_context_ptr_t
+context_create (void)
+{
+  spe_context_ptr_t spe = spe_context_create (0, NULL);
+
+  if (!spe)
+    perror ("spe_context_create");
+  return spe;
+}
+
+/* Starts loading the program into a context; falls back to loading it
+ * right away if no loader thread is available. */
+static int
+load_start (spe_context_ptr_t spe)
+{
+  if (!spe_program_load_async (spe, image, NULL))
+    return 0;
+  return spe_program_load (spe, image);
+}
+
+/* Runs a job on a context whose load has been started, and replaces the
+ * context if the job left it unfit for another one. */
+static int
+run_job (struct job *job, spe_context_ptr_t *spe, int loading,
+	 unsigned long long start)
+{
+  spe_load_stats_t stats;
+  unsigned long long waited;
+  int clean = 1;
+
+  waited = now_ns ();
+  if (loading || spe_program_load_wait (*spe)) {
+    perror ("spe_load");
+    job->status = 1;
+  } else {
+    job->load_wait_ns = now_ns () - waited;
+    if (!spe_program_load_stats_get (*spe, &stats))
+      job->load_ns = stats.load_time_ns;
+    job->status = elfspe_run_loaded (*spe, job->argc, job->argv, &clean);
+  }
+  job->latency_ns = now_ns () - start;
+  job->done = 1;
+
+  if (!clean) {
+    spe_context_destroy (*spe);
+    *spe = context_create ();
+    if (!*spe)
+      return -1;
+  }
+  return 0;
+}
+
+static void *
+worker (void *arg)
+{
+  spe_context_ptr_t spe[2] = { NULL, NULL };
+  struct job *job, *next;
+  unsigned long long start;
+  int loading[2] = { 0, 0 };
+  int cur = 0;
+
+  spe[0] = context_create ();
+  if (!spe[0])
+    return NULL;
+  if (!serial && !(spe[1] = context_create ())) {
+    spe_context_destroy (spe[0]);
+    return NULL;
+  }
+
+  job = dequeue ();
+  if (job && !serial)
+    loading[cur] = load_start (spe[cur]);
+  while (job) {
+    start = now_ns ();
+    if (serial)
+      loading[cur] = load_start (spe[cur]);
+
+    /* load the next job's program while this one runs */
+    next = serial ? NULL : dequeue ();
+    if (next)
+      loading[!cur] = load_start (spe[!cur]);
+
+    if (run_job (job, &spe[cur], loading[cur], start))
+      break;
+
+    if (serial)
+      next = dequeue ();
+    else
+      cur = !cur;
+    job = next;
+  }
+
+  if (spe[0])
+    spe_context_destroy (spe[0]);
+  if (spe[1])
+    spe_context_destroy (spe[1]);
+  return NULL;
+}
+
+/* Builds a job's argv from the fixed arguments and a work list line. */
+static int
+make_job (struct job *job, char *line, int nfixed, char **fixed)
+{
+  char *words[256], *save, *w;
+  int nwords = 0, substitute = 0, i, j;
+
+  job->line = strdup (line);
+  if (!job->line)
+    return -1;
+  for (w = strtok_r (line, " \t", &save); w; w = strtok_r (NULL, " \t", &save)) {
+    if (nwords == 256) {
+      errno = E2BIG;
+      return -1;
+    }
+    words[nwords] = strdup (w);
+    if (!words[nwords++])
+      return -1;
+  }
+
+  for (i = 0; i < nfixed; i++)
+    if (!strcmp (fixed[i], "{}"))
+      substitute++;
+
+  job->argv = malloc ((nfixed + (substitute + 1) * nwords + 1) * sizeof (char *));
+  if (!job->argv)
+    return -1;
+  job->argc = 0;
+  for (i = 0; i < nfixed; i++) {
+    if (strcmp (fixed[i], "{}")) {
+      job->argv[job->argc++] = fixed[i];
+      continue;
+    }
+    for (j = 0; j < nwords; j++)
+      job->argv[job->argc++] = words[j];
+  }
+  if (!substitute)
+    for (j = 0; j < nwords; j++)
+      job->argv[job->argc++] = words[j];
+  job->argv[job->argc] = NULL;
+
+  return 0;
+}
+
+static int
+read_jobs (FILE *fp, int nfixed, char **fixed)
+{
+  char *line = NULL;
+  size_t size = 0;
+  ssize_t len;
+  int capacity = 0;
+
+  while ((len = getline (&line, &size, fp)) >= 0) {
+    if (len && line[len - 1] == '\n')
+      line[--len] = '\0';
+    if (!len || line[0] == '#')
+      continue;
+    if (njobs == capacity) {
+      capacity = capacity ? capacity * 2 : 256;
+      jobs = realloc (jobs, capacity * sizeof (struct job));
+      if (!jobs)
+	return -1;
+    }
+    memset (&jobs[njobs], 0, sizeof (struct job));
+    if (make_job (&jobs[njobs], line, nfixed, fixed))
+      return -1;
+    njobs++;
+  }
+  free (line);
+
+  return ferror (fp) ? -1 : 0;
+}
+
+static int
+compare_latency (const void *a, const void *b)
+{
+  unsigned long long la = (*(struct job * const *) a)->latency_ns;
+  unsigned long long lb = (*(struct job * const *) b)->latency_ns;
+
+  return la < lb ? -1 : la > lb;
+}
+
+static double
+percentile_ms (struct job **sorted, int n, int p)
+{
+  return n ? sorted[(n - 1) * p / 100]->latency_ns / 1000000.0 : 0.0;
+}
+
+#define HISTOGRAM_BUCKETS 24
+
+/* Prints how many jobs took [2^k, 2^(k+1)) microseconds, for a time
+ * recorded at offset in struct job. */
+static void
+report_histogram (const char *what, size_t offset)
+{
+  unsigned int buckets[HISTOGRAM_BUCKETS] = { 0 };
+  unsigned long long us;
+  int i, k;
+
+  for (i = 0; i < njobs; i++) {
+    if (!jobs[i].done)
+      continue;
+    us = *(unsigned long long *) ((char *) &jobs[i] + offset) / 1000;
+    for (k = 0; us > 1 && k < HISTOGRAM_BUCKETS - 1; k++)
+      us >>= 1;
+    buckets[k]++;
+  }
+
+  fprintf (stderr, "spe-run-batch: %s us:", what);
+  for (k = 0; k < HISTOGRAM_BUCKETS; k++)
+    if (buckets[k])
+      fprintf (stderr, " %u-%u: %u", k ? 1u << k : 0, 1u << (k + 1),
+	       buckets[k]);
+  fprintf (stderr, "\n");
+}
+
+static int
+report (unsigned long long wall_ns)
+{
+  struct job **sorted;
+  int i, failed = 0, ran = 0;
+
+  sorted = malloc (njobs * sizeof (struct job *));
+  if (!sorted)
+    return 1;
+
+  for (i = 0; i < njobs; i++) {
+    if (!jobs[i].done)
+      continue;		/* no context was available */
+    sorted[ran++] = &jobs[i];
+    if (jobs[i].status) {
+      fprintf (stderr, "spe-run-batch: job %d (%s) exited with %d\n",
+	       i + 1, jobs[i].line, jobs[i].status);
+      failed++;
+    }
+  }
+  qsort (sorted, ran, sizeof (struct job *), compare_latency);
+
+  fprintf (stderr,
+	   "spe-run-batch: %d jobs, %d failed, %d not run in %.3fs "
+	   "(%.1f jobs/s)\n",
+	   njobs, failed, njobs - ran, wall_ns / 1e9,
+	   wall_ns ? ran * 1e9 / wall_ns : 0.0);
+  fprintf (stderr,
+	   "spe-run-batch: latency ms: p50 %.3f, p90 %.3f, p99 %.3f, "
+	   "max %.3f\n",
+	   percentile_ms (sorted, ran, 50), percentile_ms (sorted, ran, 90),
+	   percentile_ms (sorted, ran, 99), percentile_ms (sorted, ran, 100));
+  report_histogram ("load", offsetof (struct job, load_ns));
+  report_histogram ("load wait", offsetof (struct job, load_wait_ns));
+  free (sorted);
+
+  return failed || ran < njobs;
+}
+
+static void
+usage (void)
+{
+  printf ("Usage: spe-run-batch [OPTIONS] PROGRAM [ARGS...]\n"
+	  "Run the SPE PROGRAM once for every line of a work list, on all\n"
+	  "usable SPEs. The words of each line are appended to ARGS, or\n"
+	  "replace every {} among them. Empty lines and lines starting with\n"
+	  "# are skipped.\n\n"
+	  "Options:\n"
+	  "  -f, --file=LIST     read the work list from LIST (default stdin)\n"
+	  "  -j, --jobs=N        run N jobs at a time (default: usable SPEs)\n"
+	  "  -s, --serial        load the program only when a job starts,\n"
+	  "                      instead of while the previous job runs\n"
+	  "  -h, --help          display this help and exit\n\n"
+	  "The exit status is 0 if every job ran and exited with 0.\n");
+}
+
+int
+main (int argc, char **argv)
+{
+  static struct option long_options[] = {
+    {"file", 1, 0, 'f'},
+    {"jobs", 1, 0, 'j'},
+    {"serial", 0, 0, 's'},
+    {"help", 0, 0, 'h'},
+    {0, 0, 0, 0}
+  };
+  const char *list = NULL;
+  pthread_t *threads;
+  unsigned long long start;
+  FILE *fp = stdin;
+  int nthreads = 0, c, i;
+
+  /* options end at the program, whose arguments are its own */
+  while ((c = getopt_long (argc, argv, "+f:j:sh", long_options, NULL)) != -1) {
+    switch (c) {
+    case 'f':
+      list = optarg;
+      break;
+    case 'j':
+      nthreads = atoi (optarg);
+      break;
+    case 's':
+      serial = 1;
+      break;
+    case 'h':
+      usage ();
+      return 0;
+    default:
+      usage ();
+      return 1;
+    }
+  }
+  if (optind >= argc) {
+    usage ();
+    return 1;
+  }
+
+  if (list && !(fp = fopen (list, "r"))) {
+    perror (list);
+    return 1;
+  }
+  if (read_jobs (fp, argc - optind, &argv[optind])) {
+    perror ("spe-run-batch");
+    return 1;
+  }
+  if (list)
+    fclose (fp);
+  if (!njobs)
+    return 0;
+
+  image = spe_image_open (argv[optind]);
+  if (!image) {
+    perror (argv[optind]);
+    return 1;
+  }
+
+  if (nthreads <= 0)
+    nthreads = spe_cpu_info_get (SPE_COUNT_USABLE_SPES, -1);
+  if (nthreads <= 0)
+    nthreads = 1;
+  if (nthreads > njobs)
+    nthreads = njobs;
+
+  threads = malloc (nthreads * sizeof (pthread_t));
+  if (!threads) {
+    perror ("spe-run-batch");
+    return 1;
+  }
+
+  start = now_ns ();
+  for (i = 0; i < nthreads; i++)
+    if (pthread_create (&threads[i], NULL, worker, NULL)) {
+      perror ("pthread_create");
+      nthreads = i;
+      break;
+    }
+  for (i = 0; i < nthreads; i++)
+    pthread_join (threads[i], NULL);
+
+  fflush (stdout);
+  c = report (now_ns () - start);
+
+  spe_image_close (image);
+  return c;
+}
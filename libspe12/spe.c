@@ -20,6 +20,7 @@
 #include <elf.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <pthread.h>
 #define _GNU_SOURCE
 #include <sched.h>
@@ -30,6 +31,7 @@
 #include <unistd.h>
 #include <wait.h>
 
+#include <linux/futex.h>
 #include <linux/unistd.h>
 
 #include <sys/ioctl.h>
@@ -72,7 +74,55 @@ env_check(void)
 }
 
 
+/*
+ * SPE thread states
+ *
+ * The state is changed with atomic operations and waited for with a
+ * futex on thread_status, so that pausing and continuing an SPE thread
+ * takes no lock; the wake-up is only issued when somebody is waiting.
+ */
 
+static void
+thread_state_wake(struct thread_store *thread)
+{
+	__sync_synchronize();
+	if (thread->state_waiters)
+		syscall(SYS_futex, &thread->thread_status, FUTEX_WAKE, INT_MAX,
+			NULL, NULL, 0);
+}
+
+void
+thread_state_set(struct thread_store *thread, int state)
+{
+	thread->thread_status = state;
+	thread_state_wake(thread);
+}
+
+/* Returns 1 if the thread was in state from, and is now in state to. */
+int
+thread_state_change(struct thread_store *thread, int from, int to)
+{
+	if (!__sync_bool_compare_and_swap(&thread->thread_status, from, to))
+		return 0;
+	thread_state_wake(thread);
+	return 1;
+}
+
+/* Waits until the thread is in one of the states (a mask of
+ * SPE_THREAD_STATE()s) and returns that state. */
+int
+thread_state_wait(struct thread_store *thread, unsigned int states)
+{
+	int state;
+
+	while (!(states & SPE_THREAD_STATE(state = thread->thread_status))) {
+		__sync_fetch_and_add(&thread->state_waiters, 1);
+		syscall(SYS_futex, &thread->thread_status, FUTEX_WAIT, state,
+			NULL, NULL, 0);
+		__sync_fetch_and_sub(&thread->state_waiters, 1);
+	}
+	return state;
+}
 
 /**
  * Low-level API
@@ -129,6 +179,10 @@ void * spe_setup (spe_gid_t gid, spe_program_handle_t *handle, void *argp, void
 	rc = pipe(thread_store->spectx->base_private->ev_pipe);
 	if (rc)
 		thread_store->spectx->base_private->ev_pipe[0] = thread_store->spectx->base_private->ev_pipe[1] = -1;
+	else
+		/* spe_get_event reads it with the group locked, and another
+		 * caller may have taken the event already */
+		fcntl(thread_store->spectx->base_private->ev_pipe[0], F_SETFL, O_NONBLOCK);
 
 	rc = add_thread_to_group(gid, thread_store);
 
@@ -150,10 +204,11 @@ void spe_cleanup (void *ptr)
 {
 	struct thread_store *thread_store = ptr;
 	
-	_base_spe_context_destroy(thread_store->spectx);
-
+	/* leave the group's epoll set while the fds are still open */
 	remove_thread_from_group(thread_store->group_id, thread_store);
 
+	_base_spe_context_destroy(thread_store->spectx);
+
 	free (thread_store);
 }
 
@@ -167,7 +222,6 @@ int do_spe_run (void *ptr)
 	int ret;
 
 	DEBUG_PRINTF ("do_spe_run\n");
-	thread_store->thread_status = 1; 
 	
 	/* Note: in order to be able to kill a running SPE thread the 
 	 *       spe thread must be cancelable.
@@ -176,35 +230,40 @@ int do_spe_run (void *ptr)
 	pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS,NULL);
 	
 	do {
-		thread_store->thread_status = 2; 
+		thread_state_set(thread_store, SPE_THREAD_RUNNING);
 		
 		DEBUG_PRINTF ("calling _base_spe_context_run\n");
 		ret = _base_spe_context_run(thread_store->spectx, &npc,0, thread_store->argp, thread_store->envp, &stop_info);
 
 		DEBUG_PRINTF ("_base_spe_context_run() result: npc=0x%08x ret=%08x\n", npc, ret);
 		
-		thread_store->thread_status = 10; //SPE _not_ running.
+		thread_state_set(thread_store, SPE_THREAD_NOT_RUNNING);
 		
 		/* If a signal was sent to STOP execution we will pause and wait 
 		 * for a continue signal before going on.
 		 */
 
 		if ( thread_store->stop ) {
-			pthread_mutex_lock(&thread_store->event_lock);
-			pthread_cond_init(&thread_store->event_deliver, NULL);
-			
-			thread_store->thread_status = 20; //SPE _pausing_.
-			/* Now wait for the continue signal */
-			
-			pthread_cond_wait(&thread_store->event_deliver, &thread_store->event_lock);
-			pthread_mutex_unlock(&thread_store->event_lock);
+			if (thread_state_change(thread_store, SPE_THREAD_NOT_RUNNING,
+						SPE_THREAD_PAUSED)) {
+				/* a SIGCONT between reading stop and pausing
+				 * found nothing paused to wake up */
+				__sync_synchronize();
+				if (!thread_store->stop)
+					thread_state_change(thread_store,
+							    SPE_THREAD_PAUSED,
+							    SPE_THREAD_NOT_RUNNING);
+				thread_state_wait(thread_store,
+						  ~SPE_THREAD_STATE(SPE_THREAD_PAUSED));
+			}
 			thread_store->stop = 0;
-			thread_store->thread_status = 10; //SPE _not_ running.
 		}
+
+		/* SIGKILL while paused: spe_kill only woke us up */
+		if (thread_store->killed)
+			break;
                 
 		if (ret < 0) {
-			pthread_mutex_lock(&thread_store->event_lock);
-			pthread_cond_init(&thread_store->event_deliver, NULL);
 			switch(errno){
 				case EIO:
 					DEBUG_PRINTF ("received EIO. stop_info.result.spe_runtime_exception %d \n", 
@@ -235,15 +294,11 @@ int do_spe_run (void *ptr)
 				default:
 					DEBUG_PRINTF ("received %d.\n", errno);
 				}
-			pthread_mutex_unlock(&thread_store->event_lock);
 			thread_store->stop = 1;
-			thread_store->thread_status = 99; 
+			thread_state_set(thread_store, SPE_THREAD_EXITED);
 			return stop_info.spu_status;
 		}// else if (ret > 0) {
 		if (ret > 0) {
-			pthread_mutex_lock(&thread_store->event_lock);
-			pthread_cond_init(&thread_store->event_deliver, NULL);
-			
 			if (((struct group_store*)thread_store->group_id)->use_events) {
 				int callnum = ret;
 				//
@@ -251,25 +306,20 @@ int do_spe_run (void *ptr)
 				//
 				thread_store->event = SPE_EVENT_STOP;
 				thread_store->ev_data = callnum;
+
+				// Show that we're waiting before the event
+				// can be seen, then wait for SIGCONT.
+				thread_state_set(thread_store, SPE_THREAD_STOPPED);
 				//
 				//Todo Error handling
 				//
 				write(thread_store->spectx->base_private->ev_pipe[1], &thread_store->event, 4);
 				
-				//Show that we're waiting
-				thread_store->event_pending = 1;
-				
-				// Wait for a signal.
-				pthread_cond_wait(&thread_store->event_deliver, &thread_store->event_lock);
-
-				thread_store->event_pending = 0;
-				
-				pthread_mutex_unlock(&thread_store->event_lock);
+				thread_state_wait(thread_store,
+						  ~SPE_THREAD_STATE(SPE_THREAD_STOPPED));
 			} else {
-				pthread_mutex_unlock(&thread_store->event_lock);
-				
 				DEBUG_PRINTF ("SPE user events not enabled.\n");
-				thread_store->thread_status = 99; 
+				thread_state_set(thread_store, SPE_THREAD_EXITED);
 			        return -ENOSYS;
 			}
 		}
@@ -293,7 +343,7 @@ int do_spe_run (void *ptr)
 		write(thread_store->spectx->base_private->ev_pipe[1], &thread_store->event, 4);
 	}
 
-	thread_store->thread_status = 99; 
+	thread_state_set(thread_store, SPE_THREAD_EXITED);
 	return stop_info.spu_status;
 }
 
@@ -364,8 +414,18 @@ void register_handler(void * handler, unsigned int callnum )
  */
 
 
+/* A thread cancelled by spe_kill(SIGKILL) never gets to set its state;
+ * spe_wait(WUNTRACED) waits for it to be exited. */
+static void spe_thread_cancelled (void *ptr)
+{
+	thread_state_set(ptr, SPE_THREAD_EXITED);
+}
+
 void * spe_thread (void *ptr)
 {
+	void *ret;
+
+	pthread_cleanup_push(spe_thread_cancelled, ptr);
 	/* If the SPU_INFO (or SPU_DEBUG_START) environment variable is set,
 	   output a message to stderr telling the user how to attach a debugger
 	   to the new SPE thread.  */
@@ -386,7 +446,10 @@ void * spe_thread (void *ptr)
 				 (void *) 0, _NSIG / 8);
 		}
 	}
-	return (void *) (unsigned long) do_spe_run (ptr);
+	ret = (void *) (unsigned long) do_spe_run (ptr);
+	pthread_cleanup_pop(0);
+
+	return ret;
 }
 
 /**
@@ -482,7 +545,7 @@ int spe_write_in_mbox (speid_t speid ,unsigned int data)
 	if (!srch_thread(speid))
 		return -1;
 	
-	if (thread_store->thread_status == 99)
+	if (thread_store->thread_status == SPE_THREAD_EXITED)
 		return -1;
 
 	rc = _base_spe_in_mbox_write(thread_store->spectx, &data, 1, SPE_MBOX_ALL_BLOCKING);
@@ -609,7 +672,7 @@ int spe_write_signal (speid_t speid, unsigned int signal_reg, unsigned int data)
 	if (!srch_thread(speid))
 		return -1;
 	
-	if (thread_store->thread_status == 99)
+	if (thread_store->thread_status == SPE_THREAD_EXITED)
 		return -1;
 
 	return _base_spe_signal_write(thread_store->spectx, signal_reg, data);
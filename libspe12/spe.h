@@ -38,8 +38,6 @@ struct thread_store
 	spe_program_handle_t handle;
 
 	pthread_t 		spe_thread;
-	pthread_cond_t 	event_deliver;
-	pthread_mutex_t event_lock;
     
 	int 			policy, priority, affinity_mask, spe_flags,
 					npc, ret_status,event;
@@ -48,10 +46,11 @@ struct thread_store
 	unsigned long	mask;
 	unsigned int    flags;
 	unsigned long 	ev_data;
-	int 		event_pending;
 	int 		killed;
 	int 		stop;
+	/* an spe_thread_state; waited on as a futex */
 	int		thread_status;
+	int		state_waiters;
 	
 	/* Below here comes the wrapper code
 	 * */
@@ -66,6 +65,20 @@ struct thread_store
 	
 };
 
+/*SPE thread states
+ */
+enum spe_thread_state
+{
+	SPE_THREAD_CREATED,
+	SPE_THREAD_RUNNING,
+	SPE_THREAD_NOT_RUNNING,	/* between two runs */
+	SPE_THREAD_PAUSED,	/* by SIGSTOP, until SIGCONT */
+	SPE_THREAD_STOPPED,	/* on a stop event, until SIGCONT */
+	SPE_THREAD_EXITED,
+};
+
+#define SPE_THREAD_STATE(state)	(1 << (state))
+
 /*Group members list
  */
 
@@ -81,20 +94,33 @@ struct group_store
         struct 		grpListElem *grp_members;
         int 		numListSize;
         int 		deleteMe;
+        /* epoll set of the members' event fds, and the event types
+         * (1 << poll_helper type) registered in it */
+        int 		epfd;
+        unsigned int	armed;
+        /* spe_get_event callers waiting for each event type; the epoll
+         * set holds the types any of them waits for */
+        int		waiting[4];
+        /* protects the member list and the epoll set */
+        pthread_mutex_t	lock;
 };
-/*Groups List
+
+/*Registries of the live threads and groups, hashed by pointer, against
+ * which the speid_t and spe_gid_t handed to the API are validated.
  */
-struct grpsElem
+#define REGISTRY_BUCKETS 256
+
+struct regElem
 {
-        struct grpsElem 	*next;
-        struct group_store 	*group;
+        struct regElem	*next;
+        void		*key;
 };
 
-struct group_list
+struct registry
 {
-        struct grpsElem *list_start;
-	pthread_mutex_t	mutex;
-        int 		numListSize;
+        pthread_rwlock_t	lock;
+        struct regElem		*bucket[REGISTRY_BUCKETS];
+        int 			numListSize;
 };
 
 struct spe_ctx {
@@ -133,6 +159,10 @@ extern void register_handler(void * handler, unsigned int callnum );
 extern int check_priority(int policy, int priority);
 extern int remove_group_from_groups(struct group_store *gid);
 
+extern void thread_state_set(struct thread_store *thread, int state);
+extern int thread_state_change(struct thread_store *thread, int from, int to);
+extern int thread_state_wait(struct thread_store *thread, unsigned int states);
+
 void env_check(void);
 void * spe_thread (void *ptr);
 
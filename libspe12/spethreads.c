@@ -25,6 +25,7 @@
 #define _GNU_SOURCE
 #include <sched.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -34,12 +35,14 @@
 #include <linux/unistd.h>
 
 #include <sys/ioctl.h>
+#include <sys/epoll.h>
 #include <sys/mman.h>
 #include <sys/poll.h>
 #include <sys/select.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/syscall.h>
+#include <sys/time.h>
 
 #include "libspe.h"
 #include "create.h"
@@ -51,7 +54,8 @@
  *
  * */
 
-static struct group_list grp_list = {NULL,PTHREAD_MUTEX_INITIALIZER,0};
+static struct registry thread_reg = {PTHREAD_RWLOCK_INITIALIZER,{NULL},0};
+static struct registry group_reg = {PTHREAD_RWLOCK_INITIALIZER,{NULL},0};
 
 extern int check_env;
 
@@ -64,27 +68,189 @@ int default_eventmask = 0;
 
 //extern void * spe_thread (void *);
 
+/*
+ * Event fds of group members
+ *
+ * Each group keeps an epoll set with the fds of its members for the event
+ * types (see struct poll_helper) that spe_get_event was last asked for.
+ * The set is only changed when the requested types change, or when a
+ * thread joins or leaves the group. The epoll data is the thread pointer
+ * with the type in its low bits.
+ */
+
+#define EV_MAILBOX	1
+#define EV_STOP		2
+#define EV_TAG_GROUP	3
+#define EV_TYPE_MASK	3
+
+#define SPE_EVENT_STOP_ANY (SPE_EVENT_STOP | SPE_EVENT_DMA_ALIGNMENT | \
+		SPE_EVENT_SPE_ERROR | SPE_EVENT_SPE_DATA_SEGMENT | \
+		SPE_EVENT_INVALID_DMA_CMD | SPE_EVENT_SPE_DATA_STORAGE | \
+		SPE_EVENT_SPE_TRAPPED | SPE_EVENT_THREAD_EXIT)
+
+static unsigned int
+event_types(int events)
+{
+	unsigned int types = 0;
+
+	if (events & SPE_EVENT_MAILBOX)
+		types |= 1 << EV_MAILBOX;
+	if (events & SPE_EVENT_STOP_ANY)
+		types |= 1 << EV_STOP;
+	if (events & SPE_EVENT_TAG_GROUP)
+		types |= 1 << EV_TAG_GROUP;
+	return types;
+}
+
+static int
+event_fd(struct thread_store *thread, int type)
+{
+	int fd = -1;
+
+	switch (type) {
+	case EV_MAILBOX:
+		fd = _base_spe_open_if_closed(thread->spectx, FD_IBOX_NB, 0);
+		break;
+	case EV_STOP:
+		fd = thread->spectx->base_private->ev_pipe[0];
+		break;
+	case EV_TAG_GROUP:
+		fd = _base_spe_open_if_closed(thread->spectx, FD_MFC, 0);
+		if (fd == -1)
+			fprintf(stderr, "Warning: spe_get_events: attempting "
+				"to wait for tag group without DMA support\n");
+		break;
+	}
+	return fd;
+}
+
+/* Adds (op EPOLL_CTL_ADD) or removes (EPOLL_CTL_DEL) a member's fds for
+ * the given types. Called with the group lock held. */
+static void
+update_thread_events(struct group_store *gid, struct thread_store *thread,
+		     unsigned int types, int op)
+{
+	struct epoll_event ev;
+	int type, fd;
+
+	for (type = EV_MAILBOX; type <= EV_TAG_GROUP; type++) {
+		if (!(types & (1 << type)))
+			continue;
+		fd = event_fd(thread, type);
+		if (fd < 0)
+			continue;
+		ev.events = EPOLLIN;
+		ev.data.u64 = (uintptr_t)thread | type;
+		epoll_ctl(gid->epfd, op, fd, &ev);
+	}
+}
+
+static void
+arm_group_events(struct group_store *gid, unsigned int types)
+{
+	struct grpListElem *elem;
+	unsigned int add = types & ~gid->armed;
+	unsigned int del = gid->armed & ~types;
+
+	if (!add && !del)
+		return;
+
+	for (elem = gid->grp_members; elem != NULL; elem = elem->next) {
+		update_thread_events(gid, elem->thread, del, EPOLL_CTL_DEL);
+		update_thread_events(gid, elem->thread, add, EPOLL_CTL_ADD);
+	}
+	gid->armed = types;
+}
+
+/* Adds (delta 1) or removes (delta -1) a waiter for the given types, and
+ * arms the types that any waiter is left waiting for. Called with the
+ * group lock held. */
+static void
+update_group_waiters(struct group_store *gid, unsigned int types, int delta)
+{
+	unsigned int waiting = 0;
+	int type;
+
+	for (type = EV_MAILBOX; type <= EV_TAG_GROUP; type++) {
+		if (types & (1 << type))
+			gid->waiting[type] += delta;
+		if (gid->waiting[type])
+			waiting |= 1 << type;
+	}
+	arm_group_events(gid, waiting);
+}
+
+static unsigned int
+reg_hash(void *key)
+{
+	unsigned long h = (unsigned long)key;
+
+	return (h >> 4 ^ h >> 12) % REGISTRY_BUCKETS;
+}
+
+/* The element is allocated by the caller, so that a failed malloc leaves
+ * the registry untouched. */
+static void
+reg_insert(struct registry *reg, struct regElem *elem, void *key)
+{
+	elem->key = key;
+
+	pthread_rwlock_wrlock(&reg->lock);
+	elem->next = reg->bucket[reg_hash(key)];
+	reg->bucket[reg_hash(key)] = elem;
+	reg->numListSize++;
+	pthread_rwlock_unlock(&reg->lock);
+}
+
+static int
+reg_remove(struct registry *reg, void *key)
+{
+	struct regElem **pp, *elem;
+
+	pthread_rwlock_wrlock(&reg->lock);
+	for (pp = &reg->bucket[reg_hash(key)]; (elem = *pp) != NULL; pp = &elem->next)
+	{
+		if (elem->key == key)
+		{
+			*pp = elem->next;
+			reg->numListSize--;
+			pthread_rwlock_unlock(&reg->lock);
+			free(elem);
+			return 0;
+		}
+	}
+	pthread_rwlock_unlock(&reg->lock);
+
+	return -1;
+}
+
+static void *
+reg_lookup(struct registry *reg, void *key)
+{
+	struct regElem *elem;
+
+	pthread_rwlock_rdlock(&reg->lock);
+	for (elem = reg->bucket[reg_hash(key)]; elem != NULL; elem = elem->next)
+		if (elem->key == key)
+			break;
+	pthread_rwlock_unlock(&reg->lock);
+
+	return elem ? key : NULL;
+}
+
 int 
 add_group_to_groups(struct group_store *gid)
 {
-	struct grpsElem *listElem;
-	listElem = malloc(sizeof *listElem);
+	struct regElem *regElem;
+	regElem = malloc(sizeof *regElem);
 
-	if (!listElem)
+	if (!regElem)
 	{
 		errno=ENOMEM;
 		return -errno;
 	}
-	
-	pthread_mutex_lock(&grp_list.mutex);
 
-	listElem->group=gid;
-	listElem->next=grp_list.list_start;
-	
-	grp_list.list_start=listElem;
-	grp_list.numListSize++;
-		
-	pthread_mutex_unlock(&grp_list.mutex);
+	reg_insert(&group_reg, regElem, gid);
 	
 	return 0;
 	
@@ -93,23 +259,30 @@ int
 add_thread_to_group(struct group_store *gid, struct thread_store *thread)
 {
 	struct grpListElem *listElem;
+	struct regElem *regElem;
 	listElem = malloc(sizeof *listElem);
+	regElem = malloc(sizeof *regElem);
 
-	if (!listElem)
+	if (!listElem || !regElem)
 	{
+		free(listElem);
+		free(regElem);
 		errno=ENOMEM;
 		return -errno;
 	}
 
-	pthread_mutex_lock(&grp_list.mutex);
+	pthread_mutex_lock(&gid->lock);
 	
 	listElem->thread=thread;
 	listElem->next=gid->grp_members;
 
 	gid->grp_members=listElem;
 	gid->numListSize++;
+	update_thread_events(gid, thread, gid->armed, EPOLL_CTL_ADD);
 		
-	pthread_mutex_unlock(&grp_list.mutex);
+	pthread_mutex_unlock(&gid->lock);
+
+	reg_insert(&thread_reg, regElem, thread);
 	
 	return 0;
 }
@@ -117,125 +290,90 @@ add_thread_to_group(struct group_store *gid, struct thread_store *thread)
 int 
 remove_group_from_groups(struct group_store *gid)
 {
-	pthread_mutex_lock(&grp_list.mutex);
-	
-	struct grpsElem *lgp = NULL;
-	
-	for (struct grpsElem *gp=grp_list.list_start ; gp !=NULL; gp=gp->next)
+	int rc;
+
+	pthread_mutex_lock(&gid->lock);
+
+	if (gid->numListSize != 0)
 	{
-		if (gp->group == gid)
-		{
-			if (gp->group->numListSize == 0)
-			{
-				// Delete the group
-				
-				if (lgp == NULL)
-				{
-					grp_list.list_start = gp->next;
-				}
-				else
-				{
-					lgp->next = gp->next; 
-				}
-
-				free(gp);
-			}
-			
-			pthread_mutex_unlock(&grp_list.mutex);		
-			return 0;
-		}
-		lgp = gp;
+		// Deleted by its last member
+		rc = reg_lookup(&group_reg, gid) ? 0 : 1;
+		pthread_mutex_unlock(&gid->lock);
+		return rc;
 	}
 
-	pthread_mutex_unlock(&grp_list.mutex);
-	
-	return 1;
+	rc = reg_remove(&group_reg, gid);
+	if (rc == 0)
+	{
+		close(gid->epfd);
+		gid->epfd = -1;
+	}
+
+	pthread_mutex_unlock(&gid->lock);
+
+	return rc ? 1 : 0;
 }
 
 int 
 remove_thread_from_group(struct group_store *gid, struct thread_store *thread)
 {
-	pthread_mutex_lock(&grp_list.mutex);
-	
-	if (gid->numListSize == 1)
-	{	
-		struct grpListElem *p=gid->grp_members;
-		gid->numListSize--;
-		free(p);
-		gid->grp_members = NULL;
-		pthread_mutex_unlock(&grp_list.mutex);
-		
-		if (gid->deleteMe)
-		{
-			remove_group_from_groups(gid);
-		}
-		return 0;
-	}
+	struct grpListElem **pp, *p;
+	int last;
 
-	for (struct grpListElem *p=gid->grp_members; p->next!=NULL; p=p->next)
+	/* invalidate the speid first, so that no caller starts using it */
+	if (reg_remove(&thread_reg, thread))
 	{
-		struct grpListElem *np=p->next;
-		if (np->thread==thread)
-		{
-			p->next=np->next;
-			gid->numListSize--;
-			free(np);
-			
-			pthread_mutex_unlock(&grp_list.mutex);
+		errno = ESRCH;
+		return -ESRCH;
+	}
 
-			return 0;
-		}
+	pthread_mutex_lock(&gid->lock);
+
+	for (pp = &gid->grp_members; (p = *pp) != NULL; pp = &p->next)
+		if (p->thread == thread)
+			break;
+	if (p == NULL)
+	{
+		pthread_mutex_unlock(&gid->lock);
+		errno = ESRCH;
+		return -ESRCH;
 	}
 
-	pthread_mutex_unlock(&grp_list.mutex);
+	update_thread_events(gid, thread, gid->armed, EPOLL_CTL_DEL);
+	*pp = p->next;
+	gid->numListSize--;
+	free(p);
+	last = gid->numListSize == 0;
+
+	pthread_mutex_unlock(&gid->lock);
 
-	errno = ESRCH;
-	return -ESRCH;
+	if (last && gid->deleteMe)
+	{
+		remove_group_from_groups(gid);
+	}
+	return 0;
 }
 
 struct thread_store *
 srch_thread(struct thread_store *thread)
 {
-	pthread_mutex_lock(&grp_list.mutex);
-
-	for (struct grpsElem *gp=grp_list.list_start ; gp !=NULL; gp=gp->next)
+	if (!reg_lookup(&thread_reg, thread))
 	{
-		//printf("1\n");
-		struct group_store *gid = gp->group;
-			
-		for (struct grpListElem *p=gid->grp_members; p !=NULL; p=p->next)
-		{
-			//printf("2\n");
-			if (p->thread==thread)
-			{
-				pthread_mutex_unlock(&grp_list.mutex);		
-				return p->thread;
-			}
-		}
+		errno = ESRCH;
+		return NULL;
 	}
-	
-	pthread_mutex_unlock(&grp_list.mutex);
-	errno = ESRCH;
-	return NULL;
+	return thread;
 }
 
 struct group_store *
 srch_group(struct group_store *group)
 {
-	pthread_mutex_lock(&grp_list.mutex);
-
-	for (struct grpsElem *gp=grp_list.list_start ; gp !=NULL; gp=gp->next)
+	if (!reg_lookup(&group_reg, group))
 	{
-		if (gp->group == group)
-		{
-			pthread_mutex_unlock(&grp_list.mutex);		
-			return gp->group;
-		}
+		errno = ESRCH;
+		return NULL;
 	}
-	
-	pthread_mutex_unlock(&grp_list.mutex);
-	errno = ESRCH;
-	return NULL;
+	return group;
 }
 
 
@@ -258,6 +396,15 @@ spe_gid_setup(int policy, int priority, int use_events)
 	group_store->grp_members = NULL;
 	group_store->numListSize = 0;
 	group_store->deleteMe = 0;
+	group_store->armed = 0;
+	pthread_mutex_init(&group_store->lock, NULL);
+	group_store->epfd = epoll_create(MAX_THREADS_PER_GROUP);
+	if (group_store->epfd < 0)
+	{
+		DEBUG_PRINTF ("Could not create group epoll set\n");
+		free(group_store);
+		return NULL;
+	}
 
 	add_group_to_groups(group_store);
 	
@@ -615,7 +762,7 @@ spe_wait(speid_t speid, int *status, int options)
 
 	if (options & WNOHANG)
 	{
-		if (thread_store->thread_status != 99)
+		if (thread_store->thread_status != SPE_THREAD_EXITED)
 		{
 			*status = 0;
 			return 0;
@@ -624,9 +771,16 @@ spe_wait(speid_t speid, int *status, int options)
 	
 	if (options & WUNTRACED)
 	{
-		if (thread_store->thread_status == 10 || thread_store->thread_status == 20 )
+		int state = thread_state_wait(thread_store,
+				SPE_THREAD_STATE(SPE_THREAD_PAUSED) |
+				SPE_THREAD_STATE(SPE_THREAD_STOPPED) |
+				SPE_THREAD_STATE(SPE_THREAD_EXITED));
+
+		if (state != SPE_THREAD_EXITED)
 		{
-			*status = 0x4;
+			if (status)
+				*status = (SIGSTOP << 8) | 0x7f;
+			return 0;
 		}
 	}
 	
@@ -678,35 +832,27 @@ spe_kill (speid_t speid, int sig)
 	
 	if (sig == SIGCONT)
 	{
-		int stopped = 0;
-
-		pthread_mutex_lock(&thread_store->event_lock);
-		stopped = thread_store->event_pending;
-		if ( thread_store->stop || stopped )
-		{
-			pthread_cond_signal(&thread_store->event_deliver);
-		}
-		pthread_mutex_unlock(&thread_store->event_lock);
+		thread_store->stop = 0;
+		if (!thread_state_change(thread_store, SPE_THREAD_PAUSED,
+					 SPE_THREAD_NOT_RUNNING))
+			thread_state_change(thread_store, SPE_THREAD_STOPPED,
+					    SPE_THREAD_NOT_RUNNING);
 		return 0;
 	}
 	if (sig == SIGKILL)
 	{
-		int stopped;
-		int ret = 0;
-
-		pthread_mutex_lock(&thread_store->event_lock);
 		/* Tell the thread that it is to be killed.*/
 		thread_store->killed = 1;
+		__sync_synchronize();
 
-		/* See if it is halted and waiting */
-		stopped = thread_store->event_pending;
-		if (stopped) {
-			pthread_cond_signal(&thread_store->event_deliver);
-	        } else {
-			ret = pthread_cancel (thread_store->spe_thread);
-		}
-		pthread_mutex_unlock(&thread_store->event_lock);
-		return ret;
+		/* If it is halted and waiting, it ends by itself */
+		if (thread_state_change(thread_store, SPE_THREAD_STOPPED,
+					SPE_THREAD_NOT_RUNNING) ||
+		    thread_state_change(thread_store, SPE_THREAD_PAUSED,
+					SPE_THREAD_NOT_RUNNING))
+			return 0;
+
+		return pthread_cancel (thread_store->spe_thread);
 	}
 	if (sig == SIGSTOP)
 	{	
@@ -736,6 +882,97 @@ validatefd(struct poll_helper *phelper, int pos, int fd)
 	return 1;
 }
 
+/* Hands one ready fd to the first request it matches; returns 1 if it
+ * filled in an event. Called with the group lock held. */
+static int
+deliver_event(struct spe_event *pevents, int nevents, struct group_store *gid,
+	      uint64_t data)
+{
+	struct thread_store *thread = (void *)(uintptr_t)(data & ~EV_TYPE_MASK);
+	int type = data & EV_TYPE_MASK;
+	struct grpListElem *elem;
+	int i, fd, rc, val;
+
+	/* the thread may have left the group since the wait returned */
+	for (elem = gid->grp_members; elem != NULL; elem = elem->next)
+		if (elem->thread == thread)
+			break;
+	if (elem == NULL)
+		return 0;
+
+	for (i = 0; i < nevents; i++)
+		if (pevents[i].gid == gid && pevents[i].speid == NULL &&
+		    (event_types(pevents[i].events) & (1 << type)))
+			break;
+	if (i == nevents)
+		return 0;
+
+	/* the fds are nonblocking: another caller may have taken the
+	 * event, which must not block this one with the group locked */
+	fd = event_fd(thread, type);
+	rc = read(fd, &val, 4);
+	if (rc != 4)
+		return 0;
+
+	pevents[i].speid = thread;
+	switch (type) {
+	case EV_MAILBOX:
+		pevents[i].revents = SPE_EVENT_MAILBOX;
+		pevents[i].data = val;
+		break;
+	case EV_STOP:
+		pevents[i].revents = val;
+		pevents[i].data = thread->ev_data;
+		thread->ev_data = 0;
+		thread->event = 0;
+		break;
+	case EV_TAG_GROUP:
+		pevents[i].revents = SPE_EVENT_TAG_GROUP;
+		pevents[i].data = val;
+		break;
+	}
+	return 1;
+}
+
+/* Waits on the epoll sets of the groups; returns the number of ready fds
+ * stored in ready[] and their groups in ready_gid[]. */
+static int
+wait_groups(struct group_store **groups, int ngroups,
+	    struct epoll_event *ready, struct group_store **ready_gid,
+	    int max, int timeout)
+{
+	struct pollfd pfd[ngroups];
+	int i, j, n, total = 0;
+
+	if (ngroups == 1) {
+		n = epoll_wait(groups[0]->epfd, ready, max, timeout);
+		for (i = 0; i < n; i++)
+			ready_gid[i] = groups[0];
+		return n;
+	}
+
+	for (i = 0; i < ngroups; i++) {
+		pfd[i].fd = groups[i]->epfd;
+		pfd[i].events = POLLIN;
+	}
+	n = poll(pfd, ngroups, timeout);
+	if (n <= 0)
+		return n;
+
+	for (i = 0; i < ngroups && total < max; i++) {
+		if (!pfd[i].revents)
+			continue;
+		n = epoll_wait(groups[i]->epfd, ready + total, max - total, 0);
+		for (j = 0; j < n; j++)
+			ready_gid[total + j] = groups[i];
+		if (n > 0)
+			total += n;
+	}
+	return total;
+}
+
+#define SPE_GET_EVENT_BATCH 64
+
 /**
  * spe_get_event polls or waits for events that may be generated by threads in an SPE 
  * group.
@@ -764,250 +1001,116 @@ validatefd(struct poll_helper *phelper, int pos, int fd)
 int
 spe_get_event(struct spe_event *pevents, int nevents, int timeout)
 {
-	int i;
-	int ret_events = 0;
-	int numSPEsToPoll = 0;
-	int setupSPEs =0;
-	int pollRet = 0;
-
-	struct pollfd *SPEfds;
-
-	struct poll_helper *phelper;
-	
-	nevents  = 1; // force the number of events returned to 1 for the moment
-	pthread_mutex_lock(&grp_list.mutex);
-
-	for (i=0 ; i < nevents ; i++)
+	struct epoll_event ready[SPE_GET_EVENT_BATCH];
+	struct group_store *ready_gid[SPE_GET_EVENT_BATCH];
+	struct group_store *groups[nevents > 0 ? nevents : 1];
+	unsigned int types[nevents > 0 ? nevents : 1];
+	struct timeval now, deadline;
+	int i, j, n, ngroups = 0, armed = 0;
+	int ret_events = 0, err;
+
+	if (!pevents || nevents <= 0)
 	{
-		// Clear output fields.
-		pevents[i].speid = NULL;
-		pevents[i].revents=0;
-		pevents[i].data=0;
+		errno = EINVAL;
+		return -1;
 	}
-	
-	for (i=0 ; i < nevents ; i++)
+
+	// Clear output fields, and collect the groups and what to wait for.
+	for (i = 0; i < nevents; i++)
 	{
-		int j;
 		struct group_store *group = pevents[i].gid;
-		struct grpListElem *elem = group->grp_members;
 
-		DEBUG_PRINTF("spe_get_event():\n");
-		DEBUG_PRINTF("  using group  : %p\n", group);
-		DEBUG_PRINTF("  with members : %i\n", group->numListSize);
+		pevents[i].speid = NULL;
+		pevents[i].revents = 0;
+		pevents[i].data = 0;
 
-		for ( j=0 ; j < group->numListSize; j++)
+		if (!group)
 		{
-			struct thread_store *thread = elem->thread;
-		
-			DEBUG_PRINTF("  scan member  : %p\n", thread);
-			
-			// Scan for present events in the thread structures of SPEs
-			if (thread->event != 0 && thread->event & pevents[i].events)
-			{
-				int pipeval,ret;
-			
-				DEBUG_PRINTF("  has event !  : 0x%04x\n", thread->event);
-				
-				//Found an event we're looking for.
-				ret_events++;
-
-				//Fill out return struct.
-				pevents[i].revents = thread->event;
-				pevents[i].speid   = thread;
-				pevents[i].data    = thread->ev_data;
-
-				//Empty the pipe
-				ret=read(thread->spectx->base_private->ev_pipe[0], &pipeval, 4);
-				thread->ev_data = 0;
-				thread->event = 0;
-
-				pthread_mutex_unlock(&grp_list.mutex);
-				return ret_events;
-			}
-			
-			//Decide on what fd's to poll on
-			if (pevents[i].events & (SPE_EVENT_MAILBOX))
-			{
-				numSPEsToPoll++;
-			}
-			if (pevents[i].events & (SPE_EVENT_TAG_GROUP))
-			{
-				numSPEsToPoll++;
-			}
-			if (pevents[i].events & (SPE_EVENT_STOP | SPE_EVENT_DMA_ALIGNMENT |
-						SPE_EVENT_SPE_ERROR | SPE_EVENT_SPE_DATA_SEGMENT | 
-						SPE_EVENT_SPE_DATA_STORAGE | SPE_EVENT_SPE_TRAPPED | SPE_EVENT_THREAD_EXIT ))
-			{
-				numSPEsToPoll++;
-			
-			}
-			elem=elem->next;
+			errno = EINVAL;
+			return -1;
 		}
+		for (j = 0; j < ngroups && groups[j] != group; j++)
+			;
+		if (j == ngroups)
+		{
+			groups[ngroups] = group;
+			types[ngroups++] = 0;
+		}
+		types[j] |= event_types(pevents[i].events);
 	}
-	
-	if(numSPEsToPoll == 0)
+
+	for (j = 0; j < ngroups; j++)
 	{
-		pthread_mutex_unlock(&grp_list.mutex);
-		errno=EINVAL;
-		return -1;
+		pthread_mutex_lock(&groups[j]->lock);
+		DEBUG_PRINTF("spe_get_event(): group %p, %i members, types 0x%x\n",
+			     groups[j], groups[j]->numListSize, types[j]);
+		update_group_waiters(groups[j], types[j], 1);
+		if (types[j] && groups[j]->numListSize)
+			armed = 1;
+		pthread_mutex_unlock(&groups[j]->lock);
 	}
 
-	if (ret_events > 0)
+	if (!armed)
 	{
-		//printf("P1\n");
-		
-		//DEBUG_PRINTF("  returning !  : 0xi\n", ret_events);
-
-		pthread_mutex_unlock(&grp_list.mutex);
-		
-		return ret_events;
+		errno = EINVAL;
+		ret_events = -1;
+		goto out;
 	}
-	
-	DEBUG_PRINTF("  number of fd : %i\n", numSPEsToPoll);
-
-	SPEfds=malloc (numSPEsToPoll * sizeof(struct pollfd));
-	phelper=malloc (numSPEsToPoll * sizeof(struct poll_helper));
 
-	// Set up all necessary fds to poll on and remeber what they are for.
-	for (i=0 ; i < nevents ; i++)
+	if (timeout > 0)
 	{
-		int j;
-		struct group_store *group = pevents[i].gid;
-		struct grpListElem *elem = group->grp_members;
-
-		for ( j=0 ; j < group->numListSize; j++)
+		gettimeofday(&deadline, NULL);
+		deadline.tv_sec += timeout / 1000;
+		deadline.tv_usec += (timeout % 1000) * 1000;
+		if (deadline.tv_usec >= 1000000)
 		{
-			struct thread_store *thread = elem->thread;
-			
-			if (pevents[i].events & (SPE_EVENT_MAILBOX))
-			{
-				SPEfds[setupSPEs].fd=_base_spe_open_if_closed(thread->spectx,FD_IBOX, 0);
-				SPEfds[setupSPEs].events=POLLIN;
-			
-				phelper[setupSPEs].event=i;
-				phelper[setupSPEs].thread=thread;
-				phelper[setupSPEs].retfd=-1;
-				phelper[setupSPEs].type=1;
-				//printf("1\n");
-				setupSPEs++;
-			}
-			if (pevents[i].events & (SPE_EVENT_STOP | SPE_EVENT_DMA_ALIGNMENT |
-						SPE_EVENT_SPE_ERROR | SPE_EVENT_SPE_DATA_SEGMENT | SPE_EVENT_INVALID_DMA_CMD |
-						SPE_EVENT_SPE_DATA_STORAGE | SPE_EVENT_SPE_TRAPPED | SPE_EVENT_THREAD_EXIT ))
-			{
-				SPEfds[setupSPEs].fd=thread->spectx->base_private->ev_pipe[0];
-				SPEfds[setupSPEs].events=POLLIN;
-			
-				phelper[setupSPEs].event=i;
-				phelper[setupSPEs].thread=thread;
-				phelper[setupSPEs].retfd=-1;
-				phelper[setupSPEs].type=2;
-				//printf("2\n");
-				setupSPEs++;
-			}
-			if (pevents[i].events & (SPE_EVENT_TAG_GROUP))
-			{
-				SPEfds[setupSPEs].fd=_base_spe_open_if_closed(thread->spectx,FD_MFC, 0);
-				SPEfds[setupSPEs].events=POLLIN;
-
-				phelper[setupSPEs].event=i;
-				phelper[setupSPEs].thread=thread;
-				phelper[setupSPEs].retfd=-1;
-				phelper[setupSPEs].type=3;
-				if (SPEfds[setupSPEs].fd == -1)
-					fprintf(stderr, "Warning: spe_get_events: attempting "
-						"to wait for tag group without DMA support\n");
-				//printf("3\n");
-				setupSPEs++;
-			}
-			elem=elem->next;
+			deadline.tv_sec++;
+			deadline.tv_usec -= 1000000;
 		}
 	}
-	
-	if (setupSPEs != numSPEsToPoll)
+
+	for (;;)
 	{
-		DEBUG_PRINTF("ERROR:Thread number mismatch.");
-		
-		free(SPEfds);
-		free(phelper);
-		
-		pthread_mutex_unlock(&grp_list.mutex);
-		errno = EFAULT;
-		return -1;
-	}
+		n = wait_groups(groups, ngroups, ready, ready_gid,
+				SPE_GET_EVENT_BATCH, timeout);
+		DEBUG_PRINTF("Wait returned %i fds.\n", n);
+		if (n <= 0)
+		{
+			ret_events = n;	// Error or timeout.
+			break;
+		}
 
-	pthread_mutex_unlock(&grp_list.mutex);
-	
-	DEBUG_PRINTF("Polling for %i fd events.\n",setupSPEs);
+		for (i = 0; i < n && ret_events < nevents; i++)
+		{
+			pthread_mutex_lock(&ready_gid[i]->lock);
+			ret_events += deliver_event(pevents, nevents,
+						    ready_gid[i], ready[i].data.u64);
+			pthread_mutex_unlock(&ready_gid[i]->lock);
+		}
 
-	pollRet = poll(SPEfds, setupSPEs, timeout);
-	DEBUG_PRINTF("Poll returned %i events.\n",pollRet);
-	
-	ret_events = 0;
-	
-	// Timeout.
-	if (pollRet == 0)
-	{
-		free(SPEfds);
-		free(phelper);
-		return 0;
-	}
-	
-	
-	for (i=0 ; i < setupSPEs ; i++ )
-	{
-		if (SPEfds[i].revents != 0 && pevents[phelper[i].event].speid == NULL )
+		if (ret_events > 0 || timeout == 0)
+			break;
+
+		/* another caller got there first; wait for the rest */
+		if (timeout > 0)
 		{
-			int rc,data;
-			
-			if (validatefd(phelper,i,SPEfds[i].fd))
-			{	
-				switch (phelper[i].type) {
-				case 1:
-					// Read ibox data if present
-					rc = read(SPEfds[i].fd, &data, 4);
-					if (rc == 4)
-					{
-						phelper[i].retfd=SPEfds[i].fd;
-						pevents[phelper[i].event].data = data;
-						pevents[phelper[i].event].speid = phelper[i].thread;
-						pevents[phelper[i].event].revents = SPE_EVENT_MAILBOX;
-						ret_events++;
-					}
-					break;
-				case 2:
-       	                        	// Read pipe data if present
-       	                        	rc = read(SPEfds[i].fd, &data, 4);
-       	                        	//pevents[phelper[i].event].revents = pevents[phelper[i].event].revents | data;
-					phelper[i].retfd=SPEfds[i].fd;
-       	                        	pevents[phelper[i].event].revents = data;
-					pevents[phelper[i].event].speid = phelper[i].thread;
-				       	pevents[phelper[i].event].data = phelper[i].thread->ev_data;
-	
-				       	phelper[i].thread->ev_data = 0;
-				       	phelper[i].thread->event = 0;
-					ret_events++;
-					break;
-				case 3:
-					// Read tag group data if present
-					rc = read(SPEfds[i].fd, &data, 4);
-					if (rc == 4)
-					{	
-						phelper[i].retfd=SPEfds[i].fd;
-						pevents[phelper[i].event].data = data;
-						pevents[phelper[i].event].speid = phelper[i].thread;
-						pevents[phelper[i].event].revents = SPE_EVENT_TAG_GROUP;
-						ret_events++;
-					}
-					break;
-				}
-			}
+			gettimeofday(&now, NULL);
+			timeout = (deadline.tv_sec - now.tv_sec) * 1000 +
+				(deadline.tv_usec - now.tv_usec) / 1000;
+			if (timeout <= 0)
+				break;
 		}
 	}
-	
-	free(SPEfds);
-	free(phelper);
-	//printf("P2\n");
+
+out:
+	err = errno;
+	for (j = 0; j < ngroups; j++)
+	{
+		pthread_mutex_lock(&groups[j]->lock);
+		update_group_waiters(groups[j], types[j], -1);
+		pthread_mutex_unlock(&groups[j]->lock);
+	}
+	errno = err;
 	return ret_events;
 }
 
@@ -1049,14 +1152,17 @@ int spe_get_threads(spe_gid_t gid, speid_t *spe_ids)
 	}
 	else
 	{
-		struct grpListElem *elem = group->grp_members;
+		struct grpListElem *elem;
 		
+		pthread_mutex_lock(&group->lock);
+		elem = group->grp_members;
 		for(i=0; i < group->numListSize ; i++)
 		{
 			spe_ids[i] = elem->thread;
 			elem=elem->next;
 			
 		}
+		pthread_mutex_unlock(&group->lock);
 	}
 
 	return i;
@@ -0,0 +1,108 @@
+/*
+ * libspe - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ * Copyright (C) 2008 IBM Corp.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this library; if not, write to the Free Software Foundation,
+ *   Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * Measures how many mailbox events per second spe_get_event delivers for
+ * a group of SPE threads that all write their interrupt mailbox as fast
+ * as they can.
+ */
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include <libspe.h>
+
+#define NTHREADS 16
+
+int main(int argc, char* argv[])
+{
+	spe_program_handle_t *binary;
+	speid_t spe_threads[NTHREADS];
+	struct spe_event events[NTHREADS];
+	spe_gid_t spe_group;
+	struct timeval start, end;
+	unsigned long nevents = 0, ncalls = 0;
+	int nthreads, running, status, ret, i;
+	double secs;
+
+	if (argc < 2) {
+		printf("usage: ppe-event-rate spu-executable [threads]\n");
+		exit(1);
+	}
+	nthreads = argc > 2 ? atoi(argv[2]) : NTHREADS;
+	if (nthreads < 1 || nthreads > NTHREADS)
+		nthreads = NTHREADS;
+
+	binary = spe_open_image(argv[1]);
+	if (!binary)
+		exit(2);
+
+	spe_group = spe_create_group(SCHED_OTHER, 0, 1);
+	if (!spe_group) {
+		printf("error: create_group.\n");
+		exit(2);
+	}
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < nthreads; i++) {
+		spe_threads[i] = spe_create_thread(spe_group, binary, NULL,
+						   NULL, -1, 0);
+		if (!spe_threads[i]) {
+			perror("Could not create thread");
+			exit(2);
+		}
+	}
+
+	for (running = nthreads; running > 0; ) {
+		for (i = 0; i < nthreads; i++) {
+			events[i].gid = spe_group;
+			events[i].events = SPE_EVENT_MAILBOX |
+				SPE_EVENT_THREAD_EXIT;
+		}
+
+		ret = spe_get_event(events, nthreads, -1);
+		if (ret < 0) {
+			perror("spe_get_event");
+			exit(2);
+		}
+		ncalls++;
+
+		for (i = 0; i < ret; i++) {
+			if (events[i].revents & SPE_EVENT_MAILBOX)
+				nevents++;
+			if (events[i].revents & SPE_EVENT_THREAD_EXIT) {
+				spe_wait(events[i].speid, &status, 0);
+				running--;
+			}
+		}
+	}
+	gettimeofday(&end, NULL);
+
+	secs = end.tv_sec - start.tv_sec + (end.tv_usec - start.tv_usec) / 1e6;
+	printf("%d threads: %lu events in %lu calls, %.3f sec: "
+	       "%.0f events/sec, %.2f events/call\n",
+	       nthreads, nevents, ncalls, secs, nevents / secs,
+	       (double)nevents / ncalls);
+
+	spe_close_image(binary);
+
+	return 0;
+}
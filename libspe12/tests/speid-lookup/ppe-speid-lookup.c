@@ -0,0 +1,111 @@
+/*
+ * libspe - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ * Copyright (C) 2008 IBM Corp.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ *  or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public License
+ *   along with this library; if not, write to the Free Software Foundation,
+ *   Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * Measures what validating a speid_t costs, which every call taking one
+ * pays, with 1, 16 and 256 threads registered. The threads are only
+ * entered into the registry, so that no SPEs are needed.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include <libspe.h>
+#include "spe.h"
+
+#define LOOKUPS 1000000
+
+static double
+lookup_ns(struct thread_store **threads, int nthreads)
+{
+	struct timeval start, end;
+	int i, found = 0;
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < LOOKUPS; i++)
+		if (srch_thread(threads[i % nthreads]))
+			found++;
+	gettimeofday(&end, NULL);
+
+	if (found != LOOKUPS) {
+		printf("error: %d of %d lookups failed.\n",
+		       LOOKUPS - found, LOOKUPS);
+		exit(1);
+	}
+	return ((end.tv_sec - start.tv_sec) * 1e6 +
+		(end.tv_usec - start.tv_usec)) * 1000.0 / LOOKUPS;
+}
+
+static void
+run(int nthreads)
+{
+	struct thread_store **threads;
+	struct group_store **groups;
+	int ngroups = (nthreads + MAX_THREADS_PER_GROUP - 1) / MAX_THREADS_PER_GROUP;
+	int i;
+
+	threads = calloc(nthreads, sizeof(*threads));
+	groups = calloc(ngroups, sizeof(*groups));
+	if (!threads || !groups) {
+		perror("calloc");
+		exit(2);
+	}
+
+	for (i = 0; i < ngroups; i++) {
+		groups[i] = spe_gid_setup(SCHED_OTHER, 0, 1);
+		if (!groups[i]) {
+			perror("Could not create group");
+			exit(2);
+		}
+	}
+	for (i = 0; i < nthreads; i++) {
+		threads[i] = calloc(1, sizeof(struct thread_store));
+		if (!threads[i] ||
+		    add_thread_to_group(groups[i / MAX_THREADS_PER_GROUP],
+					threads[i])) {
+			perror("Could not register thread");
+			exit(2);
+		}
+		threads[i]->group_id = groups[i / MAX_THREADS_PER_GROUP];
+	}
+
+	printf("%4d threads: %6.1f ns per speid validation\n",
+	       nthreads, lookup_ns(threads, nthreads));
+
+	for (i = 0; i < nthreads; i++) {
+		remove_thread_from_group(threads[i]->group_id, threads[i]);
+		free(threads[i]);
+	}
+	for (i = 0; i < ngroups; i++)
+		spe_destroy_group(groups[i]);
+	free(threads);
+	free(groups);
+}
+
+int main(int argc, char* argv[])
+{
+	run(1);
+	run(16);
+	run(256);
+
+	return 0;
+}
@@ -105,6 +105,152 @@ struct spe_gang_context
  */
 typedef struct spe_gang_context * spe_gang_context_ptr_t;
 
+/** SPE pipeline
+ * An affinity chain of SPE contexts within a gang, as created by
+ * spe_pipeline_create. The stages are kept in ring order; each stage
+ * knows the effective address of its own local store and of the local
+ * store of its successor (the last stage's successor is the first).
+ */
+typedef struct spe_pipeline_stage
+{
+	spe_context_ptr_t spe;
+	void *ls;
+	void *next_ls;
+} spe_pipeline_stage_t;
+
+typedef struct spe_pipeline
+{
+	spe_gang_context_ptr_t gang;
+	int nstages;
+	spe_pipeline_stage_t *stages;
+} spe_pipeline_t;
+/** spe_pipeline_ptr_t
+ * 	This pointer serves as the identifier for a specific
+ *	SPE pipeline throughout the API (where needed)
+ */
+typedef spe_pipeline_t * spe_pipeline_ptr_t;
+
+/** SPE peer table
+ * Written into the local store of each context by
+ * spe_peer_table_publish: a header followed by one entry per peer,
+ * giving the effective addresses of the peer's local store and signal
+ * notification registers. The signal addresses are zero unless the peer
+ * was created with SPE_MAP_PS.
+ */
+typedef struct spe_peer_table
+{
+	unsigned int count;
+	unsigned int self;
+	unsigned int reserved[2];
+} spe_peer_table_t;
+
+typedef struct spe_peer_entry
+{
+	unsigned long long ls_ea;
+	unsigned long long sig1_ea;
+	unsigned long long sig2_ea;
+	unsigned long long reserved;
+} spe_peer_entry_t;
+
+/** SPE local store double buffer
+ * Describes two adjacent buffers in a consumer's local store that a
+ * producer SPE fills by DMA, and the consumer's signal notification 1
+ * register the producer uses to announce a filled buffer.
+ */
+typedef struct spe_ls_dbuf_desc
+{
+	unsigned long long buf_ea[2];
+	unsigned long long signal_ea;
+	unsigned int size;
+	unsigned int ls_addr;
+} spe_ls_dbuf_desc_t;
+
+#define SPE_LS_DBUF_MAX_SIZE		0x4000
+
+/** SPE program load statistics
+ * Filled in by spe_program_load. Segments of an overlay region beyond
+ * the first one are not copied to local store; the SPE overlay manager
+ * fetches them from the image when they are called.
+ */
+typedef struct spe_load_stats
+{
+	unsigned int segments;
+	unsigned int segments_loaded;
+	unsigned int overlays;
+	unsigned int overlays_loaded;
+	unsigned int bytes_copied;
+	unsigned int bytes_zeroed;
+	unsigned int bytes_skipped;
+	unsigned long long load_time_ns;
+} spe_load_stats_t;
+
+/** SPE topology entry
+ * One SPE of the system as returned by spe_cpu_topology_get: its id (the
+ * one spe_context_phys_id_get reports), the cpu node (BE) it belongs to,
+ * the NUMA node of that BE's memory (-1 if unknown), and whether it is
+ * reserved, and so not counted as usable.
+ */
+typedef struct spe_topology_entry
+{
+	int id;
+	int cpu_node;
+	int numa_node;
+	int reserved;
+} spe_topology_entry_t;
+
+/** SPE overlay segment
+ * One entry of the overlay table recorded by spe_program_load: where the
+ * segment lives in local store and in the program image, and whether it
+ * was loaded into local store.
+ */
+typedef struct spe_overlay_segment
+{
+	unsigned int ls_addr;
+	unsigned int filesz;
+	unsigned int memsz;
+	unsigned int loaded;
+	unsigned long long image_ea;
+} spe_overlay_segment_t;
+
+/** Completion of an asynchronous program load
+ * func is called with the context, the value spe_program_load would have
+ * returned (errno is set accordingly) and arg, from a library thread,
+ * once a load queued by spe_program_load_async has finished.
+ */
+typedef struct spe_load_completion
+{
+	void (*func)(spe_context_ptr_t spe, int status, void *arg);
+	void *arg;
+} spe_load_completion_t;
+
+/** SPE context checkpoint
+ * The state of a stopped context saved by spe_context_checkpoint, in one
+ * buffer of size bytes (ls_bytes of them local store), and the npc to
+ * resume at. spe_context_restore writes it back into the same or another
+ * context and records how long that took.
+ */
+typedef struct spe_checkpoint
+{
+	void *data;
+	unsigned int size;
+	unsigned int ls_bytes;
+	unsigned int npc;
+	unsigned long long checkpoint_time_ns;
+	unsigned long long restore_time_ns;
+} spe_checkpoint_t;
+
+/** spe_scheduler_ptr_t
+ * 	This pointer serves as the identifier for a specific
+ *	SPE job scheduler throughout the API (where needed)
+ */
+typedef struct spe_scheduler * spe_scheduler_ptr_t;
+
+/** spe_task_graph_ptr_t
+ * 	This pointer serves as the identifier for a specific
+ *	SPE task graph throughout the API (where needed)
+ */
+typedef struct spe_task_graph * spe_task_graph_ptr_t;
+
 /*
  * SPE stop information
  * This structure is used to return all information available 
@@ -132,6 +278,120 @@ typedef struct spe_stop_info {
 	int spu_status;
 } spe_stop_info_t;
 
+/** Number of job priorities of an SPE job scheduler */
+#define SPE_SCHED_PRIORITIES	8
+
+/** SPE job
+ * A program run submitted to an SPE job scheduler. priority is 0 (runs
+ * first) to SPE_SCHED_PRIORITIES - 1; the jobs of one priority are shared
+ * between tenants according to their weights. The scheduler fills in the
+ * rest: the value spe_context_run returned and its errno, the stop
+ * information, and how long the job waited in the queue and ran.
+ */
+typedef struct spe_job
+{
+	spe_program_handle_t *program;
+	void *argp;
+	void *envp;
+	unsigned int priority;
+	unsigned int tenant;
+	int status;
+	int error;
+	spe_stop_info_t stop_info;
+	unsigned long long wait_ns;
+	unsigned long long run_ns;
+	int done;
+} spe_job_t;
+
+/** SPE job scheduler statistics
+ * Filled in by spe_scheduler_stats_get: the contexts the scheduler runs
+ * jobs on, the jobs queued now (in all and per priority) and at most, the
+ * jobs running, and the totals since it was created, with the time jobs
+ * spent queued.
+ */
+typedef struct spe_sched_stats
+{
+	unsigned int spes;
+	unsigned int queued;
+	unsigned int queued_prio[SPE_SCHED_PRIORITIES];
+	unsigned int queued_max;
+	unsigned int running;
+	unsigned long long submitted;
+	unsigned long long completed;
+	unsigned long long rejected;
+	unsigned long long wait_time_ns;
+	unsigned long long wait_time_max_ns;
+} spe_sched_stats_t;
+
+/** SPE task
+ * A kernel of a task graph: the program, the arguments it is run with,
+ * and an optional input of in_size bytes at in_ea that is copied to
+ * local store address in_ls before the kernel starts (both
+ * addresses and the size are multiples of 16). spe_task_graph_run fills
+ * in the rest: the value spe_context_run returned and its errno
+ * (ECANCELED for a task not run because a predecessor failed), the stop
+ * information, the worker that ran it, when it started and ended after
+ * the start of the run, the time spent loading and prefetching and the
+ * time spent running, and whether it is on the critical path.
+ */
+typedef struct spe_task
+{
+	spe_program_handle_t *program;
+	void *argp;
+	void *envp;
+	void *in_ea;
+	unsigned int in_ls;
+	unsigned int in_size;
+	int status;
+	int error;
+	spe_stop_info_t stop_info;
+	int worker;
+	unsigned long long start_ns;
+	unsigned long long end_ns;
+	unsigned long long prefetch_ns;
+	unsigned long long run_ns;
+	int critical;
+} spe_task_t;
+
+/** SPE task graph statistics
+ * Filled in by spe_task_graph_run: the contexts used, the tasks run and
+ * the tasks taken from another worker, the time the run took and the
+ * time the contexts were busy, and the longest chain of dependent tasks,
+ * in time and in tasks.
+ */
+typedef struct spe_task_graph_stats
+{
+	unsigned int spes;
+	unsigned int tasks_run;
+	unsigned int steals;
+	unsigned long long elapsed_ns;
+	unsigned long long busy_ns;
+	unsigned long long critical_path_ns;
+	unsigned int critical_path_tasks;
+} spe_task_graph_stats_t;
+
+/** spe_isolated_pool_ptr_t
+ * Pool of isolated contexts made ready ahead of the secure jobs they run
+ */
+typedef struct spe_isolated_pool * spe_isolated_pool_ptr_t;
+
+/** SPE isolated pool statistics
+ * The contexts in the pool and those idle in it; the launches measured,
+ * from spe_isolated_pool_get to the loader reporting the application
+ * loaded, in total and at most; the launches that found no loader in
+ * local store; and the time spent putting loaders there between launches.
+ */
+typedef struct spe_isolated_pool_stats
+{
+	unsigned int contexts;
+	unsigned int idle;
+	unsigned long long launches;
+	unsigned long long cold_launches;
+	unsigned long long launch_time_ns;
+	unsigned long long launch_time_max_ns;
+	unsigned long long arm_time_ns;
+} spe_isolated_pool_stats_t;
+
 /*
  * SPE event structure
  * This structure is used for SPE event handling
@@ -232,6 +492,12 @@ enum ps_area { SPE_MSSYNC_AREA, SPE_MFC_COMMAND_AREA, SPE_CONTROL_AREA, SPE_SIG_
 					SPE_EVENT_TAG_GROUP | \
 					SPE_EVENT_SPE_STOPPED
 
+/**
+ * Behavior flags for spe_gang_wait
+ */
+#define SPE_WAIT_ANY			1
+#define SPE_WAIT_ALL			2
+
 /**
  * Behavior flags for mailbox read/write functions
  */
@@ -248,6 +514,11 @@ enum ps_area { SPE_MSSYNC_AREA, SPE_MFC_COMMAND_AREA, SPE_CONTROL_AREA, SPE_SIG_
 #define SPE_TAG_IMMEDIATE		3
 
 
+/**
+ * Flags for spe_context_checkpoint
+ */
+#define SPE_CHECKPOINT_COMPRESS	0x00000001	/* leave out zero LS lines */
+
 /**
  * Flags for _base_spe_context_run
  */
@@ -29,6 +29,8 @@
   */
 
 
+#include <stdlib.h>
+
 #include "libspe2.h"
 #include "spebase.h"
 #include "speevent.h"
@@ -51,6 +53,15 @@ spe_context_ptr_t spe_context_create(unsigned int flags, spe_gang_context_ptr_t
 		} else {
 			spe->event_private = NULL;
 		}
+		if ( gang != NULL && gang->event_private != NULL ) { /* track gang membership */
+			if ( _event_spe_gang_member_add(gang, spe) ) {
+				if ( spe->event_private != NULL ) {
+					_event_spe_context_finalize(spe);
+				}
+				_base_spe_context_destroy(spe);
+				return NULL;
+			}
+		}
 	}	
 	return spe; 
 }
@@ -77,6 +88,33 @@ spe_context_ptr_t spe_context_create_affinity(unsigned int flags, spe_context_pt
 		} else {
 			spe->event_private = NULL;
 		}
+		if ( gang != NULL && gang->event_private != NULL ) { /* track gang membership */
+			if ( _event_spe_gang_member_add(gang, spe) ) {
+				if ( spe->event_private != NULL ) {
+					_event_spe_context_finalize(spe);
+				}
+				_base_spe_context_destroy(spe);
+				return NULL;
+			}
+		}
+	}
+	return spe;
+}
+
+/*
+ * spe_context_create_node
+ */
+spe_context_ptr_t spe_context_create_node(unsigned int flags, spe_gang_context_ptr_t gang, int cpu_node)
+{
+	spe_context_ptr_t spe = spe_context_create(flags, gang);
+	if ( spe == NULL ) {
+		return NULL;
+	}
+	if ( _base_spe_context_node_set(spe, cpu_node) ) {
+		int errno_saved = errno;
+		spe_context_destroy(spe);
+		errno = errno_saved;
+		return NULL;
 	}
 	return spe;
 }
@@ -91,6 +129,9 @@ int spe_context_destroy (spe_context_ptr_t spe)
 		errno = ESRCH;
 		return -1;
 	}
+	if ( spe->base_private->gang != NULL ) {
+		_event_spe_gang_member_remove(spe->base_private->gang, spe);
+	}
 	if ( spe->event_private != NULL ) {
 		int ret = _event_spe_context_finalize(spe);
 		if (ret) { /* error releasing event-related resources */
@@ -106,7 +147,16 @@ int spe_context_destroy (spe_context_ptr_t spe)
  
 spe_gang_context_ptr_t spe_gang_context_create (unsigned int flags)
 {
-	return _base_spe_gang_context_create(flags); 	
+	spe_gang_context_ptr_t gang = _base_spe_gang_context_create(flags);
+	if ( gang == NULL ) {
+		return NULL;
+	}
+	gang->event_private = _event_spe_gang_context_initialize(gang);
+	if ( gang->event_private == NULL ) { /* error initializing gang events */
+		_base_spe_gang_context_destroy(gang);
+		return NULL;
+	}
+	return gang;
 }
 
 /*
@@ -119,9 +169,129 @@ int spe_gang_context_destroy (spe_gang_context_ptr_t gang)
 		errno = ESRCH;
 		return -1;
 	}
+	if ( gang->event_private != NULL ) {
+		_event_spe_gang_context_finalize(gang);
+	}
 	return _base_spe_gang_context_destroy (gang);
 }
 
+/*
+ * spe_pipeline_create
+ */
+
+spe_pipeline_ptr_t spe_pipeline_create(spe_gang_context_ptr_t gang, int nstages, unsigned int flags)
+{
+	spe_pipeline_ptr_t pipeline;
+	int i;
+
+	if ( gang == NULL ) {
+		errno = ESRCH;
+		return NULL;
+	}
+	if ( nstages <= 0 ) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	pipeline = malloc(sizeof(*pipeline));
+	if ( pipeline == NULL ) {
+		return NULL;
+	}
+	pipeline->stages = calloc(nstages, sizeof(*pipeline->stages));
+	if ( pipeline->stages == NULL ) {
+		free(pipeline);
+		return NULL;
+	}
+	pipeline->gang = gang;
+	pipeline->nstages = 0;
+
+	/* each stage is placed next to its predecessor; memory affinity,
+	 * if requested, only applies to the head of the chain */
+	for ( i = 0; i < nstages; i++ ) {
+		spe_context_ptr_t neighbor = i ? pipeline->stages[i - 1].spe : NULL;
+		unsigned int stage_flags = i ? flags & ~SPE_AFFINITY_MEMORY : flags;
+		spe_context_ptr_t spe;
+
+		spe = spe_context_create_affinity(stage_flags, neighbor, gang);
+		if ( spe == NULL ) {
+			int errno_saved = errno;
+			spe_pipeline_destroy(pipeline);
+			errno = errno_saved;
+			return NULL;
+		}
+		pipeline->stages[i].spe = spe;
+		pipeline->stages[i].ls = _base_spe_ls_area_get(spe);
+		pipeline->nstages++;
+	}
+
+	for ( i = 0; i < nstages; i++ ) {
+		pipeline->stages[i].next_ls = pipeline->stages[(i + 1) % nstages].ls;
+	}
+
+	return pipeline;
+}
+
+/*
+ * spe_pipeline_destroy
+ */
+
+int spe_pipeline_destroy(spe_pipeline_ptr_t pipeline)
+{
+	int i, ret = 0;
+
+	if ( pipeline == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	/* tear down from the tail so no stage outlives its neighbor */
+	for ( i = pipeline->nstages - 1; i >= 0; i-- ) {
+		if ( spe_context_destroy(pipeline->stages[i].spe) ) {
+			ret = -1;
+		}
+	}
+	free(pipeline->stages);
+	free(pipeline);
+	return ret;
+}
+
+/*
+ * spe_pipeline_phys_ids_get
+ */
+
+int spe_pipeline_phys_ids_get(spe_pipeline_ptr_t pipeline, int *phys_ids)
+{
+	int i, loaded = 0;
+
+	if ( pipeline == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	if ( phys_ids == NULL ) {
+		errno = EINVAL;
+		return -1;
+	}
+	for ( i = 0; i < pipeline->nstages; i++ ) {
+		phys_ids[i] = _base_spe_context_phys_id_get(pipeline->stages[i].spe);
+		if ( phys_ids[i] >= 0 ) {
+			loaded++;
+		}
+	}
+	return loaded;
+}
+
+/*
+ * spe_context_phys_id_get
+ */
+
+int spe_context_phys_id_get(spe_context_ptr_t spe)
+{
+	if (spe == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	return _base_spe_context_phys_id_get(spe);
+}
+
 /*
  * spe_image_open
  */
@@ -140,6 +310,15 @@ int spe_image_close (spe_program_handle_t *program)
 	return _base_spe_image_close(program);
 }
 
+/*
+ * spe_image_preload
+ */
+
+int spe_image_preload (spe_program_handle_t **programs, int count)
+{
+	return _base_spe_image_preload(programs, count);
+}
+
 /*
  * spe_load_program
  */
@@ -157,21 +336,396 @@ int spe_program_load (spe_context_ptr_t spe, spe_program_handle_t *program)
 	return _base_spe_program_load(spe, program);
 }
 
+/*
+ * spe_program_load_async
+ */
+
+int spe_program_load_async (spe_context_ptr_t spe, spe_program_handle_t *program, spe_load_completion_t *completion)
+{
+	if (spe == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	if (program == NULL ) {
+		errno = EINVAL;
+		return -1;
+	}
+	return _base_spe_program_load_async(spe, program, completion);
+}
+
+/*
+ * spe_program_load_wait
+ */
+
+int spe_program_load_wait (spe_context_ptr_t spe)
+{
+	if (spe == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	return _base_spe_program_load_wait(spe);
+}
+
+/*
+ * spe_program_load_next
+ */
+
+int spe_program_load_next (spe_context_ptr_t spe, spe_program_handle_t *program)
+{
+	if (spe == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	if (program == NULL ) {
+		errno = EINVAL;
+		return -1;
+	}
+	return _base_spe_program_load_next(spe, program);
+}
+
+/*
+ * spe_program_load_stats_get
+ */
+
+int spe_program_load_stats_get (spe_context_ptr_t spe, spe_load_stats_t *stats)
+{
+	if (spe == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	return _base_spe_program_load_stats_get(spe, stats);
+}
+
+/*
+ * spe_program_overlays_get
+ */
+
+int spe_program_overlays_get (spe_context_ptr_t spe, spe_overlay_segment_t *overlays, int max)
+{
+	if (spe == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	return _base_spe_program_overlays_get(spe, overlays, max);
+}
+
+/*
+ * spe_context_checkpoint
+ */
+
+int spe_context_checkpoint (spe_context_ptr_t spe, spe_checkpoint_t *ckpt, unsigned int flags)
+{
+	if (spe == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	if (ckpt == NULL ) {
+		errno = EINVAL;
+		return -1;
+	}
+	return _base_spe_context_checkpoint(spe, ckpt, flags);
+}
+
+/*
+ * spe_context_restore
+ */
+
+int spe_context_restore (spe_context_ptr_t spe, spe_checkpoint_t *ckpt, unsigned int *entry)
+{
+	if (spe == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	if (ckpt == NULL || entry == NULL ) {
+		errno = EINVAL;
+		return -1;
+	}
+	return _base_spe_context_restore(spe, ckpt, entry);
+}
+
+/*
+ * spe_checkpoint_free
+ */
+
+void spe_checkpoint_free (spe_checkpoint_t *ckpt)
+{
+	if (ckpt)
+		_base_spe_checkpoint_free(ckpt);
+}
+
+/*
+ * spe_scheduler_create
+ */
+
+spe_scheduler_ptr_t spe_scheduler_create (int nspes, unsigned int max_queued, unsigned int flags)
+{
+	return _base_spe_scheduler_create(nspes, max_queued, flags);
+}
+
+/*
+ * spe_scheduler_destroy
+ */
+
+int spe_scheduler_destroy (spe_scheduler_ptr_t sched)
+{
+	if (sched == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	return _base_spe_scheduler_destroy(sched);
+}
+
+/*
+ * spe_scheduler_tenant_set
+ */
+
+int spe_scheduler_tenant_set (spe_scheduler_ptr_t sched, unsigned int tenant, unsigned int weight)
+{
+	if (sched == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	return _base_spe_scheduler_tenant_set(sched, tenant, weight);
+}
+
+/*
+ * spe_scheduler_submit
+ */
+
+int spe_scheduler_submit (spe_scheduler_ptr_t sched, spe_job_t *job)
+{
+	if (sched == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	if (job == NULL ) {
+		errno = EINVAL;
+		return -1;
+	}
+	return _base_spe_scheduler_submit(sched, job);
+}
+
+/*
+ * spe_scheduler_wait
+ */
+
+int spe_scheduler_wait (spe_scheduler_ptr_t sched, spe_job_t *job)
+{
+	if (sched == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	if (job == NULL ) {
+		errno = EINVAL;
+		return -1;
+	}
+	return _base_spe_scheduler_wait(sched, job);
+}
+
+/*
+ * spe_scheduler_stats_get
+ */
+
+int spe_scheduler_stats_get (spe_scheduler_ptr_t sched, spe_sched_stats_t *stats)
+{
+	if (sched == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	if (stats == NULL ) {
+		errno = EINVAL;
+		return -1;
+	}
+	return _base_spe_scheduler_stats_get(sched, stats);
+}
+
+/*
+ * spe_task_graph_create
+ */
+
+spe_task_graph_ptr_t spe_task_graph_create (void)
+{
+	return _base_spe_task_graph_create();
+}
+
+/*
+ * spe_task_graph_destroy
+ */
+
+int spe_task_graph_destroy (spe_task_graph_ptr_t graph)
+{
+	if (graph == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	return _base_spe_task_graph_destroy(graph);
+}
+
+/*
+ * spe_task_graph_add
+ */
+
+int spe_task_graph_add (spe_task_graph_ptr_t graph, const spe_task_t *task)
+{
+	if (graph == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	if (task == NULL ) {
+		errno = EINVAL;
+		return -1;
+	}
+	return _base_spe_task_graph_add(graph, task);
+}
+
+/*
+ * spe_task_graph_depend
+ */
+
+int spe_task_graph_depend (spe_task_graph_ptr_t graph, int task, int after)
+{
+	if (graph == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	return _base_spe_task_graph_depend(graph, task, after);
+}
+
+/*
+ * spe_task_graph_buffer_alloc
+ */
+
+void *spe_task_graph_buffer_alloc (spe_task_graph_ptr_t graph, unsigned int size)
+{
+	if (graph == NULL ) {
+		errno = ESRCH;
+		return NULL;
+	}
+	return _base_spe_task_graph_buffer_alloc(graph, size);
+}
+
+/*
+ * spe_task_graph_run
+ */
+
+int spe_task_graph_run (spe_task_graph_ptr_t graph, int nspes, spe_task_graph_stats_t *stats)
+{
+	if (graph == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	return _base_spe_task_graph_run(graph, nspes, stats);
+}
+
+/*
+ * spe_task_graph_task_get
+ */
+
+int spe_task_graph_task_get (spe_task_graph_ptr_t graph, int task, spe_task_t *result)
+{
+	if (graph == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	if (result == NULL ) {
+		errno = EINVAL;
+		return -1;
+	}
+	return _base_spe_task_graph_task_get(graph, task, result);
+}
+
+/*
+ * spe_isolated_pool_create
+ */
+
+spe_isolated_pool_ptr_t spe_isolated_pool_create (unsigned int flags, int ncontexts)
+{
+	return _base_spe_isolated_pool_create(flags, ncontexts);
+}
+
+/*
+ * spe_isolated_pool_destroy
+ */
+
+int spe_isolated_pool_destroy (spe_isolated_pool_ptr_t pool)
+{
+	if (pool == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	return _base_spe_isolated_pool_destroy(pool);
+}
+
+/*
+ * spe_isolated_pool_get
+ */
+
+spe_context_ptr_t spe_isolated_pool_get (spe_isolated_pool_ptr_t pool, spe_program_handle_t *program)
+{
+	if (pool == NULL ) {
+		errno = ESRCH;
+		return NULL;
+	}
+	if (program == NULL ) {
+		errno = EINVAL;
+		return NULL;
+	}
+	return _base_spe_isolated_pool_get(pool, program);
+}
+
+/*
+ * spe_isolated_pool_put
+ */
+
+int spe_isolated_pool_put (spe_isolated_pool_ptr_t pool, spe_context_ptr_t spe)
+{
+	if (pool == NULL || spe == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	return _base_spe_isolated_pool_put(pool, spe);
+}
+
+/*
+ * spe_isolated_pool_stats_get
+ */
+
+int spe_isolated_pool_stats_get (spe_isolated_pool_ptr_t pool, spe_isolated_pool_stats_t *stats)
+{
+	if (pool == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	if (stats == NULL ) {
+		errno = EINVAL;
+		return -1;
+	}
+	return _base_spe_isolated_pool_stats_get(pool, stats);
+}
+
 /*
  * spe_context_run
  */
  
 int spe_context_run	(spe_context_ptr_t spe, unsigned int *entry, unsigned int runflags, void *argp, void *envp, spe_stop_info_t *stopinfo)
 {
+	int ret;
+
 	if (spe == NULL ) {
 		errno = ESRCH;
 		return -1;
 	}
 	if ( spe->event_private != NULL ) {
-		return _event_spe_context_run(spe, entry, runflags, argp, envp, stopinfo);
+		ret = _event_spe_context_run(spe, entry, runflags, argp, envp, stopinfo);
 	} else {
-		return _base_spe_context_run(spe, entry, runflags, argp, envp, stopinfo);
+		ret = _base_spe_context_run(spe, entry, runflags, argp, envp, stopinfo);
+	}
+	if ( ret <= 0 && spe->base_private->gang != NULL ) { /* exit or error */
+		int errno_saved = errno;
+		_event_spe_gang_member_completed(spe->base_private->gang, spe);
+		errno = errno_saved;
 	}
+	return ret;
 }
 
 /*
@@ -237,6 +791,45 @@ int spe_event_wait(spe_event_handler_ptr_t evhandler, spe_event_unit_t *events,
 	return _event_spe_event_wait(evhandler, events, max_events, timeout);
 }
 
+/*
+ * spe_gang_event_handler_register
+ */
+
+int spe_gang_event_handler_register(spe_event_handler_ptr_t evhandler, spe_gang_context_ptr_t gang, unsigned int events, spe_event_data_t data)
+{
+	if (gang == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	return _event_spe_gang_event_handler_register(evhandler, gang, events, data);
+}
+
+/*
+ * spe_gang_event_handler_deregister
+ */
+
+int spe_gang_event_handler_deregister(spe_event_handler_ptr_t evhandler, spe_gang_context_ptr_t gang, unsigned int events)
+{
+	if (gang == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	return _event_spe_gang_event_handler_deregister(evhandler, gang, events);
+}
+
+/*
+ * spe_gang_wait
+ */
+
+int spe_gang_wait(spe_gang_context_ptr_t gang, unsigned int mode, spe_context_ptr_t *spes, int max_spes, int timeout)
+{
+	if (gang == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	return _event_spe_gang_wait(gang, mode, spes, max_spes, timeout);
+}
+
 /* 
  * MFCIO Proxy Commands
  */
@@ -402,6 +995,24 @@ int spe_signal_write (spe_context_ptr_t spe, unsigned int signal_reg, unsigned i
 	return _base_spe_signal_write(spe, signal_reg, data);
 }
 
+int spe_signal_or (spe_context_ptr_t spe, unsigned int signal_reg, unsigned int mask)
+{
+	if (spe == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	return _base_spe_signal_or(spe, signal_reg, mask);
+}
+
+int spe_signal_doorbell_enable (spe_context_ptr_t spe, unsigned int signal_reg)
+{
+	if (spe == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	return _base_spe_signal_doorbell_enable(spe, signal_reg);
+}
+
 /*
  * spe_ls_area_get
  */
@@ -441,6 +1052,28 @@ void * spe_ps_area_get (spe_context_ptr_t spe, enum ps_area area)
 	return _base_spe_ps_area_get(spe, area);
 }
 
+/*
+ * spe_peer_table_publish
+ */
+
+int spe_peer_table_publish(spe_context_ptr_t *spes, int count, unsigned int ls_addr)
+{
+	return _base_spe_peer_table_publish(spes, count, ls_addr);
+}
+
+/*
+ * spe_ls_dbuf_desc_init
+ */
+
+int spe_ls_dbuf_desc_init(spe_context_ptr_t consumer, unsigned int ls_addr, unsigned int size, spe_ls_dbuf_desc_t *desc)
+{
+	if (consumer == NULL ) {
+		errno = ESRCH;
+		return -1;
+	}
+	return _base_spe_ls_dbuf_desc_init(consumer, ls_addr, size, desc);
+}
+
 /*
  * spe_callback_handler_register
  */
@@ -467,6 +1100,14 @@ void * spe_callback_handler_query(unsigned int callnum)
 	return _base_spe_callback_handler_query(callnum);
 }
 
+/*
+ * spe_ea_bind
+ */
+int spe_ea_bind(void *ea, size_t size, int cpu_node)
+{
+	return _base_spe_ea_bind(ea, size, cpu_node);
+}
+
 /*
  * spe_info_get
  */
@@ -475,6 +1116,22 @@ int spe_cpu_info_get(int info_requested, int cpu_node)
 	return _base_spe_cpu_info_get(info_requested, cpu_node);
 }
 
+/*
+ * spe_cpu_info_refresh
+ */
+int spe_cpu_info_refresh(void)
+{
+	return _base_spe_cpu_info_refresh();
+}
+
+/*
+ * spe_cpu_topology_get
+ */
+int spe_cpu_topology_get(spe_topology_entry_t *spes, int max)
+{
+	return _base_spe_cpu_topology_get(spes, max);
+}
+
 #ifdef __cplusplus
 }
 #endif
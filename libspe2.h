@@ -64,6 +64,11 @@ spe_context_ptr_t spe_context_create(unsigned int flags, spe_gang_context_ptr_t
  */
 spe_context_ptr_t spe_context_create_affinity(unsigned int flags, spe_context_ptr_t affinity_neighbor, spe_gang_context_ptr_t gang);
 
+/*
+ * spe_context_create_node
+ */
+spe_context_ptr_t spe_context_create_node(unsigned int flags, spe_gang_context_ptr_t gang, int cpu_node);
+
 /*
  * spe_context_destroy
  */
@@ -79,6 +84,26 @@ spe_gang_context_ptr_t spe_gang_context_create (unsigned int flags);
  */
 int spe_gang_context_destroy (spe_gang_context_ptr_t gang);
 
+/*
+ * spe_pipeline_create
+ */
+spe_pipeline_ptr_t spe_pipeline_create(spe_gang_context_ptr_t gang, int nstages, unsigned int flags);
+
+/*
+ * spe_pipeline_destroy
+ */
+int spe_pipeline_destroy(spe_pipeline_ptr_t pipeline);
+
+/*
+ * spe_pipeline_phys_ids_get
+ */
+int spe_pipeline_phys_ids_get(spe_pipeline_ptr_t pipeline, int *phys_ids);
+
+/*
+ * spe_context_phys_id_get
+ */
+int spe_context_phys_id_get(spe_context_ptr_t spe);
+
 /*
  * spe_image_open
  */
@@ -89,11 +114,146 @@ spe_program_handle_t * spe_image_open (const char *filename);
  */
 int spe_image_close (spe_program_handle_t *program);
 
+/*
+ * spe_image_preload
+ */
+int spe_image_preload (spe_program_handle_t **programs, int count);
+
 /*
  * spe_load_program
  */
 int spe_program_load (spe_context_ptr_t spe, spe_program_handle_t *program);
 
+/*
+ * spe_program_load_async
+ */
+int spe_program_load_async (spe_context_ptr_t spe, spe_program_handle_t *program, spe_load_completion_t *completion);
+
+/*
+ * spe_program_load_wait
+ */
+int spe_program_load_wait (spe_context_ptr_t spe);
+
+/*
+ * spe_program_load_next
+ */
+int spe_program_load_next (spe_context_ptr_t spe, spe_program_handle_t *program);
+
+/*
+ * spe_program_load_stats_get
+ */
+int spe_program_load_stats_get (spe_context_ptr_t spe, spe_load_stats_t *stats);
+
+/*
+ * spe_program_overlays_get
+ */
+int spe_program_overlays_get (spe_context_ptr_t spe, spe_overlay_segment_t *overlays, int max);
+
+/*
+ * spe_context_checkpoint
+ */
+int spe_context_checkpoint (spe_context_ptr_t spe, spe_checkpoint_t *ckpt, unsigned int flags);
+
+/*
+ * spe_context_restore
+ */
+int spe_context_restore (spe_context_ptr_t spe, spe_checkpoint_t *ckpt, unsigned int *entry);
+
+/*
+ * spe_checkpoint_free
+ */
+void spe_checkpoint_free (spe_checkpoint_t *ckpt);
+
+/*
+ * spe_scheduler_create
+ */
+spe_scheduler_ptr_t spe_scheduler_create (int nspes, unsigned int max_queued, unsigned int flags);
+
+/*
+ * spe_scheduler_destroy
+ */
+int spe_scheduler_destroy (spe_scheduler_ptr_t sched);
+
+/*
+ * spe_scheduler_tenant_set
+ */
+int spe_scheduler_tenant_set (spe_scheduler_ptr_t sched, unsigned int tenant, unsigned int weight);
+
+/*
+ * spe_scheduler_submit
+ */
+int spe_scheduler_submit (spe_scheduler_ptr_t sched, spe_job_t *job);
+
+/*
+ * spe_scheduler_wait
+ */
+int spe_scheduler_wait (spe_scheduler_ptr_t sched, spe_job_t *job);
+
+/*
+ * spe_scheduler_stats_get
+ */
+int spe_scheduler_stats_get (spe_scheduler_ptr_t sched, spe_sched_stats_t *stats);
+
+/*
+ * spe_task_graph_create
+ */
+spe_task_graph_ptr_t spe_task_graph_create (void);
+
+/*
+ * spe_task_graph_destroy
+ */
+int spe_task_graph_destroy (spe_task_graph_ptr_t graph);
+
+/*
+ * spe_task_graph_add
+ */
+int spe_task_graph_add (spe_task_graph_ptr_t graph, const spe_task_t *task);
+
+/*
+ * spe_task_graph_depend
+ */
+int spe_task_graph_depend (spe_task_graph_ptr_t graph, int task, int after);
+
+/*
+ * spe_task_graph_buffer_alloc
+ */
+void *spe_task_graph_buffer_alloc (spe_task_graph_ptr_t graph, unsigned int size);
+
+/*
+ * spe_task_graph_run
+ */
+int spe_task_graph_run (spe_task_graph_ptr_t graph, int nspes, spe_task_graph_stats_t *stats);
+
+/*
+ * spe_task_graph_task_get
+ */
+int spe_task_graph_task_get (spe_task_graph_ptr_t graph, int task, spe_task_t *result);
+
+/*
+ * spe_isolated_pool_create
+ */
+spe_isolated_pool_ptr_t spe_isolated_pool_create (unsigned int flags, int ncontexts);
+
+/*
+ * spe_isolated_pool_destroy
+ */
+int spe_isolated_pool_destroy (spe_isolated_pool_ptr_t pool);
+
+/*
+ * spe_isolated_pool_get
+ */
+spe_context_ptr_t spe_isolated_pool_get (spe_isolated_pool_ptr_t pool, spe_program_handle_t *program);
+
+/*
+ * spe_isolated_pool_put
+ */
+int spe_isolated_pool_put (spe_isolated_pool_ptr_t pool, spe_context_ptr_t spe);
+
+/*
+ * spe_isolated_pool_stats_get
+ */
+int spe_isolated_pool_stats_get (spe_isolated_pool_ptr_t pool, spe_isolated_pool_stats_t *stats);
+
 /*
  * spe_context_run
  */
@@ -129,6 +289,21 @@ int spe_event_handler_deregister(spe_event_handler_ptr_t evhandler, spe_event_un
  */
 int spe_event_wait(spe_event_handler_ptr_t evhandler, spe_event_unit_t *events, int max_events, int timeout);
 
+/*
+ * spe_gang_event_handler_register
+ */
+int spe_gang_event_handler_register(spe_event_handler_ptr_t evhandler, spe_gang_context_ptr_t gang, unsigned int events, spe_event_data_t data);
+
+/*
+ * spe_gang_event_handler_deregister
+ */
+int spe_gang_event_handler_deregister(spe_event_handler_ptr_t evhandler, spe_gang_context_ptr_t gang, unsigned int events);
+
+/*
+ * spe_gang_wait
+ */
+int spe_gang_wait(spe_gang_context_ptr_t gang, unsigned int mode, spe_context_ptr_t *spes, int max_spes, int timeout);
+
 /* 
  * MFCIO Proxy Commands
  */
@@ -176,6 +351,16 @@ int spe_mssync_status(spe_context_ptr_t spe);
  */
 int spe_signal_write (spe_context_ptr_t spe, unsigned int signal_reg, unsigned int data);
 
+/*
+ * spe_signal_or
+ */
+int spe_signal_or (spe_context_ptr_t spe, unsigned int signal_reg, unsigned int mask);
+
+/*
+ * spe_signal_doorbell_enable
+ */
+int spe_signal_doorbell_enable (spe_context_ptr_t spe, unsigned int signal_reg);
+
 /*
  * spe_ls_area_get
  */
@@ -191,6 +376,16 @@ int spe_ls_size_get (spe_context_ptr_t spe);
  */
 void * spe_ps_area_get (spe_context_ptr_t spe, enum ps_area area);
 
+/*
+ * spe_peer_table_publish
+ */
+int spe_peer_table_publish(spe_context_ptr_t *spes, int count, unsigned int ls_addr);
+
+/*
+ * spe_ls_dbuf_desc_init
+ */
+int spe_ls_dbuf_desc_init(spe_context_ptr_t consumer, unsigned int ls_addr, unsigned int size, spe_ls_dbuf_desc_t *desc);
+
 /*
  * spe_callback_handler_register
  */
@@ -211,6 +406,21 @@ void * spe_callback_handler_query(unsigned int callnum);
  */
 int spe_cpu_info_get(int info_requested, int cpu_node); 
 
+/*
+ * spe_cpu_info_refresh
+ */
+int spe_cpu_info_refresh(void);
+
+/*
+ * spe_cpu_topology_get
+ */
+int spe_cpu_topology_get(spe_topology_entry_t *spes, int max);
+
+/*
+ * spe_ea_bind
+ */
+int spe_ea_bind(void *ea, size_t size, int cpu_node);
+
 
 #ifdef __cplusplus
 }
@@ -110,6 +110,7 @@ Management Library.
 %if %{build_common}
 %description -n elfspe2
 This tool acts as a standalone loader for spe binaries.
+spe-run-batch runs an spe binary over a list of argument sets on all spes.
 %endif
 
 %prep
@@ -237,6 +238,7 @@ rm -rf $RPM_BUILD_ROOT
 %{sysroot}%{_bindir}/elfspe-register
 %{sysroot}%{_bindir}/elfspe-unregister
 %{sysroot}%{_bindir}/elfspe
+%{sysroot}%{_bindir}/spe-run-batch
 %{sysroot}/etc/init.d/elfspe
 %endif
 
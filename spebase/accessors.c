@@ -21,6 +21,8 @@
 
 #include <fcntl.h>
 #include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
 #include <sys/mman.h>
 
  /*
@@ -106,3 +108,32 @@ int _base_spe_ls_size_get(spe_context_ptr_t spe)
 {
 	return LS_SIZE;
 }
+
+int _base_spe_context_phys_id_get(spe_context_ptr_t spe)
+{
+	char buf[32];
+	unsigned long long id;
+	int fd, rc;
+
+	fd = openat(spe->base_private->fd_spe_dir, "phys-id", O_RDONLY);
+	if (fd < 0) {
+		errno = ENOSYS;
+		return -1;
+	}
+	rc = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (rc <= 0) {
+		errno = EIO;
+		return -1;
+	}
+	buf[rc] = '\0';
+
+	/* spufs reports -1 while the context is not loaded on an SPU */
+	id = strtoull(buf, NULL, 0);
+	if (id == (unsigned long long)-1 || id > INT_MAX) {
+		errno = EAGAIN;
+		return -1;
+	}
+
+	return (int)id;
+}
@@ -0,0 +1,153 @@
+/*
+ * libspe2 - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ * Copyright (C) 2008 IBM Corp.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "spebase.h"
+#include "callstats.h"
+#include "default_c99_handler.h"
+#include "default_posix1_handler.h"
+#include "default_libea_handler.h"
+
+static int callstats_enabled = -1;
+
+static void callstats_name(struct spe_context *spe, char *name, size_t size)
+{
+	char *p;
+
+	snprintf(name, size, "%s%s", SPE_CALLSTATS_PREFIX,
+		 spe->base_private->spufs_name);
+	/* gang contexts live in a subdirectory */
+	for (p = name + strlen(SPE_CALLSTATS_PREFIX); *p; p++)
+		if (*p == '/')
+			*p = '.';
+}
+
+static struct spe_callstats *callstats_map(struct spe_context *spe)
+{
+	struct spe_context_base_priv *priv = spe->base_private;
+	struct spe_callstats *stats;
+	char name[PATH_MAX];
+	int fd;
+
+	if (callstats_enabled < 0)
+		callstats_enabled = getenv("SPE_CALLSTATS") != NULL;
+	if (!callstats_enabled || !priv->spufs_name)
+		return NULL;
+
+	/* the calls made tell about the program: only its owner reads them */
+	callstats_name(spe, name, sizeof(name));
+	fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+	if (fd < 0) {
+		DEBUG_PRINTF("Could not create %s: %s\n", name, strerror(errno));
+		return NULL;
+	}
+	if (ftruncate(fd, sizeof(*stats))) {
+		close(fd);
+		shm_unlink(name);
+		return NULL;
+	}
+	stats = mmap(NULL, sizeof(*stats), PROT_READ | PROT_WRITE,
+		     MAP_SHARED, fd, 0);
+	close(fd);
+	if (stats == MAP_FAILED) {
+		shm_unlink(name);
+		return NULL;
+	}
+
+	stats->pid = getpid();
+	stats->version = SPE_CALLSTATS_VERSION;
+	/* readers check the magic last */
+	__sync_synchronize();
+	stats->magic = SPE_CALLSTATS_MAGIC;
+
+	return stats;
+}
+
+void _base_spe_callstats_account(struct spe_context *spe, int callnum,
+				 unsigned int opcode,
+				 unsigned long long time_ns)
+{
+	struct spe_context_base_priv *priv = spe->base_private;
+	struct spe_callstat *stat;
+
+	/* a failed mapping is not retried for every call */
+	if (priv->callstats == MAP_FAILED)
+		return;
+	if (!priv->callstats) {
+		priv->callstats = callstats_map(spe);
+		if (!priv->callstats) {
+			priv->callstats = MAP_FAILED;
+			return;
+		}
+	}
+
+	switch (callnum) {
+	case SPE_C99_CLASS & 0xff:
+		stat = &priv->callstats->calls[SPE_CALLSTATS_C99][opcode & 0xff];
+		break;
+	case SPE_POSIX1_CLASS & 0xff:
+		stat = &priv->callstats->calls[SPE_CALLSTATS_POSIX1][opcode & 0xff];
+		break;
+	case SPE_LIBEA_CLASS & 0xff:
+		stat = &priv->callstats->calls[SPE_CALLSTATS_LIBEA][opcode & 0xff];
+		break;
+	default:
+		stat = &priv->callstats->calls[SPE_CALLSTATS_OTHER][callnum & 0xff];
+		break;
+	}
+
+	/* only the thread running the context updates its segment */
+	stat->time_ns += time_ns;
+	stat->count++;
+}
+
+unsigned long long _base_spe_elapsed_ns(const struct timespec *t0)
+{
+	struct timespec t1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (t1.tv_sec - t0->tv_sec) * 1000000000ULL +
+		t1.tv_nsec - t0->tv_nsec;
+}
+
+void _base_spe_callstats_release(struct spe_context *spe)
+{
+	struct spe_context_base_priv *priv = spe->base_private;
+	char name[PATH_MAX];
+
+	if (priv->callstats && priv->callstats != MAP_FAILED) {
+		munmap(priv->callstats, sizeof(*priv->callstats));
+		callstats_name(spe, name, sizeof(name));
+		shm_unlink(name);
+	}
+	priv->callstats = NULL;
+	free(priv->spufs_name);
+	priv->spufs_name = NULL;
+}
@@ -0,0 +1,94 @@
+/*
+ * libspe2 - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ * Copyright (C) 2008 IBM Corp.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef _callstats_h_
+#define _callstats_h_
+
+#include "spebase.h"
+
+/*
+ * Per-context PPE assisted library call statistics.
+ *
+ * With the SPE_CALLSTATS environment variable set, every context that
+ * performs a library call publishes a POSIX shared memory segment named
+ * SPE_CALLSTATS_PREFIX followed by the context's spufs directory relative
+ * to the mount point, with '/' replaced by '.'
+ * (e.g. /libspe2-callstats-mygang.spethread-1234-268566536), readable by
+ * its owner only. Tools such as spu-top read it to break the spufs
+ * ppe_library counter down by call.
+ * The segment is removed when the context is destroyed; the segments of
+ * a process that died first stay in /dev/shm until removed, e.g. with
+ * spu-top --clean-callstats.
+ *
+ * The layout is part of the interface with spu-tools: only append
+ * fields, and bump SPE_CALLSTATS_VERSION on incompatible changes.
+ */
+
+#define SPE_CALLSTATS_PREFIX	"/libspe2-callstats-"
+#define SPE_CALLSTATS_MAGIC	0x53504543	/* "SPEC" */
+#define SPE_CALLSTATS_VERSION	1
+
+/* call classes; SPE_CALLSTATS_OTHER is indexed by callback number, the
+ * other classes by opcode */
+enum spe_callstats_class {
+	SPE_CALLSTATS_C99 = 0,
+	SPE_CALLSTATS_POSIX1,
+	SPE_CALLSTATS_LIBEA,
+	SPE_CALLSTATS_OTHER,
+	SPE_CALLSTATS_NR_CLASSES
+};
+
+struct spe_callstat {
+	unsigned long long count;
+	unsigned long long time_ns;	/* PPE time spent servicing */
+};
+
+struct spe_callstats {
+	unsigned int magic;
+	unsigned int version;
+	int pid;
+	unsigned int reserved;
+	struct spe_callstat calls[SPE_CALLSTATS_NR_CLASSES][256];
+};
+
+/**
+ * _base_spe_callstats_account records one serviced library call
+ *
+ * The segment is created on the first call, so contexts that never call
+ * back to the PPE do not leave anything in shared memory. Nothing is
+ * accounted unless the SPE_CALLSTATS environment variable is set.
+ *
+ * @param spe Specifies the SPE context
+ * @param callnum Specifies the library callback number (stop code & 0xff)
+ * @param opcode Specifies the opcode found in the call's parameter word
+ * @param time_ns Specifies the time spent in the handler
+ */
+extern void _base_spe_callstats_account(struct spe_context *spe, int callnum,
+					unsigned int opcode,
+					unsigned long long time_ns);
+
+/**
+ * _base_spe_callstats_release unmaps and removes the statistics segment
+ * of a context, if any
+ *
+ * @param spe Specifies the SPE context
+ */
+extern void _base_spe_callstats_release(struct spe_context *spe);
+
+#endif
@@ -0,0 +1,377 @@
+/*
+ * libspe2 - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ * Copyright (C) 2008 IBM Corp.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * Checkpoint and restore of a stopped context through its spufs files:
+ * local store, registers, the channel state spufs lets us write back and
+ * the PPE to SPE mailbox. The checkpoint is one buffer, so that the job
+ * can be resumed later, on this context or on another one.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ls_copy.h"
+#include "spebase.h"
+
+#define CHECKPOINT_MAGIC	0x5350434b	/* "SPCK" */
+#define CHECKPOINT_LINE		128
+#define CHECKPOINT_REGS_SIZE	(128 * 16)
+#define CHECKPOINT_WBOX_MAX	4
+
+/* simple spufs attributes saved and written back, in this order; the
+ * event mask is left out, as spufs only lets it be read */
+static const char *checkpoint_attrs[] = {
+	"decr",
+	"decr_status",
+	"srr0",
+};
+
+#define CHECKPOINT_ATTRS \
+	(sizeof(checkpoint_attrs) / sizeof(checkpoint_attrs[0]))
+
+struct checkpoint_header {
+	uint32_t magic;
+	uint32_t flags;
+	uint32_t size;
+	uint32_t ls_bytes;
+	uint32_t npc;
+	uint32_t entry;
+	uint32_t ls_base;
+	uint32_t ls_extent;
+	uint32_t attrs_saved;
+	uint32_t signals_saved;
+	uint32_t signal[2];
+	uint32_t nwbox;
+	uint32_t wbox[CHECKPOINT_WBOX_MAX];
+	uint64_t attrs[CHECKPOINT_ATTRS];
+	unsigned char fpcr[16];
+	unsigned char regs[CHECKPOINT_REGS_SIZE];
+} __attribute__((aligned(16)));
+
+/* With SPE_CHECKPOINT_COMPRESS, local store is kept as runs of lines
+ * that are not all zero, each one after its run header. */
+struct checkpoint_run {
+	uint32_t ls_addr;
+	uint32_t size;
+	uint32_t pad[2];
+};
+
+/* Reads a spufs file of the context into buf; returns the bytes read. */
+static int read_file(spe_context_ptr_t spe, const char *name,
+		     void *buf, int size)
+{
+	int fd, rc;
+
+	fd = openat(spe->base_private->fd_spe_dir, name, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	rc = pread(fd, buf, size, 0);
+	close(fd);
+	return rc;
+}
+
+static int write_file(spe_context_ptr_t spe, const char *name,
+		      const void *buf, int size, int flags)
+{
+	int fd, rc;
+
+	fd = openat(spe->base_private->fd_spe_dir, name, O_WRONLY | flags);
+	if (fd < 0)
+		return -1;
+	rc = write(fd, buf, size);
+	close(fd);
+	return rc == size ? 0 : -1;
+}
+
+static int read_attr(spe_context_ptr_t spe, const char *name, uint64_t *val)
+{
+	char buf[32];
+	int rc;
+
+	rc = read_file(spe, name, buf, sizeof(buf) - 1);
+	if (rc <= 0)
+		return -1;
+	buf[rc] = '\0';
+	*val = strtoull(buf, NULL, 0);
+	return 0;
+}
+
+static int write_attr(spe_context_ptr_t spe, const char *name, uint64_t val)
+{
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "0x%llx", (unsigned long long)val);
+	return write_file(spe, name, buf, strlen(buf), 0);
+}
+
+static int line_is_zero(const void *line)
+{
+	const uint64_t *p = line;
+	int i;
+
+	for (i = 0; i < CHECKPOINT_LINE / sizeof(uint64_t); i++)
+		if (p[i])
+			return 0;
+	return 1;
+}
+
+/* Copies local store into buf as runs of nonzero lines; returns the
+ * bytes used. buf has room for the worst case. */
+static unsigned int save_ls_runs(void *buf, void *ls)
+{
+	struct checkpoint_run *run;
+	unsigned int addr, start, used = 0;
+
+	for (addr = 0; addr < LS_SIZE; ) {
+		if (line_is_zero(ls + addr)) {
+			addr += CHECKPOINT_LINE;
+			continue;
+		}
+		start = addr;
+		while (addr < LS_SIZE && !line_is_zero(ls + addr))
+			addr += CHECKPOINT_LINE;
+
+		run = buf + used;
+		run->ls_addr = start;
+		run->size = addr - start;
+		run->pad[0] = run->pad[1] = 0;
+		_base_spe_ls_copy(run + 1, ls + start, run->size);
+		used += sizeof(*run) + run->size;
+	}
+	return used;
+}
+
+static int restore_ls_runs(void *ls, void *buf, unsigned int size)
+{
+	struct checkpoint_run *run;
+	unsigned int used = 0;
+
+	/* check the runs before local store is touched */
+	while (used < size) {
+		run = buf + used;
+		if (size - used < sizeof(*run) ||
+		    run->ls_addr > LS_SIZE || run->size > LS_SIZE - run->ls_addr ||
+		    run->size > size - used - sizeof(*run))
+			return -1;
+		used += sizeof(*run) + run->size;
+	}
+
+	_base_spe_ls_clear(ls, LS_SIZE);
+	for (used = 0; used < size; used += sizeof(*run) + run->size) {
+		run = buf + used;
+		_base_spe_ls_copy(ls + run->ls_addr, run + 1, run->size);
+	}
+	return 0;
+}
+
+int _base_spe_context_checkpoint(spe_context_ptr_t spe,
+				 spe_checkpoint_t *ckpt, unsigned int flags)
+{
+	struct spe_context_base_priv *priv = spe->base_private;
+	struct checkpoint_header *hdr;
+	struct timespec t0;
+	uint32_t word;
+	unsigned int max;
+	char npc[32];
+	void *data;
+	int i, rc;
+
+	if (priv->flags & (SPE_ISOLATE | SPE_ISOLATE_EMULATE) ||
+	    (flags & ~SPE_CHECKPOINT_COMPRESS)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	/* the SPE to PPE mailboxes cannot be filled again from the PPE
+	 * side, so they must have been read before */
+	if (read_file(spe, "mbox_info", &word, sizeof(word)) > 0 ||
+	    read_file(spe, "ibox_info", &word, sizeof(word)) > 0) {
+		errno = EBUSY;
+		return -1;
+	}
+
+	max = sizeof(*hdr) + LS_SIZE;
+	if (flags & SPE_CHECKPOINT_COMPRESS)
+		max += LS_SIZE / CHECKPOINT_LINE / 2 * sizeof(struct checkpoint_run);
+	if (posix_memalign(&data, CHECKPOINT_LINE, max)) {
+		errno = ENOMEM;
+		return -1;
+	}
+	hdr = data;
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->magic = CHECKPOINT_MAGIC;
+	hdr->flags = flags;
+	hdr->entry = priv->entry;
+	hdr->ls_base = priv->ls_base;
+	hdr->ls_extent = priv->ls_extent;
+
+	rc = read_file(spe, "npc", npc, sizeof(npc) - 1);
+	if (rc <= 0)
+		goto fail;
+	npc[rc] = '\0';
+	hdr->npc = strtoul(npc, NULL, 0);
+
+	if (read_file(spe, "regs", hdr->regs, sizeof(hdr->regs)) !=
+			sizeof(hdr->regs) ||
+	    read_file(spe, "fpcr", hdr->fpcr, sizeof(hdr->fpcr)) !=
+			sizeof(hdr->fpcr))
+		goto fail;
+
+	/* older kernels may not have all of them */
+	for (i = 0; i < CHECKPOINT_ATTRS; i++)
+		if (!read_attr(spe, checkpoint_attrs[i], &hdr->attrs[i]))
+			hdr->attrs_saved |= 1 << i;
+
+	/* pending signal notifications, and what the SPE has not yet
+	 * read from its inbound mailbox */
+	for (i = 0; i < 2; i++)
+		if (read_file(spe, i ? "signal2" : "signal1", &hdr->signal[i],
+			      sizeof(uint32_t)) == sizeof(uint32_t))
+			hdr->signals_saved |= 1 << i;
+	rc = read_file(spe, "wbox_info", hdr->wbox, sizeof(hdr->wbox));
+	if (rc > 0)
+		hdr->nwbox = rc / sizeof(uint32_t);
+
+	if (flags & SPE_CHECKPOINT_COMPRESS)
+		hdr->ls_bytes = save_ls_runs(hdr + 1, priv->mem_mmap_base);
+	else {
+		_base_spe_ls_copy(hdr + 1, priv->mem_mmap_base, LS_SIZE);
+		hdr->ls_bytes = LS_SIZE;
+	}
+	hdr->size = sizeof(*hdr) + hdr->ls_bytes;
+
+	ckpt->data = data;
+	ckpt->size = hdr->size;
+	ckpt->ls_bytes = hdr->ls_bytes;
+	ckpt->npc = hdr->npc;
+	ckpt->checkpoint_time_ns = _base_spe_elapsed_ns(&t0);
+	ckpt->restore_time_ns = 0;
+
+	return 0;
+
+fail:
+	DEBUG_PRINTF("checkpoint: cannot read the context state\n");
+	free(data);
+	errno = EIO;
+	return -1;
+}
+
+int _base_spe_context_restore(spe_context_ptr_t spe, spe_checkpoint_t *ckpt,
+			      unsigned int *entry)
+{
+	struct spe_context_base_priv *priv = spe->base_private;
+	struct checkpoint_header *hdr = ckpt->data;
+	struct timespec t0;
+	char npc[32];
+	int i;
+
+	if (priv->flags & (SPE_ISOLATE | SPE_ISOLATE_EMULATE)) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (!hdr || ckpt->size < sizeof(*hdr) ||
+	    hdr->magic != CHECKPOINT_MAGIC || hdr->size != ckpt->size ||
+	    hdr->ls_bytes != hdr->size - sizeof(*hdr) ||
+	    hdr->nwbox > CHECKPOINT_WBOX_MAX ||
+	    (!(hdr->flags & SPE_CHECKPOINT_COMPRESS) &&
+	     hdr->ls_bytes != LS_SIZE)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* a load in flight would overwrite what is restored */
+	if (_base_spe_program_load_wait(spe))
+		return -1;
+
+	/* fail before the context is touched if the mailbox entries will
+	 * not fit */
+	if (hdr->nwbox && _base_spe_in_mbox_status(spe) < (int)hdr->nwbox) {
+		errno = EBUSY;
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	if (hdr->flags & SPE_CHECKPOINT_COMPRESS) {
+		if (restore_ls_runs(priv->mem_mmap_base, hdr + 1,
+				    hdr->ls_bytes)) {
+			errno = EINVAL;
+			return -1;
+		}
+	} else
+		_base_spe_ls_copy(priv->mem_mmap_base, hdr + 1, LS_SIZE);
+
+	snprintf(npc, sizeof(npc), "0x%x", hdr->npc);
+	if (write_file(spe, "regs", hdr->regs, sizeof(hdr->regs), 0) ||
+	    write_file(spe, "fpcr", hdr->fpcr, sizeof(hdr->fpcr), 0) ||
+	    write_file(spe, "npc", npc, strlen(npc), 0))
+		goto fail;
+
+	for (i = 0; i < CHECKPOINT_ATTRS; i++)
+		if ((hdr->attrs_saved & 1 << i) &&
+		    write_attr(spe, checkpoint_attrs[i], hdr->attrs[i]))
+			goto fail;
+
+	for (i = 0; i < 2; i++)
+		if ((hdr->signals_saved & 1 << i) &&
+		    write_file(spe, i ? "signal2" : "signal1", &hdr->signal[i],
+			       sizeof(uint32_t), 0))
+			goto fail;
+
+	if (hdr->nwbox && write_file(spe, "wbox", hdr->wbox,
+				     hdr->nwbox * sizeof(uint32_t),
+				     O_NONBLOCK))
+		goto fail;
+
+	/* local store now holds the program of the checkpoint */
+	priv->loaded_program = NULL;
+	priv->staged_program = NULL;
+	priv->entry = hdr->entry;
+	priv->emulated_entry = hdr->entry;
+	priv->ls_base = hdr->ls_base;
+	priv->ls_extent = hdr->ls_extent;
+	free(priv->overlays);
+	priv->overlays = NULL;
+
+	*entry = hdr->npc;
+	ckpt->restore_time_ns = _base_spe_elapsed_ns(&t0);
+
+	return 0;
+
+fail:
+	DEBUG_PRINTF("restore: cannot write the context state\n");
+	errno = EIO;
+	return -1;
+}
+
+void _base_spe_checkpoint_free(spe_checkpoint_t *ckpt)
+{
+	free(ckpt->data);
+	ckpt->data = NULL;
+	ckpt->size = 0;
+}
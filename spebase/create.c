@@ -30,6 +30,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include "callstats.h"
 #include "create.h"
 #include "spebase.h"
 
@@ -85,7 +86,7 @@ static int setsignotify(int dir, const char *filename)
 
 	close(fd_sig);
 
-	return 0;
+	return rc;
 }
 
 void _base_spe_context_lock(spe_context_ptr_t spe, enum fd_name fdesc)
@@ -140,6 +141,53 @@ void _base_spe_close_if_open(struct spe_context *spe, enum fd_name fdesc)
 	_base_spe_context_unlock(spe, fdesc);
 }
 
+int _base_spe_signal_doorbell_enable(spe_context_ptr_t spe, unsigned int signal_reg)
+{
+	struct spe_context_base_priv *priv = spe->base_private;
+	const char *type_file;
+	unsigned int or_flag;
+	enum fd_name fdesc;
+
+	if (signal_reg == SPE_SIG_NOTIFY_REG_1) {
+		type_file = "signal1_type";
+		or_flag = SPE_CFG_SIGNOTIFY1_OR;
+		fdesc = FD_SIG1;
+	} else if (signal_reg == SPE_SIG_NOTIFY_REG_2) {
+		type_file = "signal2_type";
+		or_flag = SPE_CFG_SIGNOTIFY2_OR;
+		fdesc = FD_SIG2;
+	} else {
+		errno = EINVAL;
+		return -1;
+	}
+
+	_base_spe_context_lock(spe, fdesc);
+
+	if (!(priv->flags & or_flag)) {
+		if (setsignotify(priv->fd_spe_dir, type_file)) {
+			_base_spe_context_unlock(spe, fdesc);
+			errno = EFAULT;
+			return -1;
+		}
+		priv->flags |= or_flag;
+	}
+
+	/* Without a problem state mapping every notification is a write()
+	 * on the signal file; keep it open so that writers don't need to
+	 * take the fd lock. The reference is dropped on destroy. */
+	if (!(priv->flags & SPE_MAP_PS) && !(priv->doorbell & signal_reg)) {
+		if (_base_spe_open_if_closed(spe, fdesc, 1) < 0) {
+			_base_spe_context_unlock(spe, fdesc);
+			return -1;
+		}
+		priv->doorbell |= signal_reg;
+	}
+
+	_base_spe_context_unlock(spe, fdesc);
+
+	return 0;
+}
+
 static int free_spe_context(struct spe_context *spe)
 {
 	int i;
@@ -174,6 +222,11 @@ static int free_spe_context(struct spe_context *spe)
 	if (spe->base_private->fd_spe_dir >= 0)
 		close(spe->base_private->fd_spe_dir);
 
+	_base_spe_callstats_release(spe);
+	free(spe->base_private->overlays);
+	pthread_mutex_destroy(&spe->base_private->load_lock);
+	pthread_cond_destroy(&spe->base_private->load_done);
+
 	free(spe->base_private);
 	free(spe);
 
@@ -224,6 +277,28 @@ spe_context_ptr_t _base_spe_context_create(unsigned int flags,
 	priv->signal1_mmap_base = MAP_FAILED;
 	priv->signal2_mmap_base = MAP_FAILED;
 	priv->loaded_program = NULL;
+	priv->gang = gctx;
+	priv->cpu_node = -1;
+	priv->doorbell = 0;
+	priv->spufs_name = NULL;
+	priv->callstats = NULL;
+	memset(&priv->load_stats, 0, sizeof(priv->load_stats));
+	priv->overlays = NULL;
+	pthread_mutex_init(&priv->load_lock, NULL);
+	pthread_cond_init(&priv->load_done, NULL);
+	priv->load_pending = 0;
+	priv->load_queue = NULL;
+	priv->load_queue_tail = &priv->load_queue;
+	priv->load_status = 0;
+	priv->load_errno = 0;
+	priv->ls_base = 0;
+	priv->ls_extent = 0;
+	priv->staged_program = NULL;
+	priv->object_id_program = NULL;
+	priv->pool_relaunch = 0;
+	priv->loader_armed = 0;
+	priv->launch_pending = 0;
+	priv->launch_ns = 0;
 
 	for (i = 0; i < NUM_MBOX_FDS; i++) {
 		priv->spe_fds_array[i] = -1;
@@ -293,6 +368,10 @@ spe_context_ptr_t _base_spe_context_create(unsigned int flags,
 
 	priv->flags = flags;
 
+	/* name under which the context's call statistics are published;
+	 * they are optional, so an allocation failure is not fatal */
+	priv->spufs_name = strdup(pathname + strlen("/spu/"));
+
 	/* Map the required areas into process memory */
 	priv->mem_mmap_base = mapfileat(priv->fd_spe_dir, "mem", LS_SIZE);
 	if (priv->mem_mmap_base == MAP_FAILED) {
@@ -426,7 +505,11 @@ spe_gang_context_ptr_t _base_spe_gang_context_create(unsigned int flags)
 
 int _base_spe_context_destroy(spe_context_ptr_t spe)
 {
-	int ret = free_spe_context(spe);
+	int ret;
+
+	/* a loader thread may still be writing to the local store */
+	_base_spe_program_load_wait(spe);
+	ret = free_spe_context(spe);
 
 	__spe_context_update_event();
 
@@ -29,6 +29,7 @@
 
 #include "create.h"
 #include "dma.h"
+#include "ls_copy.h"
 
 static int spe_read_tag_status_block(spe_context_ptr_t spectx, unsigned int mask, unsigned int *tag_status);
 static int spe_read_tag_status_noblock(spe_context_ptr_t spectx, unsigned int mask, unsigned int *tag_status);
@@ -107,7 +108,8 @@ static int spe_do_mfc_put(spe_context_ptr_t spectx, unsigned src, void *dst,
 			errno = EINVAL;
 			return -1;
 		}
-		memcpy(dst, spectx->base_private->mem_mmap_base + src, size);
+		_base_spe_ls_copy(dst, spectx->base_private->mem_mmap_base + src,
+				  size);
 		return 0;
 	}
 }
@@ -127,7 +129,8 @@ static int spe_do_mfc_get(spe_context_ptr_t spectx, unsigned int dst, void *src,
 			errno = EINVAL;
 			return -1;
 		}
-		memcpy(spectx->base_private->mem_mmap_base + dst, src, size);
+		_base_spe_ls_copy(spectx->base_private->mem_mmap_base + dst, src,
+				  size);
 		return 0;
 	}
 }
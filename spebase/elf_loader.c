@@ -24,6 +24,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <sys/mman.h>
@@ -31,6 +32,7 @@
 #include <sys/stat.h>
 
 #include "elf_loader.h"
+#include "ls_copy.h"
 #include "spebase.h"
 
 #ifdef DEBUG
@@ -153,18 +155,27 @@ _base_spe_parse_isolated_elf(spe_program_handle_t *handle,
 	return 0;
 }
 
+/*
+ * Segments of an overlay region share their local store addresses, and
+ * the SPE overlay manager brings them in as they are called. Only the
+ * first segment of each region is loaded, the others would just be
+ * overwritten.
+ */
 static int
-overlay(Elf32_Phdr *ph, Elf32_Phdr *prev_ph)
+overlay(Elf32_Phdr *phdr, Elf32_Phdr *ph)
 {
-	/*
-	 * If our ph segment virtual address fits within that of the
-	 * previous ph, this is an overlay.
-	 */
-	if (prev_ph && (ph->p_vaddr >= prev_ph->p_vaddr) &&
-	    (ph->p_vaddr < (prev_ph->p_vaddr + prev_ph->p_memsz)))
-		return 1;
-	else
+	Elf32_Phdr *prev_ph;
+
+	if (!(ph->p_flags & PF_OVERLAY))
 		return 0;
+
+	for (prev_ph = phdr; prev_ph < ph; ++prev_ph)
+		if (prev_ph->p_type == PT_LOAD &&
+		    (prev_ph->p_flags & PF_OVERLAY) &&
+		    ph->p_vaddr < prev_ph->p_vaddr + prev_ph->p_memsz &&
+		    prev_ph->p_vaddr < ph->p_vaddr + ph->p_memsz)
+			return 1;
+	return 0;
 }
 
 static void
@@ -183,41 +194,104 @@ copy_to_ld_buffer(spe_program_handle_t *handle, void *buffer, Elf32_Phdr
 		 * sections */
 		if (toe_size != ph->p_filesz && ph->p_filesz) {
 			DEBUG_PRINTF("loading base copy\n");
-			memcpy(buffer + ph->p_vaddr, start + ph->p_offset,
-			       ph->p_filesz);
+			_base_spe_ls_copy(buffer + ph->p_vaddr,
+					  start + ph->p_offset, ph->p_filesz);
 		}
 
 		/* overlay only the total toe section size */
 		DEBUG_PRINTF("loading toe %X %X\n", ph->p_offset, toe_addr);
-		memcpy(buffer + ph->p_vaddr, handle->toe_shadow, toe_size);
+		_base_spe_ls_copy(buffer + ph->p_vaddr, handle->toe_shadow, toe_size);
 	} else if (ph->p_filesz) {
-		memcpy(buffer + ph->p_vaddr, start + ph->p_offset,
-		       ph->p_filesz);
+		_base_spe_ls_copy(buffer + ph->p_vaddr, start + ph->p_offset,
+				  ph->p_filesz);
 	}
 	DEBUG_PRINTF("done ...\n");
 }
 
+#define R_SPU_ADDR10	1
+#define R_SPU_ADDR16	2
+#define R_SPU_ADDR16_HI	3
+#define R_SPU_ADDR16_LO	4
+#define R_SPU_ADDR18	5
+#define R_SPU_ADDR32	6
+#define R_SPU_REL16	7
+#define R_SPU_ADDR7	8
+#define R_SPU_REL9	9
+#define R_SPU_REL9I	10
+#define R_SPU_ADDR10I	11
+#define R_SPU_ADDR16I	12
+#define R_SPU_REL32	13
+#define R_SPU_PPU32 15
+#define R_SPU_PPU64 16
+#define R_SPU_ADD_PIC	17
+
+/*
+ * Relocation targets in a segment that is copied to local store as is
+ * are patched in the local store copy, leaving the image untouched. The
+ * others, in overlay segments the SPE fetches from the image itself, are
+ * patched in the image.
+ */
+static int
+in_fixed_segment(Elf32_Ehdr *ehdr, Elf32_Addr vaddr, Elf32_Word size)
+{
+	Elf32_Phdr *phdr = (Elf32_Phdr *) ((char *) ehdr + ehdr->e_phoff);
+	Elf32_Phdr *ph, *other;
+
+	for (ph = phdr; ph < &phdr[ehdr->e_phnum]; ++ph) {
+		if (ph->p_type != PT_LOAD || vaddr < ph->p_vaddr ||
+		    vaddr + size > ph->p_vaddr + ph->p_filesz)
+			continue;
+
+		for (other = phdr; other < &phdr[ehdr->e_phnum]; ++other)
+			if (other != ph && other->p_type == PT_LOAD &&
+			    other->p_vaddr < ph->p_vaddr + ph->p_memsz &&
+			    ph->p_vaddr < other->p_vaddr + other->p_memsz)
+				return 0;
+		return 1;
+	}
+	return 0;
+}
+
+static Elf32_Word
+reloc_size(Elf32_Rela *r)
+{
+	if (r->r_info == ELF32_R_INFO(0,R_SPU_PPU32))
+		return sizeof(Elf32_Word);
+	if (r->r_info == ELF32_R_INFO(0,R_SPU_PPU64))
+		return sizeof(Elf64_Xword);
+	return 0;
+}
+
 /* Apply certain R_SPU_PPU* relocs in RH to SH.  We only handle relocs
-   without a symbol, which are to locations within ._ea.  */
+   without a symbol, which are to locations within ._ea.  With LD_BUFFER,
+   apply the relocs to fixed segments in the local store copy, otherwise
+   apply the others in the image.  */
 
 static void
-apply_relocations(spe_program_handle_t *handle, Elf32_Shdr *rh, Elf32_Shdr *sh)
+apply_relocations(spe_program_handle_t *handle, Elf32_Shdr *rh, Elf32_Shdr *sh,
+		  void *ld_buffer)
 {
-#define R_SPU_PPU32 15
-#define R_SPU_PPU64 16
 	void *start = handle->elf_image;
 	Elf32_Rela *r, *r_end;
 	/* Relocations in an executable specify r_offset as a virtual
-	   address, but we are applying the reloc in the image before
-	   the section has been copied to its destination sh_addr.
-	   Adjust so as to poke relative to the image base.  */
+	   address, but image relocs are applied before the section has
+	   been copied to its destination sh_addr.  Adjust so as to poke
+	   relative to the image base.  */
 	void *reloc_base = start + sh->sh_offset - sh->sh_addr;
+	Elf32_Word size;
+
+	if (ld_buffer)
+		reloc_base = ld_buffer;
 
 	r = start + rh->sh_offset;
 	r_end = (void *)r + rh->sh_size;
 	DEBUG_PRINTF("apply_relocations: %p, %#x\n", r, rh->sh_size);
 	for (; r < r_end; ++r)
 	{
+		size = reloc_size(r);
+		if (!size || !ld_buffer != !in_fixed_segment(start, r->r_offset, size))
+			continue;
+
 		if (r->r_info == ELF32_R_INFO(0,R_SPU_PPU32)) {
 			/* v is in ._ea */
 			Elf32_Word *loc = reloc_base + r->r_offset;
@@ -237,86 +311,248 @@ apply_relocations(spe_program_handle_t *handle, Elf32_Shdr *rh, Elf32_Shdr *sh)
 	}
 }
 
+/* Sets the bits [shift, shift + bits) of an instruction to v. */
+static void
+set_field(Elf32_Word *loc, int shift, int bits, Elf32_Word v)
+{
+	Elf32_Word mask = ((1u << bits) - 1) << shift;
+
+	*loc = (*loc & ~mask) | ((v << shift) & mask);
+}
+
+/*
+ * Moves one of the relocations the linker kept with --emit-relocs from
+ * local store address 0 to base: the field is recomputed from the symbol
+ * plus base. Relative relocations stay as they are, both ends move.
+ * Returns -1 for one that cannot be moved. Without ls, only checks.
+ */
+static int
+rebase_reloc(Elf32_Rela *r, Elf32_Sym *sym, void *ls, unsigned int base)
+{
+	int moved = sym->st_shndx != SHN_ABS && sym->st_shndx != SHN_UNDEF;
+	Elf32_Word v = sym->st_value + r->r_addend + base;
+	Elf32_Word *loc;
+
+	switch (ELF32_R_TYPE(r->r_info)) {
+	case R_SPU_PPU32:
+	case R_SPU_PPU64:
+	case R_SPU_ADD_PIC:
+		return 0;
+	case R_SPU_REL16:
+	case R_SPU_REL9:
+	case R_SPU_REL9I:
+	case R_SPU_REL32:
+		return moved ? 0 : -1;
+	case R_SPU_ADDR10:
+	case R_SPU_ADDR16:
+	case R_SPU_ADDR16_HI:
+	case R_SPU_ADDR16_LO:
+	case R_SPU_ADDR18:
+	case R_SPU_ADDR32:
+	case R_SPU_ADDR7:
+	case R_SPU_ADDR10I:
+	case R_SPU_ADDR16I:
+		break;
+	default:
+		return -1;
+	}
+
+	if (!moved || !ls)
+		return 0;
+
+	loc = ls + r->r_offset;
+	switch (ELF32_R_TYPE(r->r_info)) {
+	case R_SPU_ADDR10:
+		set_field(loc, 14, 10, v >> 4);
+		break;
+	case R_SPU_ADDR16:
+		set_field(loc, 7, 16, v >> 2);
+		break;
+	case R_SPU_ADDR16_HI:
+		set_field(loc, 7, 16, v >> 16);
+		break;
+	case R_SPU_ADDR16_LO:
+	case R_SPU_ADDR16I:
+		set_field(loc, 7, 16, v);
+		break;
+	case R_SPU_ADDR18:
+		set_field(loc, 7, 18, v);
+		break;
+	case R_SPU_ADDR32:
+		*loc = v;
+		break;
+	case R_SPU_ADDR7:
+		set_field(loc, 14, 7, v);
+		break;
+	case R_SPU_ADDR10I:
+		set_field(loc, 14, 10, v);
+		break;
+	}
+	return 0;
+}
+
+/* Rebases the local store copy at ls of a program linked at 0, or with
+ * ls NULL, checks that it can be. */
+static int
+rebase_program(spe_program_handle_t *handle, void *ls, unsigned int base)
+{
+	Elf32_Ehdr *ehdr = (Elf32_Ehdr *)handle->elf_image;
+	Elf32_Shdr *shdr = (Elf32_Shdr *) ((char *) ehdr + ehdr->e_shoff);
+	Elf32_Shdr *rh, *symh;
+	Elf32_Rela *r, *r_end;
+	Elf32_Sym *syms;
+	Elf32_Word nsyms;
+
+	for (rh = shdr; rh < &shdr[ehdr->e_shnum]; ++rh) {
+		if (rh->sh_type != SHT_RELA || rh->sh_info >= ehdr->e_shnum ||
+		    !(shdr[rh->sh_info].sh_flags & SHF_ALLOC))
+			continue;
+		if (rh->sh_link >= ehdr->e_shnum)
+			return -1;
+		symh = &shdr[rh->sh_link];
+		syms = (Elf32_Sym *) ((char *) ehdr + symh->sh_offset);
+		nsyms = symh->sh_size / sizeof(Elf32_Sym);
+
+		r = (Elf32_Rela *) ((char *) ehdr + rh->sh_offset);
+		r_end = (void *)r + rh->sh_size;
+		for (; r < r_end; ++r) {
+			if (ELF32_R_SYM(r->r_info) >= nsyms ||
+			    r->r_offset + sizeof(Elf32_Word) > LS_SIZE - base)
+				return -1;
+			if (rebase_reloc(r, &syms[ELF32_R_SYM(r->r_info)],
+					 ls, base))
+				return -1;
+		}
+	}
+	return 0;
+}
+
 int
 _base_spe_load_spe_elf (spe_program_handle_t *handle, void *ld_buffer, struct spe_ld_info *ld_info)
+{
+	return _base_spe_load_spe_elf_at(handle, ld_buffer, 0, ld_info);
+}
+
+/*
+ * Loads a program into local store at base instead of at the addresses
+ * it was linked for (0). A nonzero base needs a program that keeps its
+ * relocations and has no overlays.
+ */
+int
+_base_spe_load_spe_elf_at(spe_program_handle_t *handle, void *ld_buffer,
+			  unsigned int base, struct spe_ld_info *ld_info)
 {
 	Elf32_Ehdr *ehdr;
 	Elf32_Phdr *phdr;
-	Elf32_Phdr *ph, *prev_ph;
+	Elf32_Phdr *ph;
 
 	Elf32_Shdr *shdr;
 	Elf32_Shdr *sh;
 
-	Elf32_Off  toe_addr = 0;
-	long	toe_size = 0;
-
-	char* str_table = 0;
+	struct spe_image_info image, *info = &image;
+	spe_load_stats_t *stats = &ld_info->stats;
+	spe_overlay_segment_t *ovl;
+	struct timespec t0;
+	void *ls;
 
 	int num_load_seg = 0;
-	void *elf_start;
-	int ret;
 	
 	DEBUG_PRINTF ("load_spe_elf(%p, %p)\n", handle, ld_buffer);
 
-	elf_start = handle->elf_image;
-
 	DEBUG_PRINTF ("load_spe_elf(%p, %p)\n", handle->elf_image, ld_buffer);
 	ehdr = (Elf32_Ehdr *)(handle->elf_image);
 
-	/* Check for a Valid SPE ELF Image (again) */
-	if ((ret=check_spe_elf(ehdr)))
-		return ret;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	memset(stats, 0, sizeof(*stats));
+	ld_info->overlays = NULL;
+
+	/* The image was checked when it was first seen */
+	if (_base_spe_image_info(handle, info))
+		return -errno;
+	if (info->status) {
+		errno = -info->status;
+		return info->status;
+	}
 
 	/* Start processing headers */
 	phdr = (Elf32_Phdr *) ((char *) ehdr + ehdr->e_phoff);
 	shdr = (Elf32_Shdr *) ((char *) ehdr + ehdr->e_shoff);
-	str_table = (char*)ehdr + shdr[ehdr->e_shstrndx].sh_offset;
 
-	/* traverse the sections to locate the toe segment */
-	/* by specification, the toe sections are grouped together in a segment */
-	for (sh = shdr; sh < &shdr[ehdr->e_shnum]; ++sh)
-	{
-		DEBUG_PRINTF("section name: %s ( start: 0x%04x, size: 0x%04x)\n", str_table+sh->sh_name, sh->sh_offset, sh->sh_size );
-		if (sh->sh_type == SHT_RELA)
-			apply_relocations(handle, sh, &shdr[sh->sh_info]);
-		if (strcmp(".toe", str_table+sh->sh_name) == 0) {
-			DEBUG_PRINTF("section offset: %d\n", sh->sh_offset);
-			toe_size += sh->sh_size;
-			if ((toe_addr == 0) || (toe_addr > sh->sh_addr))
-				toe_addr = sh->sh_addr;
-		}
-		/* Disabled : Actually not needed, only good for testing
-		if (strcmp(".bss", str_table+sh->sh_name) == 0) {
-			DEBUG_PRINTF("zeroing .bss section:\n");
-			DEBUG_PRINTF("section offset: 0x%04x\n", sh->sh_offset);
-			DEBUG_PRINTF("section size: 0x%04x\n", sh->sh_size);
-			memset(ld_buffer + sh->sh_offset, 0, sh->sh_size);
-		}  */
-		
+	if (base && (!info->ls_relocs || info->noverlays ||
+		     info->ls_extent > LS_SIZE - base ||
+		     rebase_program(handle, NULL, base))) {
+		DEBUG_PRINTF("load_spe_elf: cannot load at 0x%x\n", base);
+		errno = ENOEXEC;
+		return -errno;
+	}
+	ls = ld_buffer + base;
+
+	if (info->has_rela)
+		for (sh = shdr; sh < &shdr[ehdr->e_shnum]; ++sh)
+			if (sh->sh_type == SHT_RELA)
+				apply_relocations(handle, sh,
+						  &shdr[sh->sh_info], NULL);
+
 #ifdef DEBUG
-		if (strcmp(".note.spu_name", str_table+sh->sh_name) == 0) 
-			display_debug_output(elf_start, sh);
+	{
+		char *str_table = (char*)ehdr + shdr[ehdr->e_shstrndx].sh_offset;
+
+		for (sh = shdr; sh < &shdr[ehdr->e_shnum]; ++sh)
+			if (strcmp(".note.spu_name", str_table+sh->sh_name) == 0)
+				display_debug_output(ehdr, sh);
+	}
 #endif /*DEBUG*/
+
+	if (info->noverlays) {
+		ld_info->overlays = calloc(info->noverlays,
+					   sizeof(*ld_info->overlays));
+		if (!ld_info->overlays)
+			return -errno;
 	}
+	ovl = ld_info->overlays;
 
 	/*
-	 * Load all PT_LOAD segments onto the SPE local store buffer.
+	 * Load the PT_LOAD segments onto the SPE local store buffer, all
+	 * but the non-resident overlays.
 	 */
 	DEBUG_PRINTF("Segments: 0x%x\n", ehdr->e_phnum);
-	for (ph = phdr, prev_ph = NULL; ph < &phdr[ehdr->e_phnum]; ++ph) {
+	for (ph = phdr; ph < &phdr[ehdr->e_phnum]; ++ph) {
 		switch (ph->p_type) {
 		case PT_LOAD:
-			if (!overlay(ph, prev_ph)) {
+			stats->segments++;
+			if (ph->p_flags & PF_OVERLAY) {
+				ovl->ls_addr = ph->p_vaddr;
+				ovl->filesz = ph->p_filesz;
+				ovl->memsz = ph->p_memsz;
+				ovl->image_ea = (unsigned long)
+					(handle->elf_image + ph->p_offset);
+				stats->overlays++;
+			}
+			if (!overlay(phdr, ph)) {
 				if (ph->p_filesz < ph->p_memsz) {
 					DEBUG_PRINTF("padding loaded image with zeros:\n");
 					DEBUG_PRINTF("start: 0x%04x\n", ph->p_vaddr + ph->p_filesz);
 					DEBUG_PRINTF("length: 0x%04x\n", ph->p_memsz - ph->p_filesz);
-					memset(ld_buffer + ph->p_vaddr + ph->p_filesz, 0, ph->p_memsz - ph->p_filesz);
+					_base_spe_ls_clear(ls + ph->p_vaddr + ph->p_filesz, ph->p_memsz - ph->p_filesz);
+					stats->bytes_zeroed += ph->p_memsz - ph->p_filesz;
 				}
-				copy_to_ld_buffer(handle, ld_buffer, ph,
-						  toe_addr, toe_size);
+				copy_to_ld_buffer(handle, ls, ph,
+						  info->toe_addr,
+						  info->toe_size);
+				stats->bytes_copied += ph->p_filesz;
+				stats->segments_loaded++;
 				num_load_seg++;
+				if (ph->p_flags & PF_OVERLAY) {
+					ovl->loaded = 1;
+					stats->overlays_loaded++;
+				}
+			} else {
+				DEBUG_PRINTF("skipping overlay at 0x%04x\n",
+					     ph->p_vaddr);
+				stats->bytes_skipped += ph->p_memsz;
 			}
+			if (ph->p_flags & PF_OVERLAY)
+				ovl++;
 			break;
 		case PT_NOTE:
 			DEBUG_PRINTF("SPE_LOAD found PT_NOTE\n");
@@ -326,18 +562,81 @@ _base_spe_load_spe_elf (spe_program_handle_t *handle, void *ld_buffer, struct sp
 	if (num_load_seg == 0)
 	  {
 		  DEBUG_PRINTF ("no segments to load");
+		  free(ld_info->overlays);
+		  ld_info->overlays = NULL;
 		  errno = EINVAL;
 		  return -errno;
 	  }
 
+	if (info->has_rela)
+		for (sh = shdr; sh < &shdr[ehdr->e_shnum]; ++sh)
+			if (sh->sh_type == SHT_RELA)
+				apply_relocations(handle, sh,
+						  &shdr[sh->sh_info], ls);
+	if (base)
+		rebase_program(handle, ls, base);
+
 	/* Remember where the code wants to be started */
-	ld_info->entry = ehdr->e_entry;
-	DEBUG_PRINTF ("entry = 0x%x\n", ehdr->e_entry);
+	ld_info->entry = ehdr->e_entry + base;
+	ld_info->extent = info->ls_extent + base;
+	DEBUG_PRINTF ("entry = 0x%x\n", ld_info->entry);
+
+	stats->load_time_ns = _base_spe_elapsed_ns(&t0);
 
 	return 0;
 
 }
 
+/**
+ * Finds the part of the image that must be private to the process: the
+ * ._ea sections, which hold PPE side data of the SPE program, and the
+ * targets of relocations that are patched in the image.
+ */
+int
+_base_spe_image_private_range(spe_program_handle_t *handle,
+			      unsigned long *start, unsigned long *end)
+{
+	Elf32_Ehdr *ehdr = (Elf32_Ehdr *)handle->elf_image;
+	Elf32_Shdr *shdr, *sh, *target;
+	Elf32_Rela *r, *r_end;
+	Elf32_Word size;
+	unsigned long offset;
+	char *str_table;
+
+	shdr = (Elf32_Shdr *) ((char *) ehdr + ehdr->e_shoff);
+	str_table = (char*)ehdr + shdr[ehdr->e_shstrndx].sh_offset;
+
+	*start = ~0UL;
+	*end = 0;
+	for (sh = shdr; sh < &shdr[ehdr->e_shnum]; ++sh) {
+		if (strncmp("._ea", str_table + sh->sh_name, 4) == 0 &&
+		    sh->sh_type != SHT_NOBITS && sh->sh_size) {
+			if (sh->sh_offset < *start)
+				*start = sh->sh_offset;
+			if (sh->sh_offset + sh->sh_size > *end)
+				*end = sh->sh_offset + sh->sh_size;
+		}
+
+		if (sh->sh_type != SHT_RELA)
+			continue;
+		target = &shdr[sh->sh_info];
+		r = (void *)ehdr + sh->sh_offset;
+		r_end = (void *)r + sh->sh_size;
+		for (; r < r_end; ++r) {
+			size = reloc_size(r);
+			if (!size || in_fixed_segment(ehdr, r->r_offset, size))
+				continue;
+			offset = target->sh_offset + r->r_offset - target->sh_addr;
+			if (offset < *start)
+				*start = offset;
+			if (offset + size > *end)
+				*end = offset + size;
+		}
+	}
+
+	return *end > *start;
+}
+
 #ifdef DEBUG
 static void
 display_debug_output(Elf32_Ehdr *elf_start, Elf32_Shdr *sh)
@@ -396,27 +695,27 @@ toe_check_syms(Elf32_Ehdr *ehdr, Elf32_Shdr *sh)
 int _base_spe_toe_ear (spe_program_handle_t *speh)
 {
 	Elf32_Ehdr *ehdr;
-	Elf32_Shdr *shdr, *sh;
-	char *str_table;
+	Elf32_Shdr *shdr;
+	struct spe_image_info image, *info = &image;
 	char **ch;
-	int ret;
+	int ret, i;
 	long toe_size;
 
+	if (_base_spe_image_info(speh, info))
+		return 1;
+	if (info->status) {
+		errno = -info->status;
+		return 1;
+	}
+
 	ehdr = (Elf32_Ehdr*) (speh->elf_image);
 	shdr = (Elf32_Shdr*) ((char*) ehdr + ehdr->e_shoff);
-	str_table = (char*)ehdr + shdr[ehdr->e_shstrndx].sh_offset;
-
-	toe_size = 0;
-	for (sh = shdr; sh < &shdr[ehdr->e_shnum]; ++sh)
-		if (strcmp(".toe", str_table + sh->sh_name) == 0)
-			toe_size += sh->sh_size;
+	toe_size = info->toe_size;
 
 	ret = 0;
 	if (toe_size > 0) {
-		for (sh = shdr; sh < &shdr[ehdr->e_shnum]; ++sh)
-			if (sh->sh_type == SHT_SYMTAB || sh->sh_type ==
-			    SHT_DYNSYM)
-				ret = toe_check_syms(ehdr, sh);
+		for (i = 0; i < info->nsymtabs; i++)
+			ret = toe_check_syms(ehdr, &shdr[info->symtabs[i]]);
 		if (!ret && toe_size != 16) {
 			/* Paranoia */
 			fprintf(stderr, "Unexpected toe size of %ld\n",
@@ -34,6 +34,39 @@ typedef union
 struct spe_ld_info
 {
 	unsigned int entry;	
+	unsigned int extent;	/* end of the loaded program in local store */
+	spe_load_stats_t stats;
+	/* malloced, NULL if the program has no overlays */
+	spe_overlay_segment_t *overlays;
+};
+
+/* segment flag of SPU overlays */
+#ifndef PF_OVERLAY
+#define PF_OVERLAY (1 << 27)
+#endif
+
+#define SPE_IMAGE_INFO_SYMTABS 2
+
+/*
+ * What the loader needs to know about an image, gathered once per
+ * program handle (see image_info.c).
+ */
+struct spe_image_info
+{
+	spe_program_handle_t *handle;
+	void *elf_image;
+	int status;		/* 0, or -errno if the image is invalid */
+	int has_rela;
+	Elf32_Off toe_addr;
+	long toe_size;
+	int nsymtabs;
+	int symtabs[SPE_IMAGE_INFO_SYMTABS];	/* section indices */
+	int noverlays;		/* PT_LOAD segments with PF_OVERLAY */
+	unsigned int ls_extent;	/* end of the highest PT_LOAD segment */
+	int ls_relocs;		/* linked with --emit-relocs: has relocs
+				   for its code, so it can be rebased */
+	unsigned int used;	/* registry clock at the last lookup */
+	struct spe_image_info *next;
 };
 
 /*
@@ -44,8 +77,21 @@ int _base_spe_verify_spe_elf_image(spe_program_handle_t *handle);
 int _base_spe_load_spe_elf (spe_program_handle_t *handle, void *ld_buffer,
 			    struct spe_ld_info *ld_info);
 
+int _base_spe_load_spe_elf_at(spe_program_handle_t *handle, void *ld_buffer,
+			      unsigned int base, struct spe_ld_info *ld_info);
+
 int _base_spe_parse_isolated_elf(spe_program_handle_t *handle,
 				 uint64_t *addr, uint32_t *size);
 
 int _base_spe_toe_ear (spe_program_handle_t *speh);
+
+int _base_spe_image_private_range(spe_program_handle_t *handle,
+				  unsigned long *start, unsigned long *end);
+
+int _base_spe_image_info(spe_program_handle_t *handle,
+			 struct spe_image_info *info);
+
+void _base_spe_image_info_forget(spe_program_handle_t *handle);
+
+unsigned int _base_spe_image_generation(void);
 		  
@@ -19,6 +19,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdlib.h>
 
 #include <sys/mman.h>
@@ -32,9 +33,103 @@
 struct image_handle {
 	spe_program_handle_t speh;
 	unsigned int map_size;
+
+	/* image cache, see image_cache_get() */
+	int refcount;
+	int cacheable;
+	dev_t dev;
+	ino_t ino;
+	time_t mtime;
+	off_t size;
+	struct image_handle *next;
 };
 
-spe_program_handle_t *_base_spe_image_open(const char *filename)
+/*
+ * With SPE_IMAGE_CACHE set in the environment, opening a file that is
+ * already open returns the same handle, as long as the file has not
+ * changed, and each spe_image_close() drops a reference. Images with
+ * private parts (._ea data) are not shared, so every open still gets
+ * its own copy of the PPE side variables.
+ */
+static pthread_mutex_t image_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct image_handle *image_cache;
+static int image_cache_enabled = -1;
+
+static struct image_handle *image_cache_get(struct stat *st)
+{
+	struct image_handle *ih;
+
+	for (ih = image_cache; ih; ih = ih->next)
+		if (ih->dev == st->st_dev && ih->ino == st->st_ino &&
+		    ih->mtime == st->st_mtime && ih->size == st->st_size) {
+			ih->refcount++;
+			return ih;
+		}
+	return NULL;
+}
+
+static void image_cache_add(struct image_handle *ih, struct stat *st)
+{
+	ih->dev = st->st_dev;
+	ih->ino = st->st_ino;
+	ih->mtime = st->st_mtime;
+	ih->size = st->st_size;
+	ih->next = image_cache;
+	image_cache = ih;
+}
+
+static void image_cache_remove(struct image_handle *ih)
+{
+	struct image_handle **p;
+
+	for (p = &image_cache; *p; p = &(*p)->next)
+		if (*p == ih) {
+			*p = ih->next;
+			break;
+		}
+}
+
+/*
+ * The file is mapped read-only and shared, so that every process running
+ * the same SPE program uses the same page cache pages. Relocations are
+ * applied to the local store copy at load time; only the parts of the
+ * image that are written to are remapped private.
+ */
+static int map_image(struct image_handle *ih, int binfd)
+{
+	unsigned long start, end;
+	size_t ps = getpagesize ();
+	void *priv;
+
+	ih->speh.elf_image = mmap(NULL, ih->map_size, PROT_READ, MAP_SHARED,
+				  binfd, 0);
+	if (ih->speh.elf_image == MAP_FAILED)
+		return -1;
+
+	/*Verify that this is a valid SPE ELF object*/
+	if (_base_spe_verify_spe_elf_image(&ih->speh))
+		return -1;
+
+	if (!_base_spe_image_private_range(&ih->speh, &start, &end))
+		return 0;
+
+	start &= ~(ps - 1);
+	end = (end + ps - 1) & ~(ps - 1);
+	if (end > ih->map_size) {
+		errno = EINVAL;
+		return -1;
+	}
+	priv = mmap(ih->speh.elf_image + start, end - start,
+		    PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+		    binfd, start);
+	if (priv == MAP_FAILED)
+		return -1;
+
+	ih->cacheable = 0;
+	return 0;
+}
+
+static spe_program_handle_t *image_open(const char *filename)
 {
 	/* allocate an extra integer in the spe handle to keep the mapped size information */
 	struct image_handle *ret;
@@ -42,21 +137,35 @@ spe_program_handle_t *_base_spe_image_open(const char *filename)
 	struct stat statbuf;
 	size_t ps = getpagesize ();
 
-	ret = malloc(sizeof(struct image_handle));
-	if (!ret)
+	binfd = open(filename, O_RDONLY);
+	if (binfd < 0)
+		return NULL;
+
+	f_stat = fstat(binfd, &statbuf);
+	if (f_stat < 0) {
+		close(binfd);
+		return NULL;
+	}
+
+	if (image_cache_enabled) {
+		ret = image_cache_get(&statbuf);
+		if (ret) {
+			close(binfd);
+			return &ret->speh;
+		}
+	}
+
+	ret = calloc(1, sizeof(struct image_handle));
+	if (!ret) {
+		close(binfd);
 		return NULL;
+	}
 
 	ret->speh.elf_image = MAP_FAILED;
 	ret->speh.handle_size = sizeof(spe_program_handle_t);
 	ret->speh.toe_shadow = NULL;
-
-	binfd = open(filename, O_RDONLY);
-	if (binfd < 0)
-		goto ret_err;
-
-	f_stat = fstat(binfd, &statbuf);
-	if (f_stat < 0)
-		goto ret_err;
+	ret->refcount = 1;
+	ret->cacheable = image_cache_enabled;
 
 	/* Sanity: is it executable ?
 	 */
@@ -68,25 +177,22 @@ spe_program_handle_t *_base_spe_image_open(const char *filename)
 	/* now store the size at the extra allocated space */
 	ret->map_size = (statbuf.st_size + ps - 1) & ~(ps - 1);
 
-	ret->speh.elf_image = mmap(NULL, ret->map_size,
-							PROT_WRITE | PROT_READ,
-							MAP_PRIVATE, binfd, 0);
-	if (ret->speh.elf_image == MAP_FAILED)
-		goto ret_err;
-
-	/*Verify that this is a valid SPE ELF object*/
-	if((_base_spe_verify_spe_elf_image((spe_program_handle_t *)ret)))
+	if (map_image(ret, binfd))
 		goto ret_err;
 
 	if (_base_spe_toe_ear(&ret->speh))
 		goto ret_err;
 
+	if (ret->cacheable)
+		image_cache_add(ret, &statbuf);
+
 	/* ok */
 	close(binfd);
 	return (spe_program_handle_t *)ret;
 
 	/* err & cleanup */
 ret_err:
+	_base_spe_image_info_forget(&ret->speh);
 	if (ret->speh.elf_image != MAP_FAILED)
 		munmap(ret->speh.elf_image, ret->map_size);
 	if (binfd >= 0)
@@ -96,6 +202,19 @@ ret_err:
 	return NULL;
 }
 
+spe_program_handle_t *_base_spe_image_open(const char *filename)
+{
+	spe_program_handle_t *ret;
+
+	pthread_mutex_lock(&image_cache_lock);
+	if (image_cache_enabled < 0)
+		image_cache_enabled = getenv("SPE_IMAGE_CACHE") != NULL;
+	ret = image_open(filename);
+	pthread_mutex_unlock(&image_cache_lock);
+
+	return ret;
+}
+
 int _base_spe_image_close(spe_program_handle_t *handle)
 {
 	int ret = 0;
@@ -113,6 +232,16 @@ int _base_spe_image_close(spe_program_handle_t *handle)
 		return -1;
 	}
 
+	pthread_mutex_lock(&image_cache_lock);
+	if (--ih->refcount > 0) {
+		pthread_mutex_unlock(&image_cache_lock);
+		return 0;
+	}
+	if (ih->cacheable)
+		image_cache_remove(ih);
+	pthread_mutex_unlock(&image_cache_lock);
+
+	_base_spe_image_info_forget(handle);
 	if (ih->speh.toe_shadow)
 		free(ih->speh.toe_shadow);
 
@@ -121,5 +250,3 @@ int _base_spe_image_close(spe_program_handle_t *handle)
 
 	return ret;
 }
-
-
@@ -0,0 +1,292 @@
+/*
+ * libspe2 - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ * Copyright (C) 2008 IBM Corp.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * Registry of the program handles seen by the loader, embedded ones as
+ * well as the ones from spe_image_open(). A handle is verified and its
+ * section headers are looked through once, the first time it is used;
+ * the loader then works from the index. Callers get a copy of the index,
+ * so that closing the image does not pull it from under them, and the
+ * least recently used entries make room for new ones, as a handle that
+ * is not opened by spe_image_open may never be closed.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "elf_loader.h"
+#include "spebase.h"
+
+#define IMAGE_INFO_BUCKETS 64
+#define IMAGE_INFO_MAX 256
+
+static pthread_mutex_t image_info_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct spe_image_info *image_info_table[IMAGE_INFO_BUCKETS];
+static unsigned int image_info_count, image_info_clock;
+static unsigned int image_generation;
+
+static unsigned int image_info_hash(spe_program_handle_t *handle)
+{
+	unsigned long h = (unsigned long)handle;
+
+	return (h >> 4 ^ h >> 12) % IMAGE_INFO_BUCKETS;
+}
+
+static int image_index(spe_program_handle_t *handle,
+		       struct spe_image_info *info)
+{
+	Elf32_Ehdr *ehdr = (Elf32_Ehdr *)handle->elf_image;
+	Elf32_Phdr *phdr, *ph;
+	Elf32_Shdr *shdr, *sh;
+	char *str_table;
+	int ret;
+
+	info->handle = handle;
+	info->elf_image = handle->elf_image;
+	info->nsymtabs = 0;
+
+	if (!ehdr) {
+		errno = EINVAL;
+		return -errno;
+	}
+	ret = _base_spe_verify_spe_elf_image(handle);
+	if (ret)
+		return ret;
+
+	phdr = (Elf32_Phdr *) ((char *) ehdr + ehdr->e_phoff);
+	for (ph = phdr; ph < &phdr[ehdr->e_phnum]; ++ph) {
+		if (ph->p_type != PT_LOAD)
+			continue;
+		if (ph->p_flags & PF_OVERLAY)
+			info->noverlays++;
+		if (ph->p_vaddr + ph->p_memsz > info->ls_extent)
+			info->ls_extent = ph->p_vaddr + ph->p_memsz;
+	}
+
+	shdr = (Elf32_Shdr *) ((char *) ehdr + ehdr->e_shoff);
+	str_table = (char*)ehdr + shdr[ehdr->e_shstrndx].sh_offset;
+
+	for (sh = shdr; sh < &shdr[ehdr->e_shnum]; ++sh) {
+		if (sh->sh_type == SHT_RELA) {
+			info->has_rela = 1;
+			if (sh->sh_info < ehdr->e_shnum &&
+			    (shdr[sh->sh_info].sh_flags & SHF_EXECINSTR))
+				info->ls_relocs = 1;
+		}
+		if ((sh->sh_type == SHT_SYMTAB || sh->sh_type == SHT_DYNSYM) &&
+		    info->nsymtabs < SPE_IMAGE_INFO_SYMTABS)
+			info->symtabs[info->nsymtabs++] = sh - shdr;
+		/* by specification, the toe sections are grouped together */
+		if (strcmp(".toe", str_table + sh->sh_name) == 0) {
+			info->toe_size += sh->sh_size;
+			if ((info->toe_addr == 0) ||
+			    (info->toe_addr > sh->sh_addr))
+				info->toe_addr = sh->sh_addr;
+		}
+	}
+
+	return 0;
+}
+
+static struct spe_image_info *image_info_find(spe_program_handle_t *handle)
+{
+	struct spe_image_info *info;
+
+	for (info = image_info_table[image_info_hash(handle)]; info;
+	     info = info->next)
+		if (info->handle == handle &&
+		    info->elf_image == handle->elf_image) {
+			info->used = ++image_info_clock;
+			return info;
+		}
+	return NULL;
+}
+
+static void image_info_free(struct spe_image_info **p)
+{
+	struct spe_image_info *info = *p;
+
+	*p = info->next;
+	free(info);
+	image_info_count--;
+}
+
+static void image_info_evict(void)
+{
+	struct spe_image_info **p, **oldest = NULL;
+	int i;
+
+	for (i = 0; i < IMAGE_INFO_BUCKETS; i++)
+		for (p = &image_info_table[i]; *p; p = &(*p)->next)
+			if (!oldest || image_info_clock - (*p)->used >
+				       image_info_clock - (*oldest)->used)
+				oldest = p;
+	if (oldest)
+		image_info_free(oldest);
+}
+
+static void image_info_unlink(spe_program_handle_t *handle)
+{
+	struct spe_image_info **p, *info;
+
+	p = &image_info_table[image_info_hash(handle)];
+	while ((info = *p) != NULL) {
+		if (info->handle == handle)
+			image_info_free(p);
+		else
+			p = &info->next;
+	}
+}
+
+/**
+ * Copies the index of a program handle into info, building it on first
+ * use. A handle that failed verification has its error in the status
+ * field. Returns -1 only if the index could not be built.
+ */
+int _base_spe_image_info(spe_program_handle_t *handle,
+			 struct spe_image_info *info)
+{
+	struct spe_image_info *entry, *found;
+
+	pthread_mutex_lock(&image_info_lock);
+	found = image_info_find(handle);
+	if (found)
+		*info = *found;
+	pthread_mutex_unlock(&image_info_lock);
+	if (found)
+		return 0;
+
+	/* index outside the lock, so that preloading runs in parallel */
+	entry = calloc(1, sizeof(*entry));
+	if (!entry)
+		return -1;
+	entry->status = image_index(handle, entry);
+
+	pthread_mutex_lock(&image_info_lock);
+	found = image_info_find(handle);
+	if (found) {
+		free(entry);
+		entry = found;
+	} else {
+		/* the handle memory was reused for another image */
+		image_info_unlink(handle);
+		if (image_info_count >= IMAGE_INFO_MAX)
+			image_info_evict();
+		entry->used = ++image_info_clock;
+		entry->next = image_info_table[image_info_hash(handle)];
+		image_info_table[image_info_hash(handle)] = entry;
+		image_info_count++;
+	}
+	*info = *entry;
+	pthread_mutex_unlock(&image_info_lock);
+
+	return 0;
+}
+
+void _base_spe_image_info_forget(spe_program_handle_t *handle)
+{
+	pthread_mutex_lock(&image_info_lock);
+	image_info_unlink(handle);
+	image_generation++;
+	pthread_mutex_unlock(&image_info_lock);
+}
+
+/**
+ * Returns a count of the images closed so far: a handle seen at two
+ * times with the same generation is still the same image.
+ */
+unsigned int _base_spe_image_generation(void)
+{
+	unsigned int gen;
+
+	pthread_mutex_lock(&image_info_lock);
+	gen = image_generation;
+	pthread_mutex_unlock(&image_info_lock);
+
+	return gen;
+}
+
+struct image_preload {
+	spe_program_handle_t **handles;
+	int count;
+	int next;
+	int error;
+};
+
+static void *image_preload_thread(void *arg)
+{
+	struct image_preload *pl = arg;
+	struct spe_image_info info;
+	int i;
+
+	while ((i = __sync_fetch_and_add(&pl->next, 1)) < pl->count) {
+		if (_base_spe_image_info(pl->handles[i], &info))
+			__sync_bool_compare_and_swap(&pl->error, 0, ENOMEM);
+		else if (info.status)
+			__sync_bool_compare_and_swap(&pl->error, 0,
+						     -info.status);
+	}
+	return NULL;
+}
+
+int _base_spe_image_preload(spe_program_handle_t **handles, int count)
+{
+	struct image_preload pl;
+	pthread_t *threads;
+	long nthreads;
+	int i;
+
+	if (!handles || count < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	for (i = 0; i < count; i++)
+		if (!handles[i]) {
+			errno = EINVAL;
+			return -1;
+		}
+
+	pl.handles = handles;
+	pl.count = count;
+	pl.next = 0;
+	pl.error = 0;
+
+	nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nthreads > count)
+		nthreads = count;
+	threads = nthreads > 1 ? malloc(nthreads * sizeof(pthread_t)) : NULL;
+
+	/* the calling thread takes its share too */
+	for (i = 1; threads && i < nthreads; i++)
+		if (pthread_create(&threads[i], NULL, image_preload_thread, &pl))
+			break;
+	nthreads = i;
+	image_preload_thread(&pl);
+	for (i = 1; threads && i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+
+	if (pl.error) {
+		errno = pl.error;
+		return -1;
+	}
+	return 0;
+}
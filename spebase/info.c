@@ -17,90 +17,384 @@
  * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
  */
 
+#define _GNU_SOURCE
+
 #include <dirent.h>
 #include <errno.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
 
 
 #include "info.h"
 
+/* Here is a list of edp capable PVRs
+ * Known non-EDP are: 0x0070 0501 ( PS3, QS20, QS21 )
+ * Known EPD capable: 0x0070 3000 ( QS22 )
+ */
+static const unsigned long pvr_list_edp[] = {0x00703000, 0};
+
+/*
+ * Snapshot of the SPE topology, read from sysfs the first time it is
+ * needed and kept until _base_spe_cpu_info_refresh, so that sizing pools
+ * does not scan sysfs on every call.
+ */
+struct spe_topology {
+	int valid;
+	int ncpu_nodes;
+	int nspes;
+	int nusable;
+	spe_topology_entry_t *spes;	/* by cpu node, then by id */
+};
+
+static pthread_mutex_t topology_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct spe_topology topology;
+
+/*
+ * Returns the cpu node an SPU belongs to, as reported by sysfs,
+ * or -1 if the kernel does not export that information.
+ */
+static int spu_node(const char *spu_name)
+{
+	char path[256];
+	FILE *fp;
+	int node;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/spu/%s/node", spu_name);
+	fp = fopen(path, "r");
+	if (!fp)
+		return -1;
+	if (fscanf(fp, "%d", &node) != 1)
+		node = -1;
+	fclose(fp);
+
+	return node;
+}
+
+/*
+ * SPEs set aside for other uses, isolated applications for instance, are
+ * listed by id in SPE_RESERVED_SPES ("0,3").
+ */
+static int spu_reserved(int id)
+{
+	const char *p = getenv("SPE_RESERVED_SPES");
+	char *end;
+
+	while (p && *p) {
+		if (strtol(p, &end, 0) == id && end != p)
+			return 1;
+		if (end == p)
+			end++;
+		p = end + strspn(end, ", ");
+	}
+	return 0;
+}
+
 /*
- * For the moment, we count the numbers of cpus and devide by 2.
- */ 
+ * Without per-SPU node attributes, we count the cpu threads and divide
+ * by the threads per BE.
+ */
+static int count_cpu_threads(void)
+{
+	const char *buff = "/sys/devices/system/cpu";
+	DIR *dirp;
+	struct dirent *dptr;
+	int cpu, ret = 0;
+
+	if ((dirp = opendir(buff)) == NULL)
+		return -1;
+	while ((dptr = readdir(dirp)))
+		if (sscanf(dptr->d_name, "cpu%d", &cpu) == 1)
+			ret++;
+	closedir(dirp);
+	return ret;
+}
+
+static int topology_compare(const void *a, const void *b)
+{
+	const spe_topology_entry_t *x = a, *y = b;
+
+	if (x->cpu_node != y->cpu_node)
+		return x->cpu_node - y->cpu_node;
+	return x->id - y->id;
+}
+
+static int topology_build(struct spe_topology *t)
+{
+	const char *buff = "/sys/devices/system/spu";
+	spe_topology_entry_t *spes = NULL, *e;
+	char path[256];
+	DIR *dirp;
+	struct dirent *dptr;
+	int id, max = 0, have_nodes = 1, i;
+
+	memset(t, 0, sizeof(*t));
+
+	if ((dirp = opendir(buff)) == NULL) {
+		fprintf(stderr,"Error opening %s ",buff);
+		perror("dirlist");
+		errno = EINVAL;
+		return -1;
+	}
+	while ((dptr = readdir(dirp))) {
+		if (sscanf(dptr->d_name, "spu%d", &id) != 1)
+			continue;
+		if (t->nspes == max) {
+			max = max ? 2 * max : 16;
+			e = realloc(spes, max * sizeof(*spes));
+			if (!e) {
+				closedir(dirp);
+				free(spes);
+				return -1;
+			}
+			spes = e;
+		}
+		e = &spes[t->nspes++];
+		e->id = id;
+		e->cpu_node = spu_node(dptr->d_name);
+		e->reserved = spu_reserved(id);
+		if (e->cpu_node == -1)
+			have_nodes = 0;
+		else if (e->cpu_node >= t->ncpu_nodes)
+			t->ncpu_nodes = e->cpu_node + 1;
+	}
+	closedir(dirp);
+
+	if (!have_nodes) {
+		/* assume the SPEs are evenly distributed over the BEs */
+		t->ncpu_nodes = count_cpu_threads() / THREADS_PER_BE;
+		if (t->ncpu_nodes < 1)
+			t->ncpu_nodes = 1;
+		qsort(spes, t->nspes, sizeof(*spes), topology_compare);
+		for (i = 0; i < t->nspes; i++)
+			spes[i].cpu_node = i * t->ncpu_nodes / t->nspes;
+	} else
+		qsort(spes, t->nspes, sizeof(*spes), topology_compare);
+
+	for (i = 0; i < t->nspes; i++) {
+		sprintf(path, "/sys/devices/system/node/node%d",
+			spes[i].cpu_node);
+		spes[i].numa_node = access(path, F_OK) ? -1 : spes[i].cpu_node;
+		if (!spes[i].reserved)
+			t->nusable++;
+	}
+
+	t->spes = spes;
+	t->valid = 1;
+	return 0;
+}
+
+/* Returns the snapshot with topology_lock held, or NULL. */
+static struct spe_topology *topology_get(void)
+{
+	pthread_mutex_lock(&topology_lock);
+	if (!topology.valid && topology_build(&topology)) {
+		pthread_mutex_unlock(&topology_lock);
+		return NULL;
+	}
+	return &topology;
+}
+
+static void topology_put(void)
+{
+	pthread_mutex_unlock(&topology_lock);
+}
+
+int _base_spe_cpu_info_refresh(void)
+{
+	struct spe_topology t;
+
+	if (topology_build(&t))
+		return -1;
+
+	pthread_mutex_lock(&topology_lock);
+	free(topology.spes);
+	topology = t;
+	pthread_mutex_unlock(&topology_lock);
+
+	return 0;
+}
+
+int _base_spe_cpu_topology_get(spe_topology_entry_t *spes, int max)
+{
+	struct spe_topology *t;
+	int n;
+
+	if (max < 0 || (max && !spes)) {
+		errno = EINVAL;
+		return -1;
+	}
+	t = topology_get();
+	if (!t)
+		return -1;
+	n = t->nspes;
+	memcpy(spes, t->spes, (n < max ? n : max) * sizeof(*spes));
+	topology_put();
+
+	return n;
+}
+
 int _base_spe_count_physical_cpus(int cpu_node)
 {
-	const char    *buff = "/sys/devices/system/cpu";
-	DIR     *dirp;
-	int ret = 0;
-	struct  dirent  *dptr;
+	struct spe_topology *t;
+	int ret;
 
 	DEBUG_PRINTF ("spe_count_physical_cpus()\n");
-	
+
 	// make sure, cpu_node is in the correct range
 	if (cpu_node != -1) {
 		errno = EINVAL;
 		return -1;
 	}
 
-	// Count number of CPUs in /sys/devices/system/cpu
-	if((dirp=opendir(buff))==NULL) {
-		fprintf(stderr,"Error opening %s ",buff);
-		perror("dirlist");
+	t = topology_get();
+	if (!t)
+		return -1;
+	ret = t->ncpu_nodes;
+	topology_put();
+	return ret;
+}
+
+/* Counts the SPEs of a node, or all of them, possibly only the usable
+ * ones. */
+static int count_spes(int cpu_node, int usable)
+{
+	struct spe_topology *t;
+	int i, ret = 0;
+
+	t = topology_get();
+	if (!t)
+		return -1;
+
+	// make sure, cpu_node is in the correct range
+	if (cpu_node < -1 || cpu_node >= t->ncpu_nodes) {
+		topology_put();
 		errno = EINVAL;
 		return -1;
 	}
-    while((dptr=readdir(dirp))) {
-		if(strncmp("cpu",dptr->d_name,3) == 0)
-			ret++;
-	}
-	closedir(dirp);
-	return ret/THREADS_PER_BE; 
+
+	if (cpu_node == -1)
+		ret = usable ? t->nusable : t->nspes;
+	else
+		for (i = 0; i < t->nspes; i++)
+			if (t->spes[i].cpu_node == cpu_node &&
+			    !(usable && t->spes[i].reserved))
+				ret++;
+	topology_put();
+	return ret;
+}
+
+int _base_spe_count_physical_spes(int cpu_node)
+{
+	DEBUG_PRINTF ("spe_count_physical_spes()\n");
+	return count_spes(cpu_node, 0);
 }
 
 /*
- * For the moment, we use all spes which are controlled by linux
+ * The SPEs controlled by linux, less the reserved ones
  */
 int _base_spe_count_usable_spes(int cpu_node)
 {
-	return _base_spe_count_physical_spes(cpu_node); // FIXME
+	return count_spes(cpu_node, 1);
 }
 
 /*
- * For the moment, we assume all SPEs are evenly distributed over the 
- * physical cpsus.
+ * Fill in the set of cpus belonging to a node from the cpuN links
+ * in /sys/devices/system/node/nodeN.
  */
-int _base_spe_count_physical_spes(int cpu_node)
+static int node_cpuset(int cpu_node, cpu_set_t *cpus)
 {
-	const char	*buff = "/sys/devices/system/spu";
-	DIR	*dirp;
-	int ret = -2;
-	struct	dirent	*dptr;
-	int no_of_bes;
-
-	DEBUG_PRINTF ("spe_count_physical_spes()\n");
+	char path[256];
+	DIR *dirp;
+	struct dirent *dptr;
+	int cpu, count = 0;
 
-	// make sure, cpu_node is in the correct range
-	no_of_bes = _base_spe_count_physical_cpus(-1);
-	if (cpu_node < -1 || cpu_node >= no_of_bes ) {
+	sprintf(path, "/sys/devices/system/node/node%d", cpu_node);
+	if ((dirp = opendir(path)) == NULL) {
 		errno = EINVAL;
 		return -1;
 	}
 
-	// Count number of SPUs in /sys/devices/system/spu
-	if((dirp=opendir(buff))==NULL) {
-		fprintf(stderr,"Error opening %s ",buff);
-		perror("dirlist");
+	CPU_ZERO(cpus);
+	while ((dptr = readdir(dirp))) {
+		if (sscanf(dptr->d_name, "cpu%d", &cpu) == 1) {
+			CPU_SET(cpu, cpus);
+			count++;
+		}
+	}
+	closedir(dirp);
+
+	if (!count) {
 		errno = EINVAL;
 		return -1;
 	}
-    while((dptr=readdir(dirp))) {
-		ret++;
+	return 0;
+}
+
+int _base_spe_context_node_set(spe_context_ptr_t spe, int cpu_node)
+{
+	cpu_set_t cpus;
+
+	if (cpu_node != -1 && node_cpuset(cpu_node, &cpus))
+		return -1;
+
+	spe->base_private->cpu_node = cpu_node;
+	return 0;
+}
+
+/*
+ * spufs schedules a context only on SPUs of the nodes the calling
+ * thread may run on, so restricting the PPE thread to the cpus of a
+ * node places the context on that node.
+ */
+int _base_spe_node_affinity_enter(int cpu_node, cpu_set_t *saved)
+{
+	cpu_set_t cpus;
+
+	if (node_cpuset(cpu_node, &cpus))
+		return -1;
+	if (sched_getaffinity(0, sizeof(*saved), saved))
+		return -1;
+	return sched_setaffinity(0, sizeof(cpus), &cpus);
+}
+
+void _base_spe_node_affinity_leave(cpu_set_t *saved)
+{
+	sched_setaffinity(0, sizeof(*saved), saved);
+}
+
+#ifndef MPOL_BIND
+#define MPOL_BIND	2
+#endif
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE	(1 << 1)
+#endif
+
+int _base_spe_ea_bind(void *ea, size_t size, int cpu_node)
+{
+	unsigned long nodemask[4];
+	unsigned long start, pagesize;
+
+	if (cpu_node < 0 || cpu_node >= sizeof(nodemask) * 8 || !size) {
+		errno = EINVAL;
+		return -1;
 	}
-	closedir(dirp);
 
-	if(cpu_node != -1) ret /= no_of_bes; // FIXME
-	return ret;
+	/* mbind works on whole pages */
+	pagesize = getpagesize();
+	start = (unsigned long)ea & ~(pagesize - 1);
+	size += (unsigned long)ea - start;
+
+	memset(nodemask, 0, sizeof(nodemask));
+	nodemask[cpu_node / (sizeof(long) * 8)] |=
+		1UL << (cpu_node % (sizeof(long) * 8));
+
+	return syscall(SYS_mbind, start, size, MPOL_BIND, nodemask,
+			sizeof(nodemask) * 8, MPOL_MF_MOVE);
 }
 
 /* Since there are no mixed-type CPU systems at this time the cpu node
@@ -20,6 +20,8 @@
 #ifndef _info_h_
 #define _info_h_
 
+#include <sched.h>
+
 #include "spebase.h"
 
 #define THREADS_PER_BE 2 
@@ -29,10 +31,7 @@ int _base_spe_count_physical_spes(int cpu_node);
 int _base_spe_count_usable_spes(int cpu_node);
 int _base_spe_read_cpu_type(int cpu_node);
 
-/* Here is a list of edp capable PVRs
- * Known non-EDP are: 0x0070 0501 ( PS3, QS20, QS21 )
- * Known EPD capable: 0x0070 3000 ( QS22 )
- */
-unsigned long pvr_list_edp[] = {0x00703000, 0};
+int _base_spe_node_affinity_enter(int cpu_node, cpu_set_t *saved);
+void _base_spe_node_affinity_leave(cpu_set_t *saved);
 
 #endif
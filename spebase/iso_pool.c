@@ -0,0 +1,223 @@
+/*
+ * libspe2 - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ * Copyright (C) 2008 IBM Corp.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * Pools of isolated contexts. Creating an isolated context is expensive,
+ * and an emulated one needs the loader copied into local store before
+ * every application; a pool keeps idle contexts with the loader already
+ * in place, so that launching a secure job only passes the application
+ * to the loader and runs it.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ls_copy.h"
+#include "spebase.h"
+
+struct iso_pool_entry {
+	spe_context_ptr_t spe;
+	struct iso_pool_entry *next;
+};
+
+struct spe_isolated_pool {
+	pthread_mutex_t lock;
+	unsigned int flags;
+	struct iso_pool_entry *idle;
+	spe_isolated_pool_stats_t stats;
+};
+
+/* Makes a context ready for the next launch, off the launch path, and
+ * returns the time that took. A context that could not be armed is
+ * still usable; its next launch loads the loader itself. With clear,
+ * nothing of the last job is left in local store for the next one. */
+static unsigned long long iso_pool_arm(struct spe_isolated_pool *pool,
+				       spe_context_ptr_t spe, int clear)
+{
+	struct timespec t0;
+
+	if (!(pool->flags & SPE_ISOLATE_EMULATE))
+		return 0;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (clear)
+		_base_spe_ls_clear(spe->base_private->mem_mmap_base, LS_SIZE);
+	_base_spe_emulated_loader_arm(spe);
+	return _base_spe_elapsed_ns(&t0);
+}
+
+static int iso_pool_add(struct spe_isolated_pool *pool)
+{
+	struct iso_pool_entry *e;
+
+	e = malloc(sizeof(*e));
+	if (!e)
+		return -1;
+	e->spe = _base_spe_context_create(pool->flags, NULL, NULL);
+	if (!e->spe) {
+		free(e);
+		return -1;
+	}
+	pool->stats.arm_time_ns += iso_pool_arm(pool, e->spe, 0);
+
+	e->next = pool->idle;
+	pool->idle = e;
+	pool->stats.contexts++;
+	pool->stats.idle++;
+	return 0;
+}
+
+spe_isolated_pool_ptr_t _base_spe_isolated_pool_create(unsigned int flags,
+						       int ncontexts)
+{
+	struct spe_isolated_pool *pool;
+	int i, err;
+
+	if (!(flags & (SPE_ISOLATE | SPE_ISOLATE_EMULATE)) || ncontexts < 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	pool = calloc(1, sizeof(*pool));
+	if (!pool)
+		return NULL;
+	pthread_mutex_init(&pool->lock, NULL);
+	pool->flags = flags;
+
+	for (i = 0; i < ncontexts; i++)
+		if (iso_pool_add(pool)) {
+			err = errno;
+			_base_spe_isolated_pool_destroy(pool);
+			errno = err;
+			return NULL;
+		}
+
+	return pool;
+}
+
+int _base_spe_isolated_pool_destroy(spe_isolated_pool_ptr_t pool)
+{
+	struct iso_pool_entry *e;
+
+	pthread_mutex_lock(&pool->lock);
+	if (pool->stats.idle != pool->stats.contexts) {
+		pthread_mutex_unlock(&pool->lock);
+		errno = EBUSY;
+		return -1;
+	}
+	while ((e = pool->idle) != NULL) {
+		pool->idle = e->next;
+		_base_spe_context_destroy(e->spe);
+		free(e);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	pthread_mutex_destroy(&pool->lock);
+	free(pool);
+	return 0;
+}
+
+spe_context_ptr_t _base_spe_isolated_pool_get(spe_isolated_pool_ptr_t pool,
+					      spe_program_handle_t *program)
+{
+	struct iso_pool_entry *e;
+	spe_context_ptr_t spe;
+	struct timespec t0;
+	int err;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	pthread_mutex_lock(&pool->lock);
+	if (!pool->idle && iso_pool_add(pool)) {
+		pthread_mutex_unlock(&pool->lock);
+		return NULL;
+	}
+	e = pool->idle;
+	pool->idle = e->next;
+	pool->stats.idle--;
+	if (!e->spe->base_private->loader_armed &&
+	    (pool->flags & SPE_ISOLATE_EMULATE))
+		pool->stats.cold_launches++;
+	pthread_mutex_unlock(&pool->lock);
+
+	spe = e->spe;
+	free(e);
+
+	spe->base_private->launch_start = t0;
+	spe->base_private->launch_pending = 1;
+	spe->base_private->pool_relaunch = 1;
+	spe->base_private->launch_ns = 0;
+	if (_base_spe_program_load(spe, program)) {
+		err = errno;
+		_base_spe_isolated_pool_put(pool, spe);
+		errno = err;
+		return NULL;
+	}
+
+	return spe;
+}
+
+void _base_spe_isolated_launch_done(spe_context_ptr_t spe)
+{
+	spe->base_private->launch_ns =
+		_base_spe_elapsed_ns(&spe->base_private->launch_start);
+	spe->base_private->launch_pending = 0;
+}
+
+int _base_spe_isolated_pool_put(spe_isolated_pool_ptr_t pool,
+				spe_context_ptr_t spe)
+{
+	struct spe_context_base_priv *priv = spe->base_private;
+	struct iso_pool_entry *e;
+	unsigned long long arm_ns;
+
+	e = malloc(sizeof(*e));
+	if (!e)
+		return -1;
+	e->spe = spe;
+	priv->launch_pending = 0;
+	priv->pool_relaunch = 0;
+	arm_ns = iso_pool_arm(pool, spe, 1);
+
+	pthread_mutex_lock(&pool->lock);
+	if (priv->launch_ns) {
+		pool->stats.launches++;
+		pool->stats.launch_time_ns += priv->launch_ns;
+		if (priv->launch_ns > pool->stats.launch_time_max_ns)
+			pool->stats.launch_time_max_ns = priv->launch_ns;
+		priv->launch_ns = 0;
+	}
+	pool->stats.arm_time_ns += arm_ns;
+	e->next = pool->idle;
+	pool->idle = e;
+	pool->stats.idle++;
+	pthread_mutex_unlock(&pool->lock);
+
+	return 0;
+}
+
+int _base_spe_isolated_pool_stats_get(spe_isolated_pool_ptr_t pool,
+				      spe_isolated_pool_stats_t *stats)
+{
+	pthread_mutex_lock(&pool->lock);
+	*stats = pool->stats;
+	pthread_mutex_unlock(&pool->lock);
+
+	return 0;
+}
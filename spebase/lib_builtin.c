@@ -19,9 +19,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <time.h>
 
 #include "spebase.h"
 #include "lib_builtin.h"
+#include "callstats.h"
 #include "default_c99_handler.h"
 #include "default_posix1_handler.h"
 #include "default_libea_handler.h"
@@ -122,6 +124,8 @@ int _base_spe_handle_library_callback(struct spe_context *spe, int callnum,
 				      unsigned int npc)
 {
 	int (*handler)(void *, unsigned int);
+	struct timespec start;
+	unsigned int opdata;
 	int rc;
 	
 	errno = 0;
@@ -139,7 +143,17 @@ int _base_spe_handle_library_callback(struct spe_context *spe, int callnum,
 	if (spe->base_private->flags & SPE_ISOLATE_EMULATE)
 		npc = SPE_EMULATE_PARAM_BUFFER;
 
+	/* the opcode is in the top byte of the parameter word, read it
+	 * before the handler stores its results over it */
+	opdata = *(unsigned int *)((char *)spe->base_private->mem_mmap_base +
+				   ((npc & LS_ADDR_MASK) & ~0x1));
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
 	rc = handler(spe->base_private->mem_mmap_base, npc);
+
+	_base_spe_callstats_account(spe, callnum, (opdata >> 24) & 0xff,
+				    _base_spe_elapsed_ns(&start));
+
 	if (rc) {
 		DEBUG_PRINTF ("SPE library call unsupported.\n");
 		errno=ENOSYS;
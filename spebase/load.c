@@ -17,6 +17,7 @@
  * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
  */
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
@@ -37,17 +38,28 @@
  */
 void _base_spe_program_load_complete(spe_context_ptr_t spectx)
 {
+	struct spe_context_base_priv *priv = spectx->base_private;
 	int objfd, len;
 	char buf[20];
 	spe_program_handle_t *program;
 
-	program = spectx->base_private->loaded_program;
+	program = priv->loaded_program;
 
 	if (!program || !program->elf_image) {
 		DEBUG_PRINTF("%s called, but no program loaded\n", __func__);
 		return;
 	}
 
+	/* a pooled isolated context relaunching the same program has
+	 * nothing new to tell oprofile, and isolated local store is closed
+	 * to the debugger anyway */
+	if (priv->pool_relaunch) {
+		priv->pool_relaunch = 0;
+		if (priv->object_id_program == program &&
+		    priv->object_id_generation == _base_spe_image_generation())
+			return;
+	}
+
 	objfd = openat(spectx->base_private->fd_spe_dir, "object-id", O_RDWR);
 	if (objfd < 0)
 		return;
@@ -55,6 +67,8 @@ void _base_spe_program_load_complete(spe_context_ptr_t spectx)
 	len = sprintf(buf, "%p", program->elf_image);
 	write(objfd, buf, len + 1);
 	close(objfd);
+	priv->object_id_program = program;
+	priv->object_id_generation = _base_spe_image_generation();
 
 	__spe_context_update_event();
 }
@@ -132,24 +146,46 @@ static int spe_start_isolated_app(struct spe_context *spe,
 	return 0;
 }
 
+static pthread_once_t emulated_loader_once = PTHREAD_ONCE_INIT;
+static spe_program_handle_t *emulated_loader;
+static int emulated_loader_errno;
+
+static void emulated_loader_open(void)
+{
+	struct spe_image_info info;
+	spe_program_handle_t *loader;
+
+	loader = _base_spe_image_open(SPE_EMULATED_LOADER_FILE);
+	if (loader && _base_spe_verify_spe_elf_image(loader)) {
+		_base_spe_image_close(loader);
+		loader = NULL;
+		errno = ENOEXEC;
+	}
+	if (!loader) {
+		emulated_loader_errno = errno;
+		DEBUG_PRINTF("Can't load emulated loader '%s': %s\n",
+				SPE_EMULATED_LOADER_FILE, strerror(errno));
+		return;
+	}
+
+	/* index it now rather than on the first isolated load */
+	_base_spe_image_info(loader, &info);
+	emulated_loader = loader;
+}
+
 /**
  * Load the emulated isolation loader program from the filesystem
  *
- * @return The loader program, or NULL if it can't be loaded. The loader binary
- *	   is cached between calls.
+ * @return The loader program, or NULL if it can't be loaded. The loader
+ *	   binary is opened and verified once per process, and kept.
  */
 static spe_program_handle_t *emulated_loader_program(void)
 {
-	static spe_program_handle_t *loader = NULL;
+	pthread_once(&emulated_loader_once, emulated_loader_open);
 
-	if (!loader)
-		loader = _base_spe_image_open(SPE_EMULATED_LOADER_FILE);
-
-	if (!loader)
-		DEBUG_PRINTF("Can't load emulated loader '%s': %s\n",
-				SPE_EMULATED_LOADER_FILE, strerror(errno));
-
-	return loader;
+	if (!emulated_loader)
+		errno = emulated_loader_errno;
+	return emulated_loader;
 }
 
 /**
@@ -158,12 +194,31 @@ static spe_program_handle_t *emulated_loader_program(void)
  */
 int _base_spe_emulated_loader_present(void)
 {
-	spe_program_handle_t *loader = emulated_loader_program();
+	return emulated_loader_program() != NULL;
+}
+
+int _base_spe_emulated_loader_arm(spe_context_ptr_t spe)
+{
+	spe_program_handle_t *loader;
+	struct spe_ld_info ld_info;
 
+	spe->base_private->loader_armed = 0;
+
+	loader = emulated_loader_program();
 	if (!loader)
-		return 0;
+		return -1;
 
-	return !_base_spe_verify_spe_elf_image(loader);
+	if (_base_spe_load_spe_elf(loader, spe->base_private->mem_mmap_base,
+				   &ld_info)) {
+		DEBUG_PRINTF("%s: No loader available\n", __FUNCTION__);
+		return -1;
+	}
+	/* the loader's overlays are of no interest */
+	free(ld_info.overlays);
+
+	spe->base_private->loader_entry = ld_info.entry;
+	spe->base_private->loader_armed = 1;
+	return 0;
 }
 
 /**
@@ -182,30 +237,26 @@ static int spe_start_emulated_isolated_app(struct spe_context *spe,
 		spe_program_handle_t *handle, struct spe_ld_info *ld_info)
 
 {
-	int rc;
-	spe_program_handle_t *loader;
-
-	/* load emulated loader from the filesystem */
-	loader = emulated_loader_program();
-
-	if (!loader)
+	/* the loader may already be waiting in local store */
+	if (!spe->base_private->loader_armed &&
+	    _base_spe_emulated_loader_arm(spe))
 		return -1;
-
-	rc = _base_spe_load_spe_elf(loader, spe->base_private->mem_mmap_base, ld_info);
-	if (rc != 0) {
-		DEBUG_PRINTF("%s: No loader available\n", __FUNCTION__);
-		return rc;
-	}
+	spe->base_private->loader_armed = 0;
+	ld_info->entry = spe->base_private->loader_entry;
 
 	return spe_start_isolated_app(spe, handle);
 }
 
-int _base_spe_program_load(spe_context_ptr_t spe, spe_program_handle_t *program)
+int _base_spe_program_load_now(spe_context_ptr_t spe,
+			       spe_program_handle_t *program)
 {
 	int rc = 0;
 	struct spe_ld_info ld_info;
 
 	spe->base_private->loaded_program = program;
+	spe->base_private->staged_program = NULL;
+	spe->base_private->ls_base = 0;
+	spe->base_private->ls_extent = LS_SIZE;
 
 	if (spe->base_private->flags & SPE_ISOLATE) {
 		rc = spe_start_isolated_app(spe, program);
@@ -216,8 +267,13 @@ int _base_spe_program_load(spe_context_ptr_t spe, spe_program_handle_t *program)
 	} else {
 		rc = _base_spe_load_spe_elf(program,
 				spe->base_private->mem_mmap_base, &ld_info);
-		if (!rc)
+		if (!rc) {
 			_base_spe_program_load_complete(spe);
+			free(spe->base_private->overlays);
+			spe->base_private->overlays = ld_info.overlays;
+			spe->base_private->load_stats = ld_info.stats;
+			spe->base_private->ls_extent = ld_info.extent;
+		}
 	}
 
 	if (rc != 0) {
@@ -230,3 +286,106 @@ int _base_spe_program_load(spe_context_ptr_t spe, spe_program_handle_t *program)
 
 	return 0;
 }
+
+int _base_spe_program_load(spe_context_ptr_t spe, spe_program_handle_t *program)
+{
+	/* a load still in flight would overwrite this one; its result is
+	 * of no interest any more */
+	_base_spe_program_load_wait(spe);
+
+	return _base_spe_program_load_now(spe, program);
+}
+
+int _base_spe_program_load_next(spe_context_ptr_t spe,
+				spe_program_handle_t *program)
+{
+	struct spe_context_base_priv *priv = spe->base_private;
+	struct spe_image_info image, *info = &image;
+	struct spe_ld_info ld_info;
+	unsigned int base, limit;
+
+	if (priv->flags & (SPE_ISOLATE | SPE_ISOLATE_EMULATE)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* the free half is the one the loaded program leaves, so that load
+	 * has to be done; a failed one leaves nothing to stage next to */
+	if (_base_spe_program_load_wait(spe))
+		return -1;
+
+	if (_base_spe_image_info(program, info))
+		return -1;
+	if (info->status) {
+		errno = -info->status;
+		return -1;
+	}
+
+	/* the half of local store the loaded program does not use */
+	base = priv->ls_base ? 0 : LS_SIZE / 2;
+	limit = base ? LS_SIZE - SPE_LS_STACK_RESERVE : LS_SIZE / 2;
+	if (info->ls_extent > limit - base ||
+	    (priv->ls_base < limit && priv->ls_extent > base)) {
+		errno = ENOSPC;
+		return -1;
+	}
+
+	if (_base_spe_load_spe_elf_at(program, priv->mem_mmap_base, base,
+				      &ld_info)) {
+		DEBUG_PRINTF ("Staging SPE ELF failed..\n");
+		return -1;
+	}
+
+	priv->staged_program = program;
+	priv->staged_base = base;
+	priv->staged_entry = ld_info.entry;
+	priv->staged_extent = ld_info.extent;
+	priv->staged_stats = ld_info.stats;
+
+	return 0;
+}
+
+void _base_spe_program_staged_switch(spe_context_ptr_t spe)
+{
+	struct spe_context_base_priv *priv = spe->base_private;
+
+	priv->loaded_program = priv->staged_program;
+	priv->staged_program = NULL;
+	priv->entry = priv->staged_entry;
+	priv->emulated_entry = priv->staged_entry;
+	priv->ls_base = priv->staged_base;
+	priv->ls_extent = priv->staged_extent;
+	priv->load_stats = priv->staged_stats;
+	free(priv->overlays);
+	priv->overlays = NULL;
+
+	_base_spe_program_load_complete(spe);
+}
+
+int _base_spe_program_load_stats_get(spe_context_ptr_t spe,
+				     spe_load_stats_t *stats)
+{
+	if (!stats || !spe->base_private->load_stats.segments) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	*stats = spe->base_private->load_stats;
+	return 0;
+}
+
+int _base_spe_program_overlays_get(spe_context_ptr_t spe,
+				   spe_overlay_segment_t *overlays, int max)
+{
+	int n = spe->base_private->load_stats.overlays;
+
+	if (!spe->base_private->load_stats.segments || max < 0 ||
+	    (max && !overlays)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	memcpy(overlays, spe->base_private->overlays,
+	       (n < max ? n : max) * sizeof(*overlays));
+	return n;
+}
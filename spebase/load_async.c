@@ -0,0 +1,204 @@
+/*
+ * libspe2 - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ * Copyright (C) 2008 IBM Corp.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * Asynchronous program loads. Requests are queued to a few loader
+ * threads, started on demand, so that relocating and copying the next
+ * program into one context overlaps with running another. The loads of
+ * one context are run in order, one at a time: only the first is
+ * queued to the loader threads, the others wait on the context and are
+ * run by the thread that finishes the one before. Anything that needs
+ * the loaded program (running, loading again, destroying the context)
+ * first waits for the loads in flight on that context.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "spebase.h"
+
+#define LOAD_THREADS_MAX 4
+
+struct load_request {
+	spe_context_ptr_t spe;
+	spe_program_handle_t *program;
+	spe_load_completion_t *completion;
+	struct load_request *next;
+};
+
+static pthread_mutex_t load_queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t load_queue_cond = PTHREAD_COND_INITIALIZER;
+static struct load_request *load_queue_head;
+static struct load_request **load_queue_tail = &load_queue_head;
+static int load_threads, load_threads_idle;
+
+/* Runs a load, and returns the next load queued on the same context. */
+static struct load_request *load_request_run(struct load_request *req)
+{
+	struct spe_context_base_priv *priv = req->spe->base_private;
+	struct load_request *next;
+	int rc, err;
+
+	rc = _base_spe_program_load_now(req->spe, req->program);
+	err = errno;
+
+	/* the completion runs before waiters are released, so that it is
+	 * done with the context when spe_program_load_wait returns */
+	if (req->completion && req->completion->func) {
+		req->completion->func(req->spe, rc, req->completion->arg);
+		errno = err;
+	}
+
+	pthread_mutex_lock(&priv->load_lock);
+	if (rc) {
+		priv->load_status = rc;
+		priv->load_errno = err;
+	}
+	next = priv->load_queue;
+	if (next) {
+		priv->load_queue = next->next;
+		if (!priv->load_queue)
+			priv->load_queue_tail = &priv->load_queue;
+	}
+	if (--priv->load_pending == 0)
+		pthread_cond_broadcast(&priv->load_done);
+	pthread_mutex_unlock(&priv->load_lock);
+
+	return next;
+}
+
+static void *load_thread(void *arg)
+{
+	struct load_request *req;
+
+	pthread_mutex_lock(&load_queue_lock);
+	for (;;) {
+		while (!load_queue_head) {
+			load_threads_idle++;
+			pthread_cond_wait(&load_queue_cond, &load_queue_lock);
+			load_threads_idle--;
+		}
+		req = load_queue_head;
+		load_queue_head = req->next;
+		if (!load_queue_head)
+			load_queue_tail = &load_queue_head;
+		pthread_mutex_unlock(&load_queue_lock);
+
+		while (req) {
+			struct load_request *next = load_request_run(req);
+
+			free(req);
+			req = next;
+		}
+
+		pthread_mutex_lock(&load_queue_lock);
+	}
+	return NULL;
+}
+
+/* Starts a loader thread if none is idle; called with the queue locked.
+ * Returns -1 only if there is no loader thread at all. */
+static int load_thread_start(void)
+{
+	pthread_attr_t attr;
+	pthread_t thread;
+	long ncpus;
+	int rc;
+
+	if (load_threads_idle)
+		return 0;
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (load_threads >= LOAD_THREADS_MAX ||
+	    (load_threads && load_threads >= ncpus))
+		return 0;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	rc = pthread_create(&thread, &attr, load_thread, NULL);
+	pthread_attr_destroy(&attr);
+	if (rc) {
+		errno = rc;
+		return load_threads ? 0 : -1;
+	}
+	load_threads++;
+	return 0;
+}
+
+int _base_spe_program_load_async(spe_context_ptr_t spe,
+				 spe_program_handle_t *program,
+				 spe_load_completion_t *completion)
+{
+	struct spe_context_base_priv *priv = spe->base_private;
+	struct load_request *req;
+
+	req = malloc(sizeof(*req));
+	if (!req)
+		return -1;
+	req->spe = spe;
+	req->program = program;
+	req->completion = completion;
+	req->next = NULL;
+
+	/* behind a load in flight on the same context, wait for it */
+	pthread_mutex_lock(&priv->load_lock);
+	if (priv->load_pending) {
+		priv->load_pending++;
+		*priv->load_queue_tail = req;
+		priv->load_queue_tail = &req->next;
+		pthread_mutex_unlock(&priv->load_lock);
+		return 0;
+	}
+
+	/* the context stays locked until the load is queued, so that no
+	 * load can queue behind one that fails to start */
+	pthread_mutex_lock(&load_queue_lock);
+	if (load_thread_start()) {
+		pthread_mutex_unlock(&load_queue_lock);
+		pthread_mutex_unlock(&priv->load_lock);
+		free(req);
+		return -1;
+	}
+	priv->load_pending++;
+	*load_queue_tail = req;
+	load_queue_tail = &req->next;
+	pthread_cond_signal(&load_queue_cond);
+	pthread_mutex_unlock(&load_queue_lock);
+	pthread_mutex_unlock(&priv->load_lock);
+
+	return 0;
+}
+
+int _base_spe_program_load_wait(spe_context_ptr_t spe)
+{
+	struct spe_context_base_priv *priv = spe->base_private;
+	int rc;
+
+	pthread_mutex_lock(&priv->load_lock);
+	while (priv->load_pending)
+		pthread_cond_wait(&priv->load_done, &priv->load_lock);
+	rc = priv->load_status;
+	if (rc)
+		errno = priv->load_errno;
+	priv->load_status = 0;
+	pthread_mutex_unlock(&priv->load_lock);
+
+	return rc;
+}
@@ -0,0 +1,162 @@
+/*
+ * libspe2 - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ * Copyright (C) 2008 IBM Corp.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __ALTIVEC__
+#include <altivec.h>
+#endif
+
+#include "ls_copy.h"
+
+#define LS_LINE		128
+
+/* below this, aligning and the line loop are not worth it */
+#define LS_COPY_MIN	(2 * LS_LINE)
+
+#ifdef __ALTIVEC__
+
+static void copy_lines(void *dst, const void *src, size_t lines)
+{
+	vector unsigned char *d = dst;
+	const unsigned char *s = src;
+	vector unsigned char v0, v1, v2, v3, v4, v5, v6, v7;
+	vector unsigned char perm, msq, lsq;
+	int i;
+
+	if (((uintptr_t)s & 15) == 0) {
+		for (; lines; lines--, s += LS_LINE, d += 8) {
+			v0 = vec_ld(0, s);
+			v1 = vec_ld(16, s);
+			v2 = vec_ld(32, s);
+			v3 = vec_ld(48, s);
+			v4 = vec_ld(64, s);
+			v5 = vec_ld(80, s);
+			v6 = vec_ld(96, s);
+			v7 = vec_ld(112, s);
+			vec_st(v0, 0, d);
+			vec_st(v1, 16, d);
+			vec_st(v2, 32, d);
+			vec_st(v3, 48, d);
+			vec_st(v4, 64, d);
+			vec_st(v5, 80, d);
+			vec_st(v6, 96, d);
+			vec_st(v7, 112, d);
+		}
+		return;
+	}
+
+	/* misaligned source: shift pairs of aligned loads into place */
+	perm = vec_lvsl(0, s);
+	msq = vec_ld(0, s);
+	for (; lines; lines--)
+		for (i = 0; i < 8; i++, s += 16, d++) {
+			lsq = vec_ld(15, s);
+			*d = vec_perm(msq, lsq, perm);
+			msq = lsq;
+		}
+}
+
+static void clear_lines(void *dst, size_t lines)
+{
+	vector unsigned char *d = dst;
+	vector unsigned char zero = vec_splat_u8(0);
+
+	for (; lines; lines--, d += 8) {
+		vec_st(zero, 0, d);
+		vec_st(zero, 16, d);
+		vec_st(zero, 32, d);
+		vec_st(zero, 48, d);
+		vec_st(zero, 64, d);
+		vec_st(zero, 80, d);
+		vec_st(zero, 96, d);
+		vec_st(zero, 112, d);
+	}
+}
+
+#else /* !__ALTIVEC__ */
+
+static void copy_lines(void *dst, const void *src, size_t lines)
+{
+	uint64_t *d = dst;
+	const uint64_t *s = src;
+	int i;
+
+	if ((uintptr_t)s & 7) {
+		memcpy(dst, src, lines * LS_LINE);
+		return;
+	}
+
+	for (; lines; lines--, s += 16, d += 16)
+		for (i = 0; i < 16; i++)
+			d[i] = s[i];
+}
+
+static void clear_lines(void *dst, size_t lines)
+{
+	uint64_t *d = dst;
+	int i;
+
+	for (; lines; lines--, d += 16)
+		for (i = 0; i < 16; i++)
+			d[i] = 0;
+}
+
+#endif /* __ALTIVEC__ */
+
+void _base_spe_ls_copy(void *dst, const void *src, size_t size)
+{
+	size_t head, body;
+
+	if (size < LS_COPY_MIN) {
+		memcpy(dst, src, size);
+		return;
+	}
+
+	/* bring the destination to a line boundary */
+	head = -(uintptr_t)dst & (LS_LINE - 1);
+	memcpy(dst, src, head);
+	dst += head;
+	src += head;
+	size -= head;
+
+	body = size & ~(size_t)(LS_LINE - 1);
+	copy_lines(dst, src, body / LS_LINE);
+	memcpy(dst + body, src + body, size - body);
+}
+
+void _base_spe_ls_clear(void *dst, size_t size)
+{
+	size_t head, body;
+
+	if (size < LS_COPY_MIN) {
+		memset(dst, 0, size);
+		return;
+	}
+
+	head = -(uintptr_t)dst & (LS_LINE - 1);
+	memset(dst, 0, head);
+	dst += head;
+	size -= head;
+
+	body = size & ~(size_t)(LS_LINE - 1);
+	clear_lines(dst, body / LS_LINE);
+	memset(dst + body, 0, size - body);
+}
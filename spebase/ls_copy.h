@@ -0,0 +1,34 @@
+/*
+ * libspe2 - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ * Copyright (C) 2008 IBM Corp.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#ifndef _ls_copy_h_
+#define _ls_copy_h_
+
+#include <stddef.h>
+
+/*
+ * Copies to and from the mapped local store. Whole 128 byte lines are
+ * moved with aligned VMX loads and stores when the library is built with
+ * AltiVec support, with 64 bit loads and stores otherwise.
+ */
+void _base_spe_ls_copy(void *dst, const void *src, size_t size);
+
+void _base_spe_ls_clear(void *dst, size_t size);
+
+#endif
@@ -346,5 +346,41 @@ int _base_spe_signal_write(spe_context_ptr_t spectx,
 	return rc;
 }
 
+int _base_spe_signal_or(spe_context_ptr_t spectx,
+			unsigned int signal_reg,
+			unsigned int mask)
+{
+	struct spe_context_base_priv *priv = spectx->base_private;
+	enum fd_name fdesc;
+	int rc;
+
+	if (signal_reg == SPE_SIG_NOTIFY_REG_1 &&
+			(priv->flags & SPE_CFG_SIGNOTIFY1_OR))
+		fdesc = FD_SIG1;
+	else if (signal_reg == SPE_SIG_NOTIFY_REG_2 &&
+			(priv->flags & SPE_CFG_SIGNOTIFY2_OR))
+		fdesc = FD_SIG2;
+	else {
+		/* in overwrite mode the bits would not accumulate */
+		errno = EINVAL;
+		return -1;
+	}
 
+	/* neither the mapped register nor the pinned fd need locking */
+	if (priv->flags & SPE_MAP_PS) {
+		if (fdesc == FD_SIG1)
+			((spe_sig_notify_1_area_t *)
+			 priv->signal1_mmap_base)->SPU_Sig_Notify_1 = mask;
+		else
+			((spe_sig_notify_2_area_t *)
+			 priv->signal2_mmap_base)->SPU_Sig_Notify_2 = mask;
+		return 0;
+	}
 
+	if (priv->doorbell & signal_reg) {
+		rc = write(priv->spe_fds_array[fdesc], &mask, 4);
+		return rc == 4 ? 0 : -1;
+	}
+
+	return _base_spe_signal_write(spectx, signal_reg, mask);
+}
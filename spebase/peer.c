@@ -0,0 +1,125 @@
+/*
+ * libspe2 - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ * Copyright (C) 2008 IBM Corp.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <sys/mman.h>
+
+#include "ls_copy.h"
+#include "spebase.h"
+
+/*
+ * SPE-to-SPE communication: every context's local store and signal
+ * notification registers are mapped into our address space, and these
+ * effective addresses are valid DMA targets for the other SPEs. The
+ * functions below hand those addresses to the SPE programs.
+ */
+
+static uint64_t signal_ea(void *area)
+{
+	if (area == MAP_FAILED)
+		return 0;
+
+	/* the register sits at the end of the first quadword */
+	return (uint64_t)(unsigned long)
+		&((spe_sig_notify_1_area_t *)area)->SPU_Sig_Notify_1;
+}
+
+static void peer_entry_fill(spe_context_ptr_t spe, spe_peer_entry_t *entry)
+{
+	struct spe_context_base_priv *priv = spe->base_private;
+
+	entry->ls_ea = (uint64_t)(unsigned long)priv->mem_mmap_base;
+	entry->sig1_ea = signal_ea(priv->signal1_mmap_base);
+	entry->sig2_ea = signal_ea(priv->signal2_mmap_base);
+	entry->reserved = 0;
+}
+
+int _base_spe_peer_table_publish(spe_context_ptr_t *spes, int count,
+		unsigned int ls_addr)
+{
+	spe_peer_table_t *header;
+	spe_peer_entry_t *entries;
+	size_t size;
+	int i;
+
+	if (!spes || count <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	size = sizeof(*header) + count * sizeof(*entries);
+	if (ls_addr & 0xf || ls_addr >= LS_SIZE || size > LS_SIZE - ls_addr) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (!spes[i]) {
+			errno = ESRCH;
+			return -1;
+		}
+	}
+
+	/* the tables only differ in self: build one, and copy it into
+	 * each local store in one go */
+	header = malloc(size);
+	if (!header)
+		return -1;
+	entries = (spe_peer_entry_t *)(header + 1);
+	header->count = count;
+	header->reserved[0] = header->reserved[1] = 0;
+	for (i = 0; i < count; i++)
+		peer_entry_fill(spes[i], &entries[i]);
+
+	for (i = 0; i < count; i++) {
+		header->self = i;
+		_base_spe_ls_copy((char *)spes[i]->base_private->mem_mmap_base
+				  + ls_addr, header, size);
+	}
+	free(header);
+
+	return 0;
+}
+
+int _base_spe_ls_dbuf_desc_init(spe_context_ptr_t consumer,
+		unsigned int ls_addr, unsigned int size,
+		spe_ls_dbuf_desc_t *desc)
+{
+	spe_peer_entry_t entry;
+
+	if (!desc || !size || size > SPE_LS_DBUF_MAX_SIZE || size & 0xf ||
+			ls_addr & 0xf || ls_addr >= LS_SIZE ||
+			2 * size > LS_SIZE - ls_addr) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	peer_entry_fill(consumer, &entry);
+
+	desc->buf_ea[0] = entry.ls_ea + ls_addr;
+	desc->buf_ea[1] = entry.ls_ea + ls_addr + size;
+	desc->signal_ea = entry.sig1_ea;
+	desc->size = size;
+	desc->ls_addr = ls_addr;
+
+	return 0;
+}
@@ -22,6 +22,7 @@
 #include <stdint.h>
 #include <string.h>
 
+#include "ls_copy.h"
 #include "spebase.h"
 #include "regs.h"
 
@@ -90,12 +91,14 @@ int _base_spe_setup_registers(struct spe_context *spe,
 		unsigned int *entry)
 {
 	unsigned int base_addr = LS_SIZE - sizeof(reg_setup_trampoline);
+	uint32_t trampoline[sizeof(reg_setup_trampoline) / sizeof(uint32_t)];
 
-	memcpy(spe->base_private->mem_mmap_base + base_addr,
-			reg_setup_trampoline, sizeof(reg_setup_trampoline));
+	/* fill in the reg_state here, so local store is written once */
+	memcpy(trampoline, reg_setup_trampoline, sizeof(trampoline));
+	memcpy(trampoline, regs, sizeof(*regs));
 
-	memcpy(spe->base_private->mem_mmap_base + base_addr,
-			regs, sizeof(*regs));
+	_base_spe_ls_copy(spe->base_private->mem_mmap_base + base_addr,
+			  trampoline, sizeof(trampoline));
 
 	*entry = base_addr + sizeof(struct spe_reg_state);
 
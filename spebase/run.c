@@ -16,8 +16,8 @@
  * along with this library; if not, write to the Free Software Foundation,
  * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
  */
+#define _GNU_SOURCE 1
 #include <errno.h>
-#define GNU_SOURCE 1
 
 #include <fcntl.h>
 #include <stdio.h>
@@ -33,6 +33,7 @@
 #include <sys/spu.h>
 
 #include "elf_loader.h"
+#include "info.h"
 #include "lib_builtin.h"
 #include "spebase.h"
 #include "regs.h"
@@ -83,6 +84,8 @@ int _base_spe_context_run(spe_context_ptr_t spe, unsigned int *entry,
 	int retval = 0, run_rc;
 	unsigned int run_status, tmp_entry;
 	spe_stop_info_t	stopinfo_buf;
+	cpu_set_t saved_cpus;
+	int placed = 0;
 	struct spe_context_info this_context_info __attribute__((cleanup(cleanupspeinfo)));
 
 	/* If the caller hasn't set a stopinfo buffer, provide a buffer on the
@@ -90,6 +93,16 @@ int _base_spe_context_run(spe_context_ptr_t spe, unsigned int *entry,
 	if (!stopinfo)
 		stopinfo = &stopinfo_buf;
 
+	/* Run the program an spe_program_load_async may still be loading */
+	if (_base_spe_program_load_wait(spe))
+		return -1;
+
+	/* Whatever runs now overwrites a loader left armed in local store */
+	spe->base_private->loader_armed = 0;
+
+	/* Start a program spe_program_load_next staged, from its entry */
+	if (spe->base_private->staged_program && *entry == SPE_DEFAULT_ENTRY)
+		_base_spe_program_staged_switch(spe);
 
 	/* In emulated isolated mode, the npc will always return as zero.
 	 * use our private entry point instead */
@@ -163,6 +176,11 @@ int _base_spe_context_run(spe_context_ptr_t spe, unsigned int *entry,
 	/*remember the ls-addr*/
 	__spe_current_active_context->spe_id = spe->base_private->fd_spe_dir;
 
+	/* run on the SPUs of the requested node */
+	if (spe->base_private->cpu_node != -1)
+		placed = !_base_spe_node_affinity_enter(
+				spe->base_private->cpu_node, &saved_cpus);
+
 do_run:
 	/*Remember the npc value*/
 	__spe_current_active_context->npc = tmp_entry;
@@ -200,10 +218,11 @@ do_run:
 		retval = -1;
 
 		/* For isolated contexts, pass EPERM up to the
-		 * caller.
+		 * caller, and EINTR for a run interrupted by a signal,
+		 * which leaves the context stopped at *entry.
 		 */
 		if (!(spe->base_private->flags & SPE_ISOLATE
-				&& errno == EPERM))
+				&& errno == EPERM) && errno != EINTR)
 			errno = EFAULT;
 
 	} else if (run_rc & SPE_SPU_INVALID_INSTR) {
@@ -285,6 +304,8 @@ do_run:
 			 * and restart
 			 */
 			if (stopcode == SPE_PROGRAM_ISO_LOAD_COMPLETE) {
+				if (spe->base_private->launch_pending)
+					_base_spe_isolated_launch_done(spe);
 				_base_spe_program_load_complete(spe);
 				goto do_run;
 			} else {
@@ -341,6 +362,9 @@ do_run:
 
 	}
 
+	if (placed)
+		_base_spe_node_affinity_leave(&saved_cpus);
+
 	freespeinfo();
 	return retval;
 }
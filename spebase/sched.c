@@ -0,0 +1,390 @@
+/*
+ * libspe2 - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ * Copyright (C) 2008 IBM Corp.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * Userspace SPE job scheduler. Jobs wait in one FIFO per priority and
+ * tenant; a fixed set of workers, no more than the usable SPEs, each run
+ * one pooled context and take the oldest job of the highest priority
+ * from the tenant that has had the least SPE time for its weight.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "spebase.h"
+
+struct sched_entry {
+	spe_job_t *job;
+	struct timespec submitted;
+	struct sched_entry *next;
+};
+
+struct sched_tenant {
+	unsigned int id;
+	unsigned int weight;
+	unsigned int active;		/* jobs queued or running */
+	unsigned long long vtime;	/* SPE time used, over weight */
+	struct sched_entry *head[SPE_SCHED_PRIORITIES];
+	struct sched_entry **tail[SPE_SCHED_PRIORITIES];
+	struct sched_tenant *next;
+};
+
+struct sched_worker {
+	struct spe_scheduler *sched;
+	pthread_t thread;
+	spe_context_ptr_t spe;
+};
+
+struct spe_scheduler {
+	pthread_mutex_t lock;
+	pthread_cond_t work;		/* a job was queued, or stopping */
+	pthread_cond_t done;		/* a job completed */
+	int stopping;
+	unsigned int max_queued;
+	unsigned long long vclock;	/* vtime of the last tenant served */
+	struct sched_tenant *tenants;
+	int nworkers;
+	struct sched_worker *workers;
+	spe_sched_stats_t stats;
+};
+
+/* Called with the scheduler locked. */
+static struct sched_tenant *sched_tenant(struct spe_scheduler *s,
+					 unsigned int id)
+{
+	struct sched_tenant *t;
+	int p;
+
+	for (t = s->tenants; t; t = t->next)
+		if (t->id == id)
+			return t;
+
+	t = calloc(1, sizeof(*t));
+	if (!t)
+		return NULL;
+	t->id = id;
+	t->weight = 1;
+	t->vtime = s->vclock;
+	for (p = 0; p < SPE_SCHED_PRIORITIES; p++)
+		t->tail[p] = &t->head[p];
+	t->next = s->tenants;
+	s->tenants = t;
+	return t;
+}
+
+/* Takes the next job off the queues; called with the scheduler locked
+ * and at least one job queued. */
+static struct sched_entry *sched_pick(struct spe_scheduler *s,
+				      struct sched_tenant **tenant)
+{
+	struct sched_tenant *t, *best;
+	struct sched_entry *e;
+	int p;
+
+	for (p = 0; p < SPE_SCHED_PRIORITIES; p++) {
+		best = NULL;
+		for (t = s->tenants; t; t = t->next)
+			if (t->head[p] && (!best || t->vtime < best->vtime))
+				best = t;
+		if (!best)
+			continue;
+
+		e = best->head[p];
+		best->head[p] = e->next;
+		if (!best->head[p])
+			best->tail[p] = &best->head[p];
+		s->stats.queued--;
+		s->stats.queued_prio[p]--;
+		if (best->vtime > s->vclock)
+			s->vclock = best->vtime;
+		*tenant = best;
+		return e;
+	}
+	return NULL;
+}
+
+static void sched_run_job(struct sched_worker *w, spe_job_t *job)
+{
+	unsigned int entry = SPE_DEFAULT_ENTRY;
+	struct timespec t0;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	/* loaded for every job, even of the same program: a job starts
+	 * with clean data, not with what the last one, possibly of another
+	 * tenant, left in local store */
+	if (_base_spe_program_load(w->spe, job->program)) {
+		job->status = -1;
+		job->error = errno;
+		goto out;
+	}
+
+	job->status = _base_spe_context_run(w->spe, &entry, 0, job->argp,
+					    job->envp, &job->stop_info);
+	job->error = job->status < 0 ? errno : 0;
+out:
+	job->run_ns = _base_spe_elapsed_ns(&t0);
+}
+
+static void *sched_worker(void *arg)
+{
+	struct sched_worker *w = arg;
+	struct spe_scheduler *s = w->sched;
+	struct sched_tenant *t;
+	struct sched_entry *e;
+	spe_job_t *job;
+
+	pthread_mutex_lock(&s->lock);
+	for (;;) {
+		while (!s->stats.queued && !s->stopping)
+			pthread_cond_wait(&s->work, &s->lock);
+		/* the queues are drained before the workers leave */
+		if (!s->stats.queued)
+			break;
+
+		e = sched_pick(s, &t);
+		job = e->job;
+		job->wait_ns = _base_spe_elapsed_ns(&e->submitted);
+		s->stats.running++;
+		s->stats.wait_time_ns += job->wait_ns;
+		if (job->wait_ns > s->stats.wait_time_max_ns)
+			s->stats.wait_time_max_ns = job->wait_ns;
+		pthread_mutex_unlock(&s->lock);
+
+		free(e);
+		sched_run_job(w, job);
+
+		pthread_mutex_lock(&s->lock);
+		t->vtime += job->run_ns / t->weight;
+		t->active--;
+		s->stats.running--;
+		s->stats.completed++;
+		job->done = 1;
+		pthread_cond_broadcast(&s->done);
+	}
+	pthread_mutex_unlock(&s->lock);
+
+	return NULL;
+}
+
+static void sched_free(struct spe_scheduler *s)
+{
+	struct sched_tenant *t;
+	int i;
+
+	for (i = 0; i < s->nworkers; i++)
+		_base_spe_context_destroy(s->workers[i].spe);
+	while ((t = s->tenants) != NULL) {
+		s->tenants = t->next;
+		free(t);
+	}
+	free(s->workers);
+	pthread_cond_destroy(&s->done);
+	pthread_cond_destroy(&s->work);
+	pthread_mutex_destroy(&s->lock);
+	free(s);
+}
+
+spe_scheduler_ptr_t _base_spe_scheduler_create(int nspes,
+					       unsigned int max_queued,
+					       unsigned int flags)
+{
+	struct spe_scheduler *s;
+	int usable, i, rc;
+
+	/* the workers run the contexts themselves */
+	if (flags & (SPE_EVENTS_ENABLE | SPE_ISOLATE | SPE_ISOLATE_EMULATE) ||
+	    nspes < 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/* admission control: never more contexts running than usable SPEs */
+	usable = _base_spe_cpu_info_get(SPE_COUNT_USABLE_SPES, -1);
+	if (usable <= 0) {
+		errno = ENODEV;
+		return NULL;
+	}
+	if (nspes == 0 || nspes > usable)
+		nspes = usable;
+
+	s = calloc(1, sizeof(*s));
+	if (!s)
+		return NULL;
+	s->workers = calloc(nspes, sizeof(*s->workers));
+	if (!s->workers) {
+		free(s);
+		return NULL;
+	}
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->work, NULL);
+	pthread_cond_init(&s->done, NULL);
+	s->max_queued = max_queued;
+	s->stats.spes = nspes;
+
+	for (i = 0; i < nspes; i++) {
+		s->workers[i].sched = s;
+		s->workers[i].spe = _base_spe_context_create(flags, NULL, NULL);
+		if (!s->workers[i].spe)
+			goto fail;
+		s->nworkers++;
+	}
+
+	for (i = 0; i < nspes; i++) {
+		rc = pthread_create(&s->workers[i].thread, NULL, sched_worker,
+				    &s->workers[i]);
+		if (rc) {
+			errno = rc;
+			goto fail_threads;
+		}
+	}
+
+	return s;
+
+fail_threads:
+	pthread_mutex_lock(&s->lock);
+	s->stopping = 1;
+	pthread_cond_broadcast(&s->work);
+	pthread_mutex_unlock(&s->lock);
+	while (i--)
+		pthread_join(s->workers[i].thread, NULL);
+fail:
+	rc = errno;
+	sched_free(s);
+	errno = rc;
+	return NULL;
+}
+
+int _base_spe_scheduler_destroy(spe_scheduler_ptr_t s)
+{
+	int i;
+
+	pthread_mutex_lock(&s->lock);
+	s->stopping = 1;
+	pthread_cond_broadcast(&s->work);
+	pthread_mutex_unlock(&s->lock);
+
+	for (i = 0; i < s->nworkers; i++)
+		pthread_join(s->workers[i].thread, NULL);
+	sched_free(s);
+
+	return 0;
+}
+
+int _base_spe_scheduler_tenant_set(spe_scheduler_ptr_t s,
+				   unsigned int tenant, unsigned int weight)
+{
+	struct sched_tenant *t;
+
+	if (weight == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	pthread_mutex_lock(&s->lock);
+	t = sched_tenant(s, tenant);
+	if (t)
+		t->weight = weight;
+	pthread_mutex_unlock(&s->lock);
+
+	return t ? 0 : -1;
+}
+
+int _base_spe_scheduler_submit(spe_scheduler_ptr_t s, spe_job_t *job)
+{
+	struct sched_tenant *t;
+	struct sched_entry *e;
+	unsigned int p = job->priority;
+
+	if (p >= SPE_SCHED_PRIORITIES || !job->program) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	e = malloc(sizeof(*e));
+	if (!e)
+		return -1;
+	e->job = job;
+	e->next = NULL;
+	job->done = 0;
+	job->status = 0;
+	job->error = 0;
+	job->wait_ns = 0;
+	job->run_ns = 0;
+
+	pthread_mutex_lock(&s->lock);
+	if (s->stopping ||
+	    (s->max_queued && s->stats.queued >= s->max_queued)) {
+		s->stats.rejected++;
+		pthread_mutex_unlock(&s->lock);
+		free(e);
+		errno = EAGAIN;
+		return -1;
+	}
+	t = sched_tenant(s, job->tenant);
+	if (!t) {
+		pthread_mutex_unlock(&s->lock);
+		free(e);
+		return -1;
+	}
+
+	/* a tenant coming back after idling starts level with the others,
+	 * rather than with the credit of its idle time */
+	if (!t->active++ && t->vtime < s->vclock)
+		t->vtime = s->vclock;
+
+	clock_gettime(CLOCK_MONOTONIC, &e->submitted);
+	*t->tail[p] = e;
+	t->tail[p] = &e->next;
+	s->stats.submitted++;
+	s->stats.queued++;
+	s->stats.queued_prio[p]++;
+	if (s->stats.queued > s->stats.queued_max)
+		s->stats.queued_max = s->stats.queued;
+	pthread_cond_signal(&s->work);
+	pthread_mutex_unlock(&s->lock);
+
+	return 0;
+}
+
+int _base_spe_scheduler_wait(spe_scheduler_ptr_t s, spe_job_t *job)
+{
+	pthread_mutex_lock(&s->lock);
+	while (!job->done)
+		pthread_cond_wait(&s->done, &s->lock);
+	pthread_mutex_unlock(&s->lock);
+
+	if (job->status < 0) {
+		errno = job->error;
+		return -1;
+	}
+	return 0;
+}
+
+int _base_spe_scheduler_stats_get(spe_scheduler_ptr_t s,
+				  spe_sched_stats_t *stats)
+{
+	pthread_mutex_lock(&s->lock);
+	*stats = s->stats;
+	pthread_mutex_unlock(&s->lock);
+
+	return 0;
+}
@@ -28,6 +28,7 @@ extern "C"
 #endif
 
 #include <pthread.h>
+#include <time.h>
 
 #include "libspe2-types.h"
 
@@ -106,6 +107,66 @@ struct spe_context_base_priv {
 	 * so we can use the zero tagmask parameter in the status functions*/
 	 
 	 int active_tagmask;
+
+	/* gang this context was created in, NULL if none */
+	spe_gang_context_ptr_t gang;
+
+	/* cpu node the context is placed on, -1 for any */
+	int cpu_node;
+
+	/* signal registers used as doorbells (SPE_SIG_NOTIFY_REG_*) whose
+	 * fds are kept open */
+	unsigned int doorbell;
+
+	/* spufs directory relative to the mount point, and the library
+	 * call statistics published under that name (see callstats.h) */
+	char *spufs_name;
+	struct spe_callstats *callstats;
+
+	/* what the last spe_program_load did, and the overlay table of
+	 * the loaded program (NULL if it has no overlays) */
+	spe_load_stats_t load_stats;
+	spe_overlay_segment_t *overlays;
+
+	/* spe_program_load_async: loads in flight, signalled on load_done
+	 * when they are all finished, the ones waiting for the load before
+	 * them, and the result of a failed one */
+	pthread_mutex_t load_lock;
+	pthread_cond_t load_done;
+	int load_pending;
+	struct load_request *load_queue;
+	struct load_request **load_queue_tail;
+	int load_status;
+	int load_errno;
+
+	/* local store base and end of the loaded program, and the program
+	 * spe_program_load_next staged in the other half of local store,
+	 * which the next run from the default entry switches to */
+	unsigned int ls_base;
+	unsigned int ls_extent;
+	spe_program_handle_t *staged_program;
+	unsigned int staged_base;
+	unsigned int staged_entry;
+	unsigned int staged_extent;
+	spe_load_stats_t staged_stats;
+
+	/* the program last written to object-id, and the image generation
+	 * then; a pooled isolated relaunch of the same program does not
+	 * write it again */
+	spe_program_handle_t *object_id_program;
+	unsigned int object_id_generation;
+	int pool_relaunch;
+
+	/* emulated isolation: the loader is in local store and has not run
+	 * yet; it is entered at loader_entry */
+	int loader_armed;
+	unsigned int loader_entry;
+
+	/* isolated launch from a pool: started at launch_start, and took
+	 * launch_ns until the loader reported the application loaded */
+	int launch_pending;
+	struct timespec launch_start;
+	unsigned long long launch_ns;
 };
 
 struct spe_reg128 {
@@ -131,6 +192,10 @@ struct spe_reg128 {
 
 #define LS_ADDR_MASK			(LS_SIZE - 1)
 
+/* top of local store left to the stack and the arguments when programs
+ * are staged in its halves (see _base_spe_program_load_next) */
+#define SPE_LS_STACK_RESERVE		0x8000
+
 /**
  * Location of the PPE-assisted library call buffer
  * for emulated isolation contexts.
@@ -168,6 +233,12 @@ struct spe_gang_context_base_priv
 /* Function Prototypes
  */
 
+/**
+ * _base_spe_elapsed_ns returns the nanoseconds since t0, a time taken
+ * with clock_gettime(CLOCK_MONOTONIC).
+ */
+extern unsigned long long _base_spe_elapsed_ns(const struct timespec *t0);
+
 /**
  * _base_spe_context_create creates a single SPE context, i.e., the corresponding directory
  * is created in SPUFS either as a subdirectory of a gang or
@@ -216,6 +287,16 @@ void _base_spe_program_load_complete(spe_context_ptr_t spectx);
  */
 int _base_spe_emulated_loader_present(void);
 
+/**
+ * Copies the emulated isolation loader into the local store of a context
+ * ahead of the next program load, which then only has to pass the
+ * application to the loader.
+ *
+ * @param spectx an SPE_ISOLATE_EMULATE context
+ * @return zero on success, -1 with errno set on failure
+ */
+int _base_spe_emulated_loader_arm(spe_context_ptr_t spectx);
+
 /**
  * _base_spe_context_destroy cleans up what is left when an SPE executable has exited. 
  * Closes open file handles and unmaps memory areas.
@@ -299,6 +380,338 @@ extern int _base_spe_image_close(spe_program_handle_t *handle);
  */
 extern spe_program_handle_t *_base_spe_image_open(const char *filename);
 
+/**
+ * _base_spe_program_load_now loads a program into a context without
+ * waiting for asynchronous loads; the loader threads use it.
+ */
+extern int _base_spe_program_load_now(spe_context_ptr_t spe,
+				      spe_program_handle_t *program);
+
+/**
+ * _base_spe_program_load_async queues a program load, which one of the
+ * library's loader threads then performs. Running the context, loading
+ * another program into it or destroying it waits for the load to finish.
+ *
+ * @param spe the context
+ * @param program the program to load
+ * @param completion if not NULL, its func is called from the loader
+ * thread with the result of the load; it must stay valid until then and
+ * must not wait for loads on the same context
+ * @retval 0 the load was queued
+ * @retval -1 it was not; errno is set (ENOMEM, EAGAIN)
+ */
+extern int _base_spe_program_load_async(spe_context_ptr_t spe,
+					spe_program_handle_t *program,
+					spe_load_completion_t *completion);
+
+/**
+ * _base_spe_program_load_wait waits for the asynchronous loads queued for
+ * a context.
+ *
+ * @param spe the context
+ * @retval 0 all of them succeeded, or none was queued
+ * @retval -1 one failed; errno is set as _base_spe_program_load would
+ * have set it. The failure is only reported once.
+ */
+extern int _base_spe_program_load_wait(spe_context_ptr_t spe);
+
+/**
+ * _base_spe_program_load_next loads a program into the half of local
+ * store the loaded program does not use, while that one may be running.
+ * The next _base_spe_context_run from SPE_DEFAULT_ENTRY starts it instead
+ * of the loaded program; the halves are used in turn.
+ *
+ * The program must have been linked with --emit-relocs, so that it can
+ * be moved from address 0, must not have overlays, and must fit in half
+ * of local store, less SPE_LS_STACK_RESERVE at the top for the stack and
+ * arguments. The running program must not use the other half, its heap
+ * included.
+ *
+ * @param spe the context
+ * @param program the program to stage
+ * @retval 0 on success
+ * @retval -1 on failure, with errno set: ENOEXEC the program cannot be
+ * moved, ENOSPC it or the loaded program is too large, EINVAL the
+ * context is isolated or the image is invalid, or the error of an
+ * asynchronous load still in flight, which is waited for first
+ */
+extern int _base_spe_program_load_next(spe_context_ptr_t spe,
+				       spe_program_handle_t *program);
+
+/**
+ * _base_spe_program_staged_switch makes the program staged by
+ * _base_spe_program_load_next the loaded program of a context.
+ */
+extern void _base_spe_program_staged_switch(spe_context_ptr_t spe);
+
+/**
+ * _base_spe_program_load_stats_get returns what the last _base_spe_program_load
+ * of a context copied to local store, and how long it took.
+ *
+ * @param spe the context
+ * @param stats[out] the statistics
+ * @retval 0 on success, -1 with errno set (EINVAL) if nothing was loaded
+ */
+extern int _base_spe_program_load_stats_get(spe_context_ptr_t spe,
+					     spe_load_stats_t *stats);
+
+/**
+ * _base_spe_program_overlays_get copies the overlay table of the program
+ * loaded into a context. Overlay segments that were not loaded are brought
+ * in by the SPE overlay manager from image_ea.
+ *
+ * @param spe the context
+ * @param overlays[out] room for max entries
+ * @param max number of entries in overlays
+ * @return the number of overlay segments of the program, which may be more
+ * than max, or -1 with errno set (EINVAL) if nothing was loaded
+ */
+extern int _base_spe_program_overlays_get(spe_context_ptr_t spe,
+					  spe_overlay_segment_t *overlays,
+					  int max);
+
+/**
+ * _base_spe_context_checkpoint saves the state of a context that is not
+ * running: local store, registers, FPCR, npc, decrementer, SRR0, pending
+ * signal notifications and the unread entries of the PPE to SPE mailbox.
+ * The SPU event mask is not saved, as spufs cannot write it back. A job can be preempted by signalling the thread in
+ * _base_spe_context_run, which then fails with EINTR, and checkpointed.
+ *
+ * The SPE to PPE mailboxes must have been read first. The MFC command
+ * queues are not saved; the job should not be stopped with DMA in flight
+ * it has not waited for.
+ *
+ * @param spe the context
+ * @param ckpt[out] the checkpoint, to be freed by _base_spe_checkpoint_free
+ * @param flags SPE_CHECKPOINT_COMPRESS to leave out all-zero lines of
+ * local store
+ * @retval 0 on success
+ * @retval -1 on failure, with errno set: EBUSY an SPE to PPE mailbox holds
+ * data, EINVAL the context is isolated or flags are invalid, ENOMEM, EIO
+ */
+extern int _base_spe_context_checkpoint(spe_context_ptr_t spe,
+					spe_checkpoint_t *ckpt,
+					unsigned int flags);
+
+/**
+ * _base_spe_context_restore writes a checkpoint back into a context that
+ * is not running, which need not be the one it was taken from. The
+ * program of the checkpoint replaces the one loaded into the context;
+ * running from the returned entry resumes it.
+ *
+ * @param spe the context
+ * @param ckpt the checkpoint
+ * @param entry[out] the npc to pass to _base_spe_context_run
+ * @retval 0 on success
+ * @retval -1 on failure, with errno set: EINVAL the checkpoint is invalid
+ * or the context isolated, EBUSY the PPE to SPE mailbox has no room for
+ * the saved entries (the context is then left as it was), EIO the state
+ * could not be written; the context is then partly restored and must
+ * have a program loaded before it is run again
+ */
+extern int _base_spe_context_restore(spe_context_ptr_t spe,
+				     spe_checkpoint_t *ckpt,
+				     unsigned int *entry);
+
+/**
+ * _base_spe_checkpoint_free frees the buffer of a checkpoint.
+ */
+extern void _base_spe_checkpoint_free(spe_checkpoint_t *ckpt);
+
+/**
+ * _base_spe_scheduler_create starts a job scheduler: one worker thread
+ * per SPE it may use, each running the jobs it is given on a context of
+ * its own. The program of a job is loaded for every job, so that no
+ * job sees what the one before it left in local store.
+ *
+ * @param nspes the number of SPEs to use, 0 for all usable SPEs; it is
+ * never more than the usable SPEs, so that the SPEs are not
+ * oversubscribed
+ * @param max_queued the number of jobs that may wait, 0 for no limit
+ * @param flags the flags the contexts are created with; SPE_EVENTS_ENABLE
+ * and the isolation flags are not allowed
+ * @return the scheduler, or NULL with errno set (EINVAL, ENODEV no usable
+ * SPE, or as for _base_spe_context_create)
+ */
+extern spe_scheduler_ptr_t _base_spe_scheduler_create(int nspes,
+						      unsigned int max_queued,
+						      unsigned int flags);
+
+/**
+ * _base_spe_scheduler_destroy runs the jobs still queued, then stops the
+ * workers and destroys their contexts.
+ */
+extern int _base_spe_scheduler_destroy(spe_scheduler_ptr_t sched);
+
+/**
+ * _base_spe_scheduler_tenant_set sets the weight of a tenant (1 for a
+ * tenant not set). Among the jobs of one priority, the next one is taken
+ * from the tenant with the least SPE run time for its weight.
+ *
+ * @retval 0 on success, -1 with errno set (EINVAL weight is 0, ENOMEM)
+ */
+extern int _base_spe_scheduler_tenant_set(spe_scheduler_ptr_t sched,
+					  unsigned int tenant,
+					  unsigned int weight);
+
+/**
+ * _base_spe_scheduler_submit queues a job. The job must stay valid until
+ * _base_spe_scheduler_wait has returned for it.
+ *
+ * @retval 0 on success
+ * @retval -1 on failure, with errno set: EAGAIN max_queued jobs are
+ * waiting or the scheduler is being destroyed, EINVAL invalid priority or
+ * no program, ENOMEM
+ */
+extern int _base_spe_scheduler_submit(spe_scheduler_ptr_t sched,
+				      spe_job_t *job);
+
+/**
+ * _base_spe_scheduler_wait waits for a submitted job to complete.
+ *
+ * @retval 0 the job ran; its stop information says how it ended
+ * @retval -1 it could not be loaded or run, errno is set from the failure
+ */
+extern int _base_spe_scheduler_wait(spe_scheduler_ptr_t sched,
+				    spe_job_t *job);
+
+/**
+ * _base_spe_scheduler_stats_get returns the queue depth and wait time
+ * statistics of a scheduler.
+ */
+extern int _base_spe_scheduler_stats_get(spe_scheduler_ptr_t sched,
+					 spe_sched_stats_t *stats);
+
+/**
+ * _base_spe_task_graph_create returns an empty task graph, or NULL with
+ * errno set (ENOMEM).
+ */
+extern spe_task_graph_ptr_t _base_spe_task_graph_create(void);
+
+/**
+ * _base_spe_task_graph_destroy destroys a task graph that is not running,
+ * with its contexts and the buffers allocated for it.
+ */
+extern int _base_spe_task_graph_destroy(spe_task_graph_ptr_t graph);
+
+/**
+ * _base_spe_task_graph_add adds a kernel to a task graph.
+ *
+ * @return the task number, or -1 with errno set (EINVAL no program or
+ * invalid input, EBUSY the graph is running, ENOMEM)
+ */
+extern int _base_spe_task_graph_add(spe_task_graph_ptr_t graph,
+				    const spe_task_t *task);
+
+/**
+ * _base_spe_task_graph_depend makes a task wait for another one to
+ * complete, typically because it reads what the other one wrote to a
+ * buffer.
+ *
+ * @retval 0 on success, -1 with errno set (EINVAL, EBUSY, ENOMEM)
+ */
+extern int _base_spe_task_graph_depend(spe_task_graph_ptr_t graph,
+				       int task, int after);
+
+/**
+ * _base_spe_task_graph_buffer_alloc allocates a line aligned buffer, freed
+ * with the graph, to pass data from one task to the next through
+ * effective addresses.
+ */
+extern void *_base_spe_task_graph_buffer_alloc(spe_task_graph_ptr_t graph,
+					       unsigned int size);
+
+/**
+ * _base_spe_task_graph_run runs every task of a graph once its
+ * predecessors have completed, and returns when all have. The calling
+ * thread is one of the workers. A graph may be run again.
+ *
+ * @param graph the task graph
+ * @param nspes the number of contexts to run on, 0 for all usable SPEs;
+ * never more than the usable SPEs. The contexts are created by the first
+ * run and kept for the next ones.
+ * @param stats[out] the statistics of the run, or NULL
+ * @retval 0 all tasks ran
+ * @retval -1 with errno set: EDEADLK the dependencies have a cycle, EBUSY
+ * the graph is running, ENODEV no usable SPE, or the error of the first
+ * task that could not be loaded or run; the tasks after it are not run
+ */
+extern int _base_spe_task_graph_run(spe_task_graph_ptr_t graph, int nspes,
+				    spe_task_graph_stats_t *stats);
+
+/**
+ * _base_spe_task_graph_task_get returns a task of a graph with the
+ * results and timings of the last run.
+ */
+extern int _base_spe_task_graph_task_get(spe_task_graph_ptr_t graph, int task,
+					 spe_task_t *result);
+
+/**
+ * _base_spe_isolated_pool_create returns a pool of isolated contexts.
+ * For SPE_ISOLATE_EMULATE the loader is put in local store of each
+ * context ahead of its launches.
+ *
+ * @param flags the context flags; SPE_ISOLATE or SPE_ISOLATE_EMULATE
+ * @param ncontexts the contexts to create now; more are created when a
+ * launch finds none idle
+ * @return the pool, or NULL with errno set (EINVAL, or the error of the
+ * context creation)
+ */
+extern spe_isolated_pool_ptr_t _base_spe_isolated_pool_create(unsigned int flags,
+							      int ncontexts);
+
+/**
+ * _base_spe_isolated_pool_destroy destroys a pool and its contexts.
+ *
+ * @retval 0 on success, -1 with errno EBUSY when a context is not back
+ */
+extern int _base_spe_isolated_pool_destroy(spe_isolated_pool_ptr_t pool);
+
+/**
+ * _base_spe_isolated_pool_get takes an idle context of a pool and loads
+ * a secure application into it, ready for spe_context_run. The launch
+ * is timed until the loader reports the application loaded.
+ *
+ * @return the context, or NULL with errno set
+ */
+extern spe_context_ptr_t _base_spe_isolated_pool_get(spe_isolated_pool_ptr_t pool,
+						     spe_program_handle_t *program);
+
+/**
+ * _base_spe_isolated_pool_put gives a context back to its pool once its
+ * application has run, and makes it ready for the next launch.
+ */
+extern int _base_spe_isolated_pool_put(spe_isolated_pool_ptr_t pool,
+				       spe_context_ptr_t spe);
+
+/**
+ * _base_spe_isolated_pool_stats_get returns the launch time statistics
+ * of a pool.
+ */
+extern int _base_spe_isolated_pool_stats_get(spe_isolated_pool_ptr_t pool,
+					     spe_isolated_pool_stats_t *stats);
+
+/**
+ * _base_spe_isolated_launch_done ends the timing of a pooled launch; run
+ * calls it when the loader stops with SPE_PROGRAM_ISO_LOAD_COMPLETE.
+ */
+extern void _base_spe_isolated_launch_done(spe_context_ptr_t spe);
+
+/**
+ * _base_spe_image_preload verifies and indexes a set of program handles,
+ * embedded ones or ones returned by spe_image_open, using all online CPUs.
+ * Loading a preloaded handle does not look at its section headers again.
+ * Handles that are not preloaded are indexed the first time they are used.
+ *
+ * @param handles the program handles
+ * @param count number of handles
+ *
+ * @retval 0 all images are valid SPE programs
+ * @retval -1 at least one image is not; errno is set from the first failure
+ * found (EINVAL for an invalid image, ENOMEM)
+ */
+extern int _base_spe_image_preload(spe_program_handle_t **handles, int count);
+
 /**
  * The _base_spe_mfcio_put function places a put DMA command on the proxy command queue 
  * of the SPE thread specified by speid. The put command transfers size bytes of 
@@ -567,6 +980,29 @@ int _base_spe_signal_write(spe_context_ptr_t spectx,
                         unsigned int signal_reg, 
                         unsigned int data );
 
+/**
+ * The _base_spe_signal_or function sets bits in a signal notification
+ * register that is configured in OR mode. Concurrent callers don't
+ * serialize against each other, and all bits set before the SPE reads
+ * the register are delivered by that single read.
+ *
+ * @param spectx Specifies the SPE context
+ * @param signal_reg Specifies the signal notification register
+ * @param mask The bits to set
+ * @return On success, 0 is returned. If the register is not in OR mode,
+ * -1 is returned and errno is set to EINVAL.
+ */
+int _base_spe_signal_or(spe_context_ptr_t spectx, unsigned int signal_reg, unsigned int mask);
+
+/**
+ * _base_spe_signal_doorbell_enable switches a signal notification
+ * register of a context to OR mode and prepares it for _base_spe_signal_or
+ *
+ * @param spectx Specifies the SPE context
+ * @param signal_reg Specifies the signal notification register
+ */
+int _base_spe_signal_doorbell_enable(spe_context_ptr_t spectx, unsigned int signal_reg);
+
 /**
  * register a handler function for the specified number
  * NOTE: registering a handler to call zero and one is ignored.
@@ -679,6 +1115,36 @@ void* _base_spe_ls_area_get(struct spe_context *spectx);
  */
 int _base_spe_ls_size_get(spe_context_ptr_t spe);
 
+/**
+ * _base_spe_context_phys_id_get returns the number of the physical SPU
+ * the context is currently loaded on
+ *
+ * @param spectx Specifies the SPE context
+ */
+int _base_spe_context_phys_id_get(spe_context_ptr_t spectx);
+
+/**
+ * _base_spe_peer_table_publish writes the local store and signal
+ * notification effective addresses of a set of contexts into the local
+ * store of each of them
+ *
+ * @param spectxs Specifies the SPE contexts
+ * @param count Specifies the number of contexts
+ * @param ls_addr Specifies the local store address of the table
+ */
+int _base_spe_peer_table_publish(spe_context_ptr_t *spectxs, int count, unsigned int ls_addr);
+
+/**
+ * _base_spe_ls_dbuf_desc_init describes a double buffer in the local
+ * store of a consumer context for use by a producer SPE
+ *
+ * @param consumer Specifies the SPE context owning the buffers
+ * @param ls_addr Specifies the local store address of the first buffer
+ * @param size Specifies the size of each buffer
+ * @param desc Returns the descriptor
+ */
+int _base_spe_ls_dbuf_desc_init(spe_context_ptr_t consumer, unsigned int ls_addr, unsigned int size, spe_ls_dbuf_desc_t *desc);
+
 /**
  * _base_spe_context_lock locks members of the SPE context
  *
@@ -696,10 +1162,51 @@ void _base_spe_context_lock(spe_context_ptr_t spe, enum fd_name fd);
 void _base_spe_context_unlock(spe_context_ptr_t spe, enum fd_name fd);
 
 /**
- * _base_spe_info_get
+ * _base_spe_info_get answers from a snapshot of the SPE topology taken
+ * the first time it is called (see _base_spe_cpu_info_refresh).
  */
 int _base_spe_cpu_info_get(int info_requested, int cpu_node);
 
+/**
+ * _base_spe_cpu_info_refresh reads the SPE topology from sysfs again, and
+ * the SPEs reserved in the SPE_RESERVED_SPES environment variable (a list
+ * of SPE ids such as "0,3").
+ *
+ * @retval 0 on success, -1 with errno set (EINVAL no SPU in sysfs, ENOMEM)
+ */
+int _base_spe_cpu_info_refresh(void);
+
+/**
+ * _base_spe_cpu_topology_get copies the SPEs of the topology snapshot,
+ * ordered by cpu node, then by id.
+ *
+ * @param spes[out] room for max entries
+ * @param max number of entries in spes
+ * @return the number of SPEs, which may be more than max, or -1 with errno
+ * set
+ */
+int _base_spe_cpu_topology_get(spe_topology_entry_t *spes, int max);
+
+/**
+ * _base_spe_context_node_set places an SPE context on a cpu node. The
+ * placement takes effect the next time the context is run.
+ *
+ * @param spectx Specifies the SPE context
+ * @param cpu_node Specifies the cpu node, -1 removes the placement
+ */
+int _base_spe_context_node_set(spe_context_ptr_t spectx, int cpu_node);
+
+/**
+ * _base_spe_ea_bind binds the memory backing an effective address range
+ * to a cpu node, so that DMA between the SPEs of that node and the
+ * buffer stays local.
+ *
+ * @param ea Specifies the start of the buffer
+ * @param size Specifies the size of the buffer in bytes
+ * @param cpu_node Specifies the cpu node
+ */
+int _base_spe_ea_bind(void *ea, size_t size, int cpu_node);
+
 /**
  * __spe_context_update_event internal function for gdb notification.
  * 
@@ -0,0 +1,561 @@
+/*
+ * libspe2 - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ * Copyright (C) 2008 IBM Corp.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License,
+ * or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public
+ * License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library; if not, write to the Free Software Foundation,
+ * Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * Task graphs of SPE kernels. Each worker thread owns a context and a
+ * deque of ready tasks: it runs the newest task of its own deque, and
+ * when that is empty, steals the oldest one of another worker. A task
+ * that completes makes its successors ready on the worker that ran it.
+ * The input of a task is copied into the mapped local store before the
+ * kernel is started: the context is stopped then, and proxy DMA would
+ * wait for it to run.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ls_copy.h"
+#include "spebase.h"
+
+struct tg_node {
+	spe_task_t task;
+	int *succ;
+	int nsucc;
+	int succ_max;
+	int npred;
+	int pending;		/* predecessors left during a run */
+	int cancelled;		/* a predecessor failed */
+	unsigned long long path_ns;
+	int path_prev;
+};
+
+struct tg_deque {
+	pthread_mutex_t lock;
+	int *items;		/* oldest at top, newest below bottom */
+	int top;
+	int bottom;
+};
+
+struct tg_worker {
+	struct spe_task_graph *graph;
+	int index;
+	pthread_t thread;
+	spe_context_ptr_t spe;
+	struct tg_deque deque;
+	unsigned int steals;
+	unsigned long long busy_ns;
+};
+
+struct spe_task_graph {
+	struct tg_node *nodes;
+	int ntasks;
+	int max_tasks;
+	void **buffers;
+	int nbuffers;
+	struct tg_worker *workers;
+	int nworkers;
+
+	/* state of a run */
+	int running;
+	int *order;
+	struct timespec t0;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;	/* a task became ready, or all are done */
+	int ready;
+	int remaining;
+	int error;
+};
+
+static void deque_push(struct tg_deque *dq, int id)
+{
+	pthread_mutex_lock(&dq->lock);
+	dq->items[dq->bottom++] = id;
+	pthread_mutex_unlock(&dq->lock);
+}
+
+/* the owner takes the newest task, which most likely uses what its
+ * predecessor just produced */
+static int deque_pop(struct tg_deque *dq)
+{
+	int id = -1;
+
+	pthread_mutex_lock(&dq->lock);
+	if (dq->bottom > dq->top)
+		id = dq->items[--dq->bottom];
+	pthread_mutex_unlock(&dq->lock);
+	return id;
+}
+
+static int deque_steal(struct tg_deque *dq)
+{
+	int id = -1;
+
+	pthread_mutex_lock(&dq->lock);
+	if (dq->bottom > dq->top)
+		id = dq->items[dq->top++];
+	pthread_mutex_unlock(&dq->lock);
+	return id;
+}
+
+static void tg_make_ready(struct tg_worker *w, int id)
+{
+	struct spe_task_graph *g = w->graph;
+
+	deque_push(&w->deque, id);
+	__sync_fetch_and_add(&g->ready, 1);
+	pthread_mutex_lock(&g->lock);
+	pthread_cond_broadcast(&g->cond);
+	pthread_mutex_unlock(&g->lock);
+}
+
+static int tg_next(struct tg_worker *w)
+{
+	struct spe_task_graph *g = w->graph;
+	int i, id;
+
+	id = deque_pop(&w->deque);
+	for (i = 1; id < 0 && i < g->nworkers; i++) {
+		id = deque_steal(&g->workers[(w->index + i) % g->nworkers].deque);
+		if (id >= 0)
+			w->steals++;
+	}
+	if (id >= 0)
+		__sync_fetch_and_sub(&g->ready, 1);
+	return id;
+}
+
+static void tg_prefetch(struct tg_worker *w, spe_task_t *task)
+{
+	_base_spe_ls_copy((char *)w->spe->base_private->mem_mmap_base +
+			  task->in_ls, task->in_ea, task->in_size);
+}
+
+static void tg_run_task(struct tg_worker *w, spe_task_t *task)
+{
+	struct spe_task_graph *g = w->graph;
+	unsigned int entry = SPE_DEFAULT_ENTRY;
+	struct timespec t0;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	task->worker = w->index;
+	task->start_ns = _base_spe_elapsed_ns(&g->t0);
+
+	/* loaded for every task, so that a kernel starts with clean data
+	 * and bss, not with what the last task left */
+	if (_base_spe_program_load(w->spe, task->program))
+		goto fail;
+
+	if (task->in_size)
+		tg_prefetch(w, task);
+	task->prefetch_ns = _base_spe_elapsed_ns(&t0);
+
+	task->status = _base_spe_context_run(w->spe, &entry, 0, task->argp,
+					     task->envp, &task->stop_info);
+	task->error = task->status < 0 ? errno : 0;
+	goto out;
+
+fail:
+	task->status = -1;
+	task->error = errno;
+out:
+	task->end_ns = _base_spe_elapsed_ns(&g->t0);
+	task->run_ns = _base_spe_elapsed_ns(&t0) - task->prefetch_ns;
+	w->busy_ns += task->end_ns - task->start_ns;
+}
+
+static void tg_complete(struct tg_worker *w, int id)
+{
+	struct spe_task_graph *g = w->graph;
+	struct tg_node *node = &g->nodes[id], *s;
+	int failed = node->task.status < 0;
+	int i;
+
+	if (failed)
+		__sync_bool_compare_and_swap(&g->error, 0, node->task.error);
+
+	for (i = 0; i < node->nsucc; i++) {
+		s = &g->nodes[node->succ[i]];
+		if (failed)
+			s->cancelled = 1;
+		if (__sync_sub_and_fetch(&s->pending, 1))
+			continue;
+		if (s->cancelled) {
+			s->task.status = -1;
+			s->task.error = ECANCELED;
+			tg_complete(w, node->succ[i]);
+		} else
+			tg_make_ready(w, node->succ[i]);
+	}
+
+	if (__sync_sub_and_fetch(&g->remaining, 1) == 0) {
+		pthread_mutex_lock(&g->lock);
+		pthread_cond_broadcast(&g->cond);
+		pthread_mutex_unlock(&g->lock);
+	}
+}
+
+static void *tg_worker(void *arg)
+{
+	struct tg_worker *w = arg;
+	struct spe_task_graph *g = w->graph;
+	int id;
+
+	for (;;) {
+		id = tg_next(w);
+		if (id >= 0) {
+			tg_run_task(w, &g->nodes[id].task);
+			tg_complete(w, id);
+			continue;
+		}
+
+		pthread_mutex_lock(&g->lock);
+		while (!g->ready && g->remaining)
+			pthread_cond_wait(&g->cond, &g->lock);
+		pthread_mutex_unlock(&g->lock);
+		if (!g->remaining)
+			break;
+	}
+	return NULL;
+}
+
+/* Orders the tasks so that each comes after its predecessors. Returns -1
+ * if the dependencies have a cycle. */
+static int tg_sort(struct spe_task_graph *g)
+{
+	struct tg_node *node;
+	int head = 0, tail = 0, i, j;
+
+	for (i = 0; i < g->ntasks; i++) {
+		g->nodes[i].pending = g->nodes[i].npred;
+		if (!g->nodes[i].npred)
+			g->order[tail++] = i;
+	}
+	for (; head < tail; head++) {
+		node = &g->nodes[g->order[head]];
+		for (j = 0; j < node->nsucc; j++)
+			if (--g->nodes[node->succ[j]].pending == 0)
+				g->order[tail++] = node->succ[j];
+	}
+	return tail == g->ntasks ? 0 : -1;
+}
+
+static void tg_critical_path(struct spe_task_graph *g,
+			     spe_task_graph_stats_t *stats)
+{
+	struct tg_node *node, *s;
+	int i, j, last = -1;
+
+	for (i = 0; i < g->ntasks; i++) {
+		g->nodes[i].path_ns = 0;
+		g->nodes[i].path_prev = -1;
+		g->nodes[i].task.critical = 0;
+	}
+
+	/* longest chain of task times ending at each task */
+	for (i = 0; i < g->ntasks; i++) {
+		node = &g->nodes[g->order[i]];
+		node->path_ns += node->task.end_ns - node->task.start_ns;
+		if (last < 0 || node->path_ns > g->nodes[last].path_ns)
+			last = g->order[i];
+		for (j = 0; j < node->nsucc; j++) {
+			s = &g->nodes[node->succ[j]];
+			if (s->path_prev < 0 || node->path_ns > s->path_ns) {
+				s->path_ns = node->path_ns;
+				s->path_prev = g->order[i];
+			}
+		}
+	}
+
+	stats->critical_path_ns = last < 0 ? 0 : g->nodes[last].path_ns;
+	stats->critical_path_tasks = 0;
+	for (; last >= 0; last = g->nodes[last].path_prev) {
+		g->nodes[last].task.critical = 1;
+		stats->critical_path_tasks++;
+	}
+}
+
+spe_task_graph_ptr_t _base_spe_task_graph_create(void)
+{
+	struct spe_task_graph *g;
+
+	g = calloc(1, sizeof(*g));
+	if (!g)
+		return NULL;
+	pthread_mutex_init(&g->lock, NULL);
+	pthread_cond_init(&g->cond, NULL);
+	return g;
+}
+
+int _base_spe_task_graph_destroy(spe_task_graph_ptr_t g)
+{
+	int i;
+
+	if (g->running) {
+		errno = EBUSY;
+		return -1;
+	}
+
+	for (i = 0; i < g->nworkers; i++) {
+		_base_spe_context_destroy(g->workers[i].spe);
+		pthread_mutex_destroy(&g->workers[i].deque.lock);
+		free(g->workers[i].deque.items);
+	}
+	free(g->workers);
+	for (i = 0; i < g->ntasks; i++)
+		free(g->nodes[i].succ);
+	free(g->nodes);
+	for (i = 0; i < g->nbuffers; i++)
+		free(g->buffers[i]);
+	free(g->buffers);
+	pthread_cond_destroy(&g->cond);
+	pthread_mutex_destroy(&g->lock);
+	free(g);
+
+	return 0;
+}
+
+int _base_spe_task_graph_add(spe_task_graph_ptr_t g, const spe_task_t *task)
+{
+	struct tg_node *nodes;
+	int max;
+
+	/* the input is copied in whole quadwords */
+	if (!task->program || (task->in_size &&
+	    (((unsigned long)task->in_ea | task->in_ls | task->in_size) & 15 ||
+	     task->in_ls >= LS_SIZE || task->in_size > LS_SIZE - task->in_ls))) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (g->running) {
+		errno = EBUSY;
+		return -1;
+	}
+
+	if (g->ntasks == g->max_tasks) {
+		max = g->max_tasks ? 2 * g->max_tasks : 16;
+		nodes = realloc(g->nodes, max * sizeof(*nodes));
+		if (!nodes)
+			return -1;
+		g->nodes = nodes;
+		g->max_tasks = max;
+	}
+
+	memset(&g->nodes[g->ntasks], 0, sizeof(*nodes));
+	g->nodes[g->ntasks].task = *task;
+	return g->ntasks++;
+}
+
+int _base_spe_task_graph_depend(spe_task_graph_ptr_t g, int task, int after)
+{
+	struct tg_node *node;
+	int *succ, max;
+
+	if (task < 0 || task >= g->ntasks || after < 0 ||
+	    after >= g->ntasks || task == after) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (g->running) {
+		errno = EBUSY;
+		return -1;
+	}
+
+	node = &g->nodes[after];
+	if (node->nsucc == node->succ_max) {
+		max = node->succ_max ? 2 * node->succ_max : 4;
+		succ = realloc(node->succ, max * sizeof(*succ));
+		if (!succ)
+			return -1;
+		node->succ = succ;
+		node->succ_max = max;
+	}
+	node->succ[node->nsucc++] = task;
+	g->nodes[task].npred++;
+
+	return 0;
+}
+
+void *_base_spe_task_graph_buffer_alloc(spe_task_graph_ptr_t g,
+					unsigned int size)
+{
+	void **buffers, *buf;
+
+	buffers = realloc(g->buffers, (g->nbuffers + 1) * sizeof(*buffers));
+	if (!buffers)
+		return NULL;
+	g->buffers = buffers;
+
+	/* line aligned, for the MFC */
+	if (posix_memalign(&buf, 128, size ? size : 1)) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	g->buffers[g->nbuffers++] = buf;
+	return buf;
+}
+
+/* Creates the workers and their contexts on the first run. */
+static int tg_workers_create(struct spe_task_graph *g, int nspes)
+{
+	struct tg_worker *w;
+	int usable, i;
+
+	usable = _base_spe_cpu_info_get(SPE_COUNT_USABLE_SPES, -1);
+	if (usable <= 0) {
+		errno = ENODEV;
+		return -1;
+	}
+	if (nspes == 0 || nspes > usable)
+		nspes = usable;
+
+	g->workers = calloc(nspes, sizeof(*g->workers));
+	if (!g->workers)
+		return -1;
+	for (i = 0; i < nspes; i++) {
+		w = &g->workers[i];
+		w->graph = g;
+		w->index = i;
+		pthread_mutex_init(&w->deque.lock, NULL);
+		w->spe = _base_spe_context_create(0, NULL, NULL);
+		if (!w->spe) {
+			pthread_mutex_destroy(&w->deque.lock);
+			break;
+		}
+		g->nworkers++;
+	}
+	if (!g->nworkers) {
+		free(g->workers);
+		g->workers = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+int _base_spe_task_graph_run(spe_task_graph_ptr_t g, int nspes,
+			     spe_task_graph_stats_t *stats)
+{
+	struct tg_worker *w;
+	spe_task_graph_stats_t st;
+	int i, n, rc;
+
+	if (nspes < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (g->running) {
+		errno = EBUSY;
+		return -1;
+	}
+	if (!g->workers && tg_workers_create(g, nspes))
+		return -1;
+
+	g->order = malloc((g->ntasks + 1) * sizeof(int));
+	if (!g->order)
+		return -1;
+	if (tg_sort(g)) {
+		free(g->order);
+		g->order = NULL;
+		errno = EDEADLK;
+		return -1;
+	}
+
+	for (i = 0; i < g->nworkers; i++) {
+		w = &g->workers[i];
+		free(w->deque.items);
+		w->deque.items = malloc((g->ntasks + 1) * sizeof(int));
+		if (!w->deque.items) {
+			free(g->order);
+			g->order = NULL;
+			return -1;
+		}
+		w->deque.top = w->deque.bottom = 0;
+		w->steals = 0;
+		w->busy_ns = 0;
+	}
+
+	g->running = 1;
+	g->error = 0;
+	g->ready = 0;
+	g->remaining = g->ntasks;
+	for (i = 0, n = 0; i < g->ntasks; i++) {
+		g->nodes[i].pending = g->nodes[i].npred;
+		g->nodes[i].cancelled = 0;
+		g->nodes[i].task.status = 0;
+		g->nodes[i].task.error = 0;
+		g->nodes[i].task.worker = -1;
+		g->nodes[i].task.start_ns = 0;
+		g->nodes[i].task.end_ns = 0;
+		g->nodes[i].task.prefetch_ns = 0;
+		g->nodes[i].task.run_ns = 0;
+		if (!g->nodes[i].npred) {
+			deque_push(&g->workers[n++ % g->nworkers].deque, i);
+			g->ready++;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &g->t0);
+	for (n = 1; n < g->nworkers; n++) {
+		rc = pthread_create(&g->workers[n].thread, NULL, tg_worker,
+				    &g->workers[n]);
+		if (rc)
+			break;
+	}
+	/* the calling thread is the first worker; workers that could not
+	 * be started leave their tasks to be stolen */
+	tg_worker(&g->workers[0]);
+	for (i = 1; i < n; i++)
+		pthread_join(g->workers[i].thread, NULL);
+
+	memset(&st, 0, sizeof(st));
+	st.spes = g->nworkers;
+	st.elapsed_ns = _base_spe_elapsed_ns(&g->t0);
+	for (i = 0; i < g->nworkers; i++) {
+		st.steals += g->workers[i].steals;
+		st.busy_ns += g->workers[i].busy_ns;
+	}
+	for (i = 0; i < g->ntasks; i++)
+		if (g->nodes[i].task.worker >= 0)
+			st.tasks_run++;
+	tg_critical_path(g, &st);
+	if (stats)
+		*stats = st;
+
+	free(g->order);
+	g->order = NULL;
+	g->running = 0;
+
+	if (g->error) {
+		errno = g->error;
+		return -1;
+	}
+	return 0;
+}
+
+int _base_spe_task_graph_task_get(spe_task_graph_ptr_t g, int id,
+				  spe_task_t *task)
+{
+	if (id < 0 || id >= g->ntasks) {
+		errno = EINVAL;
+		return -1;
+	}
+	*task = g->nodes[id].task;
+	return 0;
+}
@@ -28,6 +28,7 @@
 #include <sys/epoll.h>
 #include <poll.h>
 #include <fcntl.h>
+#include <time.h>
 
 #define __SPE_EVENT_ALL \
   ( SPE_EVENT_OUT_INTR_MBOX | SPE_EVENT_IN_MBOX | \
@@ -46,6 +47,9 @@
 #define __SPE_EVENTS_ENABLED(spe) \
   ((spe)->base_private->flags & SPE_EVENTS_ENABLE)
 
+#define __SPE_EVENT_GANG_PRIV_GET(gang) \
+  ( (spe_gang_context_event_priv_ptr_t)(gang)->event_private)
+
 
 void _event_spe_context_lock(spe_context_ptr_t spe)
 {
@@ -615,3 +619,382 @@ int _event_spe_context_run	(spe_context_ptr_t spe, unsigned int *entry, unsigned
   return rc;
 }
 
+/*
+ * gang-scoped events
+ */
+
+static int gang_member_register(spe_gang_registration_t *reg, spe_context_ptr_t spe, unsigned int events)
+{
+  spe_event_unit_t event;
+
+  if (!__SPE_EVENTS_ENABLED(spe)) { /* nothing to deliver for this member */
+    return 0;
+  }
+
+  event.events = events;
+  event.spe = spe;
+  event.data = reg->data;
+
+  return _event_spe_event_handler_register(reg->evhandler, &event);
+}
+
+static int gang_member_deregister(spe_gang_registration_t *reg, spe_context_ptr_t spe, unsigned int events)
+{
+  spe_event_unit_t event;
+
+  if (!__SPE_EVENTS_ENABLED(spe)) {
+    return 0;
+  }
+
+  event.events = events;
+  event.spe = spe;
+  event.data = reg->data;
+
+  return _event_spe_event_handler_deregister(reg->evhandler, &event);
+}
+
+struct spe_gang_context_event_priv * _event_spe_gang_context_initialize(spe_gang_context_ptr_t gang)
+{
+  spe_gang_context_event_priv_ptr_t evgang;
+
+  evgang = calloc(1, sizeof(*evgang));
+  if (!evgang) {
+    return NULL;
+  }
+
+  pthread_mutex_init(&evgang->lock, NULL);
+  pthread_cond_init(&evgang->completion, NULL);
+
+  return evgang;
+}
+
+int _event_spe_gang_context_finalize(spe_gang_context_ptr_t gang)
+{
+  spe_gang_context_event_priv_ptr_t evgang;
+
+  if (!gang) {
+    errno = ESRCH;
+    return -1;
+  }
+
+  evgang = __SPE_EVENT_GANG_PRIV_GET(gang);
+  gang->event_private = NULL;
+
+  while (evgang->members) {
+    spe_gang_member_t *member = evgang->members;
+    evgang->members = member->next;
+    /* the context outlives its gang; forget the back pointer */
+    member->spe->base_private->gang = NULL;
+    free(member);
+  }
+  while (evgang->registrations) {
+    spe_gang_registration_t *reg = evgang->registrations;
+    evgang->registrations = reg->next;
+    free(reg);
+  }
+
+  pthread_cond_destroy(&evgang->completion);
+  pthread_mutex_destroy(&evgang->lock);
+
+  free(evgang);
+
+  return 0;
+}
+
+int _event_spe_gang_member_add(spe_gang_context_ptr_t gang, spe_context_ptr_t spe)
+{
+  spe_gang_context_event_priv_ptr_t evgang;
+  spe_gang_member_t *member;
+  spe_gang_registration_t *reg, *failed;
+
+  evgang = __SPE_EVENT_GANG_PRIV_GET(gang);
+
+  member = calloc(1, sizeof(*member));
+  if (!member) {
+    return -1;
+  }
+  member->spe = spe;
+
+  pthread_mutex_lock(&evgang->lock);
+
+  /* apply the gang-scoped registrations to the new member */
+  for (reg = evgang->registrations; reg; reg = reg->next) {
+    if (gang_member_register(reg, spe, reg->events) == -1) {
+      int errno_saved = errno;
+      failed = reg;
+      for (reg = evgang->registrations; reg != failed; reg = reg->next) {
+	gang_member_deregister(reg, spe, reg->events);
+      }
+      pthread_mutex_unlock(&evgang->lock);
+      free(member);
+      errno = errno_saved;
+      return -1;
+    }
+  }
+
+  member->next = evgang->members;
+  evgang->members = member;
+
+  pthread_mutex_unlock(&evgang->lock);
+
+  return 0;
+}
+
+int _event_spe_gang_member_remove(spe_gang_context_ptr_t gang, spe_context_ptr_t spe)
+{
+  spe_gang_context_event_priv_ptr_t evgang;
+  spe_gang_member_t **pmember;
+  spe_gang_registration_t *reg;
+
+  evgang = __SPE_EVENT_GANG_PRIV_GET(gang);
+  if (!evgang) {
+    return 0;
+  }
+
+  pthread_mutex_lock(&evgang->lock);
+
+  for (reg = evgang->registrations; reg; reg = reg->next) {
+    gang_member_deregister(reg, spe, reg->events);
+  }
+
+  for (pmember = &evgang->members; *pmember; pmember = &(*pmember)->next) {
+    if ((*pmember)->spe == spe) {
+      spe_gang_member_t *member = *pmember;
+      *pmember = member->next;
+      free(member);
+      break;
+    }
+  }
+
+  /* waiters for SPE_WAIT_ALL may be satisfied by a smaller gang */
+  pthread_cond_broadcast(&evgang->completion);
+
+  pthread_mutex_unlock(&evgang->lock);
+
+  return 0;
+}
+
+void _event_spe_gang_member_completed(spe_gang_context_ptr_t gang, spe_context_ptr_t spe)
+{
+  spe_gang_context_event_priv_ptr_t evgang;
+  spe_gang_member_t *member;
+
+  evgang = __SPE_EVENT_GANG_PRIV_GET(gang);
+  if (!evgang) {
+    return;
+  }
+
+  pthread_mutex_lock(&evgang->lock);
+
+  for (member = evgang->members; member; member = member->next) {
+    if (member->spe == spe) {
+      member->completed = 1;
+      pthread_cond_broadcast(&evgang->completion);
+      break;
+    }
+  }
+
+  pthread_mutex_unlock(&evgang->lock);
+}
+
+/*
+ * spe_gang_event_handler_register
+ */
+
+int _event_spe_gang_event_handler_register(spe_event_handler_ptr_t evhandler, spe_gang_context_ptr_t gang, unsigned int events, spe_event_data_t data)
+{
+  spe_gang_context_event_priv_ptr_t evgang;
+  spe_gang_registration_t *reg;
+  spe_gang_member_t *member, *failed;
+
+  if (!evhandler) {
+    errno = ESRCH;
+    return -1;
+  }
+  evgang = __SPE_EVENT_GANG_PRIV_GET(gang);
+  if (!evgang) {
+    errno = ESRCH;
+    return -1;
+  }
+  if (!events) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (events & ~__SPE_EVENT_ALL) {
+    errno = ENOTSUP;
+    return -1;
+  }
+
+  reg = calloc(1, sizeof(*reg));
+  if (!reg) {
+    return -1;
+  }
+  reg->evhandler = evhandler;
+  reg->events = events;
+  reg->data = data;
+
+  pthread_mutex_lock(&evgang->lock);
+
+  /* register for all current members; future members are
+   * registered by _event_spe_gang_member_add */
+  for (member = evgang->members; member; member = member->next) {
+    if (gang_member_register(reg, member->spe, events) == -1) {
+      int errno_saved = errno;
+      failed = member;
+      for (member = evgang->members; member != failed; member = member->next) {
+	gang_member_deregister(reg, member->spe, events);
+      }
+      pthread_mutex_unlock(&evgang->lock);
+      free(reg);
+      errno = errno_saved;
+      return -1;
+    }
+  }
+
+  reg->next = evgang->registrations;
+  evgang->registrations = reg;
+
+  pthread_mutex_unlock(&evgang->lock);
+
+  return 0;
+}
+
+/*
+ * spe_gang_event_handler_deregister
+ */
+
+int _event_spe_gang_event_handler_deregister(spe_event_handler_ptr_t evhandler, spe_gang_context_ptr_t gang, unsigned int events)
+{
+  spe_gang_context_event_priv_ptr_t evgang;
+  spe_gang_registration_t **preg, *reg;
+  spe_gang_member_t *member;
+  int rc = 0;
+
+  if (!evhandler) {
+    errno = ESRCH;
+    return -1;
+  }
+  evgang = __SPE_EVENT_GANG_PRIV_GET(gang);
+  if (!evgang) {
+    errno = ESRCH;
+    return -1;
+  }
+  if (events & ~__SPE_EVENT_ALL) {
+    errno = ENOTSUP;
+    return -1;
+  }
+
+  pthread_mutex_lock(&evgang->lock);
+
+  for (preg = &evgang->registrations; *preg; preg = &(*preg)->next) {
+    if ((*preg)->evhandler == evhandler && ((*preg)->events & events)) {
+      break;
+    }
+  }
+  reg = *preg;
+  if (!reg) {
+    pthread_mutex_unlock(&evgang->lock);
+    errno = ENOENT;
+    return -1;
+  }
+
+  events &= reg->events;
+  for (member = evgang->members; member; member = member->next) {
+    if (gang_member_deregister(reg, member->spe, events) == -1) {
+      rc = -1;
+    }
+  }
+
+  reg->events &= ~events;
+  if (!reg->events) {
+    *preg = reg->next;
+    free(reg);
+  }
+
+  pthread_mutex_unlock(&evgang->lock);
+
+  return rc;
+}
+
+/*
+ * spe_gang_wait
+ */
+
+int _event_spe_gang_wait(spe_gang_context_ptr_t gang, unsigned int mode, spe_context_ptr_t *spes, int max_spes, int timeout)
+{
+  spe_gang_context_event_priv_ptr_t evgang;
+  spe_gang_member_t *member;
+  struct timespec deadline;
+  int num_members, num_completed;
+  int rc = 0;
+
+  evgang = __SPE_EVENT_GANG_PRIV_GET(gang);
+  if (!evgang) {
+    errno = ESRCH;
+    return -1;
+  }
+  if (!spes || max_spes <= 0 ||
+      (mode != SPE_WAIT_ANY && mode != SPE_WAIT_ALL)) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (timeout > 0) {
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (timeout % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+  }
+
+  pthread_mutex_lock(&evgang->lock);
+
+  for ( ; ; ) {
+    num_members = num_completed = 0;
+    for (member = evgang->members; member; member = member->next) {
+      num_members++;
+      if (member->completed) {
+	num_completed++;
+      }
+    }
+
+    if (num_members == 0) { /* nothing to wait for */
+      pthread_mutex_unlock(&evgang->lock);
+      errno = ECHILD;
+      return -1;
+    }
+    if (num_completed > 0 &&
+	(mode == SPE_WAIT_ANY || num_completed == num_members)) {
+      break;
+    }
+
+    if (timeout == 0) {
+      rc = ETIMEDOUT;
+    }
+    else if (timeout < 0) {
+      rc = pthread_cond_wait(&evgang->completion, &evgang->lock);
+    }
+    else {
+      rc = pthread_cond_timedwait(&evgang->completion, &evgang->lock, &deadline);
+    }
+    if (rc == ETIMEDOUT) {
+      pthread_mutex_unlock(&evgang->lock);
+      return 0;
+    }
+  }
+
+  /* hand out completed members and rearm them for the next phase */
+  rc = 0;
+  for (member = evgang->members; member && rc < max_spes; member = member->next) {
+    if (member->completed) {
+      member->completed = 0;
+      spes[rc++] = member->spe;
+    }
+  }
+
+  pthread_mutex_unlock(&evgang->lock);
+
+  return rc;
+}
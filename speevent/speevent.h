@@ -43,6 +43,29 @@ typedef struct spe_context_event_priv
   spe_event_unit_t events[__NUM_SPE_EVENT_TYPES];
 } spe_context_event_priv_t, *spe_context_event_priv_ptr_t;
 
+typedef struct spe_gang_member
+{
+  struct spe_gang_member *next;
+  spe_context_ptr_t spe;
+  int completed;
+} spe_gang_member_t;
+
+typedef struct spe_gang_registration
+{
+  struct spe_gang_registration *next;
+  spe_event_handler_ptr_t evhandler;
+  unsigned int events;
+  spe_event_data_t data;
+} spe_gang_registration_t;
+
+typedef struct spe_gang_context_event_priv
+{
+  pthread_mutex_t lock;
+  pthread_cond_t completion;
+  spe_gang_member_t *members;
+  spe_gang_registration_t *registrations;
+} spe_gang_context_event_priv_t, *spe_gang_context_event_priv_ptr_t;
+
 
 int _event_spe_stop_info_read (spe_context_ptr_t spe, spe_stop_info_t *stopinfo);
 
@@ -82,6 +105,26 @@ struct spe_context_event_priv * _event_spe_context_initialize(spe_context_ptr_t
 
 int _event_spe_context_run	(spe_context_ptr_t spe, unsigned int *entry, unsigned int runflags, void *argp, void *envp, spe_stop_info_t *stopinfo);
 
+/*
+ * gang-scoped events
+ */
+
+struct spe_gang_context_event_priv * _event_spe_gang_context_initialize(spe_gang_context_ptr_t gang);
+
+int _event_spe_gang_context_finalize(spe_gang_context_ptr_t gang);
+
+int _event_spe_gang_member_add(spe_gang_context_ptr_t gang, spe_context_ptr_t spe);
+
+int _event_spe_gang_member_remove(spe_gang_context_ptr_t gang, spe_context_ptr_t spe);
+
+void _event_spe_gang_member_completed(spe_gang_context_ptr_t gang, spe_context_ptr_t spe);
+
+int _event_spe_gang_event_handler_register(spe_event_handler_ptr_t evhandler, spe_gang_context_ptr_t gang, unsigned int events, spe_event_data_t data);
+
+int _event_spe_gang_event_handler_deregister(spe_event_handler_ptr_t evhandler, spe_gang_context_ptr_t gang, unsigned int events);
+
+int _event_spe_gang_wait(spe_gang_context_ptr_t gang, unsigned int mode, spe_context_ptr_t *spes, int max_spes, int timeout);
+
 void _event_spe_context_lock(spe_context_ptr_t spe);
 void _event_spe_context_unlock(spe_context_ptr_t spe);
 
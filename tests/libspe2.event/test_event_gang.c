@@ -0,0 +1,271 @@
+/*
+ *  libspe2 - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ *
+ *  Copyright (C) 2008 Sony Computer Entertainment Inc.
+ *  Copyright 2008 Sony Corp.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* This test checks if gang-scoped event registration and
+   spe_gang_wait work correctly. The stop event handler is registered
+   to the gang before half of the members are created, so that both
+   current and future members must deliver their events. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <errno.h>
+#include <string.h>
+
+#include "ppu_libspe2_test.h"
+
+#define COUNT 100
+
+extern spe_program_handle_t spu_event_stop;
+
+typedef struct spe_thread_params
+{
+  spe_context_ptr_t spe;
+  int index;
+  pthread_t tid;
+  unsigned int num_stop;
+} spe_thread_params_t;
+
+static const spe_stop_info_t expected_stop_info = {
+  .stop_reason = SPE_STOP_AND_SIGNAL,
+  .result.spe_signal_code = STOP_DATA,
+};
+
+static void *spe_thread_proc(void *arg)
+{
+  spe_thread_params_t *params = (spe_thread_params_t *)arg;
+  spe_context_ptr_t spe = params->spe;
+  unsigned int entry = SPE_DEFAULT_ENTRY;
+  spe_stop_info_t stop_info;
+  int ret;
+
+  if (spe_program_load(spe, &spu_event_stop)) {
+    eprintf("spe[%d]: spe_program_load: %s\n", params->index, strerror(errno));
+    fatal();
+  }
+
+  global_sync(NUM_SPES);
+
+  do { /* run until the SPE exits */
+    ret = spe_context_run(spe, &entry, 0,
+			  (void*)STOP_DATA, (void*)COUNT, &stop_info);
+  } while (ret > 0);
+
+  if (ret == -1) {
+    eprintf("spe[%d]: spe_context_run: %s\n", params->index, strerror(errno));
+    fatal();
+  }
+
+  return NULL;
+}
+
+static spe_context_ptr_t create_member(spe_gang_context_ptr_t gang)
+{
+  spe_context_ptr_t spe;
+
+  spe = spe_context_create(SPE_EVENTS_ENABLE, gang);
+  if (!spe) {
+    eprintf("spe_context_create: %s\n", strerror(errno));
+    fatal();
+  }
+
+  return spe;
+}
+
+static int test(int argc, char **argv)
+{
+  int ret;
+  spe_gang_context_ptr_t gang;
+  spe_thread_params_t params[NUM_SPES];
+  spe_event_handler_ptr_t evhandler;
+  spe_event_data_t data;
+#define MAX_EVENT NUM_SPES
+  spe_event_unit_t event[MAX_EVENT];
+  spe_context_ptr_t completed[NUM_SPES];
+  int i, j;
+  int exit_count;
+  spe_stop_info_t stop_info;
+  int num_events;
+
+  gang = spe_gang_context_create(0);
+  if (!gang) {
+    eprintf("spe_gang_context_create: %s\n", strerror(errno));
+    fatal();
+  }
+
+  /* a gang without members has nothing to wait for */
+  ret = spe_gang_wait(gang, SPE_WAIT_ANY, completed, NUM_SPES, 0);
+  if (ret != -1 || errno != ECHILD) {
+    eprintf("spe_gang_wait: unexpected result (%d).\n", ret);
+    fatal();
+  }
+
+  /* current members */
+  for (i = 0; i < NUM_SPES / 2; i++) {
+    params[i].index = i;
+    params[i].num_stop = 0;
+    params[i].spe = create_member(gang);
+  }
+
+  evhandler = spe_event_handler_create();
+  if (!evhandler) {
+    eprintf("spe_event_handler_create: %s\n", strerror(errno));
+    fatal();
+  }
+
+  data.ptr = NULL;
+  ret = spe_gang_event_handler_register(evhandler, gang,
+					SPE_EVENT_SPE_STOPPED, data);
+  if (ret == -1) {
+    eprintf("spe_gang_event_handler_register: %s\n", strerror(errno));
+    fatal();
+  }
+
+  /* future members */
+  for ( ; i < NUM_SPES; i++) {
+    params[i].index = i;
+    params[i].num_stop = 0;
+    params[i].spe = create_member(gang);
+  }
+
+  /* nobody has run yet */
+  ret = spe_gang_wait(gang, SPE_WAIT_ANY, completed, NUM_SPES, 0);
+  if (ret != 0) {
+    eprintf("spe_gang_wait: unexpected result (%d).\n", ret);
+    fatal();
+  }
+
+  for (i = 0; i < NUM_SPES; i++) {
+    ret = pthread_create(&params[i].tid, NULL, spe_thread_proc, params + i);
+    if (ret) {
+      eprintf("pthread_create: %s\n", strerror(ret));
+      fatal();
+    }
+  }
+
+  /* event loop */
+  exit_count = 0;
+  while (exit_count < NUM_SPES) {
+    ret = num_events = spe_event_wait(evhandler, event, MAX_EVENT, -1);
+    if (ret == -1) {
+      eprintf("spe_event_wait: %s\n", strerror(errno));
+      fatal();
+    }
+
+    for (i = 0; i < num_events; i++) {
+      spe_thread_params_t *cur_params = NULL;
+      for (j = 0; j < NUM_SPES; j++) {
+	if (params[j].spe == event[i].spe) {
+	  cur_params = params + j;
+	}
+      }
+      if (!cur_params || !(event[i].events & SPE_EVENT_SPE_STOPPED)) {
+	eprintf("event %u/%u: Unexpected event (0x%08x)\n",
+		i, num_events, event[i].events);
+	fatal();
+      }
+      ret = spe_stop_info_read(event[i].spe, &stop_info);
+      if (ret == -1) {
+	eprintf("spe[%d]: spe_stop_info_read: %s\n",
+		cur_params->index, strerror(errno));
+	fatal();
+      }
+      else if (stop_info.stop_reason == SPE_EXIT) {
+	if (check_exit_code(&stop_info, 0)) {
+	  fatal();
+	}
+	exit_count++;
+      }
+      else {
+	if (check_stop_info(&stop_info, &expected_stop_info)) {
+	  fatal();
+	}
+	cur_params->num_stop++;
+      }
+    }
+  }
+
+  /* all members have exited, so the barrier must be passed at once */
+  ret = spe_gang_wait(gang, SPE_WAIT_ALL, completed, NUM_SPES, -1);
+  if (ret != NUM_SPES) {
+    eprintf("spe_gang_wait: unexpected result (%d/%d).\n", ret, NUM_SPES);
+    fatal();
+  }
+  for (i = 0; i < NUM_SPES; i++) {
+    for (j = 0; j < NUM_SPES; j++) {
+      if (completed[j] == params[i].spe) {
+	break;
+      }
+    }
+    if (j == NUM_SPES) {
+      eprintf("spe[%d]: not reported as completed.\n", i);
+      failed();
+    }
+  }
+
+  /* completed members have been reaped */
+  ret = spe_gang_wait(gang, SPE_WAIT_ANY, completed, NUM_SPES, 10);
+  if (ret != 0) {
+    eprintf("spe_gang_wait: unexpected result (%d).\n", ret);
+    fatal();
+  }
+
+  ret = spe_gang_event_handler_deregister(evhandler, gang, SPE_EVENT_SPE_STOPPED);
+  if (ret == -1) {
+    eprintf("spe_gang_event_handler_deregister: %s\n", strerror(errno));
+    fatal();
+  }
+
+  for (i = 0; i < NUM_SPES; i++) {
+    pthread_join(params[i].tid, NULL);
+
+    if (params[i].num_stop != COUNT) {
+      eprintf("spe[%u]: unexpected number of events (%u/%u).\n",
+	      i, params[i].num_stop, COUNT);
+      failed();
+    }
+
+    ret = spe_context_destroy(params[i].spe);
+    if (ret) {
+      eprintf("spe_context_destroy: %s\n", strerror(errno));
+      fatal();
+    }
+  }
+
+  ret = spe_event_handler_destroy(evhandler);
+  if (ret) {
+    fatal();
+  }
+
+  ret = spe_gang_context_destroy(gang);
+  if (ret) {
+    eprintf("spe_gang_context_destroy: %s\n", strerror(errno));
+    fatal();
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  return ppu_main(argc, argv, test);
+}
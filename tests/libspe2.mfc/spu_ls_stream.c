@@ -0,0 +1,149 @@
+/*
+ *  libspe2 - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ *
+ *  Copyright (C) 2008 Sony Computer Entertainment Inc.
+ *  Copyright 2008 Sony Corp.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* This program streams blocks from one SPE to the local store of
+ * another one. Peer 0 of the peer table is the producer, peer 1 the
+ * consumer. Both SPEs announce filled and drained buffers by DMA to
+ * the other side's signal notification 1 register in OR mode.
+ */
+
+#include <spu_intrinsics.h>
+#include <spu_mfcio.h>
+
+#include "spu_libspe2_test.h"
+
+#define BLOCK_SIZE (16 * 1024)
+
+/* same layout as spe_peer_table_t / spe_peer_entry_t */
+typedef struct peer_entry
+{
+  unsigned long long ls_ea;
+  unsigned long long sig1_ea;
+  unsigned long long sig2_ea;
+  unsigned long long reserved;
+} peer_entry_t;
+
+struct
+{
+  unsigned int count;
+  unsigned int self;
+  unsigned int reserved[2];
+  peer_entry_t peers[2];
+} peer_table __attribute__((aligned(16)));
+
+/* same layout as spe_ls_dbuf_desc_t */
+struct
+{
+  unsigned long long buf_ea[2];
+  unsigned long long signal_ea;
+  unsigned int size;
+  unsigned int ls_addr;
+} dbuf_desc __attribute__((aligned(16)));
+
+unsigned char src[2][BLOCK_SIZE] __attribute__((aligned(128)));
+unsigned char dst[2][BLOCK_SIZE] __attribute__((aligned(128)));
+
+/* the value sits in the last word so that it matches the alignment of
+   the signal notification register */
+unsigned int signal_value[2][4] __attribute__((aligned(16))) = {
+  { 0, 0, 0, 1 }, { 0, 0, 0, 2 },
+};
+
+static void wait_tags(unsigned int mask)
+{
+  mfc_write_tag_mask(mask);
+  mfc_read_tag_status_all();
+}
+
+static int producer(unsigned int count)
+{
+  unsigned int i;
+  unsigned int empty = 3;
+  unsigned int start;
+
+  spu_write_decrementer(0xffffffff);
+  start = spu_read_decrementer();
+
+  for (i = 0; i < count; i++) {
+    unsigned int b = i & 1;
+    while (!(empty & (1 << b))) {
+      empty |= spu_read_signal1();
+    }
+    empty &= ~(1 << b);
+
+    wait_tags(1 << b);
+    *(unsigned int *)src[b] = i;
+    mfc_put(src[b], dbuf_desc.buf_ea[b], dbuf_desc.size, b, 0, 0);
+    mfc_putf(&signal_value[b][3], dbuf_desc.signal_ea, 4, b, 0, 0);
+  }
+
+  /* wait until the consumer has drained both buffers */
+  while (empty != 3) {
+    empty |= spu_read_signal1();
+  }
+  wait_tags(3);
+
+  spu_write_out_mbox(start - spu_read_decrementer());
+
+  return 0;
+}
+
+static int consumer(unsigned int count)
+{
+  unsigned int i;
+  unsigned int full = 0;
+  int errors = 0;
+
+  for (i = 0; i < count; i++) {
+    unsigned int b = i & 1;
+    while (!(full & (1 << b))) {
+      full |= spu_read_signal1();
+    }
+    full &= ~(1 << b);
+
+    if (*(volatile unsigned int *)dst[b] != i) {
+      errors++;
+    }
+    mfc_put(&signal_value[b][3], peer_table.peers[0].sig1_ea, 4, b, 0, 0);
+  }
+  wait_tags(3);
+
+  return errors ? 1 : 0;
+}
+
+int main(unsigned long long spe,
+	 unsigned long long argp /* count */,
+	 unsigned long long envp)
+{
+  /* tell the PPE where the table, the descriptor and the buffers are */
+  spu_write_out_mbox((unsigned int)&peer_table);
+  spu_write_out_mbox((unsigned int)&dbuf_desc);
+  spu_write_out_mbox((unsigned int)dst);
+
+  /* wait until both have been written */
+  spu_read_in_mbox();
+
+  if (peer_table.count != 2) {
+    return 2;
+  }
+
+  return peer_table.self == 0 ? producer(argp) : consumer(argp);
+}
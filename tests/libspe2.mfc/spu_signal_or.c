@@ -0,0 +1,44 @@
+/*
+ *  libspe2 - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ *
+ *  Copyright (C) 2008 Sony Computer Entertainment Inc.
+ *  Copyright 2008 Sony Corp.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* This program collects doorbell bits from SNR 1 until all expected
+ * bits have been seen, and returns the number of reads it needed.
+ */
+
+#include <spu_intrinsics.h>
+#include <spu_mfcio.h>
+
+int main(unsigned long long spe,
+	 unsigned long long argp /* expected bits */,
+	 unsigned long long envp)
+{
+  unsigned int bits = 0;
+  unsigned int reads = 0;
+
+  while (bits != (unsigned int)argp) {
+    bits |= spu_read_signal1();
+    reads++;
+  }
+
+  spu_write_out_intr_mbox(reads);
+
+  return 0;
+}
@@ -0,0 +1,175 @@
+/*
+ *  libspe2 - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ *
+ *  Copyright (C) 2008 Sony Computer Entertainment Inc.
+ *  Copyright 2008 Sony Corp.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* This test checks if spe_peer_table_publish and spe_ls_dbuf_desc_init
+ * allow two SPEs to stream data directly between their local stores,
+ * and reports the stage-to-stage bandwidth.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "ppu_libspe2_test.h"
+
+#define COUNT 4096
+#define BLOCK_SIZE (16 * 1024)
+
+extern spe_program_handle_t spu_ls_stream;
+
+static void *spe_thread_proc(void *arg)
+{
+  ppe_thread_t *ppe = (ppe_thread_t*)arg;
+  spe_context_ptr_t *spes = (spe_context_ptr_t *)ppe->group->data;
+  spe_context_ptr_t spe = spes[ppe->index];
+  unsigned int entry = SPE_DEFAULT_ENTRY;
+  int ret;
+  spe_stop_info_t stop_info;
+
+  if (spe_program_load(spe, &spu_ls_stream)) {
+    eprintf("spe_program_load: %s\n", strerror(errno));
+    fatal();
+  }
+
+  ret = spe_context_run(spe, &entry, 0, (void*)COUNT, NULL, &stop_info);
+  if (ret == 0) {
+    if (check_exit_code(&stop_info, 0)) {
+      fatal();
+    }
+  }
+  else {
+    eprintf("spe_context_run: %s\n", strerror(errno));
+    fatal();
+  }
+
+  return NULL;
+}
+
+static unsigned int out_mbox_read(spe_context_ptr_t spe)
+{
+  unsigned int data;
+  int ret;
+
+  while ((ret = spe_out_mbox_read(spe, &data, 1)) == 0) {
+    /* wait */
+  }
+  if (ret != 1) {
+    eprintf("spe_out_mbox_read: %s\n", strerror(errno));
+    fatal();
+  }
+  return data;
+}
+
+static int test(int argc, char **argv)
+{
+  int ret;
+  int i;
+  spe_context_ptr_t spes[2];
+  ppe_thread_group_t *group;
+  unsigned int table_ls, desc_ls, buf_ls;
+  spe_ls_dbuf_desc_t desc;
+  unsigned int data = 0;
+  unsigned int ticks;
+  double secs;
+
+  for (i = 0; i < 2; i++) {
+    spes[i] = spe_context_create(SPE_MAP_PS | SPE_CFG_SIGNOTIFY1_OR, NULL);
+    if (!spes[i]) {
+      eprintf("spe_context_create: %s\n", strerror(errno));
+      fatal();
+    }
+  }
+
+  group = ppe_thread_group_create(2, spe_thread_proc, spes);
+  if (!group) {
+    fatal();
+  }
+
+  /* both SPEs run the same program, so the addresses are the same */
+  for (i = 0; i < 2; i++) {
+    table_ls = out_mbox_read(spes[i]);
+    desc_ls = out_mbox_read(spes[i]);
+    buf_ls = out_mbox_read(spes[i]);
+  }
+
+  ret = spe_peer_table_publish(spes, 2, table_ls);
+  if (ret) {
+    eprintf("spe_peer_table_publish: %s\n", strerror(errno));
+    fatal();
+  }
+
+  ret = spe_ls_dbuf_desc_init(spes[1], buf_ls, BLOCK_SIZE, &desc);
+  if (ret) {
+    eprintf("spe_ls_dbuf_desc_init: %s\n", strerror(errno));
+    fatal();
+  }
+  if (desc.buf_ea[0] != (uintptr_t)spe_ls_area_get(spes[1]) + buf_ls ||
+      desc.buf_ea[1] != desc.buf_ea[0] + BLOCK_SIZE ||
+      !desc.signal_ea) {
+    eprintf("spe_ls_dbuf_desc_init: unexpected descriptor\n");
+    fatal();
+  }
+  memcpy((char *)spe_ls_area_get(spes[0]) + desc_ls, &desc, sizeof(desc));
+
+  /* must be failed */
+  ret = spe_ls_dbuf_desc_init(spes[1], buf_ls + 1, BLOCK_SIZE, &desc);
+  if (ret == 0 || errno != EINVAL) {
+    eprintf("spe_ls_dbuf_desc_init: unexpected result\n");
+    fatal();
+  }
+
+  for (i = 0; i < 2; i++) {
+    ret = spe_in_mbox_write(spes[i], &data, 1, SPE_MBOX_ALL_BLOCKING);
+    if (ret != 1) {
+      eprintf("spe_in_mbox_write: %s\n", strerror(errno));
+      fatal();
+    }
+  }
+
+  ticks = out_mbox_read(spes[0]);
+
+  ret = ppe_thread_group_wait(group, NULL);
+  if (ret) {
+    fatal();
+  }
+
+  secs = (double)ticks / get_timebase_frequency();
+  printf("SPE to SPE: %u x %u bytes in %.6f sec: %.1f MB/s\n",
+	 COUNT, BLOCK_SIZE, secs,
+	 secs > 0 ? (double)COUNT * BLOCK_SIZE / secs / (1024 * 1024) : 0.0);
+
+  for (i = 0; i < 2; i++) {
+    ret = spe_context_destroy(spes[i]);
+    if (ret) {
+      eprintf("spe_context_destroy: %s\n", strerror(errno));
+      fatal();
+    }
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  return ppu_main(argc, argv, test);
+}
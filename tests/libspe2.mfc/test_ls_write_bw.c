@@ -0,0 +1,137 @@
+/*
+ *  libspe2 - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ *
+ *  Copyright (C) 2008 IBM Corp.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* This program reports the bandwidth of the paths through which the
+ * library writes to local store: the ELF loader, and proxy DMA (or the
+ * direct copy used when the kernel has no proxy DMA support). A plain
+ * memcpy into the mapped local store is shown for comparison.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "ppu_libspe2_test.h"
+
+#define COUNT 1000
+#define DMA_SIZE MAX_DMA_SIZE
+#define LS_BUF_SIZE (128 * 1024)
+
+extern spe_program_handle_t spu_dma;
+
+static unsigned char data_buf[LS_BUF_SIZE] __attribute__((aligned(128)));
+
+static double now(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void report(const char *path, unsigned long long bytes, double secs)
+{
+  printf("%-12s %10llu bytes in %.6f sec: %8.1f MB/s\n", path, bytes, secs,
+	 secs > 0 ? bytes / secs / (1024 * 1024) : 0.0);
+}
+
+static int test(int argc, char **argv)
+{
+  spe_context_ptr_t spe;
+  spe_load_stats_t stats;
+  unsigned long long bytes, ns;
+  unsigned int tag_status;
+  void *ls;
+  double start;
+  int ret, i, j;
+
+  spe = spe_context_create(0, NULL);
+  if (!spe) {
+    eprintf("spe_context_create: %s\n", strerror(errno));
+    fatal();
+  }
+  ls = spe_ls_area_get(spe);
+  if (!ls) {
+    eprintf("spe_ls_area_get: %s\n", strerror(errno));
+    fatal();
+  }
+  generate_data(data_buf, 0, sizeof(data_buf));
+
+  /* plain memcpy, for comparison */
+  start = now();
+  for (i = 0; i < COUNT; i++)
+    memcpy(ls, data_buf, LS_BUF_SIZE);
+  report("memcpy", (unsigned long long)COUNT * LS_BUF_SIZE, now() - start);
+
+  /* ELF loader, as timed by the library itself */
+  bytes = ns = 0;
+  for (i = 0; i < COUNT; i++) {
+    if (spe_program_load(spe, &spu_dma)) {
+      eprintf("spe_program_load: %s\n", strerror(errno));
+      fatal();
+    }
+    ret = spe_program_load_stats_get(spe, &stats);
+    if (ret) {
+      eprintf("spe_program_load_stats_get: %s\n", strerror(errno));
+      fatal();
+    }
+    bytes += stats.bytes_copied + stats.bytes_zeroed;
+    ns += stats.load_time_ns;
+  }
+  report("load", bytes, ns / 1e9);
+
+  /* proxy DMA, or its fallback */
+  start = now();
+  for (i = 0; i < COUNT; i++) {
+    for (j = 0; j < LS_BUF_SIZE; j += DMA_SIZE) {
+      ret = spe_mfcio_get(spe, j, data_buf + j, DMA_SIZE, 0, 0, 0);
+      if (ret) {
+	eprintf("spe_mfcio_get: %s\n", strerror(errno));
+	fatal();
+      }
+    }
+    ret = spe_mfcio_tag_status_read(spe, 1, SPE_TAG_ALL, &tag_status);
+    if (ret) {
+      eprintf("spe_mfcio_tag_status_read: %s\n", strerror(errno));
+      fatal();
+    }
+  }
+  report("proxy DMA", (unsigned long long)COUNT * LS_BUF_SIZE, now() - start);
+
+  if (memcmp(ls, data_buf, LS_BUF_SIZE)) {
+    eprintf("local store does not match the source data\n");
+    fatal();
+  }
+
+  ret = spe_context_destroy(spe);
+  if (ret) {
+    eprintf("spe_context_destroy: %s\n", strerror(errno));
+    fatal();
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  return ppu_main(argc, argv, test);
+}
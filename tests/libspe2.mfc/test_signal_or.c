@@ -0,0 +1,171 @@
+/*
+ *  libspe2 - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ *
+ *  Copyright (C) 2008 Sony Computer Entertainment Inc.
+ *  Copyright 2008 Sony Corp.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* This test checks if the spe_signal_or doorbell works correctly: many
+ * PPE threads set their own bit concurrently and the SPE must see all
+ * of them.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "ppu_libspe2_test.h"
+
+#define NUM_PRODUCERS 16
+#define COUNT 1000
+
+typedef struct test_params
+{
+  const char *name;
+  unsigned int flags;
+  spe_context_ptr_t spe;
+} test_params_t;
+
+extern spe_program_handle_t spu_signal_or;
+
+static void *spe_thread_proc(void *arg)
+{
+  test_params_t *params = (test_params_t *)arg;
+  unsigned int entry = SPE_DEFAULT_ENTRY;
+  int ret;
+  spe_stop_info_t stop_info;
+
+  ret = spe_context_run(params->spe, &entry, 0,
+			(void*)((1U << NUM_PRODUCERS) - 1), NULL, &stop_info);
+  if (ret == 0) {
+    if (check_exit_code(&stop_info, 0)) {
+      fatal();
+    }
+  }
+  else {
+    eprintf("%s: spe_context_run: %s\n", params->name, strerror(errno));
+    fatal();
+  }
+
+  return NULL;
+}
+
+static void *producer_proc(void *arg)
+{
+  ppe_thread_t *ppe = (ppe_thread_t*)arg;
+  test_params_t *params = (test_params_t *)ppe->group->data;
+  int i;
+
+  global_sync(NUM_PRODUCERS);
+
+  /* ring the same bit repeatedly; the rings coalesce on the SPE */
+  for (i = 0; i < COUNT; i++) {
+    if (spe_signal_or(params->spe, SPE_SIG_NOTIFY_REG_1, 1U << ppe->index)) {
+      eprintf("%s: spe_signal_or: %s\n", params->name, strerror(errno));
+      fatal();
+    }
+  }
+
+  return NULL;
+}
+
+static int test_doorbell(test_params_t *params)
+{
+  int ret;
+  pthread_t tid;
+  unsigned int reads;
+
+  params->spe = spe_context_create(params->flags, NULL);
+  if (!params->spe) {
+    eprintf("%s: spe_context_create: %s\n", params->name, strerror(errno));
+    fatal();
+  }
+
+  /* must be failed: SNR 2 is in overwrite mode */
+  ret = spe_signal_or(params->spe, SPE_SIG_NOTIFY_REG_2, 1);
+  if (ret == 0 || errno != EINVAL) {
+    eprintf("%s: spe_signal_or: unexpected result\n", params->name);
+    fatal();
+  }
+
+  ret = spe_signal_doorbell_enable(params->spe, SPE_SIG_NOTIFY_REG_1);
+  if (ret) {
+    eprintf("%s: spe_signal_doorbell_enable: %s\n", params->name, strerror(errno));
+    fatal();
+  }
+
+  if (spe_program_load(params->spe, &spu_signal_or)) {
+    eprintf("%s: spe_program_load: %s\n", params->name, strerror(errno));
+    fatal();
+  }
+
+  ret = pthread_create(&tid, NULL, spe_thread_proc, params);
+  if (ret) {
+    eprintf("%s: pthread_create: %s\n", params->name, strerror(ret));
+    fatal();
+  }
+
+  ret = ppe_thread_group_run(NUM_PRODUCERS, producer_proc, params, NULL);
+  if (ret) {
+    fatal();
+  }
+
+  ret = spe_out_intr_mbox_read(params->spe, &reads, 1, SPE_MBOX_ALL_BLOCKING);
+  if (ret != 1) {
+    eprintf("%s: spe_out_intr_mbox_read: %s\n", params->name, strerror(errno));
+    fatal();
+  }
+  tprintf("%s: %u rings delivered in %u reads\n",
+	  params->name, NUM_PRODUCERS * COUNT, reads);
+
+  pthread_join(tid, NULL);
+
+  ret = spe_context_destroy(params->spe);
+  if (ret) {
+    eprintf("%s: spe_context_destroy: %s\n", params->name, strerror(errno));
+    fatal();
+  }
+
+  return 0;
+}
+
+static int test(int argc, char **argv)
+{
+  static test_params_t params[] = {
+    { .name = "file", .flags = 0 },
+    { .name = "mapped", .flags = SPE_MAP_PS },
+    { .name = "file, OR", .flags = SPE_CFG_SIGNOTIFY1_OR },
+    { .name = "mapped, OR", .flags = SPE_MAP_PS | SPE_CFG_SIGNOTIFY1_OR },
+  };
+  unsigned int i;
+
+  for (i = 0; i < sizeof(params) / sizeof(params[0]); i++) {
+    if (test_doorbell(params + i)) {
+      fatal();
+    }
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  return ppu_main(argc, argv, test);
+}
@@ -0,0 +1,36 @@
+/*
+ *  libspe2 - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ *
+ *  Copyright (C) 2008 IBM Corp.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* Exits with EXIT_DATA if the input test_task_graph puts in local store
+ * before the run is there. */
+
+#include "spu_libspe2_test.h"
+
+#define BUFFER_SIZE 32768	/* as in test_task_graph.c */
+#define BUFFER_LS 0x20000
+
+int main(unsigned long long spe,
+	 unsigned long long argp,
+	 unsigned long long envp)
+{
+  if (!data_check((unsigned char *)BUFFER_LS, 0, BUFFER_SIZE))
+    return 1;
+  return EXIT_DATA;
+}
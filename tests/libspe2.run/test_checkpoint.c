@@ -0,0 +1,171 @@
+/*
+ *  libspe2 - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ *
+ *  Copyright (C) 2008 IBM Corp.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* This test checks spe_context_checkpoint and spe_context_restore: a
+ * program stopped between two stop instructions is saved, compressed or
+ * not, and resumed on another context as well as on its own.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+
+#include "ppu_libspe2_test.h"
+
+#define FIRST_STOP 1
+#define LAST_STOP 3
+
+extern spe_program_handle_t spu_stop;
+extern spe_program_handle_t spu_exit;
+
+static void run(spe_context_ptr_t spe, unsigned int *entry, int code)
+{
+  spe_stop_info_t stop_info;
+  spe_stop_info_t expected;
+  int ret;
+
+  ret = spe_context_run(spe, entry, SPE_NO_CALLBACKS,
+			(void*)FIRST_STOP, (void*)(LAST_STOP + 1), &stop_info);
+  if (code) {
+    expected.stop_reason = SPE_STOP_AND_SIGNAL;
+    expected.result.spe_signal_code = code;
+  }
+  else {
+    expected.stop_reason = SPE_EXIT;
+    expected.result.spe_exit_code = 0;
+  }
+  if (check_stop_info(&stop_info, &expected))
+    fatal();
+  if (ret != code) {
+    eprintf("Unexpected return code: 0x%04x\n", ret);
+    fatal();
+  }
+}
+
+static spe_context_ptr_t create(spe_program_handle_t *program)
+{
+  spe_context_ptr_t spe;
+
+  spe = spe_context_create(0, NULL);
+  if (!spe) {
+    eprintf("spe_context_create(0, NULL): %s\n", strerror(errno));
+    fatal();
+  }
+  if (spe_program_load(spe, program)) {
+    eprintf("spe_program_load(%p, ...): %s\n", spe, strerror(errno));
+    fatal();
+  }
+  return spe;
+}
+
+static void checkpoint(spe_context_ptr_t spe, spe_checkpoint_t *ckpt,
+		       unsigned int flags)
+{
+  if (spe_context_checkpoint(spe, ckpt, flags)) {
+    eprintf("spe_context_checkpoint(%p, ..., 0x%x): %s\n",
+	    spe, flags, strerror(errno));
+    fatal();
+  }
+  tprintf("checkpoint: %u bytes, %u of local store, %llu ns\n",
+	  ckpt->size, ckpt->ls_bytes, ckpt->checkpoint_time_ns);
+}
+
+static void restore(spe_context_ptr_t spe, spe_checkpoint_t *ckpt,
+		    unsigned int *entry)
+{
+  if (spe_context_restore(spe, ckpt, entry)) {
+    eprintf("spe_context_restore(%p, ...): %s\n", spe, strerror(errno));
+    fatal();
+  }
+  if (*entry != ckpt->npc) {
+    eprintf("spe_context_restore: entry 0x%x, npc 0x%x\n", *entry, ckpt->npc);
+    fatal();
+  }
+  tprintf("restore: %llu ns\n", ckpt->restore_time_ns);
+}
+
+static int test(int argc, char **argv)
+{
+  spe_context_ptr_t spe[2];
+  spe_checkpoint_t full, compressed;
+  unsigned int entry = SPE_DEFAULT_ENTRY, entry2;
+  int i, ret;
+
+  spe[0] = create(&spu_stop);
+  spe[1] = create(&spu_exit);
+
+  run(spe[0], &entry, FIRST_STOP);
+
+  checkpoint(spe[0], &full, 0);
+  checkpoint(spe[0], &compressed, SPE_CHECKPOINT_COMPRESS);
+  if (full.npc != entry || compressed.npc != entry) {
+    eprintf("spe_context_checkpoint: npc 0x%x, 0x%x, expected 0x%x\n",
+	    full.npc, compressed.npc, entry);
+    fatal();
+  }
+  if (compressed.ls_bytes >= full.ls_bytes) {
+    eprintf("spe_context_checkpoint: %u bytes compressed, %u not\n",
+	    compressed.ls_bytes, full.ls_bytes);
+    fatal();
+  }
+
+  /* the job goes on in another context */
+  restore(spe[1], &compressed, &entry2);
+  for (i = FIRST_STOP + 1; i <= LAST_STOP; i++)
+    run(spe[1], &entry2, i);
+  run(spe[1], &entry2, 0);
+
+  /* and, from the same point, in its own */
+  run(spe[0], &entry, FIRST_STOP + 1);
+  restore(spe[0], &full, &entry);
+  for (i = FIRST_STOP + 1; i <= LAST_STOP; i++)
+    run(spe[0], &entry, i);
+  run(spe[0], &entry, 0);
+
+  /* a damaged checkpoint is refused */
+  ((unsigned int *)compressed.data)[0] ^= 1;
+  ret = spe_context_restore(spe[1], &compressed, &entry2);
+  if (ret == 0) {
+    eprintf("spe_context_restore: Unexpected success.\n");
+    fatal();
+  }
+  if (errno != EINVAL) {
+    eprintf("spe_context_restore: Unexpected errno: %s\n", strerror(errno));
+    fatal();
+  }
+
+  spe_checkpoint_free(&full);
+  spe_checkpoint_free(&compressed);
+
+  for (i = 0; i < 2; i++) {
+    ret = spe_context_destroy(spe[i]);
+    if (ret) {
+      eprintf("spe_context_destroy(%p): %s\n", spe[i], strerror(errno));
+      fatal();
+    }
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  return ppu_main(argc, argv, test);
+}
@@ -20,7 +20,7 @@
  */
 
 /* This test checks if the spe_cpu_info_get function works
- * correctly. */
+ * correctly, and agrees with spe_cpu_topology_get. */
 
 #include <string.h>
 
@@ -91,6 +91,47 @@ static int test(int argc, char **argv)
     }
   }
 
+  check_failed();
+
+  /* the topology snapshot agrees with the counts, before and after a
+   * refresh */
+  for (i = 0; i < 2; i++) {
+    spe_topology_entry_t spes[64];
+    int n, j, usable = 0;
+
+    if (i && spe_cpu_info_refresh()) {
+      eprintf("spe_cpu_info_refresh(): %s\n", strerror(errno));
+      fatal();
+    }
+
+    n = spe_cpu_topology_get(spes, 64);
+    if (n < 0) {
+      eprintf("spe_cpu_topology_get(): %s\n", strerror(errno));
+      fatal();
+    }
+    if (n != spe_cpu_info_get(SPE_COUNT_PHYSICAL_SPES, -1)) {
+      eprintf("spe_cpu_topology_get(): %d SPEs\n", n);
+      failed();
+    }
+    for (j = 0; j < n && j < 64; j++) {
+      if (spes[j].cpu_node < 0 || spes[j].cpu_node >= bes ||
+	  (j && spes[j].cpu_node < spes[j - 1].cpu_node)) {
+	eprintf("spe_cpu_topology_get(): SPE %d on node %d\n",
+		spes[j].id, spes[j].cpu_node);
+	failed();
+      }
+      if (!spes[j].reserved)
+	usable++;
+      tprintf("SPE %d: cpu node %d, numa node %d%s\n", spes[j].id,
+	      spes[j].cpu_node, spes[j].numa_node,
+	      spes[j].reserved ? ", reserved" : "");
+    }
+    if (n <= 64 && usable != spe_cpu_info_get(SPE_COUNT_USABLE_SPES, -1)) {
+      eprintf("spe_cpu_topology_get(): %d usable SPEs\n", usable);
+      failed();
+    }
+  }
+
   return 0;
 }
 
@@ -0,0 +1,125 @@
+/*
+ *  libspe2 - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ *
+ *  Copyright (C) 2008 IBM Corp.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* This test checks if embedded and external ELF images can be
+ * preloaded with spe_image_preload and run afterwards.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+
+#include "ppu_libspe2_test.h"
+
+#define SPE_ELF "spu_arg.spu.elf"
+
+extern spe_program_handle_t spu_exit;
+extern spe_program_handle_t spu_arg;
+
+static int run(spe_program_handle_t *prog)
+{
+  spe_context_ptr_t spe;
+  unsigned int entry = SPE_DEFAULT_ENTRY;
+  spe_stop_info_t stop_info;
+  int ret;
+
+  spe = spe_context_create(0, NULL);
+  if (!spe) {
+    eprintf("spe_context_create(0, NULL): %s\n", strerror(errno));
+    fatal();
+  }
+
+  if (spe_program_load(spe, prog)) {
+    eprintf("spe_program_load(%p, %p): %s\n", spe, prog, strerror(errno));
+    fatal();
+  }
+
+  ret = spe_context_run(spe, &entry, 0,
+			(void*)RUN_ARGP_DATA, (void*)RUN_ENVP_DATA, &stop_info);
+  if (ret < 0) {
+    eprintf("spe_context_run(%p, ...): %s\n", spe, strerror(errno));
+    fatal();
+  }
+
+  ret = spe_context_destroy(spe);
+  if (ret) {
+    eprintf("spe_context_destroy(%p): %s\n", spe, strerror(errno));
+    fatal();
+  }
+
+  return 0;
+}
+
+static int test(int argc, char **argv)
+{
+  spe_program_handle_t *progs[3], bad;
+  char junk[256];
+  int ret;
+
+  progs[0] = &spu_exit;
+  progs[1] = &spu_arg;
+  progs[2] = spe_image_open(SPE_ELF);
+  if (!progs[2]) {
+    eprintf("spe_image_open(%s): %s\n", SPE_ELF, strerror(errno));
+    fatal();
+  }
+
+  ret = spe_image_preload(progs, 3);
+  if (ret) {
+    eprintf("spe_image_preload: %s\n", strerror(errno));
+    fatal();
+  }
+
+  /* preloading twice is harmless */
+  ret = spe_image_preload(progs, 3);
+  if (ret) {
+    eprintf("spe_image_preload (again): %s\n", strerror(errno));
+    fatal();
+  }
+
+  run(progs[0]);
+  run(progs[1]);
+  run(progs[2]);
+  spe_image_close(progs[2]);
+
+  /* an invalid image is reported, and cannot be loaded */
+  memset(junk, 0, sizeof(junk));
+  bad.handle_size = sizeof(bad);
+  bad.elf_image = junk;
+  bad.toe_shadow = NULL;
+  progs[2] = &bad;
+  ret = spe_image_preload(progs, 3);
+  if (ret == 0) {
+    eprintf("spe_image_preload: Unexpected success.\n");
+    fatal();
+  }
+  if (errno != EINVAL) {
+    eprintf("spe_image_preload: Unexpected errno: %d (%s)\n",
+	    errno, strerror(errno));
+    fatal();
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  return ppu_main(argc, argv, test);
+}
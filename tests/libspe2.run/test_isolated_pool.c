@@ -0,0 +1,146 @@
+/*
+ *  libspe2 - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ *
+ *  Copyright (C) 2008 IBM Corp.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* This test checks the pools of isolated contexts: a pool only takes
+ * isolated flags, its contexts are made ready when it is created, a
+ * launch that fails gives its context back, contexts given back are made
+ * ready again so that the next launches are warm, and a pool with every
+ * context back can be destroyed. The test is skipped when the emulated
+ * isolation loader is not installed.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+
+#include "ppu_libspe2_test.h"
+
+#define NUM_CONTEXTS 2
+#define NUM_LAUNCHES 2
+
+extern spe_program_handle_t spu_exit;
+extern spe_program_handle_t spu_null_isolated;
+
+static int test(int argc, char **argv)
+{
+  spe_isolated_pool_ptr_t pool;
+  spe_isolated_pool_stats_t stats;
+  spe_context_ptr_t spe;
+  spe_stop_info_t stop_info;
+  unsigned int entry;
+  int i;
+
+  /* must be failed */
+  pool = spe_isolated_pool_create(0, NUM_CONTEXTS);
+  if (pool) {
+    eprintf("spe_isolated_pool_create(0): unexpected success\n");
+    failed();
+  }
+  else if (errno != EINVAL) {
+    eprintf("spe_isolated_pool_create(0): %s\n", strerror(errno));
+    failed();
+  }
+
+  pool = spe_isolated_pool_create(SPE_ISOLATE_EMULATE, NUM_CONTEXTS);
+  if (!pool) {
+    if (errno == EINVAL) {
+      tprintf("emulated isolation loader not available; skipped\n");
+      return 0;
+    }
+    eprintf("spe_isolated_pool_create: %s\n", strerror(errno));
+    fatal();
+  }
+
+  if (spe_isolated_pool_stats_get(pool, &stats)) {
+    eprintf("spe_isolated_pool_stats_get: %s\n", strerror(errno));
+    fatal();
+  }
+  if (stats.contexts != NUM_CONTEXTS || stats.idle != NUM_CONTEXTS) {
+    eprintf("pool has %u contexts, %u idle; expected %d\n",
+	    stats.contexts, stats.idle, NUM_CONTEXTS);
+    failed();
+  }
+
+  /* spu_exit is not an isolated application: the launch must fail, and
+   * the context must go back to the pool */
+  spe = spe_isolated_pool_get(pool, &spu_exit);
+  if (spe) {
+    eprintf("spe_isolated_pool_get: unexpected success\n");
+    failed();
+    spe_isolated_pool_put(pool, spe);
+  }
+  if (spe_isolated_pool_stats_get(pool, &stats)) {
+    eprintf("spe_isolated_pool_stats_get: %s\n", strerror(errno));
+    fatal();
+  }
+  if (stats.idle != stats.contexts || stats.launches != 0) {
+    eprintf("after a failed launch: %u of %u contexts idle, %llu launches\n",
+	    stats.idle, stats.contexts, stats.launches);
+    failed();
+  }
+  tprintf("arm time %llu ns\n", stats.arm_time_ns);
+
+  /* get, run and put back an isolated program, twice: the context put
+   * back is armed again, so neither launch loads the loader itself */
+  for (i = 0; i < NUM_LAUNCHES; i++) {
+    spe = spe_isolated_pool_get(pool, &spu_null_isolated);
+    if (!spe) {
+      eprintf("spe_isolated_pool_get: %s\n", strerror(errno));
+      fatal();
+    }
+    entry = SPE_DEFAULT_ENTRY;
+    if (spe_context_run(spe, &entry, 0, NULL, NULL, &stop_info)) {
+      eprintf("spe_context_run: %s\n", strerror(errno));
+      fatal();
+    }
+    if (check_exit_code(&stop_info, 0)) {
+      fatal();
+    }
+    if (spe_isolated_pool_put(pool, spe)) {
+      eprintf("spe_isolated_pool_put: %s\n", strerror(errno));
+      fatal();
+    }
+  }
+  if (spe_isolated_pool_stats_get(pool, &stats)) {
+    eprintf("spe_isolated_pool_stats_get: %s\n", strerror(errno));
+    fatal();
+  }
+  if (stats.launches != NUM_LAUNCHES || stats.cold_launches != 0 ||
+      stats.idle != stats.contexts) {
+    eprintf("after %d launches: %llu launches, %llu cold, "
+	    "%u of %u contexts idle\n", NUM_LAUNCHES, stats.launches,
+	    stats.cold_launches, stats.idle, stats.contexts);
+    failed();
+  }
+  tprintf("launch time %llu ns, at most %llu ns\n",
+	  stats.launch_time_ns, stats.launch_time_max_ns);
+
+  if (spe_isolated_pool_destroy(pool)) {
+    eprintf("spe_isolated_pool_destroy: %s\n", strerror(errno));
+    fatal();
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  return ppu_main(argc, argv, test);
+}
@@ -0,0 +1,196 @@
+/*
+ *  libspe2 - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ *
+ *  Copyright (C) 2008 IBM Corp.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* This test checks spe_program_load_async: a program loaded into one
+ * context while another one runs, the completion callback, running
+ * without waiting first, loads queued back to back on one context, and
+ * the report of a failed load.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+
+#include "ppu_libspe2_test.h"
+
+extern spe_program_handle_t spu_exit;
+
+static int completions;
+static int completion_status = -2;
+
+static void completion_func(spe_context_ptr_t spe, int status, void *arg)
+{
+  completions++;
+  completion_status = status;
+  if (arg != (void *)spe) {
+    eprintf("completion: unexpected arg %p for %p\n", arg, spe);
+    fatal();
+  }
+}
+
+/* records the order in which back to back loads complete */
+static int ordered[2];
+static int nordered;
+
+static void ordered_func(spe_context_ptr_t spe, int status, void *arg)
+{
+  if (nordered < 2)
+    ordered[nordered] = status;
+  nordered++;
+}
+
+static void run(spe_context_ptr_t spe)
+{
+  unsigned int entry = SPE_DEFAULT_ENTRY;
+  spe_stop_info_t stop_info;
+  int ret;
+
+  ret = spe_context_run(spe, &entry, 0,
+			(void*)RUN_ARGP_DATA, (void*)RUN_ENVP_DATA, &stop_info);
+  if (ret < 0) {
+    eprintf("spe_context_run(%p, ...): %s\n", spe, strerror(errno));
+    fatal();
+  }
+  if (check_exit_code(&stop_info, EXIT_DATA))
+    fatal();
+}
+
+static int test(int argc, char **argv)
+{
+  spe_context_ptr_t spe[2];
+  spe_load_completion_t completion, order_completion;
+  spe_program_handle_t bad;
+  char junk[256];
+  int i, ret;
+
+  for (i = 0; i < 2; i++) {
+    spe[i] = spe_context_create(0, NULL);
+    if (!spe[i]) {
+      eprintf("spe_context_create(0, NULL): %s\n", strerror(errno));
+      fatal();
+    }
+  }
+
+  /* nothing queued */
+  if (spe_program_load_wait(spe[0])) {
+    eprintf("spe_program_load_wait: %s\n", strerror(errno));
+    fatal();
+  }
+
+  /* load the second context while the first one runs */
+  completion.func = completion_func;
+  completion.arg = spe[1];
+  if (spe_program_load(spe[0], &spu_exit)) {
+    eprintf("spe_program_load(%p, &spu_exit): %s\n", spe[0], strerror(errno));
+    fatal();
+  }
+  if (spe_program_load_async(spe[1], &spu_exit, &completion)) {
+    eprintf("spe_program_load_async(%p, &spu_exit): %s\n",
+	    spe[1], strerror(errno));
+    fatal();
+  }
+  run(spe[0]);
+  if (spe_program_load_wait(spe[1])) {
+    eprintf("spe_program_load_wait(%p): %s\n", spe[1], strerror(errno));
+    fatal();
+  }
+  if (completions != 1 || completion_status != 0) {
+    eprintf("completion: called %d times, status %d\n",
+	    completions, completion_status);
+    fatal();
+  }
+  run(spe[1]);
+
+  /* spe_context_run waits for the load by itself */
+  for (i = 0; i < 8; i++) {
+    if (spe_program_load_async(spe[0], &spu_exit, NULL)) {
+      eprintf("spe_program_load_async(%p, &spu_exit): %s\n",
+	      spe[0], strerror(errno));
+      fatal();
+    }
+    run(spe[0]);
+  }
+
+  /* a failed load is reported once, by the wait */
+  memset(junk, 0, sizeof(junk));
+  bad.handle_size = sizeof(bad);
+  bad.elf_image = junk;
+  bad.toe_shadow = NULL;
+  completion.arg = spe[1];
+  if (spe_program_load_async(spe[1], &bad, &completion)) {
+    eprintf("spe_program_load_async(%p, &bad): %s\n", spe[1], strerror(errno));
+    fatal();
+  }
+  ret = spe_program_load_wait(spe[1]);
+  if (ret == 0) {
+    eprintf("spe_program_load_wait: Unexpected success.\n");
+    fatal();
+  }
+  if (completions != 2 || completion_status != -1) {
+    eprintf("completion: called %d times, status %d\n",
+	    completions, completion_status);
+    fatal();
+  }
+  if (spe_program_load_wait(spe[1])) {
+    eprintf("spe_program_load_wait (again): %s\n", strerror(errno));
+    fatal();
+  }
+
+  /* loads queued back to back on one context run in order: the last
+   * one queued is the program that runs */
+  order_completion.func = ordered_func;
+  order_completion.arg = NULL;
+  if (spe_program_load_async(spe[1], &bad, &order_completion) ||
+      spe_program_load_async(spe[1], &spu_exit, &order_completion)) {
+    eprintf("spe_program_load_async(%p): %s\n", spe[1], strerror(errno));
+    fatal();
+  }
+  if (spe_program_load_wait(spe[1]) == 0) {
+    eprintf("spe_program_load_wait: failed load not reported.\n");
+    fatal();
+  }
+  if (nordered != 2 || ordered[0] != -1 || ordered[1] != 0) {
+    eprintf("back to back loads: %d completions, status %d then %d\n",
+	    nordered, ordered[0], ordered[1]);
+    fatal();
+  }
+  run(spe[1]);
+
+  /* destroying a context waits for its load */
+  if (spe_program_load_async(spe[1], &spu_exit, NULL)) {
+    eprintf("spe_program_load_async(%p, &spu_exit): %s\n",
+	    spe[1], strerror(errno));
+    fatal();
+  }
+  for (i = 0; i < 2; i++) {
+    ret = spe_context_destroy(spe[i]);
+    if (ret) {
+      eprintf("spe_context_destroy(%p): %s\n", spe[i], strerror(errno));
+      fatal();
+    }
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  return ppu_main(argc, argv, test);
+}
@@ -0,0 +1,105 @@
+/*
+ *  libspe2 - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ *
+ *  Copyright (C) 2008 IBM Corp.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* This test checks spe_program_load_next: programs staged in the free
+ * half of local store and started by the next run, in turn, and the
+ * refusal of a program that cannot be moved.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+
+#include "ppu_libspe2_test.h"
+
+extern spe_program_handle_t spu_exit;
+extern spe_program_handle_t spu_exit_relocs;
+
+static void run(spe_context_ptr_t spe)
+{
+  unsigned int entry = SPE_DEFAULT_ENTRY;
+  spe_stop_info_t stop_info;
+  int ret;
+
+  ret = spe_context_run(spe, &entry, 0,
+			(void*)RUN_ARGP_DATA, (void*)RUN_ENVP_DATA, &stop_info);
+  if (ret < 0) {
+    eprintf("spe_context_run(%p, ...): %s\n", spe, strerror(errno));
+    fatal();
+  }
+  if (check_exit_code(&stop_info, EXIT_DATA))
+    fatal();
+}
+
+static int test(int argc, char **argv)
+{
+  spe_context_ptr_t spe;
+  int i, ret;
+
+  spe = spe_context_create(0, NULL);
+  if (!spe) {
+    eprintf("spe_context_create(0, NULL): %s\n", strerror(errno));
+    fatal();
+  }
+
+  if (spe_program_load(spe, &spu_exit_relocs)) {
+    eprintf("spe_program_load(%p, &spu_exit_relocs): %s\n",
+	    spe, strerror(errno));
+    fatal();
+  }
+  run(spe);
+
+  /* stage the next run in the other half, then back again */
+  for (i = 0; i < 4; i++) {
+    if (spe_program_load_next(spe, &spu_exit_relocs)) {
+      eprintf("spe_program_load_next(%p, &spu_exit_relocs): %s\n",
+	      spe, strerror(errno));
+      fatal();
+    }
+    run(spe);
+  }
+
+  /* a program linked without its relocations stays at address 0 */
+  ret = spe_program_load_next(spe, &spu_exit);
+  if (ret == 0) {
+    eprintf("spe_program_load_next(%p, &spu_exit): Unexpected success.\n",
+	    spe);
+    fatal();
+  }
+  if (errno != ENOEXEC) {
+    eprintf("spe_program_load_next(%p, &spu_exit): Unexpected errno: %s\n",
+	    spe, strerror(errno));
+    fatal();
+  }
+  run(spe);
+
+  ret = spe_context_destroy(spe);
+  if (ret) {
+    eprintf("spe_context_destroy(%p): %s\n", spe, strerror(errno));
+    fatal();
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  return ppu_main(argc, argv, test);
+}
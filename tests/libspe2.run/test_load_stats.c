@@ -0,0 +1,94 @@
+/*
+ *  libspe2 - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ *
+ *  Copyright (C) 2008 IBM Corp.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* This test checks the load statistics and the overlay table
+ * reported for a loaded program.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+
+#include "ppu_libspe2_test.h"
+
+extern spe_program_handle_t spu_arg;
+
+static int test(int argc, char **argv)
+{
+  spe_context_ptr_t spe;
+  spe_load_stats_t stats;
+  spe_overlay_segment_t ovl[8];
+  int ret;
+
+  spe = spe_context_create(0, NULL);
+  if (!spe) {
+    eprintf("spe_context_create(0, NULL): %s\n", strerror(errno));
+    fatal();
+  }
+
+  /* nothing loaded yet */
+  ret = spe_program_load_stats_get(spe, &stats);
+  if (ret == 0) {
+    eprintf("spe_program_load_stats_get: Unexpected success.\n");
+    fatal();
+  }
+  if (errno != EINVAL) {
+    eprintf("spe_program_load_stats_get: Unexpected errno: %d (%s)\n",
+	    errno, strerror(errno));
+    fatal();
+  }
+
+  if (spe_program_load(spe, &spu_arg)) {
+    eprintf("spe_program_load(%p, &spu_arg): %s\n", spe, strerror(errno));
+    fatal();
+  }
+
+  ret = spe_program_load_stats_get(spe, &stats);
+  if (ret) {
+    eprintf("spe_program_load_stats_get: %s\n", strerror(errno));
+    fatal();
+  }
+  if (stats.segments_loaded == 0 || stats.bytes_copied == 0 ||
+      stats.segments_loaded > stats.segments) {
+    eprintf("spe_program_load_stats_get: %u of %u segments, %u bytes\n",
+	    stats.segments_loaded, stats.segments, stats.bytes_copied);
+    fatal();
+  }
+
+  /* spu_arg has no overlays */
+  ret = spe_program_overlays_get(spe, ovl, 8);
+  if (ret != 0 || stats.overlays != 0 || stats.bytes_skipped != 0) {
+    eprintf("spe_program_overlays_get: %d overlays\n", ret);
+    fatal();
+  }
+
+  ret = spe_context_destroy(spe);
+  if (ret) {
+    eprintf("spe_context_destroy(%p): %s\n", spe, strerror(errno));
+    fatal();
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  return ppu_main(argc, argv, test);
+}
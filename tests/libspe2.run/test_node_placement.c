@@ -0,0 +1,202 @@
+/*
+ *  libspe2 - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ *
+ *  Copyright (C) 2008 Sony Computer Entertainment Inc.
+ *  Copyright 2008 Sony Corp.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* This test checks if the per-node SPE counts, the
+ * spe_context_create_node function and the spe_ea_bind function work
+ * correctly, and if a context created for a node runs on an SPE of that
+ * node. */
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "ppu_libspe2_test.h"
+
+#define BUFFER_SIZE (64 * 1024)
+#define MAX_SPES 64
+
+extern spe_program_handle_t spu_wbox;
+
+static void *spe_thread_proc(void *arg)
+{
+  ppe_thread_t *ppe = (ppe_thread_t*)arg;
+  spe_context_ptr_t spe = (spe_context_ptr_t)ppe->group->data;
+  unsigned int entry = SPE_DEFAULT_ENTRY;
+  spe_stop_info_t stop_info;
+
+  /* the context blocks on its inbound mailbox until released */
+  if (spe_context_run(spe, &entry, 0, (void*)1, NULL, &stop_info)) {
+    eprintf("spe_context_run: %s\n", strerror(errno));
+    fatal();
+  }
+  if (check_exit_code(&stop_info, 0)) {
+    fatal();
+  }
+
+  return NULL;
+}
+
+/* Returns the cpu node of the SPE a running context is loaded on, or -1
+ * if spufs does not tell. */
+static int running_node(spe_context_ptr_t spe,
+			spe_topology_entry_t *spes, int nspes)
+{
+  int id, i;
+
+  do {
+    id = spe_context_phys_id_get(spe);
+  } while (id == -1 && errno == EAGAIN);
+  if (id == -1) {
+    if (errno != ENOSYS) {
+      eprintf("spe_context_phys_id_get: %s\n", strerror(errno));
+      failed();
+    }
+    return -1;
+  }
+
+  for (i = 0; i < nspes; i++)
+    if (spes[i].id == id)
+      return spes[i].cpu_node;
+  eprintf("SPE %d is not in the topology\n", id);
+  failed();
+  return -1;
+}
+
+static int test(int argc, char **argv)
+{
+  int ret;
+  int i;
+  int bes;
+  int total, sum;
+  int nspes, node;
+  spe_context_ptr_t spe;
+  spe_topology_entry_t spes[MAX_SPES];
+  ppe_thread_group_t *group;
+  unsigned int data = 1;
+  void *buf = NULL;
+
+  bes = spe_cpu_info_get(SPE_COUNT_PHYSICAL_CPU_NODES, -1);
+  total = spe_cpu_info_get(SPE_COUNT_PHYSICAL_SPES, -1);
+  if (bes <= 0 || total <= 0) {
+    eprintf("spe_cpu_info_get: %s\n", strerror(errno));
+    fatal();
+  }
+
+  /* the per-node counts must add up to the number of SPEs */
+  sum = 0;
+  for (i = 0; i < bes; i++) {
+    ret = spe_cpu_info_get(SPE_COUNT_PHYSICAL_SPES, i);
+    if (ret < 0) {
+      eprintf("spe_cpu_info_get(SPE_COUNT_PHYSICAL_SPES, %d): %s\n", i, strerror(errno));
+      fatal();
+    }
+    tprintf("node %d: %d SPEs\n", i, ret);
+    sum += ret;
+  }
+  if (sum != total) {
+    eprintf("per-node SPE counts (%d) don't match the total (%d)\n", sum, total);
+    failed();
+  }
+
+  nspes = spe_cpu_topology_get(spes, MAX_SPES);
+  if (nspes < 0) {
+    eprintf("spe_cpu_topology_get: %s\n", strerror(errno));
+    fatal();
+  }
+
+  /* run a context on each node, and check where it runs */
+  for (i = 0; i < bes; i++) {
+    spe = spe_context_create_node(0, NULL, i);
+    if (!spe) {
+      eprintf("spe_context_create_node(%d): %s\n", i, strerror(errno));
+      fatal();
+    }
+    if (spe_program_load(spe, &spu_wbox)) {
+      eprintf("spe_program_load: %s\n", strerror(errno));
+      fatal();
+    }
+    group = ppe_thread_group_create(1, spe_thread_proc, spe);
+    if (!group) {
+      fatal();
+    }
+
+    node = running_node(spe, spes, nspes);
+    if (node >= 0) {
+      tprintf("node %d: context runs on node %d\n", i, node);
+      if (node != i) {
+	eprintf("context created for node %d runs on node %d\n", i, node);
+	failed();
+      }
+    }
+
+    ret = spe_in_mbox_write(spe, &data, 1, SPE_MBOX_ALL_BLOCKING);
+    if (ret != 1) {
+      eprintf("spe_in_mbox_write: %s\n", strerror(errno));
+      fatal();
+    }
+    ret = ppe_thread_group_wait(group, NULL);
+    if (ret) {
+      fatal();
+    }
+    ret = spe_context_destroy(spe);
+    if (ret) {
+      eprintf("spe_context_destroy: %s\n", strerror(errno));
+      fatal();
+    }
+  }
+
+  /* must be failed */
+  spe = spe_context_create_node(0, NULL, 1024);
+  if (spe) {
+    eprintf("spe_context_create_node(1024): unexpected success\n");
+    failed();
+  }
+  else if (errno != EINVAL) {
+    eprintf("spe_context_create_node(1024): %s\n", strerror(errno));
+    failed();
+  }
+
+  /* bind a DMA buffer; kernels without NUMA support don't have mbind */
+  ret = posix_memalign(&buf, 128, BUFFER_SIZE);
+  if (ret) {
+    eprintf("posix_memalign: %s\n", strerror(ret));
+    fatal();
+  }
+  ret = spe_ea_bind(buf, BUFFER_SIZE, 0);
+  if (ret && errno != ENOSYS) {
+    eprintf("spe_ea_bind: %s\n", strerror(errno));
+    failed();
+  }
+  ret = spe_ea_bind(buf, BUFFER_SIZE, -1);
+  if (ret == 0 || errno != EINVAL) {
+    eprintf("spe_ea_bind(-1): unexpected result\n");
+    failed();
+  }
+  free(buf);
+
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  return ppu_main(argc, argv, test);
+}
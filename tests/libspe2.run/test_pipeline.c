@@ -0,0 +1,157 @@
+/*
+ *  libspe2 - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ *
+ *  Copyright (C) 2008 Sony Computer Entertainment Inc.
+ *  Copyright 2008 Sony Corp.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* This test checks if spe_pipeline_create builds an affinity chain in
+ * ring order and reports the physical SPUs of the running stages.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "ppu_libspe2_test.h"
+
+extern spe_program_handle_t spu_wbox;
+
+static void *spe_thread_proc(void *arg)
+{
+  ppe_thread_t *ppe = (ppe_thread_t*)arg;
+  spe_pipeline_ptr_t pipeline = (spe_pipeline_ptr_t)ppe->group->data;
+  spe_context_ptr_t spe = pipeline->stages[ppe->index].spe;
+  unsigned int entry = SPE_DEFAULT_ENTRY;
+  int ret;
+  spe_stop_info_t stop_info;
+
+  if (spe_program_load(spe, &spu_wbox)) {
+    eprintf("spe_program_load: %s\n", strerror(errno));
+    fatal();
+  }
+
+  /* the stage blocks on its inbound mailbox until released */
+  ret = spe_context_run(spe, &entry, 0, (void*)1, NULL, &stop_info);
+  if (ret == 0) {
+    if (check_exit_code(&stop_info, 0)) {
+      fatal();
+    }
+  }
+  else {
+    eprintf("spe_context_run: %s\n", strerror(errno));
+    fatal();
+  }
+
+  return NULL;
+}
+
+static int test(int argc, char **argv)
+{
+  int ret;
+  int i, j;
+  spe_gang_context_ptr_t gang;
+  spe_pipeline_ptr_t pipeline;
+  ppe_thread_group_t *group;
+  int phys_ids[NUM_SPES];
+  unsigned int data = 1;
+
+  gang = spe_gang_context_create(0);
+  if (!gang) {
+    eprintf("spe_gang_context_create: %s\n", strerror(errno));
+    fatal();
+  }
+
+  pipeline = spe_pipeline_create(gang, NUM_SPES, SPE_AFFINITY_MEMORY);
+  if (!pipeline) {
+    eprintf("spe_pipeline_create: %s\n", strerror(errno));
+    fatal();
+  }
+
+  /* each stage must see its successor's local store */
+  if (pipeline->nstages != NUM_SPES) {
+    eprintf("unexpected number of stages: %d\n", pipeline->nstages);
+    fatal();
+  }
+  for (i = 0; i < NUM_SPES; i++) {
+    if (pipeline->stages[i].ls != spe_ls_area_get(pipeline->stages[i].spe) ||
+	pipeline->stages[i].next_ls != pipeline->stages[(i + 1) % NUM_SPES].ls) {
+      eprintf("stage %d: unexpected local store mapping\n", i);
+      failed();
+    }
+  }
+  check_failed();
+
+  group = ppe_thread_group_create(NUM_SPES, spe_thread_proc, pipeline);
+  if (!group) {
+    fatal();
+  }
+
+  /* the gang is scheduled as a whole once every stage is waiting */
+  do {
+    ret = spe_pipeline_phys_ids_get(pipeline, phys_ids);
+    if (ret == -1) {
+      eprintf("spe_pipeline_phys_ids_get: %s\n", strerror(errno));
+      fatal();
+    }
+  } while (ret < NUM_SPES);
+
+  for (i = 0; i < NUM_SPES; i++) {
+    tprintf("stage %d: SPU %d\n", i, phys_ids[i]);
+    for (j = 0; j < i; j++) {
+      if (phys_ids[i] == phys_ids[j]) {
+	eprintf("stages %d and %d share SPU %d\n", i, j, phys_ids[i]);
+	failed();
+      }
+    }
+  }
+
+  for (i = 0; i < NUM_SPES; i++) {
+    ret = spe_in_mbox_write(pipeline->stages[i].spe, &data, 1,
+			    SPE_MBOX_ALL_BLOCKING);
+    if (ret != 1) {
+      eprintf("spe_in_mbox_write: %s\n", strerror(errno));
+      fatal();
+    }
+  }
+
+  ret = ppe_thread_group_wait(group, NULL);
+  if (ret) {
+    fatal();
+  }
+
+  ret = spe_pipeline_destroy(pipeline);
+  if (ret) {
+    eprintf("spe_pipeline_destroy: %s\n", strerror(errno));
+    fatal();
+  }
+
+  ret = spe_gang_context_destroy(gang);
+  if (ret) {
+    eprintf("spe_gang_context_destroy: %s\n", strerror(errno));
+    fatal();
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  return ppu_main(argc, argv, test);
+}
@@ -0,0 +1,265 @@
+/*
+ *  libspe2 - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ *
+ *  Copyright (C) 2008 IBM Corp.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* This test checks the SPE job scheduler: jobs of several priorities and
+ * tenants all run to completion on no more contexts than usable SPEs, and
+ * the statistics account for them. On a single SPE, it also checks that
+ * a high priority job overtakes the queued low priority ones, and that
+ * tenants weighted 3:1 share the SPE time accordingly.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "ppu_libspe2_test.h"
+
+#define NUM_JOBS 64
+#define NUM_ORDER_JOBS 8
+#define NUM_SHARE_JOBS 32
+#define NUM_SHARE_CHECKED 16	/* started while both tenants had jobs */
+#define BLOCKER_SPIN 100000000ULL
+#define JOB_SPIN 1000000ULL
+
+extern spe_program_handle_t spu_exit;
+extern spe_program_handle_t spu_spin;
+
+/* Submits a job running spu_spin, and records when, in microseconds. */
+static void submit_spin(spe_scheduler_ptr_t sched, spe_job_t *job,
+			unsigned long long count, unsigned int priority,
+			unsigned int tenant, unsigned long long *submitted)
+{
+  struct timeval tv;
+
+  memset(job, 0, sizeof(*job));
+  job->program = &spu_spin;
+  job->argp = (void*)(unsigned long)count;
+  job->priority = priority;
+  job->tenant = tenant;
+
+  gettimeofday(&tv, NULL);
+  *submitted = tv.tv_sec * 1000000ULL + tv.tv_usec;
+  if (spe_scheduler_submit(sched, job)) {
+    eprintf("spe_scheduler_submit: %s\n", strerror(errno));
+    fatal();
+  }
+}
+
+/* Waits for a job, and returns when it started, in microseconds. */
+static unsigned long long wait_spin(spe_scheduler_ptr_t sched, spe_job_t *job,
+				    unsigned long long submitted)
+{
+  if (spe_scheduler_wait(sched, job)) {
+    eprintf("spe_scheduler_wait: %s\n", strerror(errno));
+    fatal();
+  }
+  if (check_exit_code(&job->stop_info, 0))
+    fatal();
+  return submitted + job->wait_ns / 1000;
+}
+
+static void test_priority_order(void)
+{
+  spe_scheduler_ptr_t sched;
+  spe_job_t blocker, low[NUM_ORDER_JOBS], high;
+  unsigned long long t_blocker, t_low[NUM_ORDER_JOBS], t_high;
+  unsigned long long start_low[NUM_ORDER_JOBS], start_high;
+  int i;
+
+  sched = spe_scheduler_create(1, 0, 0);
+  if (!sched) {
+    eprintf("spe_scheduler_create(1, 0, 0): %s\n", strerror(errno));
+    fatal();
+  }
+
+  /* the blocker keeps the SPE busy while the others are queued; it has
+   * the highest priority, so it runs first whenever the worker wakes */
+  submit_spin(sched, &blocker, BLOCKER_SPIN, 0, 0, &t_blocker);
+  for (i = 0; i < NUM_ORDER_JOBS; i++)
+    submit_spin(sched, &low[i], JOB_SPIN, SPE_SCHED_PRIORITIES - 1, 0,
+		&t_low[i]);
+  submit_spin(sched, &high, JOB_SPIN, 0, 0, &t_high);
+
+  wait_spin(sched, &blocker, t_blocker);
+  start_high = wait_spin(sched, &high, t_high);
+  for (i = 0; i < NUM_ORDER_JOBS; i++) {
+    start_low[i] = wait_spin(sched, &low[i], t_low[i]);
+    if (start_low[i] < start_high) {
+      eprintf("low priority job %d started before the high priority one\n", i);
+      failed();
+    }
+    if (i && start_low[i] < start_low[i - 1]) {
+      eprintf("low priority job %d started before job %d\n", i, i - 1);
+      failed();
+    }
+  }
+
+  if (spe_scheduler_destroy(sched)) {
+    eprintf("spe_scheduler_destroy: %s\n", strerror(errno));
+    fatal();
+  }
+}
+
+static void test_fair_share(void)
+{
+  spe_scheduler_ptr_t sched;
+  spe_job_t jobs[2][NUM_SHARE_JOBS];
+  unsigned long long submitted[2][NUM_SHARE_JOBS];
+  unsigned long long start[2][NUM_SHARE_JOBS], last;
+  int i, t, n[2];
+
+  sched = spe_scheduler_create(1, 0, 0);
+  if (!sched) {
+    eprintf("spe_scheduler_create(1, 0, 0): %s\n", strerror(errno));
+    fatal();
+  }
+  if (spe_scheduler_tenant_set(sched, 0, 3) ||
+      spe_scheduler_tenant_set(sched, 1, 1)) {
+    eprintf("spe_scheduler_tenant_set: %s\n", strerror(errno));
+    fatal();
+  }
+
+  for (i = 0; i < NUM_SHARE_JOBS; i++) {
+    submit_spin(sched, &jobs[0][i], JOB_SPIN, 0, 0, &submitted[0][i]);
+    submit_spin(sched, &jobs[1][i], JOB_SPIN, 0, 1, &submitted[1][i]);
+  }
+  for (i = 0; i < NUM_SHARE_JOBS; i++) {
+    start[0][i] = wait_spin(sched, &jobs[0][i], submitted[0][i]);
+    start[1][i] = wait_spin(sched, &jobs[1][i], submitted[1][i]);
+  }
+
+  /* of the first jobs started, with equal run times, three quarters
+   * must be the weight 3 tenant's */
+  n[0] = n[1] = 0;
+  last = 0;
+  while (n[0] + n[1] < NUM_SHARE_CHECKED) {
+    t = n[0] < NUM_SHARE_JOBS &&
+      (n[1] == NUM_SHARE_JOBS || start[0][n[0]] < start[1][n[1]]) ? 0 : 1;
+    if (start[t][n[t]] < last) {
+      eprintf("tenant %d's jobs started out of order\n", t);
+      failed();
+    }
+    last = start[t][n[t]];
+    n[t]++;
+  }
+  tprintf("first %d jobs: %d of tenant 0 (weight 3), %d of tenant 1\n",
+	  NUM_SHARE_CHECKED, n[0], n[1]);
+  if (n[0] < NUM_SHARE_CHECKED * 3 / 4 - 2 ||
+      n[0] > NUM_SHARE_CHECKED * 3 / 4 + 2) {
+    eprintf("tenant 0 got %d of the first %d jobs, expected about %d\n",
+	    n[0], NUM_SHARE_CHECKED, NUM_SHARE_CHECKED * 3 / 4);
+    failed();
+  }
+
+  if (spe_scheduler_destroy(sched)) {
+    eprintf("spe_scheduler_destroy: %s\n", strerror(errno));
+    fatal();
+  }
+}
+
+static int test(int argc, char **argv)
+{
+  spe_scheduler_ptr_t sched;
+  spe_job_t jobs[NUM_JOBS], bad;
+  spe_sched_stats_t stats;
+  int usable, i, ret;
+
+  usable = spe_cpu_info_get(SPE_COUNT_USABLE_SPES, -1);
+
+  sched = spe_scheduler_create(0, NUM_JOBS, 0);
+  if (!sched) {
+    eprintf("spe_scheduler_create(0, %d, 0): %s\n", NUM_JOBS, strerror(errno));
+    fatal();
+  }
+  if (spe_scheduler_tenant_set(sched, 1, 3)) {
+    eprintf("spe_scheduler_tenant_set: %s\n", strerror(errno));
+    fatal();
+  }
+
+  for (i = 0; i < NUM_JOBS; i++) {
+    memset(&jobs[i], 0, sizeof(jobs[i]));
+    jobs[i].program = &spu_exit;
+    jobs[i].argp = (void*)RUN_ARGP_DATA;
+    jobs[i].envp = (void*)RUN_ENVP_DATA;
+    jobs[i].priority = i % SPE_SCHED_PRIORITIES;
+    jobs[i].tenant = i % 3;
+    if (spe_scheduler_submit(sched, &jobs[i])) {
+      eprintf("spe_scheduler_submit(%d): %s\n", i, strerror(errno));
+      fatal();
+    }
+  }
+
+  memset(&bad, 0, sizeof(bad));
+  bad.program = &spu_exit;
+  bad.priority = SPE_SCHED_PRIORITIES;
+  ret = spe_scheduler_submit(sched, &bad);
+  if (ret == 0 || errno != EINVAL) {
+    eprintf("spe_scheduler_submit(bad priority): %d, %s\n",
+	    ret, strerror(errno));
+    fatal();
+  }
+
+  for (i = 0; i < NUM_JOBS; i++) {
+    if (spe_scheduler_wait(sched, &jobs[i])) {
+      eprintf("spe_scheduler_wait(%d): %s\n", i, strerror(errno));
+      fatal();
+    }
+    if (check_exit_code(&jobs[i].stop_info, EXIT_DATA))
+      fatal();
+    tprintf("job %d: waited %llu ns, ran %llu ns\n",
+	    i, jobs[i].wait_ns, jobs[i].run_ns);
+  }
+
+  if (spe_scheduler_stats_get(sched, &stats)) {
+    eprintf("spe_scheduler_stats_get: %s\n", strerror(errno));
+    fatal();
+  }
+  if (stats.spes < 1 || stats.spes > usable) {
+    eprintf("scheduler uses %u SPEs, %d usable\n", stats.spes, usable);
+    fatal();
+  }
+  if (stats.queued || stats.running || stats.submitted != NUM_JOBS ||
+      stats.completed != NUM_JOBS || stats.rejected) {
+    eprintf("stats: queued %u, running %u, submitted %llu, completed %llu, "
+	    "rejected %llu\n", stats.queued, stats.running, stats.submitted,
+	    stats.completed, stats.rejected);
+    fatal();
+  }
+  tprintf("queued at most %u, waited at most %llu ns\n",
+	  stats.queued_max, stats.wait_time_max_ns);
+
+  ret = spe_scheduler_destroy(sched);
+  if (ret) {
+    eprintf("spe_scheduler_destroy: %s\n", strerror(errno));
+    fatal();
+  }
+
+  test_priority_order();
+  test_fair_share();
+  check_failed();
+
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  return ppu_main(argc, argv, test);
+}
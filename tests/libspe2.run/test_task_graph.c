@@ -0,0 +1,157 @@
+/*
+ *  libspe2 - A wrapper library to adapt the JSRE SPU usage model to SPUFS
+ *
+ *  Copyright (C) 2008 IBM Corp.
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/* This test checks the SPE task graph runtime: a decode, transform,
+ * encode graph whose transform stage fans out runs every task after its
+ * predecessors, with their inputs in local store when they start (the
+ * tasks with an input check it), and a cycle is refused.
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+
+#include "ppu_libspe2_test.h"
+
+#define NUM_TRANSFORMS 6
+#define BUFFER_SIZE 32768
+#define BUFFER_LS 0x20000	/* as in spu_check_input.c */
+
+extern spe_program_handle_t spu_exit;
+extern spe_program_handle_t spu_check_input;
+
+static int add(spe_task_graph_ptr_t graph, void *in)
+{
+  spe_task_t task;
+  int id;
+
+  memset(&task, 0, sizeof(task));
+  task.program = in ? &spu_check_input : &spu_exit;
+  task.argp = (void*)RUN_ARGP_DATA;
+  task.envp = (void*)RUN_ENVP_DATA;
+  if (in) {
+    task.in_ea = in;
+    task.in_ls = BUFFER_LS;
+    task.in_size = BUFFER_SIZE;
+  }
+  id = spe_task_graph_add(graph, &task);
+  if (id < 0) {
+    eprintf("spe_task_graph_add: %s\n", strerror(errno));
+    fatal();
+  }
+  return id;
+}
+
+static void depend(spe_task_graph_ptr_t graph, int task, int after)
+{
+  if (spe_task_graph_depend(graph, task, after)) {
+    eprintf("spe_task_graph_depend(%d, %d): %s\n", task, after,
+	    strerror(errno));
+    fatal();
+  }
+}
+
+static int test(int argc, char **argv)
+{
+  spe_task_graph_ptr_t graph;
+  spe_task_graph_stats_t stats;
+  spe_task_t task, pred;
+  int decode, transform[NUM_TRANSFORMS], encode;
+  void *buf;
+  int i, ret;
+
+  graph = spe_task_graph_create();
+  if (!graph) {
+    eprintf("spe_task_graph_create: %s\n", strerror(errno));
+    fatal();
+  }
+  buf = spe_task_graph_buffer_alloc(graph, BUFFER_SIZE);
+  if (!buf) {
+    eprintf("spe_task_graph_buffer_alloc: %s\n", strerror(errno));
+    fatal();
+  }
+  generate_data(buf, 0, BUFFER_SIZE);
+
+  decode = add(graph, NULL);
+  for (i = 0; i < NUM_TRANSFORMS; i++) {
+    transform[i] = add(graph, buf);
+    depend(graph, transform[i], decode);
+  }
+  encode = add(graph, buf);
+  for (i = 0; i < NUM_TRANSFORMS; i++)
+    depend(graph, encode, transform[i]);
+
+  /* twice, on the contexts of the first run the second time */
+  for (i = 0; i < 2; i++) {
+    if (spe_task_graph_run(graph, 0, &stats)) {
+      eprintf("spe_task_graph_run: %s\n", strerror(errno));
+      fatal();
+    }
+    if (stats.tasks_run != NUM_TRANSFORMS + 2 ||
+	stats.critical_path_tasks != 3 ||
+	stats.critical_path_ns > stats.elapsed_ns) {
+      eprintf("stats: %u tasks run, critical path of %u tasks, %llu ns "
+	      "of %llu\n", stats.tasks_run, stats.critical_path_tasks,
+	      stats.critical_path_ns, stats.elapsed_ns);
+      fatal();
+    }
+    tprintf("%u SPEs, %llu ns, busy %llu ns, %u steals, critical path "
+	    "%llu ns\n", stats.spes, stats.elapsed_ns, stats.busy_ns,
+	    stats.steals, stats.critical_path_ns);
+  }
+
+  for (i = 0; i <= encode; i++) {
+    spe_task_graph_task_get(graph, i, &task);
+    if (check_exit_code(&task.stop_info, EXIT_DATA))
+      fatal();
+    tprintf("task %d: worker %d, %llu-%llu ns, prefetch %llu ns%s\n", i,
+	    task.worker, task.start_ns, task.end_ns, task.prefetch_ns,
+	    task.critical ? ", critical" : "");
+  }
+  spe_task_graph_task_get(graph, decode, &pred);
+  for (i = 0; i < NUM_TRANSFORMS; i++) {
+    spe_task_graph_task_get(graph, transform[i], &task);
+    if (task.start_ns < pred.end_ns) {
+      eprintf("task %d started before task %d ended\n", transform[i], decode);
+      fatal();
+    }
+  }
+
+  /* a cycle is refused */
+  depend(graph, decode, encode);
+  ret = spe_task_graph_run(graph, 0, NULL);
+  if (ret == 0 || errno != EDEADLK) {
+    eprintf("spe_task_graph_run(cycle): %d, %s\n", ret, strerror(errno));
+    fatal();
+  }
+
+  ret = spe_task_graph_destroy(graph);
+  if (ret) {
+    eprintf("spe_task_graph_destroy: %s\n", strerror(errno));
+    fatal();
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  return ppu_main(argc, argv, test);
+}
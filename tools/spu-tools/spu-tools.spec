@@ -13,11 +13,15 @@ BuildRequires: help2man
 
 %description
 The spu-tools package contains user space tools for Cell/B.E.
-Currently, it contain two tools:
+Currently, it contain four tools:
 - spu-top: a tool like top to watch the SPU's on a Cell BE
 System. It shows information about SPUs and running SPU contexts.
 - spu-ps: a tool like ps, which dumps a report on the currently
 running SPU contexts.
+- spu-export: a daemon that periodically exports SPU, context and
+process counters as JSON lines or a Prometheus text file.
+- spu-record: a high resolution recorder of SPU and context statistics,
+whose recordings can be replayed with spu-top --replay.
 
 %prep
 %setup -c -q
@@ -38,8 +42,12 @@ rm -rf $RPM_BUILD_ROOT
 %defattr(-,root,root)
 %dir /%{_prefix}/bin/spu-top
 %dir /%{_prefix}/bin/spu-ps
+%dir /%{_prefix}/bin/spu-export
+%dir /%{_prefix}/bin/spu-record
 %dir /%{_prefix}/share/man/man1/spu-top.1.gz
 %dir /%{_prefix}/share/man/man1/spu-ps.1.gz
+%dir /%{_prefix}/share/man/man1/spu-export.1.gz
+%dir /%{_prefix}/share/man/man1/spu-record.1.gz
 
 %changelog
 * Fri Jul 04 2008  Andre Detsch <adetsch@br.ibm.com> 1.1-5
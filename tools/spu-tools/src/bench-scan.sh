@@ -0,0 +1,40 @@
+#!/bin/sh
+#
+# Measures spu-ps/spu-top context refresh cost against the number of
+# contexts, using fake spufs trees so it can run on any host.
+#
+# usage: bench-scan.sh [REFRESHES] [COUNT...]
+#
+
+REFRESHES=${1:-100}
+[ $# -gt 0 ] && shift
+COUNTS=${*:-"16 64 256 1024"}
+
+SPU_PS=${SPU_PS:-./spu-ps}
+TMP=$(mktemp -d /tmp/spu-bench.XXXXXX) || exit 1
+trap 'rm -rf $TMP' EXIT
+
+mkctx()
+{
+	mkdir -p $1
+	echo $$ > $1/tid
+	echo "user 1 2 3 4 5 6 7 8 9 10 11 12" > $1/stat
+	echo 0x1 > $1/phys-id
+	echo "sched step" > $1/capabilities
+}
+
+for n in $COUNTS; do
+	dir=$TMP/spu-$n
+	mkdir -p $dir
+	i=0
+	while [ $i -lt $n ]; do
+		# every fourth context lives in a gang
+		if [ $((i % 4)) -eq 0 ]; then
+			mkctx $dir/gang$((i / 64))/spethread-$$-$i
+		else
+			mkctx $dir/spethread-$$-$i
+		fi
+		i=$((i + 1))
+	done
+	$SPU_PS --spufs=$dir --benchmark=$REFRESHES
+done
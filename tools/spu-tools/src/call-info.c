@@ -0,0 +1,432 @@
+/*
+ * Copyright (C) 2008 IBM Corp.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include "spu-tools.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <dirent.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/***********************************************
+ * PER-CALL INFORMATION
+ ***********************************************/
+
+struct field call_fields[] = {
+	{ CALL_PPU_PID,      "PID",     "%6s",     "%6d",     "PPU Side Process ID",                  1, "PPU_PID" },
+	{ CALL_THREAD_ID,    "TID",     "%6s",     "%6d",     "PPU Side Thread ID",                   1, "THREAD_ID" },
+	{ CALL_SPE,          "SPE",     "%4s",     "%4s",     "SPE Number",                           1, "SPE" },
+	{ CALL_CLASS,        "CLASS",   " %-6s",   " %-6s",   "Library Call Class",                   1, "CLASS" },
+	{ CALL_NAME,         "CALL",    " %-12s",  " %-12s",  "Library Call",                         1, "CALL" },
+	{ CALL_RATE,         "CALLS/s", "%9s",     "%9.1f",   "Calls per Second",                     1, "RATE" },
+	{ CALL_PERCENT_TIME, "%TIME",   "%7s",     "%7.1f",   "Time Spent Servicing the Call",        1, "PERCENT_TIME" },
+	{ CALL_AVG_TIME,     "AVG_us",  "%9s",     "%9.1f",   "Average Service Time in microseconds", 1, "AVG_TIME" },
+	{ CALL_COUNT,        "COUNT",   "%10s",    "%10llu",  "Total Number of Calls",                0, "COUNT" },
+	{ CALL_TOTAL_TIME,   "TIME",    "%9s",     "%9.3f",   "Total Service Time in seconds",        0, "TOTAL_TIME" },
+	{ CALL_PERCENT_SPU,  "%SPU",    "%6s",     "%6.1f",   "SPU Usage of the Context",             1, "PERCENT_SPU" },
+	{ CALL_BINARY_NAME,  "BINARY",  " %-18s",  " %-18s",  "Binary Name",                          1, "BINARY_NAME" },
+
+	{ 0,            NULL,   NULL ,     NULL,    NULL,                        0, NULL }
+};
+
+static const char *class_names[CALLSTATS_NR_CLASSES] = {
+	"C99", "POSIX1", "LIBEA", "OTHER"
+};
+
+/* opcodes, in the order of the libspe2 default handlers */
+static const char *c99_names[] = {
+	NULL, "clearerr", "fclose", "feof", "ferror", "fflush", "fgetc",
+	"fgetpos", "fgets", "fileno", "fopen", "fputc", "fputs", "fread",
+	"freopen", "fseek", "fsetpos", "ftell", "fwrite", "getc", "getchar",
+	"gets", "perror", "putc", "putchar", "puts", "remove", "rename",
+	"rewind", "setbuf", "setvbuf", "system", "tmpfile", "tmpnam",
+	"ungetc", "vfprintf", "vfscanf", "vprintf", "vscanf", "vsnprintf",
+	"vsprintf", "vsscanf"
+};
+
+static const char *posix1_names[] = {
+	NULL, "adjtimex", "close", "creat", "fstat", "ftok", "getpagesize",
+	"gettimeofday", "kill", "lseek", "lstat", "mmap", "mremap", "msync",
+	"munmap", "open", "read", "shmat", "shmctl", "shmdt", "shmget",
+	"shm_open", "shm_unlink", "stat", "unlink", "wait", "waitpid",
+	"write", "ftruncate", "access", "dup", "time", "nanosleep", "chdir",
+	"fchdir", "mkdir", "mknod", "rmdir", "chmod", "fchmod", "chown",
+	"fchown", "lchown", "getcwd", "link", "symlink", "readlink", "sync",
+	"fsync", "fdatasync", "dup2", "lockf", "truncate", "mkstemp",
+	"mktemp", "opendir", "closedir", "readdir", "rewinddir", "seekdir",
+	"telldir", "sched_yield", "umask", "utime", "utimes", "pread",
+	"pwrite", "readv", "writev"
+};
+
+static const char *libea_names[] = {
+	NULL, "calloc", "free", "malloc", "realloc", "posix_memalign"
+};
+
+#define N_NAMES(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+static const char *call_name(const struct call *call, char *buf)
+{
+	const char *name = NULL;
+
+	switch (call->class) {
+		case CALLSTATS_C99:
+			if (call->op < N_NAMES(c99_names))
+				name = c99_names[call->op];
+			break;
+		case CALLSTATS_POSIX1:
+			if (call->op < N_NAMES(posix1_names))
+				name = posix1_names[call->op];
+			break;
+		case CALLSTATS_LIBEA:
+			if (call->op < N_NAMES(libea_names))
+				name = libea_names[call->op];
+			break;
+		default:
+			/* user registered handlers have no opcodes */
+			sprintf(buf, "0x21%02x", call->op);
+			return buf;
+	}
+	if (!name) {
+		sprintf(buf, "op%d", call->op);
+		return buf;
+	}
+	return name;
+}
+
+static int call_sort_descending = 1;
+
+static enum call_field_id call_sort_field = CALL_PERCENT_TIME;
+
+inline enum call_field_id get_call_sort_field()
+{
+	return call_sort_field;
+}
+
+inline void set_call_sort_field(enum call_field_id field)
+{
+	call_sort_field = field;
+}
+
+void set_call_sort_descending(int descending)
+{
+	call_sort_descending = descending;
+}
+
+/*
+ * The segments stay mapped while their context exists; the previous
+ * counters give the per-period figures.
+ */
+#define CALLMAP_HASH 64
+
+struct callmap {
+	int id;                  /* of the context */
+	int generation;
+	struct callstats *stats;
+	struct callstats *prev;
+	struct callmap *next;
+};
+
+static struct callmap *callmaps[CALLMAP_HASH];
+static int generation;
+
+static struct callstats *map_callstats(struct ctx *ctx)
+{
+	char path[PATH_MAX], *p;
+	struct callstats *stats;
+	struct stat st;
+	int fd;
+
+	if (!ctx->path)
+		return NULL;
+
+	p = path + sprintf(path, CALLSTATS_PATH "/" CALLSTATS_PREFIX);
+	snprintf(p, sizeof(path) - (p - path), "%s", ctx->path);
+	for (; *p; p++)
+		if (*p == '/')
+			*p = '.';
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	/* libspe2 may not have sized it yet */
+	if (fstat(fd, &st) || st.st_size < sizeof(*stats)) {
+		close(fd);
+		return NULL;
+	}
+	stats = mmap(NULL, sizeof(*stats), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	return stats == MAP_FAILED ? NULL : stats;
+}
+
+static struct callmap *get_callmap(struct ctx *ctx)
+{
+	struct callmap *m;
+	int h = ctx->id % CALLMAP_HASH;
+
+	for (m = callmaps[h]; m; m = m->next)
+		if (m->id == ctx->id)
+			break;
+	if (!m) {
+		m = calloc(1, sizeof(*m));
+		if (!m)
+			exit(-ENOMEM);
+		m->id = ctx->id;
+		m->next = callmaps[h];
+		callmaps[h] = m;
+	}
+	m->generation = generation;
+
+	if (!m->stats) {
+		m->stats = map_callstats(ctx);
+		if (!m->stats)
+			return NULL;
+		m->prev = malloc(sizeof(*m->prev));
+		if (!m->prev)
+			exit(-ENOMEM);
+		/* the first period starts now */
+		memcpy(m->prev, m->stats, sizeof(*m->prev));
+	}
+
+	/* a segment left behind by a crashed process may carry the name */
+	if (m->stats->magic != CALLSTATS_MAGIC ||
+	    m->stats->version != CALLSTATS_VERSION ||
+	    m->stats->pid != ctx->ppu_pid)
+		return NULL;
+
+	return m;
+}
+
+static void put_callmaps()
+{
+	struct callmap **p, *m;
+	int h;
+
+	for (h = 0; h < CALLMAP_HASH; h++) {
+		p = &callmaps[h];
+		while ((m = *p) != NULL) {
+			if (m->generation == generation) {
+				p = &m->next;
+				continue;
+			}
+			*p = m->next;
+			if (m->stats)
+				munmap(m->stats, sizeof(*m->stats));
+			free(m->prev);
+			free(m);
+		}
+	}
+}
+
+static struct call *calls;
+static struct call **call_table;
+static int calls_capacity;
+
+static void calls_ensure_capacity(int n)
+{
+	if (n < calls_capacity)
+		return;
+	calls_capacity = n + 256;
+	calls = realloc(calls, sizeof(struct call) * calls_capacity);
+	call_table = realloc(call_table, sizeof(struct call *) * (calls_capacity + 1));
+	if (!calls || !call_table)
+		exit(-ENOMEM);
+}
+
+#define CMP(a, b) ((a) < (b) ? -1 : (a) > (b))
+
+static int calls_compare(const void *v1, const void *v2)
+{
+	int ret;
+	char n1[16], n2[16];
+	const struct call *c1, *c2;
+
+	c1 = *(struct call * const *)v1;
+	c2 = *(struct call * const *)v2;
+
+	switch (call_sort_field) {
+		case CALL_PPU_PID:
+			ret = c1->ctx->ppu_pid - c2->ctx->ppu_pid; break;
+		case CALL_THREAD_ID:
+			ret = c1->ctx->thread_id - c2->ctx->thread_id; break;
+		case CALL_SPE:
+			ret = c1->ctx->spe - c2->ctx->spe; break;
+		case CALL_CLASS:
+			ret = c1->class - c2->class; break;
+		case CALL_NAME:
+			ret = strcmp(call_name(c1, n1), call_name(c2, n2)); break;
+		case CALL_RATE:
+			ret = CMP(c1->rate, c2->rate); break;
+		case CALL_PERCENT_TIME:
+			ret = CMP(c1->percent_time, c2->percent_time); break;
+		case CALL_AVG_TIME:
+			ret = CMP(c1->avg_us, c2->avg_us); break;
+		case CALL_COUNT:
+			ret = CMP(c1->count, c2->count); break;
+		case CALL_TOTAL_TIME:
+			ret = CMP(c1->time_ns, c2->time_ns); break;
+		case CALL_PERCENT_SPU:
+			ret = CMP(c1->ctx->percent_spu, c2->ctx->percent_spu); break;
+		case CALL_BINARY_NAME:
+			ret = strcmp(c1->ctx->binary_name, c2->ctx->binary_name); break;
+		default:
+			ret = 0;
+	}
+
+	/* idle calls are ordered by how much they cost overall */
+	if (!ret)
+		ret = CMP(c1->time_ns, c2->time_ns);
+
+	return call_sort_descending? -ret : ret;
+}
+
+struct call **get_calls(struct ctx **ctxs, u64 period)
+{
+	struct callmap *m;
+	struct call *call;
+	u64 dcount, dtime;
+	int i, class, op, n = 0;
+
+	if (!ctxs)
+		return NULL;
+
+	generation++;
+	for (i = 0; ctxs[i]; i++) {
+		m = get_callmap(ctxs[i]);
+		if (!m)
+			continue;
+
+		for (class = 0; class < CALLSTATS_NR_CLASSES; class++) {
+			for (op = 0; op < 256; op++) {
+				if (!m->stats->calls[class][op].count)
+					continue;
+
+				calls_ensure_capacity(n + 1);
+				call = &calls[n++];
+				call->ctx = ctxs[i];
+				call->class = class;
+				call->op = op;
+				call->count = m->stats->calls[class][op].count;
+				call->time_ns = m->stats->calls[class][op].time_ns;
+
+				dcount = call->count - m->prev->calls[class][op].count;
+				dtime = call->time_ns - m->prev->calls[class][op].time_ns;
+				call->rate = period ? dcount * 1000.0 / period : 0.0;
+				call->percent_time = period ? dtime / (period * 10000.0) : 0.0;
+				call->avg_us = call->time_ns / 1000.0 / call->count;
+			}
+		}
+		memcpy(m->prev, m->stats, sizeof(*m->prev));
+	}
+	put_callmaps();
+
+	calls_ensure_capacity(n);
+	for (i = 0; i < n; i++)
+		call_table[i] = &calls[i];
+	call_table[n] = NULL;
+
+	qsort(call_table, n, sizeof(struct call *), calls_compare);
+
+	return call_table;
+}
+
+/*
+ * Removes the segments of the processes that are gone: libspe2 removes a
+ * segment with its context, which a crashed process never destroys.
+ * Returns the number of segments removed, or -1.
+ */
+int clean_callstats()
+{
+	char path[PATH_MAX];
+	struct callstats stats;
+	struct dirent *entry;
+	DIR *dir;
+	int fd, stale, n = 0;
+
+	dir = opendir(CALLSTATS_PATH);
+	if (!dir)
+		return -1;
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (strncmp(entry->d_name, CALLSTATS_PREFIX, strlen(CALLSTATS_PREFIX)))
+			continue;
+		snprintf(path, sizeof(path), CALLSTATS_PATH "/%s", entry->d_name);
+		fd = open(path, O_RDONLY);
+		if (fd < 0)
+			continue;
+		/* one that is not filled in yet belongs to a live process */
+		stale = read(fd, &stats, sizeof(stats)) == sizeof(stats) &&
+			stats.magic == CALLSTATS_MAGIC &&
+			kill(stats.pid, 0) && errno == ESRCH;
+		close(fd);
+		if (stale && !unlink(path))
+			n++;
+	}
+	closedir(dir);
+
+	return n;
+}
+
+int print_call_field(struct call *call, char *buf, enum call_field_id field,
+		     const char *format)
+{
+	switch(field) {
+		case CALL_PPU_PID:
+			return sprintf(buf, format, call->ctx->ppu_pid);
+		case CALL_THREAD_ID:
+			return sprintf(buf, format, call->ctx->thread_id);
+		case CALL_SPE:
+			if (call->ctx->spe == SPE_NONE || call->ctx->spe == SPE_UNKNOWN)
+				return sprintf(buf, format, "-");
+			else {
+				char spe[8];
+				sprintf(spe, "%d", call->ctx->spe);
+				return sprintf(buf, format, spe);
+			}
+		case CALL_CLASS:
+			return sprintf(buf, format, class_names[call->class]);
+		case CALL_NAME: {
+			char name[16];
+			return sprintf(buf, format, call_name(call, name));
+		}
+		case CALL_RATE:
+			return sprintf(buf, format, call->rate);
+		case CALL_PERCENT_TIME:
+			return sprintf(buf, format, call->percent_time);
+		case CALL_AVG_TIME:
+			return sprintf(buf, format, call->avg_us);
+		case CALL_COUNT:
+			return sprintf(buf, format, call->count);
+		case CALL_TOTAL_TIME:
+			return sprintf(buf, format, call->time_ns / 1000000000.0);
+		case CALL_PERCENT_SPU:
+			return sprintf(buf, format, call->ctx->percent_spu);
+		case CALL_BINARY_NAME:
+			return sprintf(buf, format, call->ctx->binary_name);
+		default :
+			return 0;
+	}
+}
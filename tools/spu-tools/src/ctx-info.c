@@ -19,6 +19,7 @@
  *
  */
 
+#define _GNU_SOURCE
 #include "spu-tools.h"
 
 #include <stdio.h>
@@ -33,6 +34,9 @@
 #include <pwd.h>
 #include <assert.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
 
 float PERCENT(u64 old_t, u64 new_t, u64 tot_t) {
 	float ret = ((tot_t) > 0)?
@@ -68,6 +72,14 @@ static struct ctx** ctxs;
 static int ctxs_n;
 static int ctxs_capacity;
 
+static const char *spufs_path = SPUFS_PATH;
+static int spufs_fd = -1;
+
+void set_spufs_path(const char *path)
+{
+	spufs_path = path;
+}
+
 
 /* USERNAME CACHE */
 
@@ -254,44 +266,62 @@ static int ctxs_compare(const void *v1, const void *v2)
 	return ctx_sort_descending? -ret : ret;
 }
 
-static struct ctx *alloc_ctx()
+/* CONTEXT INDEX
+ *
+ * Contexts are indexed by their path relative to the spufs mount point
+ * ("ctx" or "gang/ctx"), which is also the name inotify reports.
+ */
+
+#define CTX_HASH_SIZE 256
+static struct ctx *ctx_hash[CTX_HASH_SIZE];
+
+static unsigned int hash_path(const char *path)
 {
-	struct ctx *s;
+	unsigned int h = 5381;
 
-	s = (struct ctx *)calloc(1, sizeof(struct ctx));
-	s->ppu_pid = 0;
-	s->status = '?';
-	return s;
+	while (*path)
+		h = h * 33 + (unsigned char)*path++;
+	return h % CTX_HASH_SIZE;
 }
 
-static int ctxs_ensure_capacity(int n)
+static struct ctx *ctxs_lookup(const char *path)
 {
-	while (ctxs_capacity < n) {
-		void* ret;
-		ret = realloc(ctxs, sizeof(struct ctx*) *
-			(ctxs_capacity + DEFAULT_CAPACITY));
-		if (!ret)
-			exit(-ENOMEM);
-		ctxs = ret;
-		ctxs_capacity += DEFAULT_CAPACITY;
-	}
-	return ctxs_capacity;
-}
+	struct ctx *ctx;
 
+	for (ctx = ctx_hash[hash_path(path)]; ctx; ctx = ctx->hash_next)
+		if (!strcmp(ctx->path, path))
+			return ctx;
+	return NULL;
+}
 
-static struct ctx *ctxs_get_ctx(int thread_id)
+static void ctxs_hash_remove(struct ctx *ctx)
 {
-	int i;
+	struct ctx **p;
 
-	/* This could be optimized by using a hash table */
-	for (i = 0; i < ctxs_n; i++) {
-		if (ctxs[i]->thread_id == thread_id)
-			return ctxs[i];
+	for (p = &ctx_hash[hash_path(ctx->path)]; *p; p = &(*p)->hash_next) {
+		if (*p == ctx) {
+			*p = ctx->hash_next;
+			break;
+		}
 	}
-	return NULL;
 }
 
-static int find_thread_pid(int thread_id)
+
+/* TID -> PID CACHE */
+
+#define TID_HASH_SIZE 64
+
+struct tid_pid {
+	int tid;
+	int pid;
+	int refs;
+	struct tid_pid *next;
+};
+
+static struct tid_pid *tid_hash[TID_HASH_SIZE];
+
+/* Fallback for kernels not exposing hidden thread entries in /proc */
+static int walk_thread_pid(int thread_id)
 {
 	DIR* proc_dir;
 	struct dirent *entry;
@@ -312,120 +342,231 @@ static int find_thread_pid(int thread_id)
 	return pid;
 }
 
-static int
-process_ctx_entry(struct dirent *entry, const char *gang_name, u64 last_period)
+static int read_file_at(int dirfd, const char *name, char *buf, size_t size)
 {
-	static char buf[PATH_MAX];
-	FILE *fp;
-	int uid, thread_id;
-	struct ctx *ctx;
-
-	if (gang_name)
-		sprintf(buf, "%s/%s/%s", SPUFS_PATH, gang_name, entry->d_name);
-	else
-		sprintf(buf, "%s/%s", SPUFS_PATH, entry->d_name);
-	chdir(buf);
-
-	fp = fopen("tid", "r");
-	if (fp) {
-		fscanf(fp, "%d", &thread_id);
-		fclose(fp);
-	} else {
-		return 0;
-	}
+	int fd, n;
+
+	fd = openat(dirfd, name, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	n = read(fd, buf, size - 1);
+	close(fd);
+	if (n < 0)
+		return -1;
+	buf[n] = '\0';
+	return n;
+}
 
-	ctx = ctxs_get_ctx(thread_id);
-	if (!ctx) {
-		ctxs_ensure_capacity(ctxs_n + 1);
-		ctx = alloc_ctx();
-		ctxs[ctxs_n] = ctx;
-		ctxs_n++;
+static int find_thread_pid(int thread_id)
+{
+	struct tid_pid *tp;
+	static char buf[4096];
+	char path[64];
+	char *tgid;
+	int pid = -1;
 
-		ctx->thread_id = thread_id;
-		ctx->ppu_pid = find_thread_pid(thread_id);
+	for (tp = tid_hash[thread_id % TID_HASH_SIZE]; tp; tp = tp->next) {
+		if (tp->tid == thread_id) {
+			tp->refs++;
+			return tp->pid;
+		}
 	}
 
-	sprintf(buf, "%s/%d/stat", PROCFS_PATH, ctx->ppu_pid);
-	fp = fopen(buf, "r");
-	if (fp) {
-		fscanf(fp, "%d %s", &ctx->ppu_pid, buf);
-		buf[strlen(buf)-1] = '\0';         /* Remove trailing ')'*/
-		ctx->binary_name = strdup(buf+1);  /* Skip initial '('   */
-		fclose(fp);
-	} else {
-		return 0;
-	}
+	/* /proc/<tid> is reachable even though readdir does not list it */
+	sprintf(path, "%s/%d/status", PROCFS_PATH, thread_id);
+	if (read_file_at(AT_FDCWD, path, buf, sizeof(buf)) > 0 &&
+	    (tgid = strstr(buf, "\nTgid:")) != NULL)
+		sscanf(tgid + 6, "%d", &pid);
+	if (pid < 0)
+		pid = walk_thread_pid(thread_id);
+	if (pid < 0)
+		return pid;
+
+	tp = malloc(sizeof(*tp));
+	if (!tp)
+		exit(-ENOMEM);
+	tp->tid = thread_id;
+	tp->pid = pid;
+	tp->refs = 1;
+	tp->next = tid_hash[thread_id % TID_HASH_SIZE];
+	tid_hash[thread_id % TID_HASH_SIZE] = tp;
+	return pid;
+}
 
-	sprintf(buf, "%s/%d/status", PROCFS_PATH, ctx->ppu_pid);
-	fp = fopen(buf, "r");
-	if (fp) {
-		while (fscanf(fp, "%s", buf) != EOF) {
-			if (!strncmp(buf, "Uid:", 4)) {
-				fscanf(fp, "%d", &uid);
-				ctx->user = get_username(uid);
-				break;
+/* Thread ids get recycled, so drop the entry with its last context */
+static void put_thread_pid(int thread_id)
+{
+	struct tid_pid **p, *tp;
+
+	for (p = &tid_hash[thread_id % TID_HASH_SIZE]; *p; p = &(*p)->next) {
+		if ((*p)->tid == thread_id) {
+			tp = *p;
+			if (--tp->refs == 0) {
+				*p = tp->next;
+				free(tp);
 			}
+			return;
 		}
-		fclose(fp);
 	}
+}
 
-	if (access("phys-id", R_OK) != 0) {
-		ctx->spe = SPE_UNKNOWN;
-	} else {
-		fp = fopen("phys-id", "r");
-		if (fp) {
-			fscanf(fp, "%x", &ctx->spe);
-			fclose(fp);
-		}
-	}
 
-	fp = fopen("stat", "r");
-	if (fp) {
-		u64 last_time;
-		last_time = ctx->time[TIME_TOTAL];
-		fscanf(fp, "%s %llu %llu %llu %llu "
-			"%llu %llu %llu %llu %llu %llu %llu %llu",
-			buf,                            /* current SPE state */
-			&ctx->time[TIME_USER],          /* total user time in milliseconds */
-			&ctx->time[TIME_SYSTEM],        /* total system time in milliseconds */
-			&ctx->time[TIME_IOWAIT],        /* total iowait time in milliseconds */
-			&ctx->time[TIME_LOADED],        /* total loaded time in milliseconds */
-			&ctx->voluntary_ctx_switches,   /* number of voluntary context switches */
-			&ctx->involuntary_ctx_switches, /* number of involuntary context switches */
-			&ctx->slb_misses,               /* number of SLB misses */
-			&ctx->hash_faults,              /* number of hash faults */
-			&ctx->minor_page_faults,        /* number of minor page faults */
-			&ctx->major_page_faults,        /* number of major page faults */
-			&ctx->class2_interrupts,        /* number of class2 interrupts received */
-			&ctx->ppe_library);             /* number of ppe assisted library performed */
-
-		fclose(fp);
-
-		ctx->status = toupper(buf[0]);
-		ctx->time[TIME_TOTAL] = ctx->time[TIME_USER] + ctx->time[TIME_SYSTEM]
-					+ ctx->time[TIME_IOWAIT];
-		ctx->percent_spu = PERCENT(last_time, ctx->time[TIME_TOTAL], last_period);
-	} else {
-		ctx->status = '?';
-	}
+/* PER-CTX DATA */
 
-	fp = fopen("capabilities", "r");
-	if (fp) {
-		ctx->flags = 'I';
-		while (fscanf(fp, "%s", buf) != EOF) {
-			if (!strcmp(buf, "sched")) {
-				ctx->flags = ' ';
-				break;
-			}
-		}
-		fclose(fp);
+static struct ctx *alloc_ctx()
+{
+	struct ctx *s;
+
+	s = (struct ctx *)calloc(1, sizeof(struct ctx));
+	s->ppu_pid = 0;
+	s->status = '?';
+	s->dirfd = -1;
+	return s;
+}
+
+static int ctxs_ensure_capacity(int n)
+{
+	while (ctxs_capacity < n) {
+		void* ret;
+		ret = realloc(ctxs, sizeof(struct ctx*) *
+			(ctxs_capacity + DEFAULT_CAPACITY));
+		if (!ret)
+			exit(-ENOMEM);
+		ctxs = ret;
+		ctxs_capacity += DEFAULT_CAPACITY;
 	}
-	else {
+	return ctxs_capacity;
+}
+
+static void free_ctx(struct ctx *ctx)
+{
+	ctxs_hash_remove(ctx);
+	if (ctx->ppu_pid > 0)
+		put_thread_pid(ctx->thread_id);
+	if (ctx->dirfd >= 0)
+		close(ctx->dirfd);
+	free(ctx->path);
+	free(ctx->binary_name);
+	free(ctx);
+}
+
+/*
+ * Reads the information that does not change during the lifetime of a
+ * context. Everything here is done only once, when the context shows up.
+ */
+static int init_ctx(struct ctx *ctx)
+{
+	static char buf[4096];
+	char path[64];
+	char *p, *q;
+	int uid;
+
+	if (read_file_at(ctx->dirfd, "tid", buf, sizeof(buf)) <= 0 ||
+	    sscanf(buf, "%d", &ctx->thread_id) != 1)
+		return -1;
+
+	ctx->ppu_pid = find_thread_pid(ctx->thread_id);
+	if (ctx->ppu_pid < 0)
+		return -1;
+
+	sprintf(path, "%s/%d/stat", PROCFS_PATH, ctx->ppu_pid);
+	if (read_file_at(AT_FDCWD, path, buf, sizeof(buf)) <= 0)
+		return -1;
+	p = strchr(buf, '(');
+	q = strrchr(buf, ')');
+	if (!p || !q || q < p)
+		return -1;
+	*q = '\0';
+	ctx->binary_name = strdup(p + 1);
+
+	ctx->user = "UNKNOWN";
+	sprintf(path, "%s/%d/status", PROCFS_PATH, ctx->ppu_pid);
+	if (read_file_at(AT_FDCWD, path, buf, sizeof(buf)) > 0 &&
+	    (p = strstr(buf, "\nUid:")) != NULL &&
+	    sscanf(p + 5, "%d", &uid) == 1)
+		ctx->user = get_username(uid);
+
+	if (read_file_at(ctx->dirfd, "capabilities", buf, sizeof(buf)) >= 0)
+		ctx->flags = strstr(buf, "sched") ? ' ' : 'I';
+	else
 		ctx->flags = '?';
+
+	return 0;
+}
+
+static int last_ctx_id;
+
+static void add_ctx(const char *path)
+{
+	struct ctx *ctx;
+
+	if (ctxs_lookup(path))
+		return;
+
+	ctx = alloc_ctx();
+	ctx->id = ++last_ctx_id;
+	ctx->dirfd = openat(spufs_fd, path, O_RDONLY | O_DIRECTORY);
+	if (ctx->dirfd >= 0)
+		fcntl(ctx->dirfd, F_SETFD, FD_CLOEXEC);
+	ctx->path = strdup(path);
+	if (ctx->dirfd < 0 || init_ctx(ctx) < 0) {
+		free(ctx->path);
+		if (ctx->dirfd >= 0)
+			close(ctx->dirfd);
+		if (ctx->ppu_pid > 0)
+			put_thread_pid(ctx->thread_id);
+		free(ctx->binary_name);
+		free(ctx);
+		return;
 	}
 
-	ctx->updated = 1;
-	chdir(SPUFS_PATH);
+	ctx->hash_next = ctx_hash[hash_path(path)];
+	ctx_hash[hash_path(path)] = ctx;
+
+	ctxs_ensure_capacity(ctxs_n + 2);
+	ctxs[ctxs_n++] = ctx;
+}
+
+/*
+ * Per-refresh update. Only the files whose contents change are read, all
+ * of them relative to the context directory. A failure here means the
+ * context was destroyed.
+ */
+static int update_ctx(struct ctx *ctx, u64 last_period)
+{
+	static char buf[4096];
+	static char state[64];
+	u64 last_time;
+
+	if (read_file_at(ctx->dirfd, "stat", buf, sizeof(buf)) <= 0)
+		return -1;
+
+	last_time = ctx->time[TIME_TOTAL];
+	sscanf(buf, "%63s %llu %llu %llu %llu "
+		"%llu %llu %llu %llu %llu %llu %llu %llu",
+		state,                          /* current SPE state */
+		&ctx->time[TIME_USER],          /* total user time in milliseconds */
+		&ctx->time[TIME_SYSTEM],        /* total system time in milliseconds */
+		&ctx->time[TIME_IOWAIT],        /* total iowait time in milliseconds */
+		&ctx->time[TIME_LOADED],        /* total loaded time in milliseconds */
+		&ctx->voluntary_ctx_switches,   /* number of voluntary context switches */
+		&ctx->involuntary_ctx_switches, /* number of involuntary context switches */
+		&ctx->slb_misses,               /* number of SLB misses */
+		&ctx->hash_faults,              /* number of hash faults */
+		&ctx->minor_page_faults,        /* number of minor page faults */
+		&ctx->major_page_faults,        /* number of major page faults */
+		&ctx->class2_interrupts,        /* number of class2 interrupts received */
+		&ctx->ppe_library);             /* number of ppe assisted library performed */
+
+	ctx->status = toupper(state[0]);
+	ctx->time[TIME_TOTAL] = ctx->time[TIME_USER] + ctx->time[TIME_SYSTEM]
+				+ ctx->time[TIME_IOWAIT];
+	ctx->percent_spu = PERCENT(last_time, ctx->time[TIME_TOTAL], last_period);
+
+	if (read_file_at(ctx->dirfd, "phys-id", buf, sizeof(buf)) <= 0 ||
+	    sscanf(buf, "%x", &ctx->spe) != 1)
+		ctx->spe = SPE_UNKNOWN;
+
 	return 0;
 }
 
@@ -434,49 +575,270 @@ void ctxs_delete(int index)
 	int i;
 
 	assert(ctxs[index]);
-	free(ctxs[index]->binary_name);
+	free_ctx(ctxs[index]);
 	for (i = index; i < ctxs_n; i++)
 		ctxs[i] = ctxs[i + 1];
 	ctxs_n--;
 }
 
-struct ctx **get_spu_contexts(u64 last_period)
+
+/* DISCOVERY
+ *
+ * The spufs tree is walked once and then kept up to date with inotify:
+ * one watch on the mount point and one on each gang directory. A full
+ * walk is still done on queue overflow, when a new directory could not
+ * be classified yet, and every RESCAN_PERIOD refreshes in case spufs
+ * missed an event. Without inotify every refresh does a full walk.
+ */
+
+#define RESCAN_PERIOD 64
+
+struct gang_watch {
+	int wd;
+	char *name;
+	struct gang_watch *next;
+};
+
+static int inotify_fd = -1;
+static int root_wd = -1;
+static struct gang_watch *gang_watches;
+static int need_rescan = 1;
+static int refreshes;
+
+static void watch_gang(const char *name)
 {
-	struct dirent *entry, *gang_entry;
-	DIR *ctxs_dir, *gang_dir;
-	int i;
 	static char buf[PATH_MAX];
+	struct gang_watch *gw;
+	int wd;
+
+	if (inotify_fd < 0)
+		return;
+
+	sprintf(buf, "%s/%s", spufs_path, name);
+	wd = inotify_add_watch(inotify_fd, buf,
+			IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR);
+	if (wd < 0)
+		return;
+
+	for (gw = gang_watches; gw; gw = gw->next)
+		if (gw->wd == wd)
+			return;
+
+	gw = malloc(sizeof(*gw));
+	if (!gw)
+		exit(-ENOMEM);
+	gw->wd = wd;
+	gw->name = strdup(name);
+	gw->next = gang_watches;
+	gang_watches = gw;
+}
 
-	ctxs_dir = opendir(SPUFS_PATH);
-	if (!ctxs_dir)
-		return NULL;
+static void unwatch_gang(int wd)
+{
+	struct gang_watch **p, *gw;
+
+	for (p = &gang_watches; *p; p = &(*p)->next) {
+		if ((*p)->wd == wd) {
+			gw = *p;
+			*p = gw->next;
+			free(gw->name);
+			free(gw);
+			return;
+		}
+	}
+}
+
+static const char *gang_name(int wd)
+{
+	struct gang_watch *gw;
+
+	for (gw = gang_watches; gw; gw = gw->next)
+		if (gw->wd == wd)
+			return gw->name;
+	return NULL;
+}
+
+static int init_scanner()
+{
+	if (spufs_fd >= 0)
+		return 0;
+
+	spufs_fd = open(spufs_path, O_RDONLY | O_DIRECTORY);
+	if (spufs_fd < 0)
+		return -1;
+	fcntl(spufs_fd, F_SETFD, FD_CLOEXEC);
+
+	inotify_fd = inotify_init();
+	if (inotify_fd < 0)
+		return 0;
+	fcntl(inotify_fd, F_SETFL, O_NONBLOCK);
+	fcntl(inotify_fd, F_SETFD, FD_CLOEXEC);
+
+	root_wd = inotify_add_watch(inotify_fd, spufs_path,
+			IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR);
+	if (root_wd < 0) {
+		close(inotify_fd);
+		inotify_fd = -1;
+	}
+	return 0;
+}
 
-	for (i = 0; i < ctxs_n; i++)
-		ctxs[i]->updated = 0;
+static int is_ctx_dir(int dirfd, const char *name)
+{
+	static char buf[PATH_MAX];
+	struct stat st;
+
+	sprintf(buf, "%s/stat", name);
+	return fstatat(dirfd, buf, &st, 0) == 0;
+}
+
+static void scan_gang(int root_fd, const char *name)
+{
+	static char buf[PATH_MAX];
+	struct dirent *entry;
+	DIR *gang_dir;
+	int fd;
+
+	fd = openat(root_fd, name, O_RDONLY | O_DIRECTORY);
+	if (fd < 0)
+		return;
+	gang_dir = fdopendir(fd);
+	if (!gang_dir) {
+		close(fd);
+		return;
+	}
+
+	while ((entry = readdir(gang_dir)) != NULL) {
+		if (entry->d_name[0] == '.')
+			continue;
+		if (is_ctx_dir(fd, entry->d_name)) {
+			sprintf(buf, "%s/%s", name, entry->d_name);
+			add_ctx(buf);
+		}
+	}
+	closedir(gang_dir);
+}
+
+static int full_scan()
+{
+	struct dirent *entry;
+	DIR *ctxs_dir;
+	int root_fd;
+
+	ctxs_dir = opendir(spufs_path);
+	if (!ctxs_dir)
+		return -1;
+	root_fd = dirfd(ctxs_dir);
 
 	while ((entry = readdir(ctxs_dir)) != NULL) {
-		sprintf(buf, "%s/%s/stat", SPUFS_PATH, entry->d_name);
-		if (access(buf, F_OK) == 0) {
-			process_ctx_entry(entry, NULL, last_period);
+		if (entry->d_name[0] == '.')
+			continue;
+		if (is_ctx_dir(root_fd, entry->d_name)) {
+			add_ctx(entry->d_name);
 		} else {
-			/* contexts within a gang */
-			sprintf(buf, "%s/%s", SPUFS_PATH, entry->d_name);
-			gang_dir = opendir(buf);
-			if (gang_dir) {
-				while ((gang_entry = readdir(gang_dir)) != NULL) {
-					sprintf(buf, "%s/%s/%s/stat", SPUFS_PATH, entry->d_name, gang_entry->d_name);
-					if (access(buf, F_OK) == 0)
-						process_ctx_entry(gang_entry, entry->d_name, last_period);
-				}
-				closedir(gang_dir);
-			}
+			/* contexts within a gang; watch before reading */
+			watch_gang(entry->d_name);
+			scan_gang(root_fd, entry->d_name);
 		}
 	}
-
 	closedir(ctxs_dir);
+	need_rescan = 0;
+	return 0;
+}
+
+static void remove_ctx(const char *path)
+{
+	struct ctx *ctx;
+	int i;
+
+	ctx = ctxs_lookup(path);
+	if (!ctx)
+		return;
 	for (i = 0; i < ctxs_n; i++) {
-		if (!ctxs[i]->updated)
+		if (ctxs[i] == ctx) {
+			ctxs_delete(i);
+			return;
+		}
+	}
+}
+
+static void handle_event(struct inotify_event *ev)
+{
+	static char buf[PATH_MAX];
+	const char *gang = NULL;
+
+	if (ev->mask & IN_Q_OVERFLOW) {
+		need_rescan = 1;
+		return;
+	}
+	if (ev->mask & IN_IGNORED) {
+		unwatch_gang(ev->wd);
+		return;
+	}
+	if (!ev->len || !(ev->mask & IN_ISDIR))
+		return;
+
+	if (ev->wd != root_wd) {
+		gang = gang_name(ev->wd);
+		if (!gang)
+			return;
+		sprintf(buf, "%s/%s", gang, ev->name);
+	} else {
+		strcpy(buf, ev->name);
+	}
+
+	if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+		remove_ctx(buf);
+		return;
+	}
+
+	if (is_ctx_dir(spufs_fd, buf)) {
+		add_ctx(buf);
+	} else if (!gang) {
+		/* either a new gang or a context still being populated */
+		watch_gang(buf);
+		scan_gang(spufs_fd, buf);
+		need_rescan = 1;
+	}
+}
+
+static void process_events()
+{
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event *ev;
+	int n, off;
+
+	while ((n = read(inotify_fd, buf, sizeof(buf))) > 0) {
+		for (off = 0; off < n; off += sizeof(*ev) + ev->len) {
+			ev = (struct inotify_event *)(buf + off);
+			handle_event(ev);
+		}
+	}
+}
+
+void sort_ctxs(struct ctx **table, int n)
+{
+	qsort(table, n, sizeof(struct ctx *), ctxs_compare);
+}
+
+struct ctx **get_spu_contexts(u64 last_period)
+{
+	int i;
+
+	if (init_scanner() < 0)
+		return NULL;
+
+	if (inotify_fd >= 0)
+		process_events();
+	if (inotify_fd < 0 || need_rescan || ++refreshes % RESCAN_PERIOD == 0)
+		if (full_scan() < 0)
+			return NULL;
+
+	for (i = 0; i < ctxs_n; ) {
+		if (update_ctx(ctxs[i], last_period) < 0)
 			ctxs_delete(i);
+		else
+			i++;
 	}
 
 	ctxs_ensure_capacity(ctxs_n + 1);
@@ -486,4 +848,3 @@ struct ctx **get_spu_contexts(u64 last_period)
 
 	return ctxs;
 }
-
@@ -0,0 +1,582 @@
+/*
+ * Copyright (C) 2008 IBM Corp.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include "spu-tools.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#define REC_TAG_CTX   'C'
+#define REC_TAG_KEY   'K'
+#define REC_TAG_FRAME 'F'
+
+/**********************************************
+ * ENCODING
+ **********************************************/
+
+static void put_varint(FILE *fp, u64 v)
+{
+	while (v >= 0x80) {
+		putc((v & 0x7f) | 0x80, fp);
+		v >>= 7;
+	}
+	putc(v, fp);
+}
+
+static void put_svarint(FILE *fp, long long v)
+{
+	put_varint(fp, ((u64)v << 1) ^ (u64)(v >> 63));
+}
+
+static void put_string(FILE *fp, const char *s)
+{
+	size_t len = s ? strlen(s) : 0;
+
+	put_varint(fp, len);
+	fwrite(s, 1, len, fp);
+}
+
+static int get_byte(struct recording *rec, int *c)
+{
+	if (rec->pos >= rec->size)
+		return -1;
+	*c = rec->map[rec->pos++];
+	return 0;
+}
+
+static int get_varint(struct recording *rec, u64 *v)
+{
+	int shift = 0, c;
+
+	*v = 0;
+	do {
+		if (get_byte(rec, &c) || shift > 63)
+			return -1;
+		*v |= (u64)(c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+	return 0;
+}
+
+static int get_svarint(struct recording *rec, long long *v)
+{
+	u64 u;
+
+	if (get_varint(rec, &u))
+		return -1;
+	*v = (long long)(u >> 1) ^ -(long long)(u & 1);
+	return 0;
+}
+
+static int get_string(struct recording *rec, char **s)
+{
+	u64 len;
+
+	if (get_varint(rec, &len) || len > rec->size - rec->pos)
+		return -1;
+	*s = malloc(len + 1);
+	if (!*s)
+		return -1;
+	memcpy(*s, rec->map + rec->pos, len);
+	(*s)[len] = '\0';
+	rec->pos += len;
+	return 0;
+}
+
+
+/**********************************************
+ * CONTEXT TABLE
+ **********************************************/
+
+static struct rec_ctx *lookup_ctx(struct recording *rec, int id)
+{
+	struct rec_ctx *c;
+
+	for (c = rec->ctx_hash[id % REC_CTX_HASH]; c; c = c->next)
+		if (c->id == id)
+			return c;
+	return NULL;
+}
+
+static struct rec_ctx *insert_ctx(struct recording *rec, int id)
+{
+	struct rec_ctx *c;
+
+	c = calloc(1, sizeof(*c));
+	if (!c)
+		exit(-ENOMEM);
+	c->id = id;
+	c->frame = -1;
+	c->next = rec->ctx_hash[id % REC_CTX_HASH];
+	rec->ctx_hash[id % REC_CTX_HASH] = c;
+	return c;
+}
+
+static void free_ctx(struct rec_ctx *c)
+{
+	free(c->binary_name);
+	free(c->user);
+	free(c->path);
+	free(c);
+}
+
+
+/**********************************************
+ * WRITER
+ **********************************************/
+
+static u64 wall_us()
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (u64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+struct recording *rec_create(const char *path, u32 interval_us, int nspus,
+			     const int *numbers)
+{
+	struct recording *rec;
+	int i;
+
+	rec = calloc(1, sizeof(*rec));
+	if (!rec)
+		return NULL;
+	rec->spus = calloc(nspus ? nspus : 1, sizeof(struct rec_spu));
+	rec->spu_prev = calloc((nspus ? nspus : 1) * REC_NCOUNTERS, sizeof(u64));
+	if (!rec->spus || !rec->spu_prev) {
+		rec_close(rec);
+		return NULL;
+	}
+	rec->fp = fopen(path, "w");
+	if (!rec->fp) {
+		rec_close(rec);
+		return NULL;
+	}
+
+	rec->interval_us = interval_us;
+	rec->nspus = nspus;
+	rec->start_us = wall_us();
+	rec->frame = -1;
+
+	fwrite(REC_MAGIC, 1, sizeof(REC_MAGIC) - 1, rec->fp);
+	put_varint(rec->fp, interval_us);
+	put_varint(rec->fp, rec->start_us);
+	put_varint(rec->fp, nspus);
+	for (i = 0; i < nspus; i++) {
+		rec->spus[i].number = numbers[i];
+		put_varint(rec->fp, numbers[i]);
+	}
+	return rec;
+}
+
+static void ctx_values(struct ctx *ctx, u64 *v)
+{
+	v[REC_USER] = ctx->time[TIME_USER];
+	v[REC_SYSTEM] = ctx->time[TIME_SYSTEM];
+	v[REC_IOWAIT] = ctx->time[TIME_IOWAIT];
+	v[REC_LOADED] = ctx->time[TIME_LOADED];
+	v[REC_VCSW] = ctx->voluntary_ctx_switches;
+	v[REC_ICSW] = ctx->involuntary_ctx_switches;
+	v[REC_SLB] = ctx->slb_misses;
+	v[REC_HFLT] = ctx->hash_faults;
+	v[REC_MINFLT] = ctx->minor_page_faults;
+	v[REC_MAJFLT] = ctx->major_page_faults;
+	v[REC_IRQ2] = ctx->class2_interrupts;
+	v[REC_PPE_LIB] = ctx->ppe_library;
+}
+
+/*
+ * Appends a frame with the current contents of rec->spus and the given
+ * contexts. t_us is the time since the start of the recording.
+ */
+int rec_write_frame(struct recording *rec, u64 t_us, struct ctx **ctxs)
+{
+	struct rec_ctx *c, **cp;
+	u64 v[REC_NCOUNTERS];
+	long frame = rec->frame + 1;
+	int key = frame % REC_KEYFRAME == 0;
+	int i, j, n;
+
+	for (n = 0; ctxs && ctxs[n]; n++) {
+		if (lookup_ctx(rec, ctxs[n]->id))
+			continue;
+		c = insert_ctx(rec, ctxs[n]->id);
+		putc(REC_TAG_CTX, rec->fp);
+		put_varint(rec->fp, ctxs[n]->id);
+		put_varint(rec->fp, ctxs[n]->ppu_pid);
+		put_varint(rec->fp, ctxs[n]->thread_id);
+		put_string(rec->fp, ctxs[n]->binary_name);
+		put_string(rec->fp, ctxs[n]->user);
+		put_string(rec->fp, ctxs[n]->path);
+	}
+
+	putc(key ? REC_TAG_KEY : REC_TAG_FRAME, rec->fp);
+	put_varint(rec->fp, key ? t_us : t_us - rec->t_us);
+
+	for (i = 0; i < rec->nspus; i++) {
+		u64 *prev = rec->spu_prev + i * REC_NCOUNTERS;
+
+		putc(rec->spus[i].state, rec->fp);
+		for (j = 0; j < REC_NCOUNTERS; j++) {
+			if (key)
+				put_varint(rec->fp, rec->spus[i].v[j]);
+			else
+				put_svarint(rec->fp, rec->spus[i].v[j] - prev[j]);
+			prev[j] = rec->spus[i].v[j];
+		}
+	}
+
+	put_varint(rec->fp, n);
+	for (i = 0; i < n; i++) {
+		c = lookup_ctx(rec, ctxs[i]->id);
+		ctx_values(ctxs[i], v);
+		put_varint(rec->fp, c->id);
+		putc(ctxs[i]->status, rec->fp);
+		put_svarint(rec->fp, ctxs[i]->spe);
+		for (j = 0; j < REC_NCOUNTERS; j++) {
+			if (key)
+				put_varint(rec->fp, v[j]);
+			else
+				put_svarint(rec->fp, v[j] - (c->frame == frame - 1 ? c->v[j] : 0));
+			c->v[j] = v[j];
+		}
+		c->frame = frame;
+	}
+
+	/* the writer only needs the contexts of the last frame */
+	for (i = 0; i < REC_CTX_HASH; i++) {
+		cp = &rec->ctx_hash[i];
+		while ((c = *cp) != NULL) {
+			if (c->frame != frame) {
+				*cp = c->next;
+				free_ctx(c);
+			} else {
+				cp = &c->next;
+			}
+		}
+	}
+
+	rec->frame = frame;
+	rec->t_us = t_us;
+	return ferror(rec->fp) ? -1 : 0;
+}
+
+int rec_close(struct recording *rec)
+{
+	struct rec_ctx *c, *next;
+	int ret = 0;
+	int i;
+
+	if (rec->fp)
+		ret = fclose(rec->fp);
+	if (rec->map)
+		munmap(rec->map, rec->size);
+	for (i = 0; i < REC_CTX_HASH; i++) {
+		for (c = rec->ctx_hash[i]; c; c = next) {
+			next = c->next;
+			free_ctx(c);
+		}
+	}
+	free(rec->keys);
+	free(rec->spu_prev);
+	free(rec->spus);
+	free(rec);
+	return ret;
+}
+
+
+/**********************************************
+ * READER
+ **********************************************/
+
+static int read_ctx_def(struct recording *rec)
+{
+	struct rec_ctx *c;
+	u64 id, pid, tid;
+	char *name, *user, *path;
+
+	if (get_varint(rec, &id) || get_varint(rec, &pid) || get_varint(rec, &tid))
+		return -1;
+	if (get_string(rec, &name))
+		return -1;
+	if (get_string(rec, &user)) {
+		free(name);
+		return -1;
+	}
+	if (get_string(rec, &path)) {
+		free(name);
+		free(user);
+		return -1;
+	}
+
+	if (lookup_ctx(rec, id)) {
+		/* already known from the initial scan */
+		free(name);
+		free(user);
+		free(path);
+		return 0;
+	}
+
+	c = insert_ctx(rec, id);
+	c->pid = pid;
+	c->tid = tid;
+	c->binary_name = name;
+	c->user = user;
+	c->path = path;
+	c->list = rec->ctxs;
+	rec->ctxs = c;
+	return 0;
+}
+
+/* Decodes the next frame, with any context definitions before it */
+static int read_frame(struct recording *rec)
+{
+	struct rec_ctx *c;
+	long frame = rec->frame + 1;
+	long long d;
+	u64 t, n, id, v;
+	int tag, state, key, i, j;
+
+	for (;;) {
+		if (get_byte(rec, &tag))
+			return -1;
+		if (tag != REC_TAG_CTX)
+			break;
+		if (read_ctx_def(rec))
+			return -1;
+	}
+	if (tag != REC_TAG_KEY && tag != REC_TAG_FRAME)
+		return -1;
+	key = tag == REC_TAG_KEY;
+
+	if (get_varint(rec, &t))
+		return -1;
+	t = key ? t : rec->t_us + t;
+
+	for (i = 0; i < rec->nspus; i++) {
+		if (get_byte(rec, &state))
+			return -1;
+		rec->spus[i].state = state;
+		for (j = 0; j < REC_NCOUNTERS; j++) {
+			if (key) {
+				if (get_varint(rec, &v))
+					return -1;
+				rec->spus[i].v[j] = v;
+			} else {
+				if (get_svarint(rec, &d))
+					return -1;
+				rec->spus[i].v[j] += d;
+			}
+		}
+	}
+
+	if (get_varint(rec, &n))
+		return -1;
+	for (i = 0; i < n; i++) {
+		if (get_varint(rec, &id) || get_byte(rec, &state) || get_svarint(rec, &d))
+			return -1;
+		c = lookup_ctx(rec, id);
+		if (!c)
+			return -1;
+		c->state = state;
+		c->spe = d;
+		for (j = 0; j < REC_NCOUNTERS; j++) {
+			if (key) {
+				if (get_varint(rec, &v))
+					return -1;
+				c->v[j] = v;
+			} else {
+				if (get_svarint(rec, &d))
+					return -1;
+				c->v[j] = (c->frame == frame - 1 ? c->v[j] : 0) + d;
+			}
+		}
+		c->frame = frame;
+	}
+
+	rec->frame = frame;
+	rec->t_us = t;
+	return 0;
+}
+
+/*
+ * Maps a recording and indexes its keyframes. A truncated last frame,
+ * as left by an interrupted spu-record, is ignored.
+ */
+struct recording *rec_open(const char *path)
+{
+	struct recording *rec;
+	struct stat st;
+	u64 interval, start, nspus, number;
+	size_t pos;
+	int fd, i;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &st) || st.st_size < sizeof(REC_MAGIC) - 1) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	rec = calloc(1, sizeof(*rec));
+	if (!rec) {
+		close(fd);
+		return NULL;
+	}
+	rec->size = st.st_size;
+	rec->map = mmap(NULL, rec->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (rec->map == MAP_FAILED) {
+		free(rec);
+		return NULL;
+	}
+
+	if (memcmp(rec->map, REC_MAGIC, sizeof(REC_MAGIC) - 1))
+		goto invalid;
+	rec->pos = sizeof(REC_MAGIC) - 1;
+	if (get_varint(rec, &interval) || get_varint(rec, &start) ||
+	    get_varint(rec, &nspus) || nspus > 1024)
+		goto invalid;
+	rec->interval_us = interval;
+	rec->start_us = start;
+	rec->nspus = nspus;
+	rec->spus = calloc(nspus ? nspus : 1, sizeof(struct rec_spu));
+	if (!rec->spus)
+		goto invalid;
+	for (i = 0; i < nspus; i++) {
+		if (get_varint(rec, &number))
+			goto invalid;
+		rec->spus[i].number = number;
+	}
+
+	rec->frame = -1;
+	for (;;) {
+		pos = rec->pos;
+		if (read_frame(rec))
+			break;
+		if (rec->frame % REC_KEYFRAME == 0) {
+			if (rec->nkeys % 64 == 0) {
+				void *keys = realloc(rec->keys,
+					(rec->nkeys + 64) * sizeof(struct rec_key));
+				if (!keys)
+					goto invalid;
+				rec->keys = keys;
+			}
+			rec->keys[rec->nkeys].frame = rec->frame;
+			rec->keys[rec->nkeys].t_us = rec->t_us;
+			rec->keys[rec->nkeys].pos = pos;
+			rec->nkeys++;
+		}
+		rec->duration_us = rec->t_us;
+	}
+	rec->nframes = rec->frame + 1;
+	if (!rec->nframes)
+		goto invalid;
+
+	rec_seek(rec, 0);
+	return rec;
+
+invalid:
+	rec_close(rec);
+	errno = EINVAL;
+	return NULL;
+}
+
+/* Positions the reader at the last frame not later than t_us */
+int rec_seek(struct recording *rec, u64 t_us)
+{
+	struct rec_ctx *c;
+	int lo = 0, hi = rec->nkeys - 1, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (rec->keys[mid].t_us <= t_us)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	for (c = rec->ctxs; c; c = c->list)
+		c->frame = -1;
+	rec->pos = rec->keys[lo].pos;
+	rec->frame = rec->keys[lo].frame - 1;
+	if (read_frame(rec))
+		return -1;
+
+	while (rec->frame + 1 < rec->nframes && rec_next_time(rec) <= t_us)
+		if (rec_next(rec))
+			return -1;
+	return 0;
+}
+
+int rec_next(struct recording *rec)
+{
+	if (rec->frame + 1 >= rec->nframes)
+		return -1;
+	return read_frame(rec);
+}
+
+/* Time of the frame after the current one, without consuming it */
+u64 rec_next_time(struct recording *rec)
+{
+	size_t pos = rec->pos;
+	char *s;
+	u64 t, skip;
+	int tag;
+
+	if (rec->frame + 1 >= rec->nframes)
+		return (u64)-1;
+
+	for (;;) {
+		if (get_byte(rec, &tag))
+			goto out;
+		if (tag != REC_TAG_CTX)
+			break;
+		/* id, pid, tid and three strings */
+		if (get_varint(rec, &skip) || get_varint(rec, &skip) ||
+		    get_varint(rec, &skip))
+			goto out;
+		if (get_string(rec, &s))
+			goto out;
+		free(s);
+		if (get_string(rec, &s))
+			goto out;
+		free(s);
+		if (get_string(rec, &s))
+			goto out;
+		free(s);
+	}
+	if (get_varint(rec, &t))
+		goto out;
+	rec->pos = pos;
+	return tag == REC_TAG_KEY ? t : rec->t_us + t;
+out:
+	rec->pos = pos;
+	return (u64)-1;
+}
@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) 2008 IBM Corp.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include "spu-tools.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <curses.h>
+
+/*
+ * spu-top shows a recording through a window ending at the cursor: usage
+ * percentages are computed over the whole window, like the live view
+ * does over its refresh period, and the per-SPU percentile fields give
+ * the distribution of the usage over every recorded interval inside it.
+ */
+
+#define DEFAULT_WINDOW 100000   /* us */
+#define MIN_STEP       1000     /* us */
+
+static struct recording *rec;
+static const char *rec_path;
+static u64 cursor, window = DEFAULT_WINDOW, step = DEFAULT_WINDOW;
+static int playing = 1;
+static long window_frames;
+
+static struct spu *spu_pool;
+static struct spu **spu_table;
+static u64 *spu_mark;            /* counters at the window start */
+static u64 *spu_prev;            /* busy and idle time of the last frame */
+static float **spu_usage;        /* per-interval usage samples */
+static long spu_usage_capacity;
+
+static struct ctx *ctx_pool;
+static struct ctx **ctx_table;
+static u64 *ctx_mark;            /* indexed like the context list */
+static int ctx_capacity;
+
+int replay_open(const char *path)
+{
+	int i;
+
+	rec = rec_open(path);
+	if (!rec)
+		return -1;
+	rec_path = path;
+
+	spu_pool = calloc(rec->nspus + 1, sizeof(struct spu));
+	spu_table = calloc(rec->nspus + 1, sizeof(struct spu *));
+	spu_mark = calloc((rec->nspus + 1) * REC_NCOUNTERS, sizeof(u64));
+	spu_prev = calloc((rec->nspus + 1) * 2, sizeof(u64));
+	spu_usage = calloc(rec->nspus + 1, sizeof(float *));
+	if (!spu_pool || !spu_table || !spu_mark || !spu_prev || !spu_usage)
+		return -1;
+
+	if (rec->interval_us > step)
+		window = step = rec->interval_us;
+	cursor = window < rec->duration_us ? window : rec->duration_us;
+
+	/* percentiles are what a replay is about, show them by default */
+	for (i = 0; spu_fields[i].id; i++) {
+		switch (spu_fields[i].id) {
+			case SPU_PERCENTILE_50:
+			case SPU_PERCENTILE_90:
+			case SPU_PERCENTILE_99:
+			case SPU_PERCENT_MAX:
+				spu_fields[i].do_show = 1;
+		}
+	}
+	return 0;
+}
+
+void replay_advance(u64 elapsed_ms)
+{
+	if (!playing)
+		return;
+	cursor += elapsed_ms * 1000;
+	if (cursor >= rec->duration_us) {
+		cursor = rec->duration_us;
+		playing = 0;
+	}
+}
+
+int replay_key(int ch)
+{
+	switch (ch) {
+		case ' ':
+			playing = !playing;
+			if (playing && cursor >= rec->duration_us)
+				cursor = 0;
+			break;
+		case KEY_LEFT:
+			cursor = cursor > step ? cursor - step : 0;
+			break;
+		case KEY_RIGHT:
+			cursor = cursor + step < rec->duration_us ?
+				cursor + step : rec->duration_us;
+			break;
+		case KEY_HOME:
+			cursor = 0;
+			break;
+		case KEY_END:
+			cursor = rec->duration_us;
+			break;
+		case '[':
+			step = step / 2 > MIN_STEP ? step / 2 : MIN_STEP;
+			break;
+		case ']':
+			step *= 2;
+			break;
+		case '<':
+			window = window / 2 > rec->interval_us ? window / 2 : rec->interval_us;
+			break;
+		case '>':
+			window *= 2;
+			break;
+		default:
+			return 0;
+	}
+	return 1;
+}
+
+static int compare_float(const void *a, const void *b)
+{
+	float fa = *(const float *)a, fb = *(const float *)b;
+
+	return fa < fb ? -1 : fa > fb;
+}
+
+static float percentile(float *v, long n, int p)
+{
+	return n ? v[(n - 1) * p / 100] : 0.0;
+}
+
+static u64 busy(u64 *v)
+{
+	return v[REC_USER] + v[REC_SYSTEM] + v[REC_IOWAIT];
+}
+
+static void ensure_ctx_capacity(int n)
+{
+	if (n <= ctx_capacity)
+		return;
+	ctx_capacity = n + 32;
+	ctx_pool = realloc(ctx_pool, ctx_capacity * sizeof(struct ctx));
+	ctx_table = realloc(ctx_table, (ctx_capacity + 1) * sizeof(struct ctx *));
+	ctx_mark = realloc(ctx_mark, ctx_capacity * sizeof(u64));
+	if (!ctx_pool || !ctx_table || !ctx_mark)
+		exit(-ENOMEM);
+}
+
+static void fill_spu(struct spu *spu, struct rec_spu *r, u64 *mark)
+{
+	enum time time;
+	u64 period;
+
+	spu->number = r->number;
+	spu->state = r->state;
+	spu->time[TIME_USER] = r->v[REC_USER];
+	spu->time[TIME_SYSTEM] = r->v[REC_SYSTEM];
+	spu->time[TIME_IOWAIT] = r->v[REC_IOWAIT];
+	spu->time[TIME_IDLE] = r->v[REC_IDLE];
+	spu->time[TIME_TOTAL] = busy(r->v);
+	spu->last_time[TIME_USER] = mark[REC_USER];
+	spu->last_time[TIME_SYSTEM] = mark[REC_SYSTEM];
+	spu->last_time[TIME_IOWAIT] = mark[REC_IOWAIT];
+	spu->last_time[TIME_IDLE] = mark[REC_IDLE];
+	spu->last_time[TIME_TOTAL] = busy(mark);
+
+	spu->voluntary_ctx_switches = r->v[REC_VCSW];
+	spu->involuntary_ctx_switches = r->v[REC_ICSW];
+	spu->slb_misses = r->v[REC_SLB];
+	spu->hash_faults = r->v[REC_HFLT];
+	spu->minor_page_faults = r->v[REC_MINFLT];
+	spu->major_page_faults = r->v[REC_MAJFLT];
+	spu->class2_interrupts = r->v[REC_IRQ2];
+	spu->ppe_library = r->v[REC_PPE_LIB];
+
+	period = (spu->time[TIME_TOTAL] - spu->last_time[TIME_TOTAL]) +
+		(spu->time[TIME_IDLE] - spu->last_time[TIME_IDLE]);
+	for_each_time(time)
+		spu->percent[time] = PERCENT(spu->last_time[time], spu->time[time], period);
+}
+
+static void fill_ctx(struct ctx *ctx, struct rec_ctx *r, u64 mark, u64 period_ms)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->id = r->id;
+	ctx->ppu_pid = r->pid;
+	ctx->thread_id = r->tid;
+	ctx->user = r->user;
+	ctx->binary_name = r->binary_name;
+	ctx->path = r->path;
+	ctx->dirfd = -1;
+	ctx->status = r->state;
+	ctx->flags = ' ';
+	ctx->spe = r->spe;
+
+	ctx->time[TIME_USER] = r->v[REC_USER];
+	ctx->time[TIME_SYSTEM] = r->v[REC_SYSTEM];
+	ctx->time[TIME_IOWAIT] = r->v[REC_IOWAIT];
+	ctx->time[TIME_LOADED] = r->v[REC_LOADED];
+	ctx->time[TIME_TOTAL] = busy(r->v);
+	ctx->percent_spu = PERCENT(mark, ctx->time[TIME_TOTAL], period_ms);
+
+	ctx->voluntary_ctx_switches = r->v[REC_VCSW];
+	ctx->involuntary_ctx_switches = r->v[REC_ICSW];
+	ctx->slb_misses = r->v[REC_SLB];
+	ctx->hash_faults = r->v[REC_HFLT];
+	ctx->minor_page_faults = r->v[REC_MINFLT];
+	ctx->major_page_faults = r->v[REC_MAJFLT];
+	ctx->class2_interrupts = r->v[REC_IRQ2];
+	ctx->ppe_library = r->v[REC_PPE_LIB];
+}
+
+/*
+ * Builds the SPU and context tables for the window ending at the cursor,
+ * decoding every frame inside it once.
+ */
+void replay_sample(struct spu ***spus, struct ctx ***ctxs)
+{
+	struct rec_ctx *c;
+	u64 start, t0, b, idle;
+	long n = 0;
+	int i, nctx;
+
+	start = cursor > window ? cursor - window : 0;
+	rec_seek(rec, start);
+	t0 = rec->t_us;
+
+	for (i = 0; i < rec->nspus; i++)
+		memcpy(spu_mark + i * REC_NCOUNTERS, rec->spus[i].v,
+			sizeof(rec->spus[i].v));
+	for (nctx = 0, c = rec->ctxs; c; c = c->list)
+		nctx++;
+	ensure_ctx_capacity(nctx);
+	for (i = 0, c = rec->ctxs; c; c = c->list, i++)
+		ctx_mark[i] = c->frame == rec->frame ? busy(c->v) : 0;
+
+	while (rec_next_time(rec) <= cursor) {
+		if (n >= spu_usage_capacity) {
+			spu_usage_capacity += 1024;
+			for (i = 0; i < rec->nspus; i++) {
+				spu_usage[i] = realloc(spu_usage[i],
+					spu_usage_capacity * sizeof(float));
+				if (!spu_usage[i])
+					exit(-ENOMEM);
+			}
+		}
+		for (i = 0; i < rec->nspus; i++) {
+			spu_prev[2 * i] = busy(rec->spus[i].v);
+			spu_prev[2 * i + 1] = rec->spus[i].v[REC_IDLE];
+		}
+		if (rec_next(rec))
+			break;
+		for (i = 0; i < rec->nspus; i++) {
+			b = busy(rec->spus[i].v) - spu_prev[2 * i];
+			idle = rec->spus[i].v[REC_IDLE] - spu_prev[2 * i + 1];
+			spu_usage[i][n] = PERCENT(0, b, b + idle);
+		}
+		n++;
+	}
+	window_frames = n;
+
+	for (i = 0; i < rec->nspus; i++) {
+		fill_spu(&spu_pool[i], &rec->spus[i], spu_mark + i * REC_NCOUNTERS);
+		qsort(spu_usage[i], n, sizeof(float), compare_float);
+		spu_pool[i].percentile[0] = percentile(spu_usage[i], n, 50);
+		spu_pool[i].percentile[1] = percentile(spu_usage[i], n, 90);
+		spu_pool[i].percentile[2] = percentile(spu_usage[i], n, 99);
+		spu_pool[i].percent_max = percentile(spu_usage[i], n, 100);
+		spu_table[i] = &spu_pool[i];
+	}
+	spu_table[rec->nspus] = NULL;
+	sort_spus(spu_table, rec->nspus);
+
+	for (nctx = 0, i = 0, c = rec->ctxs; c; c = c->list, i++) {
+		if (c->frame != rec->frame)
+			continue;
+		fill_ctx(&ctx_pool[nctx], c, ctx_mark[i], (rec->t_us - t0) / 1000);
+		ctx_table[nctx] = &ctx_pool[nctx];
+		nctx++;
+	}
+	ctx_table[nctx] = NULL;
+	sort_ctxs(ctx_table, nctx);
+
+	*spus = spu_table;
+	*ctxs = ctx_table;
+}
+
+void replay_status(char *line1, char *line2)
+{
+	sprintf(line1, "Replay %s: %.3fs of %.3fs%s",
+		rec_path, cursor / 1000000.0, rec->duration_us / 1000000.0,
+		playing ? "" : " [paused]");
+	sprintf(line2, "Window %.3fs (%ld intervals of %.1fms), step %.3fs",
+		window / 1000000.0, window_frames, rec->interval_us / 1000.0,
+		step / 1000000.0);
+}
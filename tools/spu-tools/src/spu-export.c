@@ -0,0 +1,697 @@
+/*
+ * Copyright (C) 2008 IBM Corp.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include "spu-tools.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <getopt.h>
+
+#define DEFAULT_INTERVAL 1000   /* ms */
+#define DEFAULT_HISTORY  60     /* samples */
+
+#define die(...) do { fprintf(stderr, __VA_ARGS__); exit(1); } while (0)
+
+/**********************************************
+ * COUNTERS
+ **********************************************/
+
+enum counter {
+	C_USER_TIME = 0,
+	C_SYSTEM_TIME,
+	C_IOWAIT_TIME,
+	C_LOADED_TIME,
+	C_IDLE_TIME,
+	C_VOLUNTARY_CTX_SWITCHES,
+	C_INVOLUNTARY_CTX_SWITCHES,
+	C_SLB_MISSES,
+	C_HASH_FAULTS,
+	C_MINOR_PAGE_FAULTS,
+	C_MAJOR_PAGE_FAULTS,
+	C_CLASS2_INTERRUPTS,
+	C_PPE_LIBRARY,
+	C_MAX
+};
+
+#define K_SPU  1
+#define K_CTX  2
+#define K_PROC 4
+
+static const struct {
+	const char *name;
+	int kinds;
+} counters[C_MAX] = {
+	{ "user_ms",                  K_SPU | K_CTX | K_PROC },
+	{ "system_ms",                K_SPU | K_CTX | K_PROC },
+	{ "iowait_ms",                K_SPU | K_CTX | K_PROC },
+	{ "loaded_ms",                K_CTX | K_PROC },
+	{ "idle_ms",                  K_SPU },
+	{ "voluntary_ctx_switches",   K_SPU | K_CTX | K_PROC },
+	{ "involuntary_ctx_switches", K_SPU | K_CTX | K_PROC },
+	{ "slb_misses",               K_SPU | K_CTX | K_PROC },
+	{ "hash_faults",              K_SPU | K_CTX | K_PROC },
+	{ "minor_page_faults",        K_SPU | K_CTX | K_PROC },
+	{ "major_page_faults",        K_SPU | K_CTX | K_PROC },
+	{ "class2_interrupts",        K_SPU | K_CTX | K_PROC },
+	{ "ppe_library",              K_SPU | K_CTX | K_PROC },
+};
+
+#define for_each_counter(c, kind) \
+	for ((c) = 0; (c) < C_MAX; (c)++) if (counters[c].kinds & (kind))
+
+static void spu_counters(struct spu *spu, u64 *v)
+{
+	v[C_USER_TIME] = spu->time[TIME_USER];
+	v[C_SYSTEM_TIME] = spu->time[TIME_SYSTEM];
+	v[C_IOWAIT_TIME] = spu->time[TIME_IOWAIT];
+	v[C_LOADED_TIME] = 0;
+	v[C_IDLE_TIME] = spu->time[TIME_IDLE];
+	v[C_VOLUNTARY_CTX_SWITCHES] = spu->voluntary_ctx_switches;
+	v[C_INVOLUNTARY_CTX_SWITCHES] = spu->involuntary_ctx_switches;
+	v[C_SLB_MISSES] = spu->slb_misses;
+	v[C_HASH_FAULTS] = spu->hash_faults;
+	v[C_MINOR_PAGE_FAULTS] = spu->minor_page_faults;
+	v[C_MAJOR_PAGE_FAULTS] = spu->major_page_faults;
+	v[C_CLASS2_INTERRUPTS] = spu->class2_interrupts;
+	v[C_PPE_LIBRARY] = spu->ppe_library;
+}
+
+static void ctx_counters(struct ctx *ctx, u64 *v)
+{
+	v[C_USER_TIME] = ctx->time[TIME_USER];
+	v[C_SYSTEM_TIME] = ctx->time[TIME_SYSTEM];
+	v[C_IOWAIT_TIME] = ctx->time[TIME_IOWAIT];
+	v[C_LOADED_TIME] = ctx->time[TIME_LOADED];
+	v[C_IDLE_TIME] = 0;
+	v[C_VOLUNTARY_CTX_SWITCHES] = ctx->voluntary_ctx_switches;
+	v[C_INVOLUNTARY_CTX_SWITCHES] = ctx->involuntary_ctx_switches;
+	v[C_SLB_MISSES] = ctx->slb_misses;
+	v[C_HASH_FAULTS] = ctx->hash_faults;
+	v[C_MINOR_PAGE_FAULTS] = ctx->minor_page_faults;
+	v[C_MAJOR_PAGE_FAULTS] = ctx->major_page_faults;
+	v[C_CLASS2_INTERRUPTS] = ctx->class2_interrupts;
+	v[C_PPE_LIBRARY] = ctx->ppe_library;
+}
+
+static void proc_counters(struct proc *proc, u64 *v)
+{
+	v[C_USER_TIME] = proc->time[TIME_USER];
+	v[C_SYSTEM_TIME] = proc->time[TIME_SYSTEM];
+	v[C_IOWAIT_TIME] = proc->time[TIME_IOWAIT];
+	v[C_LOADED_TIME] = proc->time[TIME_LOADED];
+	v[C_IDLE_TIME] = 0;
+	v[C_VOLUNTARY_CTX_SWITCHES] = proc->voluntary_ctx_switches;
+	v[C_INVOLUNTARY_CTX_SWITCHES] = proc->involuntary_ctx_switches;
+	v[C_SLB_MISSES] = proc->slb_misses;
+	v[C_HASH_FAULTS] = proc->hash_faults;
+	v[C_MINOR_PAGE_FAULTS] = proc->minor_page_faults;
+	v[C_MAJOR_PAGE_FAULTS] = proc->major_page_faults;
+	v[C_CLASS2_INTERRUPTS] = proc->class2_interrupts;
+	v[C_PPE_LIBRARY] = proc->ppe_library;
+}
+
+
+/**********************************************
+ * DELTAS
+ *
+ * Every sampled entity (SPU, context, process) keeps its previous
+ * counters here, so deltas are computed once per sample and shared by
+ * all output formats. Entries not seen in a sample are dropped.
+ **********************************************/
+
+#define PREV_HASH_SIZE 256
+
+struct prev {
+	int kind;
+	char *key;
+	u64 value[C_MAX];
+	int seen;
+	struct prev *next;
+};
+
+static struct prev *prev_hash[PREV_HASH_SIZE];
+
+static unsigned int hash_key(int kind, const char *key)
+{
+	unsigned int h = kind;
+
+	while (*key)
+		h = h * 33 + (unsigned char)*key++;
+	return h % PREV_HASH_SIZE;
+}
+
+/*
+ * Fills delta with the increase since the last sample of the same
+ * entity. New entities and counter resets report the raw value.
+ */
+static void compute_delta(int kind, const char *key, u64 *value, u64 *delta)
+{
+	struct prev *p;
+	unsigned int h = hash_key(kind, key);
+	int c;
+
+	for (p = prev_hash[h]; p; p = p->next)
+		if (p->kind == kind && !strcmp(p->key, key))
+			break;
+
+	if (!p) {
+		p = calloc(1, sizeof(*p));
+		if (!p)
+			exit(-ENOMEM);
+		p->kind = kind;
+		p->key = strdup(key);
+		p->next = prev_hash[h];
+		prev_hash[h] = p;
+	}
+
+	for (c = 0; c < C_MAX; c++) {
+		delta[c] = value[c] >= p->value[c] ? value[c] - p->value[c] : value[c];
+		p->value[c] = value[c];
+	}
+	p->seen = 1;
+}
+
+static void expire_deltas()
+{
+	struct prev **pp, *p;
+	int i;
+
+	for (i = 0; i < PREV_HASH_SIZE; i++) {
+		pp = &prev_hash[i];
+		while ((p = *pp) != NULL) {
+			if (!p->seen) {
+				*pp = p->next;
+				free(p->key);
+				free(p);
+			} else {
+				p->seen = 0;
+				pp = &p->next;
+			}
+		}
+	}
+}
+
+
+/* Counters and deltas of the current sample, indexed like the tables */
+struct sample {
+	int n;
+	int capacity;
+	u64 (*value)[C_MAX];
+	u64 (*delta)[C_MAX];
+};
+
+static struct sample spu_sample, ctx_sample, proc_sample;
+
+static void sample_reserve(struct sample *s, int n)
+{
+	if (n <= s->capacity)
+		return;
+	s->capacity = n + 32;
+	s->value = realloc(s->value, s->capacity * sizeof(*s->value));
+	s->delta = realloc(s->delta, s->capacity * sizeof(*s->delta));
+	if (!s->value || !s->delta)
+		exit(-ENOMEM);
+}
+
+static void compute_sample(struct spu **spus, struct ctx **ctxs, struct proc **procs)
+{
+	char key[32];
+	int i;
+
+	for (i = 0; spus && spus[i]; i++) {
+		sample_reserve(&spu_sample, i + 1);
+		sprintf(key, "%d", spus[i]->number);
+		spu_counters(spus[i], spu_sample.value[i]);
+		compute_delta(K_SPU, key, spu_sample.value[i], spu_sample.delta[i]);
+	}
+	spu_sample.n = i;
+
+	for (i = 0; ctxs && ctxs[i]; i++) {
+		sample_reserve(&ctx_sample, i + 1);
+		ctx_counters(ctxs[i], ctx_sample.value[i]);
+		compute_delta(K_CTX, ctxs[i]->path, ctx_sample.value[i], ctx_sample.delta[i]);
+	}
+	ctx_sample.n = i;
+
+	for (i = 0; procs && procs[i]; i++) {
+		sample_reserve(&proc_sample, i + 1);
+		sprintf(key, "%d", procs[i]->ppu_pid);
+		proc_counters(procs[i], proc_sample.value[i]);
+		compute_delta(K_PROC, key, proc_sample.value[i], proc_sample.delta[i]);
+	}
+	proc_sample.n = i;
+
+	expire_deltas();
+}
+
+
+/**********************************************
+ * HISTORY
+ *
+ * Ring of the last history_n per-SPU samples. Memory is allocated once,
+ * so rates over the whole window cost nothing to keep around.
+ **********************************************/
+
+static int history_n = DEFAULT_HISTORY;
+static int history_spus;
+static int history_head;
+static int history_count;
+static double *history_time;
+static u64 *history_value;      /* history_n x history_spus x C_MAX */
+
+static u64 *history_slot(int slot, int spu)
+{
+	return history_value + ((u64)slot * history_spus + spu) * C_MAX;
+}
+
+static void history_init(int nspus)
+{
+	history_spus = nspus;
+	history_time = calloc(history_n, sizeof(double));
+	history_value = calloc((size_t)history_n * (nspus ? nspus : 1) * C_MAX, sizeof(u64));
+	if (!history_time || !history_value)
+		exit(-ENOMEM);
+}
+
+static void history_push(double t)
+{
+	int i;
+
+	history_time[history_head] = t;
+	for (i = 0; i < history_spus && i < spu_sample.n; i++)
+		memcpy(history_slot(history_head, i), spu_sample.value[i],
+			sizeof(spu_sample.value[i]));
+	history_head = (history_head + 1) % history_n;
+	if (history_count < history_n)
+		history_count++;
+}
+
+/*
+ * Per-second rate of a counter of the i-th SPU over the whole window.
+ * Returns the window length in seconds, 0 if there is not enough data.
+ */
+static double history_rate(int spu, enum counter c, double *rate)
+{
+	int newest, oldest;
+	double dt;
+	u64 v0, v1;
+
+	*rate = 0;
+	if (history_count < 2)
+		return 0;
+
+	newest = (history_head + history_n - 1) % history_n;
+	oldest = (history_head + history_n - history_count) % history_n;
+	dt = history_time[newest] - history_time[oldest];
+	if (dt <= 0)
+		return 0;
+
+	v0 = history_slot(oldest, spu)[c];
+	v1 = history_slot(newest, spu)[c];
+	*rate = v1 >= v0 ? (v1 - v0) / dt : 0;
+	return dt;
+}
+
+
+/**********************************************
+ * OUTPUT
+ **********************************************/
+
+static enum { FORMAT_JSON, FORMAT_PROMETHEUS } format = FORMAT_JSON;
+
+/* Escapes a string for a JSON string or a Prometheus label value; JSON
+ * takes no raw control characters at all. */
+static void print_escaped(FILE *fp, const char *s)
+{
+	for (; s && *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fputc('\\', fp);
+		if (*s == '\n')
+			fputs("\\n", fp);
+		else if ((unsigned char)*s < 0x20 && format == FORMAT_JSON)
+			fprintf(fp, "\\u%04x", (unsigned char)*s);
+		else
+			fputc(*s, fp);
+	}
+}
+
+static void json_counters(FILE *fp, int kind, const char *obj, u64 *v)
+{
+	int c, first = 1;
+
+	fprintf(fp, ",\"%s\":{", obj);
+	for_each_counter(c, kind) {
+		fprintf(fp, "%s\"%s\":%llu", first ? "" : ",", counters[c].name, v[c]);
+		first = 0;
+	}
+	fputc('}', fp);
+}
+
+static void dump_json(FILE *fp, double t, u64 period, struct spu **spus,
+		      struct ctx **ctxs, struct proc **procs)
+{
+	double rate, window = 0;
+	int i, c, first;
+
+	fprintf(fp, "{\"timestamp\":%.3f,\"interval_ms\":%llu", t, period);
+
+	fprintf(fp, ",\"spus\":[");
+	for (i = 0; i < spu_sample.n; i++) {
+		fprintf(fp, "%s{\"spu\":%d,\"state\":\"%c\",\"percent_spu\":%.1f",
+			i ? "," : "", spus[i]->number, spus[i]->state,
+			spus[i]->percent[TIME_TOTAL]);
+		json_counters(fp, K_SPU, "counters", spu_sample.value[i]);
+		json_counters(fp, K_SPU, "delta", spu_sample.delta[i]);
+
+		fprintf(fp, ",\"rate\":{");
+		first = 1;
+		for_each_counter(c, K_SPU) {
+			window = history_rate(i, c, &rate);
+			fprintf(fp, "%s\"%s\":%.3f", first ? "" : ",", counters[c].name, rate);
+			first = 0;
+		}
+		fprintf(fp, ",\"window_s\":%.3f}}", window);
+	}
+
+	fprintf(fp, "],\"contexts\":[");
+	for (i = 0; i < ctx_sample.n; i++) {
+		fprintf(fp, "%s{\"ctx\":\"", i ? "," : "");
+		print_escaped(fp, ctxs[i]->path);
+		fprintf(fp, "\",\"pid\":%d,\"tid\":%d,\"spe\":%d,\"state\":\"%c\","
+			"\"percent_spu\":%.1f,\"binary\":\"",
+			ctxs[i]->ppu_pid, ctxs[i]->thread_id, ctxs[i]->spe,
+			ctxs[i]->status, ctxs[i]->percent_spu);
+		print_escaped(fp, ctxs[i]->binary_name);
+		fputc('"', fp);
+		json_counters(fp, K_CTX, "counters", ctx_sample.value[i]);
+		json_counters(fp, K_CTX, "delta", ctx_sample.delta[i]);
+		fputc('}', fp);
+	}
+
+	fprintf(fp, "],\"procs\":[");
+	for (i = 0; i < proc_sample.n; i++) {
+		fprintf(fp, "%s{\"pid\":%d,\"threads\":%d,\"percent_spu\":%.1f,\"binary\":\"",
+			i ? "," : "", procs[i]->ppu_pid, procs[i]->n_threads,
+			procs[i]->percent_spu);
+		print_escaped(fp, procs[i]->binary_name);
+		fputc('"', fp);
+		json_counters(fp, K_PROC, "counters", proc_sample.value[i]);
+		json_counters(fp, K_PROC, "delta", proc_sample.delta[i]);
+		fputc('}', fp);
+	}
+	fprintf(fp, "]}\n");
+	fflush(fp);
+}
+
+static void dump_prometheus(FILE *fp, double t, u64 period, struct spu **spus,
+			    struct ctx **ctxs, struct proc **procs)
+{
+	double rate, window = 0;
+	int i, c;
+
+	for (i = 0; i < spu_sample.n; i++) {
+		for_each_counter(c, K_SPU) {
+			fprintf(fp, "spu_%s_total{spu=\"%d\"} %llu\n",
+				counters[c].name, spus[i]->number, spu_sample.value[i][c]);
+			window = history_rate(i, c, &rate);
+			if (window > 0)
+				fprintf(fp, "spu_%s_rate{spu=\"%d\"} %.3f\n",
+					counters[c].name, spus[i]->number, rate);
+		}
+		/* a gauge of its own: as a label, the window would start a new
+		 * series with every sample */
+		if (window > 0)
+			fprintf(fp, "spu_rate_window_seconds{spu=\"%d\"} %.3f\n",
+				spus[i]->number, window);
+		fprintf(fp, "spu_percent{spu=\"%d\"} %.1f\n",
+			spus[i]->number, spus[i]->percent[TIME_TOTAL]);
+	}
+
+	for (i = 0; i < ctx_sample.n; i++) {
+		for_each_counter(c, K_CTX) {
+			fprintf(fp, "spu_ctx_%s_total{ctx=\"", counters[c].name);
+			print_escaped(fp, ctxs[i]->path);
+			fprintf(fp, "\",pid=\"%d\",tid=\"%d\",binary=\"",
+				ctxs[i]->ppu_pid, ctxs[i]->thread_id);
+			print_escaped(fp, ctxs[i]->binary_name);
+			fprintf(fp, "\"} %llu\n", ctx_sample.value[i][c]);
+		}
+		fprintf(fp, "spu_ctx_percent{ctx=\"");
+		print_escaped(fp, ctxs[i]->path);
+		fprintf(fp, "\",spe=\"%d\"} %.1f\n", ctxs[i]->spe, ctxs[i]->percent_spu);
+	}
+
+	for (i = 0; i < proc_sample.n; i++) {
+		for_each_counter(c, K_PROC) {
+			fprintf(fp, "spu_proc_%s_total{pid=\"%d\",binary=\"",
+				counters[c].name, procs[i]->ppu_pid);
+			print_escaped(fp, procs[i]->binary_name);
+			fprintf(fp, "\"} %llu\n", proc_sample.value[i][c]);
+		}
+		fprintf(fp, "spu_proc_percent{pid=\"%d\"} %.1f\n",
+			procs[i]->ppu_pid, procs[i]->percent_spu);
+	}
+
+	fprintf(fp, "spu_export_timestamp_seconds %.3f\n", t);
+	fprintf(fp, "spu_export_interval_ms %llu\n", period);
+}
+
+/* Prometheus text files are replaced atomically, never appended to */
+static void write_prometheus(const char *path, double t, u64 period,
+			     struct spu **spus, struct ctx **ctxs, struct proc **procs)
+{
+	static char tmp[PATH_MAX];
+	FILE *fp;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	fp = fopen(tmp, "w");
+	if (!fp) {
+		perror(tmp);
+		return;
+	}
+	dump_prometheus(fp, t, period, spus, ctxs, procs);
+	if (fclose(fp) == 0)
+		rename(tmp, path);
+	else
+		unlink(tmp);
+}
+
+
+/**********************************************
+ * MAIN LOOP
+ **********************************************/
+
+static volatile sig_atomic_t do_quit;
+
+static void quit(int sig)
+{
+	do_quit = 1;
+}
+
+static double now()
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static u64 monotonic_ms()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void version()
+{
+	printf(
+		"spu-export (spu-tools 1.1)\n\n"
+		"Copyright (C) IBM 2008.\n"
+		"Released under the GNU GPL.\n\n"
+	);
+}
+
+static void usage()
+{
+	printf(
+		"Usage: spu-export [OPTIONS]\n"
+		"Periodically export SPU, context and process counters.\n\n"
+		"Options:\n"
+		"  -i, --interval=MS      sampling interval in milliseconds (default %d)\n"
+		"  -f, --format=FORMAT    json (newline-delimited, default) or prometheus\n"
+		"  -o, --output=FILE      append JSON lines to FILE, or rewrite FILE with\n"
+		"                         the Prometheus text format on every sample\n"
+		"  -d, --spufs=DIR        read contexts from DIR instead of " SPUFS_PATH "\n"
+		"  -H, --history=N        samples kept for SPU rates (default %d)\n"
+		"  -c, --count=N          exit after N samples (default: run forever)\n"
+		"  -b, --background       detach and run as a daemon\n"
+		"  -h, --help             display this help and exit\n"
+		"  -v, --version          output version information and exit\n\n"
+		"Examples:\n"
+		"  spu-export -i 500 | collector\n\n"
+		"  spu-export -b -f prometheus -o /var/lib/node_exporter/spu.prom\n\n",
+		DEFAULT_INTERVAL, DEFAULT_HISTORY
+	);
+}
+
+int main(int argc, char **argv)
+{
+	struct spu **spus;
+	struct ctx **ctxs;
+	struct proc **procs;
+	const char *output = NULL;
+	FILE *fp = stdout;
+	u64 interval = DEFAULT_INTERVAL;
+	u64 last, next, current;
+	int background = 0;
+	long count = 0, samples;
+	int c;
+
+	static struct option long_options[] = {
+		{"interval",   1, 0, 'i'},
+		{"format",     1, 0, 'f'},
+		{"output",     1, 0, 'o'},
+		{"spufs",      1, 0, 'd'},
+		{"history",    1, 0, 'H'},
+		{"count",      1, 0, 'c'},
+		{"background", 0, 0, 'b'},
+		{"help",       0, 0, 'h'},
+		{"version",    0, 0, 'v'},
+		{0, 0, 0, 0}
+	};
+
+	while (1) {
+		c = getopt_long(argc, argv, "i:f:o:d:H:c:bhv", long_options, NULL);
+		if (c == -1)
+			break;
+
+		switch(c) {
+			case 'i':
+				interval = strtoull(optarg, NULL, 0);
+				if (interval == 0)
+					die("Invalid interval %s.\n", optarg);
+				break;
+
+			case 'f':
+				if (!strcmp(optarg, "json"))
+					format = FORMAT_JSON;
+				else if (!strcmp(optarg, "prometheus"))
+					format = FORMAT_PROMETHEUS;
+				else
+					die("Invalid format %s.\n", optarg);
+				break;
+
+			case 'o':
+				output = optarg;
+				break;
+
+			case 'd':
+				set_spufs_path(optarg);
+				break;
+
+			case 'H':
+				history_n = atoi(optarg);
+				if (history_n < 2)
+					die("History must hold at least 2 samples.\n");
+				break;
+
+			case 'c':
+				count = atol(optarg);
+				break;
+
+			case 'b':
+				background = 1;
+				break;
+
+			case 'v':
+				version();
+				exit(0);
+
+			default:
+				usage();
+				exit(0);
+		}
+	}
+
+	if (format == FORMAT_PROMETHEUS && !output)
+		die("The prometheus format needs an output file (-o).\n");
+	if (format == FORMAT_JSON && output) {
+		fp = fopen(output, "a");
+		if (!fp)
+			die("Could not open %s: %s\n", output, strerror(errno));
+	}
+	if (background && format == FORMAT_JSON && !output)
+		die("Running in background needs an output file (-o).\n");
+	/* stay in the working directory, where relative -o and -d paths
+	 * are resolved on every sample */
+	if (background && daemon(1, 0) < 0)
+		die("Could not detach: %s\n", strerror(errno));
+
+	signal(SIGHUP, quit);
+	signal(SIGINT, quit);
+	signal(SIGTERM, quit);
+	signal(SIGPIPE, quit);
+
+	/* First sample only provides the base for the deltas */
+	spus = get_spus();
+	history_init(count_spus());
+	ctxs = get_spu_contexts(interval);
+	procs = get_procs(ctxs);
+	compute_sample(spus, ctxs, procs);
+	history_push(now());
+	last = monotonic_ms();
+	next = last + interval;
+
+	for (samples = 0; !do_quit && (!count || samples < count); samples++) {
+		current = monotonic_ms();
+		if (next > current)
+			usleep((next - current) * 1000);
+		if (do_quit)
+			break;
+
+		current = monotonic_ms();
+		next += interval;
+		if (next <= current)	/* we fell behind, do not burst */
+			next = current + interval;
+
+		spus = get_spus();
+		ctxs = get_spu_contexts(current - last);
+		procs = get_procs(ctxs);
+		compute_sample(spus, ctxs, procs);
+		history_push(now());
+
+		if (format == FORMAT_JSON)
+			dump_json(fp, now(), current - last, spus, ctxs, procs);
+		else
+			write_prometheus(output, now(), current - last, spus, ctxs, procs);
+		last = current;
+	}
+
+	if (fp != stdout)
+		fclose(fp);
+	return 0;
+}
@@ -108,6 +108,15 @@ static int spus_compare(const void *v1, const void *v2)
 		case SPU_CTX_THREAD_ID:
 			ret = p1->ctx_thread_id - p2->ctx_thread_id; break;
 
+		case SPU_PERCENTILE_50:
+			ret = p1->percentile[0] - p2->percentile[0]; break;
+		case SPU_PERCENTILE_90:
+			ret = p1->percentile[1] - p2->percentile[1]; break;
+		case SPU_PERCENTILE_99:
+			ret = p1->percentile[2] - p2->percentile[2]; break;
+		case SPU_PERCENT_MAX:
+			ret = p1->percent_max - p2->percent_max; break;
+
 		default :
 			ret = 0; break;
 	}
@@ -223,6 +232,11 @@ struct field spu_fields[] = {
 
 	{ SPU_CTX_THREAD_ID,            "TID",     "%6s", "%6d",   "SPE Controlling Thread ID",                0, "" },
 
+	{ SPU_PERCENTILE_50,            "P50",     "%6s", "%6.1f", "Median SPU Usage of the Replay Window",     0, "" },
+	{ SPU_PERCENTILE_90,            "P90",     "%6s", "%6.1f", "90th Percentile SPU Usage of the Window",   0, "" },
+	{ SPU_PERCENTILE_99,            "P99",     "%6s", "%6.1f", "99th Percentile SPU Usage of the Window",   0, "" },
+	{ SPU_PERCENT_MAX,              "MAX",     "%6s", "%6.1f", "Peak SPU Usage of the Replay Window",       0, "" },
+
 	{ 0,            NULL,    NULL,      NULL,    NULL,                        0 }
 };
 
@@ -262,12 +276,26 @@ int print_spu_field(struct spu *spu, char *buf, enum spu_field_id field, const c
 		case SPU_CTX_THREAD_ID:
 			return sprintf(buf, format, spu->ctx_thread_id);
 
+		case SPU_PERCENTILE_50:
+			return sprintf(buf, format, spu->percentile[0]);
+		case SPU_PERCENTILE_90:
+			return sprintf(buf, format, spu->percentile[1]);
+		case SPU_PERCENTILE_99:
+			return sprintf(buf, format, spu->percentile[2]);
+		case SPU_PERCENT_MAX:
+			return sprintf(buf, format, spu->percent_max);
+
 		default:
 			return 0;
 	}
 }
 
 
+void sort_spus(struct spu **table, int n)
+{
+	qsort(table, n, sizeof(struct spu *), spus_compare);
+}
+
 void fill_spus_tids(struct spu** spus, struct ctx** ctxs)
 {
 	int i, j;
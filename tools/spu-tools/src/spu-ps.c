@@ -110,6 +110,7 @@ static int set_sort_order(const char *id_string)
 }
 
 #include <getopt.h>
+#include <sys/time.h>
 
 #define die(...) do { fprintf(stderr, __VA_ARGS__); exit(1); } while (0)
 
@@ -136,6 +137,41 @@ static void dump_default_fields()
 	printf("\n");
 }
 
+static double elapsed_ms(struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) * 1000.0
+		+ (now.tv_usec - start->tv_usec) / 1000.0;
+}
+
+/*
+ * Measures the cost of the initial spufs scan and of the subsequent
+ * incremental refreshes, as done by spu-top every 100ms.
+ */
+static void benchmark(int refreshes)
+{
+	struct timeval start;
+	struct ctx **ctxs;
+	double first, total;
+	int i, n = 0;
+
+	gettimeofday(&start, NULL);
+	ctxs = get_spu_contexts(1);
+	first = elapsed_ms(&start);
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < refreshes; i++)
+		ctxs = get_spu_contexts(100);
+	total = elapsed_ms(&start);
+
+	while (ctxs && ctxs[n])
+		n++;
+	printf("%6d contexts: first scan %9.3f ms, refresh %9.3f ms\n",
+		n, first, refreshes ? total / refreshes : 0.0);
+}
+
 static void version()
 {
 	printf(
@@ -154,6 +190,8 @@ static void usage()
 		"Options:\n"
 		"  -f, --fields=FIELD,FIELD,...  list of fields to be dumped\n"
 		"  -s, --sort=FIELD              sort the output according to the given field\n"
+		"  -d, --spufs=DIR               read contexts from DIR instead of " SPUFS_PATH "\n"
+		"  -b, --benchmark=N             time N refreshes of the context list and exit\n"
 		"  -h, --help                    display this help and exit\n"
 		"  -v, --version                 output version information and exit\n\n"
 		"Valid field names are:\n"
@@ -170,10 +208,13 @@ int main(int argc, char **argv)
 {
 	int c;
 	int i, ret;
+	int refreshes = -1;
 
 	static struct option long_options[] = {
 		{"sort-by",  1, 0, 's'},
 		{"fields",   1, 0, 'f'},
+		{"spufs",    1, 0, 'd'},
+		{"benchmark", 1, 0, 'b'},
 		{"help",     0, 0, 'h'},
 		{"version",  0, 0, 'v'},
 		{0, 0, 0, 0}
@@ -185,7 +226,7 @@ int main(int argc, char **argv)
 	}
 	
 	while (1) {
-		c = getopt_long(argc, argv, "f:s:hv", long_options, NULL);
+		c = getopt_long(argc, argv, "f:s:d:b:hv", long_options, NULL);
 		if (c == -1)
 			break;
 
@@ -210,6 +251,14 @@ int main(int argc, char **argv)
 				hide_fields(i);
 				break;
 
+			case 'd':
+				set_spufs_path(optarg);
+				break;
+
+			case 'b':
+				refreshes = atoi(optarg);
+				break;
+
 			case 'v':
 				version();
 				exit(0);
@@ -220,6 +269,11 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if (refreshes >= 0) {
+		benchmark(refreshes);
+		return 0;
+	}
+
 	print_header(ctx_fields);
 	dump_ctxs_or_spus((void**)get_spu_contexts(1), ctx_fields);
 
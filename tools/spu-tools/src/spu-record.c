@@ -0,0 +1,239 @@
+/*
+ * Copyright (C) 2008 IBM Corp.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include "spu-tools.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <getopt.h>
+
+#define DEFAULT_INTERVAL 1      /* ms */
+
+#define die(...) do { fprintf(stderr, __VA_ARGS__); exit(1); } while (0)
+
+static int *spu_fds;
+static int *spu_numbers;
+static int nspus;
+
+static int compare_int(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+/*
+ * The sysfs stat files stay open for the whole recording and are
+ * re-read from offset 0, which regenerates their contents.
+ */
+static void open_spus()
+{
+	static char buf[PATH_MAX];
+	struct dirent *entry;
+	DIR *dir;
+	int i = 0;
+
+	nspus = count_spus();
+	spu_fds = malloc(sizeof(int) * (nspus + 1));
+	spu_numbers = malloc(sizeof(int) * (nspus + 1));
+	if (!spu_fds || !spu_numbers)
+		exit(-ENOMEM);
+
+	dir = opendir(SYSFS_PATH "/devices/system/spu");
+	if (!dir) {
+		nspus = 0;
+		return;
+	}
+	while ((entry = readdir(dir)) != NULL && i < nspus)
+		if (sscanf(entry->d_name, "spu%d", &spu_numbers[i]) == 1)
+			i++;
+	closedir(dir);
+	nspus = i;
+
+	qsort(spu_numbers, nspus, sizeof(int), compare_int);
+	for (i = 0; i < nspus; i++) {
+		sprintf(buf, SYSFS_PATH "/devices/system/spu/spu%d/stat", spu_numbers[i]);
+		spu_fds[i] = open(buf, O_RDONLY);
+		if (spu_fds[i] < 0)
+			die("Could not open %s: %s\n", buf, strerror(errno));
+	}
+}
+
+static void sample_spus(struct rec_spu *spus)
+{
+	char buf[512], state[64];
+	u64 *v;
+	int i, n;
+
+	for (i = 0; i < nspus; i++) {
+		n = pread(spu_fds[i], buf, sizeof(buf) - 1, 0);
+		if (n <= 0)
+			continue;
+		buf[n] = '\0';
+		v = spus[i].v;
+		sscanf(buf, "%63s %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu %llu",
+			state,
+			&v[REC_USER], &v[REC_SYSTEM], &v[REC_IOWAIT], &v[REC_IDLE],
+			&v[REC_VCSW], &v[REC_ICSW], &v[REC_SLB], &v[REC_HFLT],
+			&v[REC_MINFLT], &v[REC_MAJFLT], &v[REC_IRQ2], &v[REC_PPE_LIB]);
+		spus[i].state = toupper(state[0]);
+	}
+}
+
+static volatile sig_atomic_t do_quit;
+
+static void quit(int sig)
+{
+	do_quit = 1;
+}
+
+static u64 monotonic_us()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void version()
+{
+	printf(
+		"spu-record (spu-tools 1.1)\n\n"
+		"Copyright (C) IBM 2008.\n"
+		"Released under the GNU GPL.\n\n"
+	);
+}
+
+static void usage()
+{
+	printf(
+		"Usage: spu-record [OPTIONS] -o FILE\n"
+		"Record SPU and SPU context statistics for later replay with\n"
+		"spu-top --replay=FILE.\n\n"
+		"Options:\n"
+		"  -o, --output=FILE      recording file\n"
+		"  -i, --interval=MS      sampling interval in milliseconds (default %d)\n"
+		"  -t, --time=SECONDS     stop after SECONDS (default: until interrupted)\n"
+		"  -d, --spufs=DIR        read contexts from DIR instead of " SPUFS_PATH "\n"
+		"  -h, --help             display this help and exit\n"
+		"  -v, --version          output version information and exit\n\n"
+		"Examples:\n"
+		"  spu-record -o spu.rec -t 60\n\n",
+		DEFAULT_INTERVAL
+	);
+}
+
+int main(int argc, char **argv)
+{
+	struct recording *rec;
+	struct ctx **ctxs;
+	const char *output = NULL;
+	u64 interval = DEFAULT_INTERVAL * 1000, duration = 0;
+	u64 start, next, current;
+	long frames = 0;
+	int c;
+
+	static struct option long_options[] = {
+		{"output",   1, 0, 'o'},
+		{"interval", 1, 0, 'i'},
+		{"time",     1, 0, 't'},
+		{"spufs",    1, 0, 'd'},
+		{"help",     0, 0, 'h'},
+		{"version",  0, 0, 'v'},
+		{0, 0, 0, 0}
+	};
+
+	while (1) {
+		c = getopt_long(argc, argv, "o:i:t:d:hv", long_options, NULL);
+		if (c == -1)
+			break;
+
+		switch(c) {
+			case 'o':
+				output = optarg;
+				break;
+
+			case 'i':
+				interval = strtoull(optarg, NULL, 0) * 1000;
+				if (interval == 0)
+					die("Invalid interval %s.\n", optarg);
+				break;
+
+			case 't':
+				duration = strtoull(optarg, NULL, 0) * 1000000;
+				break;
+
+			case 'd':
+				set_spufs_path(optarg);
+				break;
+
+			case 'v':
+				version();
+				exit(0);
+
+			default:
+				usage();
+				exit(0);
+		}
+	}
+
+	if (!output)
+		die("An output file must be given (-o).\n");
+
+	open_spus();
+	rec = rec_create(output, interval, nspus, spu_numbers);
+	if (!rec)
+		die("Could not create %s: %s\n", output, strerror(errno));
+
+	signal(SIGHUP, quit);
+	signal(SIGINT, quit);
+	signal(SIGTERM, quit);
+
+	start = next = monotonic_us();
+	while (!do_quit) {
+		current = monotonic_us();
+		if (duration && current - start >= duration)
+			break;
+
+		sample_spus(rec->spus);
+		ctxs = get_spu_contexts(interval / 1000);
+		if (rec_write_frame(rec, current - start, ctxs))
+			die("Could not write %s: %s\n", output, strerror(errno));
+		frames++;
+
+		/* keep the sampling grid, but do not burst when late */
+		next += interval;
+		current = monotonic_us();
+		if (next > current)
+			usleep(next - current);
+		else
+			next = current;
+	}
+
+	if (rec_close(rec))
+		die("Could not write %s: %s\n", output, strerror(errno));
+	fprintf(stderr, "%ld frames recorded in %s\n", frames, output);
+	return 0;
+}
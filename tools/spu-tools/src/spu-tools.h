@@ -23,6 +23,7 @@
 #define SPUPS_H
 
 #include <dirent.h>
+#include <stdio.h>
 
 #ifndef SPUFS_PATH
 #define SPUFS_PATH  "/spu"
@@ -113,11 +114,19 @@ struct ctx {
 	u64 ppe_library;
 
 	int updated;
+	int id;                  /* unique for the lifetime of the tool */
+
+	/* scanner private */
+	char       *path;        /* relative to the spufs mount point */
+	int         dirfd;
+	struct ctx *hash_next;
 };
 
 extern struct field ctx_fields[];
 
 struct ctx **get_spu_contexts(u64 period);
+void set_spufs_path(const char *path);
+void sort_ctxs(struct ctx **ctxs, int n);
 
 int print_ctx_field(struct ctx *ctx, char *buf, enum ctx_field_id field,
 		     const char *format);
@@ -148,6 +157,10 @@ enum spu_field_id {
 	SPU_CLASS2_INTERRUPTS,
 	SPU_PPE_LIBRARY,
 	SPU_CTX_THREAD_ID,
+	SPU_PERCENTILE_50,
+	SPU_PERCENTILE_90,
+	SPU_PERCENTILE_99,
+	SPU_PERCENT_MAX,
 	SPU_MAX_FIELD
 };
 
@@ -171,6 +184,10 @@ struct spu {
 	float percent[TIME_MAX];
 
 	int ctx_thread_id;
+
+	/* distribution of per-sample usage, only known when replaying */
+	float percentile[3];     /* 50th, 90th, 99th */
+	float percent_max;
 };
 
 
@@ -186,6 +203,7 @@ inline void set_spu_sort_field(enum spu_field_id field);
 void set_spu_sort_descending(int descending);
 
 void fill_spus_tids(struct spu** spus, struct ctx** ctxs);
+void sort_spus(struct spu **spus, int n);
 
 /*
  * PER_PROC
@@ -246,6 +264,76 @@ inline enum proc_field_id get_proc_sort_field();
 inline void set_proc_sort_field(enum proc_field_id field);
 void set_proc_sort_descending(int descending);
 
+/*
+ * PER_CALL
+ *
+ * libspe2 publishes the PPE assisted library calls serviced for each
+ * context in a shared memory segment named after its spufs directory.
+ * The layout must match spebase/callstats.h in libspe2.
+ */
+
+#define CALLSTATS_PATH     "/dev/shm"
+#define CALLSTATS_PREFIX   "libspe2-callstats-"
+#define CALLSTATS_MAGIC    0x53504543
+#define CALLSTATS_VERSION  1
+
+enum callstats_class { CALLSTATS_C99 = 0, CALLSTATS_POSIX1, CALLSTATS_LIBEA,
+		       CALLSTATS_OTHER, CALLSTATS_NR_CLASSES };
+
+struct callstats {
+	u32 magic;
+	u32 version;
+	int pid;
+	u32 reserved;
+	struct {
+		u64 count;
+		u64 time_ns;
+	} calls[CALLSTATS_NR_CLASSES][256];
+};
+
+enum call_field_id {
+	CALL_INVALID=0,
+	CALL_PPU_PID='a',
+	CALL_THREAD_ID,
+	CALL_SPE,
+	CALL_CLASS,
+	CALL_NAME,
+	CALL_RATE,
+	CALL_PERCENT_TIME,
+	CALL_AVG_TIME,
+	CALL_COUNT,
+	CALL_TOTAL_TIME,
+	CALL_PERCENT_SPU,
+	CALL_BINARY_NAME,
+	CALL_MAX_FIELD
+};
+
+struct call {
+	struct ctx *ctx;
+	enum callstats_class class;
+	int op;
+
+	u64 count;
+	u64 time_ns;
+
+	float rate;              /* calls per second over the period */
+	float percent_time;      /* of the period spent servicing the call */
+	float avg_us;
+};
+
+extern struct field call_fields[];
+
+struct call **get_calls(struct ctx **ctxs, u64 period);
+
+int clean_callstats();
+
+int print_call_field(struct call *call, char *buf, enum call_field_id field,
+		     const char *format);
+
+inline enum call_field_id get_call_sort_field();
+inline void set_call_sort_field(enum call_field_id field);
+void set_call_sort_descending(int descending);
+
 /*
  * GENERAL
  */
@@ -260,6 +348,99 @@ void get_spu_stats(struct spu** spus, float *percents);
 
 void get_cpu_stats(float *percents);
 
+/*
+ * RECORDING
+ *
+ * spu-record samples the per-SPU sysfs and per-context spufs stat files
+ * into a compact file, which spu-top can replay. The file starts with
+ * REC_MAGIC and a header, followed by records: context definitions and
+ * frames. A frame holds the SPU and present context counters, absolute
+ * in keyframes and zigzag-encoded differences to the previous frame
+ * otherwise. Every integer is stored as a LEB128 varint.
+ */
+
+#define REC_MAGIC      "SPUREC\0\1"
+#define REC_KEYFRAME   1024     /* frames between keyframes */
+#define REC_NCOUNTERS  12       /* the numeric columns of a stat file */
+#define REC_CTX_HASH   256
+
+/* counter slots, in stat file order */
+enum rec_counter { REC_USER = 0, REC_SYSTEM, REC_IOWAIT,
+		   REC_LOADED,  /* idle time for SPUs */
+		   REC_VCSW, REC_ICSW, REC_SLB, REC_HFLT, REC_MINFLT, REC_MAJFLT,
+		   REC_IRQ2, REC_PPE_LIB };
+#define REC_IDLE REC_LOADED
+
+struct rec_spu {
+	int number;
+	char state;
+	u64 v[REC_NCOUNTERS];
+};
+
+struct rec_ctx {
+	int id;
+	int pid;
+	int tid;
+	int spe;
+	char state;
+	char *binary_name;
+	char *user;
+	char *path;
+	u64 v[REC_NCOUNTERS];
+	long frame;              /* last frame the context was present in */
+	struct rec_ctx *next;    /* hash chain */
+	struct rec_ctx *list;    /* all contexts, reader only */
+};
+
+struct recording {
+	u32 interval_us;
+	u64 start_us;            /* wall clock time of the first frame */
+	int nspus;
+	struct rec_spu *spus;
+	struct rec_ctx *ctx_hash[REC_CTX_HASH];
+	struct rec_ctx *ctxs;
+
+	u64 t_us;                /* time of the current frame since start */
+	long frame;              /* index of the current frame */
+
+	/* writer */
+	FILE *fp;
+	u64 *spu_prev;
+
+	/* reader */
+	unsigned char *map;
+	size_t size;
+	size_t pos;
+	struct rec_key {
+		long frame;
+		u64 t_us;
+		size_t pos;
+	} *keys;
+	int nkeys;
+	long nframes;
+	u64 duration_us;
+};
+
+struct recording *rec_create(const char *path, u32 interval_us, int nspus,
+			     const int *numbers);
+int rec_write_frame(struct recording *rec, u64 t_us, struct ctx **ctxs);
+int rec_close(struct recording *rec);
+
+struct recording *rec_open(const char *path);
+int rec_seek(struct recording *rec, u64 t_us);
+int rec_next(struct recording *rec);
+u64 rec_next_time(struct recording *rec);
+
+/*
+ * REPLAY
+ */
+
+int replay_open(const char *path);
+void replay_advance(u64 elapsed_ms);
+int replay_key(int ch);
+void replay_sample(struct spu ***spus, struct ctx ***ctxs);
+void replay_status(char *line1, char *line2);
+
 
 #endif
 
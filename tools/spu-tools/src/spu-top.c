@@ -42,7 +42,58 @@
 #define MAX_LINE_SIZE 1024
 
 static int refresh_delay = DEFAULT_REFRESH_DELAY;
-static enum screen_mode { PER_CTX, PER_SPU, PER_PROC } screen_mode = PER_CTX;
+static int replaying;
+static enum screen_mode { PER_CTX, PER_SPU, PER_PROC, PER_CALL } screen_mode = PER_CTX;
+
+static struct field *mode_fields()
+{
+	switch (screen_mode) {
+		case PER_CTX:  return ctx_fields;
+		case PER_SPU:  return spu_fields;
+		case PER_PROC: return proc_fields;
+		default:       return call_fields;
+	}
+}
+
+static char mode_max_field()
+{
+	switch (screen_mode) {
+		case PER_CTX:  return CTX_MAX_FIELD;
+		case PER_SPU:  return SPU_MAX_FIELD;
+		case PER_PROC: return PROC_MAX_FIELD;
+		default:       return CALL_MAX_FIELD;
+	}
+}
+
+static char mode_sort_field()
+{
+	switch (screen_mode) {
+		case PER_CTX:  return get_ctx_sort_field();
+		case PER_SPU:  return get_spu_sort_field();
+		case PER_PROC: return get_proc_sort_field();
+		default:       return get_call_sort_field();
+	}
+}
+
+static void set_mode_sort_field(char field)
+{
+	switch (screen_mode) {
+		case PER_CTX:  set_ctx_sort_field(field);  break;
+		case PER_SPU:  set_spu_sort_field(field);  break;
+		case PER_PROC: set_proc_sort_field(field); break;
+		default:       set_call_sort_field(field); break;
+	}
+}
+
+static void set_mode_sort_descending(int descending)
+{
+	switch (screen_mode) {
+		case PER_CTX:  set_ctx_sort_descending(descending);  break;
+		case PER_SPU:  set_spu_sort_descending(descending);  break;
+		case PER_PROC: set_proc_sort_descending(descending); break;
+		default:       set_call_sort_descending(descending); break;
+	}
+}
 
 static void print_header(struct field *fields)
 {
@@ -51,7 +102,8 @@ static void print_header(struct field *fields)
 	char buf[MAX_LINE_SIZE];
 
 	mvprintw(0, 0, "spu-top: %s View", screen_mode == PER_CTX? "Context" :
-			 screen_mode == PER_SPU? "SPU" : "Process");
+			 screen_mode == PER_SPU? "SPU" :
+			 screen_mode == PER_PROC? "Process" : "Library Call");
 	wbkgdset(stdscr, COLOR_PAIR(BLACK_ON_WHITE));
 	move(6, 0);
 	clrtoeol();
@@ -99,9 +151,12 @@ static void dump_fields(void **table, struct field *fields)
 			} else if (screen_mode == PER_SPU) {
 				chars += print_spu_field((struct spu *)table[i],
 						buf+chars, fields[j].id, fields[j].format);
-			} else {
+			} else if (screen_mode == PER_PROC) {
 				chars += print_proc_field((struct proc *)table[i],
 						buf+chars, fields[j].id, fields[j].format);
+			} else {
+				chars += print_call_field((struct call *)table[i],
+						buf+chars, fields[j].id, fields[j].format);
 			}
 		}
 		if (chars)
@@ -146,7 +201,7 @@ static void init_ncurses()
 
 void print_cpu_info(int min_time_has_passed)
 {
-	static float percents[TIME_TOTAL];
+	static float percents[TIME_MAX];
 	static float avg1min, avg5min, avg15min;
 
 	wbkgdset(stdscr, COLOR_PAIR(WHITE_ON_BLACK));
@@ -161,9 +216,20 @@ void print_cpu_info(int min_time_has_passed)
 			percents[TIME_NICE], percents[TIME_IDLE]);
 }
 
+/* The Spu(s) times line, shared by the live and the replay headers. */
+static void print_spu_times(struct spu** spus, int update)
+{
+	static float percents[TIME_MAX];
+
+	if (update)
+		get_spu_stats(spus, percents);
+	mvprintw(4, 0, "Spu(s):%5.1f%%us,%5.1f%%sys,%5.1f%%wait,%5.1f%%idle",
+		 	percents[TIME_USER], percents[TIME_SYSTEM],
+			percents[TIME_IOWAIT], percents[TIME_IDLE]);
+}
+
 void print_spu_info(struct spu** spus, int min_time_has_passed)
 {
-	static float percents[TIME_TOTAL];
 	static float avg1min, avg5min, avg15min;
 
 	wbkgdset(stdscr, COLOR_PAIR(WHITE_ON_BLACK));
@@ -172,11 +238,23 @@ void print_spu_info(struct spu** spus, int min_time_has_passed)
 	mvprintw(2, 0, "Spu(s) load avg: %4.2f, %4.2f, %4.2f\n",
 		 	avg1min, avg5min, avg15min);
 
-	if (min_time_has_passed)
-		get_spu_stats(spus, percents);
-	mvprintw(4, 0, "Spu(s):%5.1f%%us,%5.1f%%sys,%5.1f%%wait,%5.1f%%idle",
-		 	percents[TIME_USER], percents[TIME_SYSTEM],
-			percents[TIME_IOWAIT], percents[TIME_IDLE]);
+	print_spu_times(spus, min_time_has_passed);
+}
+
+void print_replay_info(struct spu** spus)
+{
+	char line1[MAX_LINE_SIZE], line2[MAX_LINE_SIZE];
+
+	wbkgdset(stdscr, COLOR_PAIR(WHITE_ON_BLACK));
+	replay_status(line1, line2);
+	move(1, 0);
+	clrtoeol();
+	mvaddstr(1, 0, line1);
+	move(2, 0);
+	clrtoeol();
+	mvaddstr(2, 0, line2);
+
+	print_spu_times(spus, 1);
 }
 
 static void config_sort(struct field *fields)
@@ -184,13 +262,10 @@ static void config_sort(struct field *fields)
 	int i;
 	char lc;
 	const int ofs = 3;
-	char max_field = screen_mode == PER_CTX? CTX_MAX_FIELD :
-			 screen_mode == PER_SPU? SPU_MAX_FIELD : PROC_MAX_FIELD;
+	char max_field = mode_max_field();
 
 	for (;;) {
-		char sort_field = screen_mode == PER_CTX? get_ctx_sort_field() :
-					screen_mode == PER_SPU? get_spu_sort_field() :
-					get_proc_sort_field();
+		char sort_field = mode_sort_field();
 		erase();
 		mvprintw(1, 0, "Select sort field via field letter, type any other key to return");
 		for (i = 0; fields[i].id; i++) {
@@ -207,8 +282,7 @@ static void config_sort(struct field *fields)
 		lc = tolower(getch());
 		if (lc < 'a' || lc > max_field)
 			break;
-		screen_mode == PER_CTX? set_ctx_sort_field(lc) :
-			screen_mode == PER_SPU? set_spu_sort_field(lc) : set_proc_sort_field(lc);
+		set_mode_sort_field(lc);
 	}
 	halfdelay(refresh_delay);
 }
@@ -218,8 +292,7 @@ static void config_show(struct field *fields)
 	int i;
 	char lc;
 	int ofs = 3;
-	char max_field = screen_mode == PER_CTX? CTX_MAX_FIELD :
-			 screen_mode == PER_SPU? SPU_MAX_FIELD : PROC_MAX_FIELD;
+	char max_field = mode_max_field();
 	
 	for (;;) {
 		erase();
@@ -254,8 +327,7 @@ static void config_order(struct field *fields)
 	int i;
 	char c, lc;
 	int ofs = 4;
-	char max_field = screen_mode == PER_CTX? CTX_MAX_FIELD :
-			 screen_mode == PER_SPU? SPU_MAX_FIELD : PROC_MAX_FIELD;
+	char max_field = mode_max_field();
 
 	for (;;) {
 		erase();
@@ -314,7 +386,17 @@ static void show_help()
 	mvprintw(l++, 0, " %-5s - %s", "c", "switch to per-context view");
 	mvprintw(l++, 0, " %-5s - %s", "p", "switch to per-process view");
 	mvprintw(l++, 0, " %-5s - %s", "s", "switch to per-spu view");
+	mvprintw(l++, 0, " %-5s - %s", "l", "switch to per-library-call view");
 	l++;
+	if (replaying) {
+		mvprintw(l++, 0, " %-5s - %s", "space", "pause or resume the replay");
+		mvprintw(l++, 0, " %-5s - %s", "<-,->", "move backwards or forwards by one step");
+		mvprintw(l++, 0, " %-5s - %s", "[,]", "halve or double the step");
+		mvprintw(l++, 0, " %-5s - %s", "<,>", "halve or double the window");
+		mvprintw(l++, 0, " %-5s - %s", "Home", "go to the start of the recording");
+		mvprintw(l++, 0, " %-5s - %s", "End", "go to the end of the recording");
+		l++;
+	}
 	mvprintw(l++, 0, " %-5s - %s", "h,H,?", "displays this help screen");
 	mvprintw(l++, 0, " %-5s - %s", "q,Q", "quit program");
 	l++;
@@ -341,15 +423,22 @@ static void usage()
 	printf(
 		"Usage: spu-top [OPTIONS]\n"
 		"The spu-top program provides a dynamic real-time view of the\n"
-		"running system in regards to Cell/B.E. SPUs. It provides 3 view modes:""\n\n"
+		"running system in regards to Cell/B.E. SPUs. It provides 4 view modes:""\n\n"
 		"* Per-Context: information about all instantiated SPU contexts.""\n\n"
 		"* Per-Process: same information as in Per-Context view, but consolidating\n"
 		"all data from the contexts belonging to a same process in a single line.\n"
 		"That means that statistics such as spu usage may reach number_of_spus * 100%%.\n\n"
 		"* Per-SPU: information about each physical SPU present on the system.""\n\n"
+		"* Per-Library-Call: the PPE assisted library calls (fprintf, open,\n"
+		"malloc, ...) serviced for each context, with the share of time spent\n"
+		"servicing them. Only contexts of programs using libspe2 and run with\n"
+		"the SPE_CALLSTATS environment variable set are shown.\n\n"
 		"Selection of mode and shown fields can be done within the program.""\n"
 		"Press 'h' while running spu-top for help on the interactive commands.""\n\n"
 		"Options:\n"
+		"  -r, --replay=FILE             replay a recording made with spu-record\n"
+		"  -C, --clean-callstats         remove the library call statistics left\n"
+		"                                by processes that died, and exit\n"
 		"  -h, --help                    display this help and exit\n"
 		"  -v, --version                 output version information and exit\n\n"
 	);
@@ -360,26 +449,51 @@ int main(int argc, char **argv)
 	int c;
 	u64 period;
 	int do_quit = 0;
+	int replay_moved = 0;
 	struct spu** spus;
 	struct proc** procs;
+	struct call** calls;
 	struct ctx** ctxs;
 	struct timeval last_time, current_time;
 	char* term;
 
 	/* Parse options */
 	static struct option long_options[] = {
+		{"replay",   1, 0, 'r'},
+		{"clean-callstats", 0, 0, 'C'},
 		{"help",     0, 0, 'h'},
 		{"version",  0, 0, 'v'},
 		{0, 0, 0, 0}
 	};
 	
 	while (1) {
-		c = getopt_long(argc, argv, "hv", long_options, NULL);
+		c = getopt_long(argc, argv, "r:Chv", long_options, NULL);
 
 		if (c == -1)
 			break;
 
 		switch(c) {
+			case 'r':
+				if (replay_open(optarg)) {
+					fprintf(stderr, "Could not replay %s: %s\n",
+						optarg, strerror(errno));
+					exit(1);
+				}
+				replaying = 1;
+				/* playback needs a smoother refresh than sampling */
+				refresh_delay = 2;
+				break;
+
+			case 'C':
+				c = clean_callstats();
+				if (c < 0) {
+					fprintf(stderr, "Could not read %s: %s\n",
+						CALLSTATS_PATH, strerror(errno));
+					exit(1);
+				}
+				printf("%d segments removed\n", c);
+				exit(0);
+
 			case 'v':
 				version();
 				exit(0);
@@ -422,9 +536,14 @@ int main(int argc, char **argv)
 	last_time.tv_usec = 0;
 
 	/* Providing a valid time range for the first measure (0.055 sec) */
-	spus = get_spus();
-	ctxs = get_spu_contexts(refresh_delay);
+	if (replaying) {
+		replay_sample(&spus, &ctxs);
+	} else {
+		spus = get_spus();
+		ctxs = get_spu_contexts(refresh_delay);
+	}
 	procs = get_procs(ctxs);
+	calls = get_calls(ctxs, 0);
 	usleep(55000);
 
 	while (!do_quit) {
@@ -439,25 +558,40 @@ int main(int argc, char **argv)
 			- ((double)last_time.tv_sec*1000 + (double)last_time.tv_usec/1000);
 		min_time_has_passed = period > 100;
 
-		if (min_time_has_passed) {
-			spus = get_spus();
-			ctxs = get_spu_contexts(period);
+		if (min_time_has_passed || replay_moved) {
+			if (replaying) {
+				if (min_time_has_passed)
+					replay_advance(period);
+				replay_sample(&spus, &ctxs);
+				replay_moved = 0;
+			} else {
+				spus = get_spus();
+				ctxs = get_spu_contexts(period);
+			}
 			procs = get_procs(ctxs);
+			calls = get_calls(ctxs, period);
 			fill_spus_tids(spus, ctxs);
 			last_time = current_time;
 		}
 
-		print_cpu_info(min_time_has_passed);
-		print_spu_info(spus, min_time_has_passed);
+		if (replaying) {
+			print_replay_info(spus);
+		} else {
+			print_cpu_info(min_time_has_passed);
+			print_spu_info(spus, min_time_has_passed);
+		}
 		if (screen_mode == PER_CTX) {
 			print_header(ctx_fields);
 			dump_fields((void**)ctxs, ctx_fields);
 		} else if (screen_mode == PER_SPU) {
 			print_header(spu_fields);
 			dump_fields((void**)spus, spu_fields);
-		} else {
+		} else if (screen_mode == PER_PROC) {
 			print_header(proc_fields);
 			dump_fields((void**)procs, proc_fields);
+		} else {
+			print_header(call_fields);
+			dump_fields((void**)calls, call_fields);
 		}
 
 		move(5, 0);
@@ -475,25 +609,18 @@ int main(int argc, char **argv)
 			case 'c': screen_mode = PER_CTX;  break;
 			case 's': screen_mode = PER_SPU;  break;
 			case 'p': screen_mode = PER_PROC; break;
+			case 'l': screen_mode = PER_CALL; break;
 
-			case 'A': screen_mode==PER_CTX? set_ctx_sort_descending(0) :
-				  screen_mode==PER_SPU? set_spu_sort_descending(0) :
-				  set_proc_sort_descending(0);
-				  break;
+			case 'A': set_mode_sort_descending(0); break;
+			case 'D': set_mode_sort_descending(1); break;
 
-			case 'D': screen_mode==PER_CTX? set_ctx_sort_descending(1) :
-				  screen_mode==PER_SPU? set_spu_sort_descending(1) :
-				  set_proc_sort_descending(1);
-				  break;
+			case 'f': config_show(mode_fields());  break;
+			case 'o': config_order(mode_fields()); break;
+			case 'O': config_sort(mode_fields());  break;
 
-			case 'f': config_show( screen_mode==PER_CTX? ctx_fields :
-				screen_mode==PER_SPU? spu_fields : proc_fields);
-				break;
-			case 'o': config_order(screen_mode==PER_CTX? ctx_fields :
-				screen_mode==PER_SPU? spu_fields : proc_fields);
-				break;
-			case 'O': config_sort( screen_mode==PER_CTX? ctx_fields :
-				screen_mode==PER_SPU? spu_fields : proc_fields);
+			default:
+				if (replaying)
+					replay_moved = replay_key(ch);
 				break;
 		}
 	}